@@ -23,6 +23,7 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include <stdio.h>
+#include <string.h>
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -32,6 +33,8 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define REC_SIZE	128		// uart receive ring
+#define LINE_SIZE	64		// longer esp lines are truncated
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -60,8 +63,12 @@ static void MX_TIM4_Init(void);
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 char sendBuff[64], sendBuff2[64];
-uint8_t recArr[64], recData;
-uint8_t buffLen, buffLen2, buffCnt = 0;
+uint8_t recArr[REC_SIZE], recData;
+uint8_t buffLen, buffLen2;
+volatile uint16_t buffCnt = 0;		// written by the uart interrupt
+uint16_t recRead = 0;				// read by espWait
+char recLine[LINE_SIZE];
+uint8_t recLineLen = 0;
 uint8_t dhtval[2];
 
 const char API_KEY[] = "YOUR_THINGSPEAK_API_KEY";
@@ -197,11 +204,59 @@ uint8_t readDHT11(uint8_t *pData)
 
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
-	recArr[buffCnt++] = recData;
-	if(buffCnt == 64) buffCnt = 0;
+	recArr[buffCnt] = recData;
+	buffCnt = (buffCnt + 1) % REC_SIZE;
 	HAL_UART_Receive_IT(&huart1, &recData, 1);
 }
 
+//wait for a response line of the ESP8266 starting with key ("OK", "SEND OK", ">" for the
+//AT+CIPSEND prompt), returns as soon as it arrives; 0 on ERROR, FAIL or timeout (ms)
+uint8_t espWait(const char *key, uint32_t timeout)
+{
+	uint32_t start = HAL_GetTick();
+	size_t keyLen = strlen(key);
+
+	while(HAL_GetTick() - start < timeout)
+	{
+		if(recRead == buffCnt) continue;
+
+		char c = recArr[recRead];
+		recRead = (recRead + 1) % REC_SIZE;
+
+		if(c == '\r') continue;
+
+		if(c != '\n')
+		{
+			if(recLineLen < LINE_SIZE - 1) recLine[recLineLen++] = c;
+
+			if(c == '>' && recLineLen == 1 && key[0] == '>')
+			{
+				recLineLen = 0;
+				return 1;
+			}
+			continue;
+		}
+
+		recLine[recLineLen] = '\0';
+		if(recLineLen == 0) continue;
+		recLineLen = 0;
+
+		if(strncmp(recLine, key, keyLen) == 0) return 1;
+		if(strcmp(recLine, "ERROR") == 0 || strcmp(recLine, "FAIL") == 0 || strcmp(recLine, "SEND FAIL") == 0) return 0;
+	}
+
+	return 0;
+}
+
+//send a command (with \r\n) and wait for its answer, earlier received bytes are discarded
+uint8_t espCommand(const char *cmd, uint8_t len, const char *key, uint32_t timeout)
+{
+	recRead = buffCnt;
+	recLineLen = 0;
+	HAL_UART_Transmit(&huart1, (uint8_t *)cmd, len, 1000);
+	return espWait(key, timeout);
+}
+
 /* USER CODE END 0 */
 
 /**
@@ -237,17 +292,17 @@ int main(void)
   /* USER CODE BEGIN 2 */
   HAL_TIM_Base_Start(&htim4);
 
-  // Wifi Connection
+  HAL_UART_Receive_IT(&huart1, &recData, 1);
+
+  // Wifi Connection, every command waits for its OK
   buffLen = sprintf(sendBuff, "AT+CWMODE_CUR=1\r\n");
-  HAL_UART_Transmit(&huart1, (uint8_t *)sendBuff, buffLen, 1000);
+  espCommand(sendBuff, buffLen, "OK", 2000);
 
   buffLen = sprintf(sendBuff, "AT+CWLAP\r\n");
-  HAL_UART_Transmit(&huart1, (uint8_t *)sendBuff, buffLen, 1000);
-
-  HAL_Delay(2000);
+  espCommand(sendBuff, buffLen, "OK", 10000);
 
   buffLen = sprintf(sendBuff, "AT+CWJAP_CUR=\"%s\",\"%s\"\r\n", WIFI_NAME, WIFI_PASSW);
-  HAL_UART_Transmit(&huart1, (uint8_t *)sendBuff, buffLen, 1000);
+  espCommand(sendBuff, buffLen, "OK", 20000);
 
 
   /* USER CODE END 2 */
@@ -261,17 +316,19 @@ int main(void)
 	  {
 		  // connect Thinkspeak server
 		  buffLen = sprintf(sendBuff, "AT+CIPSTART=\"TCP\",\"api.thingspeak.com\",80\r\n");
-		  HAL_UART_Transmit(&huart1, (uint8_t *)sendBuff, buffLen, 1000);
-		  HAL_Delay(3000);
-
-		  // after connection to Thingspeak prepare data to send
-		  buffLen = sprintf(sendBuff, "GET /update?api_key=%s&field1=%d&field2=%d\r\n", API_KEY, dhtval[0], dhtval[1]);
-		  buffLen2 = sprintf(sendBuff2, "AT+CIPSEND=%d\r\n", buffLen);
-
-		  // send preapeared buffers to Thingspeak using ESP8266
-		  HAL_UART_Transmit(&huart1, (uint8_t *)sendBuff2, buffLen2, 1000);
-		  HAL_Delay(1000);
-		  HAL_UART_Transmit(&huart1, (uint8_t *)sendBuff, buffLen, 1000);
+		  if(espCommand(sendBuff, buffLen, "OK", 10000))
+		  {
+			  // after connection to Thingspeak prepare data to send
+			  buffLen = sprintf(sendBuff, "GET /update?api_key=%s&field1=%d&field2=%d\r\n", API_KEY, dhtval[0], dhtval[1]);
+			  buffLen2 = sprintf(sendBuff2, "AT+CIPSEND=%d\r\n", buffLen);
+
+			  // send preapeared buffers to Thingspeak using ESP8266, data after the > prompt
+			  if(espCommand(sendBuff2, buffLen2, ">", 2000))
+			  {
+				  HAL_UART_Transmit(&huart1, (uint8_t *)sendBuff, buffLen, 1000);
+				  espWait("SEND OK", 5000);
+			  }
+		  }
 
 		  // wait for 30sn to send new data
 		  HAL_Delay(30000);
@@ -0,0 +1,267 @@
+/*
+ FrameCodec.cpp - streaming codec for the 0xA5 0x5A command frames.
+ */
+#include "FrameCodec.h"
+#include <string.h>
+
+// CRC-8, polynomial 0x07, one nibble at a time
+static const uint8_t    crcTable[16] =
+{
+    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d
+};
+
+/**
+ * @brief
+ * @note    The table is not copied and must outlive the codec.
+ * @param   table Handlers by command id
+ * @param   count Number of table entries
+ * @param   flags FRAME_LEN and/or FRAME_CRC
+ * @param   bodyLen Body length (id included) of every frame without FRAME_LEN
+ * @retval
+ */
+FrameCodec::FrameCodec(const frame_command_t* table, uint8_t count, uint8_t flags, uint8_t bodyLen) :
+    _table(table),
+    _count(count),
+    _flags(flags),
+    _bodyLen(bodyLen ? (bodyLen < FRAME_MAXBODY ? bodyLen : FRAME_MAXBODY) : 1),
+    _default(NULL),
+    _ctx(NULL),
+    _frames(0),
+    _unknown(0),
+    _crcErrors(0),
+    _badLength(0),
+    _skipped(0)
+{
+    reset();
+}
+
+/**
+ * @brief   Drops a partially received frame
+ * @note
+ * @param
+ * @retval
+ */
+void FrameCodec::reset()
+{
+    _state = SYNC1;
+    _need = 0;
+    _pos = 0;
+    _crc = 0;
+}
+
+/**
+ * @brief
+ * @note    CRC-8 with polynomial 0x07, initial value 0, no reflection
+ *          (CRC-8/SMBUS, check value 0xF4).
+ * @param   crc 0, or the CRC of the preceding bytes
+ * @param
+ * @retval
+ */
+uint8_t FrameCodec::crc8(uint8_t crc, const uint8_t* data, size_t len)
+{
+    while (len--) {
+        crc ^= *data++;
+        crc = (crc << 4) ^ crcTable[crc >> 4];
+        crc = (crc << 4) ^ crcTable[crc >> 4];
+    }
+
+    return crc;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void FrameCodec::_startBody(uint8_t len)
+{
+    _need = len;
+    _pos = 0;
+    _state = BODY;
+}
+
+/**
+ * @brief   Hands a complete frame to its handler
+ * @note    The parser is ready for the next frame before the handler runs.
+ * @param
+ * @retval
+ */
+void FrameCodec::_dispatch()
+{
+    uint8_t         id = _body[0];
+    frame_handler_t handler = _default;
+
+    _state = SYNC1;
+    _frames++;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_table[i].id == id) {
+            handler = _table[i].handler;
+            break;
+        }
+    }
+
+    if (!handler) {
+        _unknown++;
+        return;
+    }
+
+    handler(id, _body + 1, _need - 1, _ctx);
+}
+
+/**
+ * @brief   Parses one byte
+ * @note    For byte-wise sources such as a UART.
+ * @param
+ * @retval  true if the byte completed a frame
+ */
+bool FrameCodec::feed(uint8_t c)
+{
+    switch (_state) {
+        case SYNC1:
+            if (c == FRAME_SYNC1)
+                _state = SYNC2;
+            else
+                _skipped++;
+            return false;
+
+        case SYNC2:
+            if (c == FRAME_SYNC2) {
+                _crc = 0;
+                if (_flags & FRAME_LEN)
+                    _state = LENGTH;
+                else
+                    _startBody(_bodyLen);
+            }
+            else
+            if (c == FRAME_SYNC1)
+                _skipped++;
+            else {
+                _skipped += 2;
+                _state = SYNC1;
+            }
+            return false;
+
+        case LENGTH:
+            if (c == 0 || c > FRAME_MAXBODY) {
+                _badLength++;
+                _state = SYNC1;
+                return false;
+            }
+
+            _crc = crc8(0, &c, 1);
+            _startBody(c);
+            return false;
+
+        case BODY:
+            _body[_pos++] = c;
+            if (_flags & FRAME_CRC)
+                _crc = crc8(_crc, &c, 1);
+            if (_pos < _need)
+                return false;
+
+            if (_flags & FRAME_CRC) {
+                _state = CRC;
+                return false;
+            }
+            break;
+
+        case CRC:
+            if (c != _crc) {
+                _crcErrors++;
+                _state = SYNC1;
+                return false;
+            }
+            break;
+    }
+
+    _dispatch();
+    return true;
+}
+
+/**
+ * @brief   Parses a buffer
+ * @note    Frames may span calls and a buffer may hold many frames. The
+ *          sync byte is searched with memchr() and bodies are copied in one
+ *          go, only the header bytes go through the byte-wise parser.
+ * @param
+ * @retval  Number of frames completed
+ */
+size_t FrameCodec::feed(const uint8_t* data, size_t len)
+{
+    const uint8_t*  end = data + len;
+    size_t          frames = 0;
+
+    while (data < end) {
+        if (_state == SYNC1) {
+            const uint8_t*  sync = (const uint8_t*)memchr(data, FRAME_SYNC1, end - data);
+
+            if (!sync) {
+                _skipped += end - data;
+                break;
+            }
+
+            _skipped += sync - data;
+            data = sync + 1;
+            _state = SYNC2;
+            continue;
+        }
+
+        if (_state == BODY) {
+            size_t  n = _need - _pos;
+
+            if (n > (size_t)(end - data))
+                n = end - data;
+            memcpy(_body + _pos, data, n);
+            if (_flags & FRAME_CRC)
+                _crc = crc8(_crc, data, n);
+            _pos += n;
+            data += n;
+            if (_pos < _need)
+                break;
+
+            if (_flags & FRAME_CRC)
+                _state = CRC;
+            else {
+                _dispatch();
+                frames++;
+            }
+            continue;
+        }
+
+        if (feed(*data++))
+            frames++;
+    }
+
+    return frames;
+}
+
+/**
+ * @brief   Writes a frame
+ * @note    Uses the codec's layout; the body length is not limited to the
+ *          one of received frames, so replies may carry more data.
+ * @param   out Buffer for the frame
+ * @param   size Size of the buffer
+ * @param   id Command id
+ * @param   data Bytes following the id
+ * @param   len Number of bytes in data
+ * @retval  Length of the frame, 0 if it does not fit
+ */
+size_t FrameCodec::encode(uint8_t* out, size_t size, uint8_t id, const uint8_t* data, uint8_t len)
+{
+    size_t  head = (_flags & FRAME_LEN) ? 3 : 2;
+    size_t  total = head + 1 + len + ((_flags & FRAME_CRC) ? 1 : 0);
+
+    if (total > size || len + 1 > FRAME_MAXBODY)
+        return 0;
+
+    out[0] = FRAME_SYNC1;
+    out[1] = FRAME_SYNC2;
+    if (_flags & FRAME_LEN)
+        out[2] = len + 1;
+    out[head] = id;
+    memcpy(out + head + 1, data, len);
+    if (_flags & FRAME_CRC)
+        out[total - 1] = crc8(0, out + 2, total - 3);
+    return total;
+}
@@ -0,0 +1,497 @@
+/*
+ HttpServer.cpp - small HTTP/1.1 server on top of TcpServer.
+ */
+#include "HttpServer.h"
+#include "UipEthernet.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char   busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+static const char* reason(int status)
+{
+    switch (status) {
+        case 200:   return "OK";
+        case 304:   return "Not Modified";
+        case 400:   return "Bad Request";
+        case 404:   return "Not Found";
+        case 405:   return "Method Not Allowed";
+        case 413:   return "Payload Too Large";
+        case 503:   return "Service Unavailable";
+        default:    return "Internal Server Error";
+    }
+}
+
+/**
+ * @brief   Looks up a header without modifying the request
+ * @note
+ * @param   head Request line and headers, zero terminated
+ * @param   name Header name, matched ignoring case
+ * @retval  Value of the header or NULL
+ */
+static const char* header(const char* head, const char* name)
+{
+    size_t      len = strlen(name);
+    const char* line = strstr(head, "\r\n");
+
+    while (line) {
+        line += 2;
+        if (strncasecmp(line, name, len) == 0 && line[len] == ':') {
+            line += len + 1;
+            while (*line == ' ')
+                line++;
+            return line;
+        }
+
+        line = strstr(line, "\r\n");
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief
+ * @note    The routes and assets tables are not copied and must outlive the
+ *          server.
+ * @param   routes Handlers of the dynamic pages
+ * @param   assets Static files, usually the table written by tools/http_assets.py
+ * @retval
+ */
+HttpServer::HttpServer(const http_route_t* routes, uint8_t routeCount, const http_asset_t* assets, uint8_t assetCount) :
+    _routes(routes),
+    _routeCount(routeCount),
+    _assets(assets),
+    _assetCount(assetCount),
+    _ctx(NULL),
+    _requests(0),
+    _notModified(0),
+    _errors(0),
+    _refused(0)
+{
+    for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++)
+        _conns[i].client = NULL;
+}
+
+/**
+ * @brief   Starts listening
+ * @note
+ * @param
+ * @retval
+ */
+void HttpServer::open(UipEthernet* ethernet, uint16_t port)
+{
+    _server.open(ethernet);
+    _server.bind(port);
+    _server.listen(HTTP_CONNECTIONS);
+}
+
+/**
+ * @brief   Reads an integer parameter of a query string
+ * @note
+ * @param   query e.g. "id=1&on=0"
+ * @param   name Parameter name
+ * @param   def Returned if the parameter is missing
+ * @retval
+ */
+int HttpServer::param(const char* query, const char* name, int def)
+{
+    size_t  len = strlen(name);
+
+    while (*query) {
+        if (strncmp(query, name, len) == 0 && query[len] == '=')
+            return atoi(query + len + 1);
+
+        query = strchr(query, '&');
+        if (!query)
+            break;
+        query++;
+    }
+
+    return def;
+}
+
+/**
+ * @brief   Serves the connections
+ * @note    Reads what arrived, answers every complete request and resumes
+ *          responses the connection could not take at once. Requests
+ *          pipelined behind a response wait until it is sent.
+ * @param
+ * @retval
+ */
+void HttpServer::poll()
+{
+    _accept();
+    for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++) {
+        http_connection_t*  conn = &_conns[i];
+        int                 used = 0;
+
+        if (!conn->client || !_flush(conn))
+            continue;
+
+        size_t  len = conn->client->available();
+
+        if (len && conn->rxLen < HTTP_REQUEST_MAX) {
+            if (len > (size_t)(HTTP_REQUEST_MAX - conn->rxLen))
+                len = HTTP_REQUEST_MAX - conn->rxLen;
+            conn->client->recv((uint8_t*)conn->rx + conn->rxLen, len);
+            conn->rxLen += len;
+            conn->idle.reset();
+        }
+
+        while (!conn->close && (used = _request(conn)) > 0) {
+            conn->rxLen -= used;
+            memmove(conn->rx, conn->rx + used, conn->rxLen);
+            if (!_flush(conn))
+                break;
+        }
+
+        if (used < 0)
+            _flush(conn);
+
+        if (conn->outLen)
+            continue;
+
+        if (conn->close || !conn->client->connected() || conn->idle.read_ms() > HTTP_KEEPALIVE_MS)
+            _close(conn);
+    }
+}
+
+/**
+ * @brief   Takes a new connection
+ * @note    Without a free slot the client gets a 503 and is closed.
+ * @param
+ * @retval
+ */
+void HttpServer::_accept()
+{
+    TcpClient*  client = _server.accept();
+
+    if (!client)
+        return;
+
+    for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++) {
+        http_connection_t*  conn = &_conns[i];
+
+        if (conn->client)
+            continue;
+
+        conn->client = client;
+        conn->requests = 0;
+        conn->rxLen = 0;
+        conn->outLen = 0;
+        conn->nextLen = 0;
+        conn->close = false;
+        conn->idle.reset();
+        conn->idle.start();
+        return;
+    }
+
+    _refused++;
+    client->send((const uint8_t*)busy, sizeof(busy) - 1);
+    client->close();
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void HttpServer::_close(http_connection_t* conn)
+{
+    conn->client->close();
+    conn->client = NULL;
+    conn->idle.stop();
+}
+
+/**
+ * @brief   Sends the rest of the response
+ * @note    A connection that fails to send is marked for closing.
+ * @param
+ * @retval  true if nothing is left to send
+ */
+bool HttpServer::_flush(http_connection_t* conn)
+{
+    while (conn->outLen) {
+        int n = conn->client->send(conn->out, conn->outLen);
+
+        if (n < 0) {
+            conn->outLen = 0;
+            conn->nextLen = 0;
+            conn->close = true;
+            break;
+        }
+
+        if (n == 0)
+            return false;
+
+        conn->idle.reset();
+        conn->out += n;
+        conn->outLen -= n;
+        if (conn->outLen == 0 && conn->nextLen) {
+            conn->out = conn->next;
+            conn->outLen = conn->nextLen;
+            conn->nextLen = 0;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Parses and answers the first request in the receive buffer
+ * @note    The request is parsed in place, its strings point into the
+ *          buffer until it is consumed.
+ * @param
+ * @retval  Bytes consumed, 0 if the request is not complete yet or -1 if it
+ *          was answered with an error and the connection is closing
+ */
+int HttpServer::_request(http_connection_t* conn)
+{
+    char*           rx = conn->rx;
+    char*           end;
+    http_request_t  request;
+    const char*     etag = NULL;
+
+    rx[conn->rxLen] = '\0';
+    end = strstr(rx, "\r\n\r\n");
+    if (!end) {
+        if (conn->rxLen < HTTP_REQUEST_MAX)
+            return 0;
+
+        _error(conn, 413);
+        return -1;
+    }
+
+    // the body length is needed before the headers are cut up
+    size_t      headLen = end + 4 - rx;
+    size_t      bodyLen = 0;
+    const char* length;
+
+    *end = '\0';
+    length = header(rx, "Content-Length");
+    if (length)
+        bodyLen = strtoul(length, NULL, 10);
+    if (bodyLen > HTTP_REQUEST_MAX - headLen) {
+        _error(conn, 413);
+        return -1;
+    }
+
+    if (conn->rxLen < headLen + bodyLen) {
+        *end = '\r';
+        return 0;
+    }
+
+    // request line
+    char*   line = rx;
+    char*   next = strstr(line, "\r\n");
+    char*   target;
+    char*   version;
+
+    if (next) {
+        *next = '\0';
+        next += 2;
+    }
+
+    target = strchr(line, ' ');
+    version = target ? strchr(target + 1, ' ') : NULL;
+    if (!version || target[1] != '/' || strncmp(version + 1, "HTTP/1.", 7) != 0) {
+        _error(conn, 400);
+        return -1;
+    }
+
+    *target++ = '\0';
+    *version++ = '\0';
+    request.method = strcmp(line, "GET") == 0 ? HTTP_GET : strcmp(line, "HEAD") == 0 ? HTTP_HEAD : strcmp(line, "POST") == 0 ? HTTP_POST : 0;
+    request.path = target;
+    request.keepAlive = version[7] != '0';              // HTTP/1.0 closes by default
+    request.body = rx + headLen;
+    request.bodyLen = bodyLen;
+
+    char*   query = strchr(target, '?');
+
+    if (query)
+        *query++ = '\0';
+    request.query = query ? query : "";
+
+    // headers
+    while (next) {
+        char*   colon;
+        char*   value;
+
+        line = next;
+        next = strstr(line, "\r\n");
+        if (next) {
+            *next = '\0';
+            next += 2;
+        }
+
+        colon = strchr(line, ':');
+        if (!colon)
+            continue;
+
+        *colon = '\0';
+        for (value = colon + 1; *value == ' '; value++);
+        if (strcasecmp(line, "Connection") == 0) {
+            if (strncasecmp(value, "close", 5) == 0)
+                request.keepAlive = false;
+            else
+            if (strncasecmp(value, "keep-alive", 10) == 0)
+                request.keepAlive = true;
+        }
+        else
+        if (strcasecmp(line, "If-None-Match") == 0)
+            etag = value;
+    }
+
+    _handle(conn, &request, etag);
+    return headLen + bodyLen;
+}
+
+/**
+ * @brief   Answers a parsed request
+ * @note
+ * @param   etag If-None-Match header or NULL
+ * @retval
+ */
+void HttpServer::_handle(http_connection_t* conn, http_request_t* request, const char* etag)
+{
+    _requests++;
+    if (++conn->requests >= HTTP_KEEPALIVE_MAX)
+        request->keepAlive = false;
+
+    for (uint8_t i = 0; i < _assetCount; i++) {
+        if (strcmp(_assets[i].path, request->path) == 0) {
+            if (request->method & (HTTP_GET | HTTP_HEAD))
+                _asset(conn, request, &_assets[i], etag);
+            else
+                _reply(conn, request, 405, 0);
+            return;
+        }
+    }
+
+    for (uint8_t i = 0; i < _routeCount; i++) {
+        if (strcmp(_routes[i].path, request->path) == 0) {
+            if (!(_routes[i].methods & request->method)) {
+                _reply(conn, request, 405, 0);
+                return;
+            }
+
+            size_t  size = HTTP_TX_MAX - HTTP_HEADER_MAX;
+            int     n = _routes[i].handler(request, (char*)conn->tx + HTTP_HEADER_MAX, size, _ctx);
+
+            if (n < 0)
+                _reply(conn, request, -n, 0);
+            else
+            if ((size_t)n >= size)
+                _reply(conn, request, 500, 0);  // truncated
+            else
+                _reply(conn, request, 200, n);
+            return;
+        }
+    }
+
+    _reply(conn, request, 404, 0);
+}
+
+/**
+ * @brief   Answers with a static file
+ * @note    The precomputed header and the first part of the body are
+ *          copied to the transmit buffer so they leave in one segment, the
+ *          rest is sent straight from flash.
+ * @param
+ * @retval
+ */
+void HttpServer::_asset(http_connection_t* conn, const http_request_t* request, const http_asset_t* asset, const char* etag)
+{
+    const char* connection = request->keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    size_t      len;
+
+    conn->out = conn->tx;
+    conn->nextLen = 0;
+    conn->close = !request->keepAlive;
+    if (etag && (strstr(etag, asset->etag) || strcmp(etag, "*") == 0)) {
+        _notModified++;
+        conn->outLen = snprintf
+            (
+                (char*)conn->tx,
+                HTTP_TX_MAX,
+                "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n%s",
+                asset->etag,
+                connection
+            );
+        return;
+    }
+
+    len = strlen(connection);
+    memcpy(conn->tx, asset->header, asset->headerLen);
+    memcpy(conn->tx + asset->headerLen, connection, len);
+    len += asset->headerLen;
+    conn->outLen = len;
+    if (request->method == HTTP_HEAD)
+        return;
+
+    size_t  first = HTTP_TX_MAX - len;
+
+    if (first > asset->length)
+        first = asset->length;
+    memcpy(conn->tx + len, asset->data, first);
+    conn->outLen += first;
+    conn->next = asset->data + first;
+    conn->nextLen = asset->length - first;
+}
+
+/**
+ * @brief   Answers with the JSON body at tx + HTTP_HEADER_MAX
+ * @note    The header is written right in front of the body.
+ * @param
+ * @retval
+ */
+void HttpServer::_reply(http_connection_t* conn, const http_request_t* request, int status, size_t bodyLen)
+{
+    char    head[HTTP_HEADER_MAX];
+    int     n;
+
+    if (status >= 400)
+        _errors++;
+
+    n = snprintf
+        (
+            head,
+            sizeof(head),
+            "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nCache-Control: no-store\r\nConnection: %s\r\n\r\n",
+            status,
+            reason(status),
+            (unsigned)bodyLen,
+            request->keepAlive ? "keep-alive" : "close"
+        );
+    conn->out = conn->tx + HTTP_HEADER_MAX - n;
+    memcpy((uint8_t*)conn->out, head, n);
+    conn->outLen = n + (request->method == HTTP_HEAD ? 0 : bodyLen);
+    conn->nextLen = 0;
+    conn->close = !request->keepAlive;
+}
+
+/**
+ * @brief   Answers a request that could not be parsed and closes
+ * @note
+ * @param
+ * @retval
+ */
+void HttpServer::_error(http_connection_t* conn, int status)
+{
+    http_request_t  request;
+
+    request.method = HTTP_GET;
+    request.keepAlive = false;
+    _requests++;
+    _reply(conn, &request, status, 0);
+}
@@ -0,0 +1,132 @@
+/*
+ HttpServer.h - small HTTP/1.1 server on top of TcpServer.
+
+ Connections are kept alive and requests on them may be pipelined. A
+ request is answered from one of two tables:
+
+    assets      static files compiled into flash, gzipped, with their
+                response header, Content-Length and ETag computed at build
+                time (tools/http_assets.py). A matching If-None-Match is
+                answered with 304 Not Modified.
+    routes      handlers writing a small JSON body into a buffer, e.g. the
+                current state of the board.
+
+ Nothing is allocated per request: every connection owns a receive buffer
+ for the request and a transmit buffer for the response header.
+ */
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include "mbed.h"
+#include "TcpServer.h"
+
+#ifndef HTTP_CONNECTIONS
+#define HTTP_CONNECTIONS    2       // kept alive at the same time
+#endif
+
+#ifndef HTTP_REQUEST_MAX
+#define HTTP_REQUEST_MAX    384     // request line, headers and body
+#endif
+
+#ifndef HTTP_TX_MAX
+#define HTTP_TX_MAX         512     // response header and JSON body, one segment
+#endif
+
+#ifndef HTTP_KEEPALIVE_MS
+#define HTTP_KEEPALIVE_MS   5000    // idle connections are closed after this
+#endif
+
+#ifndef HTTP_KEEPALIVE_MAX
+#define HTTP_KEEPALIVE_MAX  100     // requests per connection
+#endif
+
+#define HTTP_HEADER_MAX     160     // room reserved in front of a JSON body
+
+#define HTTP_GET            0x01
+#define HTTP_HEAD           0x02
+#define HTTP_POST           0x04
+
+typedef struct
+{
+    uint8_t         method;
+    const char*     path;
+    const char*     query;          // after '?', "" if none
+    const char*     body;
+    size_t          bodyLen;
+    bool            keepAlive;
+} http_request_t;
+
+// Writes the JSON body of the response to body and returns its length, or
+// a negative HTTP status (e.g. -400) to answer with an empty error response.
+typedef int (*http_handler_t)(const http_request_t* request, char* body, size_t size, void* ctx);
+
+typedef struct
+{
+    uint8_t         methods;        // HTTP_GET | HTTP_POST ...
+    const char*     path;
+    http_handler_t  handler;
+} http_route_t;
+
+typedef struct
+{
+    const char*     path;
+    const char*     etag;           // quoted
+    const char*     header;         // status line up to the last header line but Connection
+    uint16_t        headerLen;
+    const uint8_t*  data;           // gzipped body
+    uint32_t        length;
+} http_asset_t;
+
+class UipEthernet;
+
+class HttpServer
+{
+public:
+    HttpServer(const http_route_t* routes, uint8_t routeCount, const http_asset_t* assets, uint8_t assetCount);
+    void        open(UipEthernet* ethernet, uint16_t port = 80);
+    void        poll();                                 // call from the main loop
+    void        setContext(void* ctx)   { _ctx = ctx; }
+    static int  param(const char* query, const char* name, int def);
+
+    uint32_t    requests()              { return _requests; }
+    uint32_t    notModified()           { return _notModified; }   // answered with 304
+    uint32_t    errors()                { return _errors; }        // answered with 4xx/5xx
+    uint32_t    refused()               { return _refused; }       // no free connection
+private:
+    typedef struct
+    {
+        TcpClient*      client;
+        Timer           idle;
+        uint16_t        requests;       // served on this connection
+        uint16_t        rxLen;
+        const uint8_t*  out;            // response bytes not sent yet
+        size_t          outLen;
+        const uint8_t*  next;           // sent after out, the rest of an asset
+        size_t          nextLen;
+        bool            close;          // close once the response is out
+        char            rx[HTTP_REQUEST_MAX + 1];
+        uint8_t         tx[HTTP_TX_MAX];
+    } http_connection_t;
+
+    TcpServer           _server;
+    const http_route_t* _routes;
+    uint8_t             _routeCount;
+    const http_asset_t* _assets;
+    uint8_t             _assetCount;
+    void*               _ctx;
+    http_connection_t   _conns[HTTP_CONNECTIONS];
+    uint32_t            _requests;
+    uint32_t            _notModified;
+    uint32_t            _errors;
+    uint32_t            _refused;
+
+    void                _accept();
+    void                _close(http_connection_t* conn);
+    bool                _flush(http_connection_t* conn);
+    int                 _request(http_connection_t* conn);
+    void                _handle(http_connection_t* conn, http_request_t* request, const char* etag);
+    void                _asset(http_connection_t* conn, const http_request_t* request, const http_asset_t* asset, const char* etag);
+    void                _reply(http_connection_t* conn, const http_request_t* request, int status, size_t bodyLen);
+    void                _error(http_connection_t* conn, int status);
+};
+#endif
@@ -0,0 +1,687 @@
+/*
+ MqttClient.cpp - compact MQTT 3.1.1 client on top of TcpClient.
+ */
+#include "MqttClient.h"
+#include "UipEthernet.h"
+#include <string.h>
+
+#define MQTT_CONNECT        0x10
+#define MQTT_CONNACK        0x20
+#define MQTT_PUBLISH        0x30
+#define MQTT_PUBACK         0x40
+#define MQTT_SUBSCRIBE      0x82    // with the reserved flags set
+#define MQTT_SUBACK         0x90
+#define MQTT_PINGREQ        0xC0
+#define MQTT_PINGRESP       0xD0
+#define MQTT_DISCONNECT     0xE0
+
+#define MQTT_CLEAN_SESSION  0x02
+#define MQTT_WILL           0x04
+#define MQTT_WILL_RETAIN    0x20
+#define MQTT_PASSWORD       0x40
+#define MQTT_USER           0x80
+
+/**
+ * @brief   Size of a packet with the given remaining length
+ * @note
+ * @param
+ * @retval
+ */
+static size_t packetSize(size_t remaining)
+{
+    return 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : remaining < 2097152 ? 3 : 4) + remaining;
+}
+
+/**
+ * @brief
+ * @note    The tables are not copied and must outlive the client.
+ * @param   clientId Unique per broker, a second client with the same id
+ *          disconnects the first one
+ * @param   topics Names published by index, may be NULL
+ * @param   subscriptions Filters subscribed on every connect, may be NULL
+ * @retval
+ */
+MqttClient::MqttClient
+(
+    const char*                 clientId,
+    const char* const*          topics,
+    uint8_t                     topicCount,
+    const mqtt_subscription_t*  subscriptions,
+    uint8_t                     subscriptionCount
+) :
+    _clientId(clientId),
+    _topics(topics),
+    _topicCount(topicCount),
+    _subscriptions(subscriptions),
+    _subscriptionCount(subscriptionCount),
+    _user(NULL),
+    _password(NULL),
+    _willTopic(NULL),
+    _willMessage(NULL),
+    _willFlags(0),
+    _ctx(NULL),
+    _host(NULL),
+    _port(MQTT_PORT),
+    _keepAlive(MQTT_KEEPALIVE_S),
+    _state(CLOSED),
+    _pinging(false),
+    _packetId(0),
+    _inflightCount(0),
+    _txLen(0),
+    _rxLen(0),
+    _remaining(0),
+    _length(0),
+    _header(0),
+    _lengthBytes(0),
+    _body(false),
+    _published(0),
+    _acknowledged(0),
+    _lost(0),
+    _received(0),
+    _segments(0),
+    _skipped(0),
+    _reconnects(0)
+{ }
+
+/**
+ * @brief
+ * @note    Takes effect with the next connect.
+ * @param   password May be NULL
+ * @retval
+ */
+void MqttClient::setCredentials(const char* user, const char* password)
+{
+    _user = user;
+    _password = password;
+}
+
+/**
+ * @brief   Message the broker publishes when the connection breaks
+ * @note    Takes effect with the next connect. A retained "offline" will
+ *          together with a retained "online" publish after connecting keeps
+ *          the state of the node visible to new subscribers.
+ * @param   topic NULL removes the will
+ * @retval
+ */
+void MqttClient::setWill(const char* topic, const char* message, uint8_t qos, bool retain)
+{
+    _willTopic = topic;
+    _willMessage = message;
+    _willFlags = topic ? MQTT_WILL | (qos << 3) | (retain ? MQTT_WILL_RETAIN : 0) : 0;
+}
+
+/**
+ * @brief   Connects to the broker
+ * @note    Only starts the TCP handshake, poll() sends CONNECT once it is
+ *          done. If it fails poll() retries every MQTT_RECONNECT_MS ms, as
+ *          it does whenever the connection is lost. A host name is looked
+ *          up first, which waits for the DNS server.
+ * @param   host IP address or host name of the broker
+ * @param   keepAlive Seconds, the broker drops the connection after 1.5 times
+ *          this without a packet
+ * @retval  0 if the handshake was started, MQTT_ERROR if not
+ */
+int MqttClient::open(UipEthernet* ethernet, const char* host, uint16_t port, uint16_t keepAlive)
+{
+    _client.open(ethernet);
+    _host = host;
+    _port = port;
+    _keepAlive = keepAlive;
+    _reconnects = 0;
+    _state = DISCONNECTED;
+    _timer.start();
+    _sent.start();
+    _connect();
+    return _state == OPENING ? 0 : MQTT_ERROR;
+}
+
+/**
+ * @brief   Disconnects gracefully, the will is not published
+ * @note    Batched messages are sent first.
+ * @param
+ * @retval
+ */
+void MqttClient::close()
+{
+    if (_state == CONNECTED && _reserve(2)) {
+        _put(MQTT_DISCONNECT);
+        _put(0);
+        flush();
+    }
+
+    _disconnect();
+    _state = CLOSED;
+    _timer.stop();
+    _sent.stop();
+}
+
+/**
+ * @brief   Runs the client
+ * @note    Reads and dispatches what the broker sent, sends the batched
+ *          packets, keeps the connection alive and reconnects.
+ * @param
+ * @retval
+ */
+void MqttClient::poll()
+{
+    if (_state == CLOSED)
+        return;
+
+    if (_state == DISCONNECTED) {
+        if (_timer.read_ms() >= MQTT_RECONNECT_MS)
+            _connect();
+        return;
+    }
+
+    if (_state == OPENING) {
+        if (_client.connecting() && _timer.read_ms() <= MQTT_TIMEOUT_MS)
+            return;
+
+        if (_client.connected())
+            _sendConnect();
+        else
+            _disconnect();
+        return;
+    }
+
+    _receive();
+    if (_state < CONNECTING)
+        return;
+
+    if (!_client.connected()) {
+        _disconnect();
+        return;
+    }
+
+    if (_state == CONNECTING) {
+        if (_timer.read_ms() > MQTT_TIMEOUT_MS)
+            _disconnect();
+        return;
+    }
+
+    if (_pinging) {
+        if (_timer.read_ms() > MQTT_TIMEOUT_MS) {
+            _disconnect();
+            return;
+        }
+    }
+    else
+    if (_keepAlive && _sent.read_ms() >= _keepAlive * 750 && _reserve(2)) {
+        _put(MQTT_PINGREQ);
+        _put(0);
+        _pinging = true;
+        _timer.reset();
+    }
+
+    flush();
+}
+
+/**
+ * @brief   Publishes a message
+ * @note    The message is batched with the others published before the next
+ *          poll(). A message that does not fit into the transmit buffer is
+ *          sent at once, its payload straight from the caller's buffer.
+ * @param   topic Name, no wildcards
+ * @param   qos 0 or 1
+ * @retval  Packet id for QoS 1, 0 for QoS 0, MQTT_BUSY if MQTT_INFLIGHT QoS 1
+ *          messages are unacknowledged or the batch could not be sent yet,
+ *          MQTT_ERROR if not connected
+ */
+int MqttClient::publish(const char* topic, const void* payload, size_t len, uint8_t qos, bool retain)
+{
+    if (_state != CONNECTED)
+        return MQTT_ERROR;
+
+    if (qos && _inflightCount == MQTT_INFLIGHT)
+        return MQTT_BUSY;
+
+    size_t      topicLen = strlen(topic);
+    size_t      remaining = 2 + topicLen + (qos ? 2 : 0) + len;
+    size_t      size = packetSize(remaining);
+    bool        direct = size > MQTT_TX_MAX;
+
+    if (direct)
+        size -= len;                    // only the header is batched
+    if (!_reserve(size))
+        return _state == CONNECTED ? MQTT_BUSY : MQTT_ERROR;
+
+    uint16_t    id = qos ? _nextId() : 0;
+
+    _putHeader(MQTT_PUBLISH | (qos ? 0x02 : 0) | (retain ? 0x01 : 0), remaining);
+    _putString(topic, topicLen);
+    if (qos)
+        _put16(id);
+
+    if (direct) {
+        if (!flush() || _send((const uint8_t*)payload, len) != (int)len) {
+            _disconnect();              // the stream is broken after a partial packet
+            return MQTT_ERROR;
+        }
+
+        _segments++;
+    }
+    else {
+        memcpy(_tx + _txLen, payload, len);
+        _txLen += len;
+    }
+
+    if (qos)
+        _inflight[_inflightCount++] = id;
+    _published++;
+    return id;
+}
+
+/**
+ * @brief   Publishes a message to a topic of the topics table
+ * @note
+ * @param   topic Index into the topics table
+ * @retval  See publish(const char* ...)
+ */
+int MqttClient::publish(uint8_t topic, const void* payload, size_t len, uint8_t qos, bool retain)
+{
+    if (topic >= _topicCount)
+        return MQTT_ERROR;
+
+    return publish(_topics[topic], payload, len, qos, retain);
+}
+
+/**
+ * @brief   Sends the batched packets
+ * @note
+ * @param
+ * @retval  true if nothing is left to send
+ */
+bool MqttClient::flush()
+{
+    if (!_txLen)
+        return true;
+
+    int n = _send(_tx, _txLen);
+
+    if (n < 0) {
+        _disconnect();
+        return false;
+    }
+
+    if (n > 0) {
+        _segments++;
+        _sent.reset();
+        _txLen -= n;
+        memmove(_tx, _tx + n, _txLen);
+    }
+
+    return _txLen == 0;
+}
+
+/**
+ * @brief   Matches a topic against a subscription filter
+ * @note    Topics starting with '$' match no filter starting with a wildcard.
+ * @param   filter e.g. "stm32/+/led" or "stm32/#"
+ * @param   topic e.g. "stm32/node1/led"
+ * @retval
+ */
+bool MqttClient::matches(const char* filter, const char* topic)
+{
+    if (*topic == '$' && (*filter == '+' || *filter == '#'))
+        return false;
+
+    while (*filter) {
+        if (*filter == '#')
+            return true;
+
+        if (*filter == '+') {
+            while (*topic && *topic != '/')
+                topic++;
+            filter++;
+            continue;
+        }
+
+        if (*filter != *topic)
+            return *topic == '\0' && strcmp(filter, "/#") == 0;    // "a/#" matches "a"
+
+        filter++;
+        topic++;
+    }
+
+    return *topic == '\0';
+}
+
+/**
+ * @brief   Starts the TCP handshake
+ * @note    poll() follows it, the main loop keeps running while the broker
+ *          does not answer.
+ * @param
+ * @retval
+ */
+void MqttClient::_connect()
+{
+    _timer.reset();
+    if (_client.startConnect(_host, _port) == 0)
+        _state = OPENING;
+}
+
+/**
+ * @brief   Sends CONNECT on the open TCP connection
+ * @note
+ * @param
+ * @retval
+ */
+void MqttClient::_sendConnect()
+{
+    size_t  clientIdLen = strlen(_clientId);
+    size_t  remaining = 10 + 2 + clientIdLen;
+    uint8_t flags = MQTT_CLEAN_SESSION | _willFlags;
+
+    if (_willTopic)
+        remaining += 2 + strlen(_willTopic) + 2 + strlen(_willMessage);
+    if (_user) {
+        flags |= MQTT_USER;
+        remaining += 2 + strlen(_user);
+    }
+
+    if (_password) {
+        flags |= MQTT_PASSWORD;
+        remaining += 2 + strlen(_password);
+    }
+
+    _txLen = 0;
+    if (packetSize(remaining) > MQTT_TX_MAX) {
+        _disconnect();
+        return;
+    }
+
+    _putHeader(MQTT_CONNECT, remaining);
+    _putString("MQTT", 4);
+    _put(4);                            // protocol level 3.1.1
+    _put(flags);
+    _put16(_keepAlive);
+    _putString(_clientId, clientIdLen);
+    if (_willTopic) {
+        _putString(_willTopic, strlen(_willTopic));
+        _putString(_willMessage, strlen(_willMessage));
+    }
+
+    if (_user)
+        _putString(_user, strlen(_user));
+    if (_password)
+        _putString(_password, strlen(_password));
+
+    _state = CONNECTING;
+    _timer.reset();
+    if (!flush())
+        _disconnect();
+}
+
+/**
+ * @brief   Drops the connection, poll() reconnects
+ * @note    Batched and unacknowledged messages are lost.
+ * @param
+ * @retval
+ */
+void MqttClient::_disconnect()
+{
+    if (_state >= CONNECTING)
+        _reconnects++;
+    _client.stop();
+    _lost += _inflightCount;
+    _inflightCount = 0;
+    _txLen = 0;
+    _header = 0;
+    _body = false;
+    _pinging = false;
+    _state = DISCONNECTED;
+    _timer.reset();
+}
+
+/**
+ * @brief   Subscribes the filters of the subscriptions table
+ * @note    One SUBSCRIBE per filter, batched like the publishes.
+ * @param
+ * @retval
+ */
+void MqttClient::_subscribe()
+{
+    for (uint8_t i = 0; i < _subscriptionCount; i++) {
+        size_t  len = strlen(_subscriptions[i].filter);
+        size_t  remaining = 2 + 2 + len + 1;
+
+        if (!_reserve(packetSize(remaining)))
+            return;
+
+        _putHeader(MQTT_SUBSCRIBE, remaining);
+        _put16(_nextId());
+        _putString(_subscriptions[i].filter, len);
+        _put(_subscriptions[i].qos);
+    }
+}
+
+/**
+ * @brief   Reads what the broker sent
+ * @note    Packets may be split across segments and several may arrive in
+ *          one. Packets larger than MQTT_RX_MAX are read and dropped.
+ * @param
+ * @retval
+ */
+void MqttClient::_receive()
+{
+    size_t  avail;
+
+    while (_state >= CONNECTING && (avail = _client.available()) > 0) {
+        if (!_body) {
+            uint8_t b;
+
+            _client.recv(&b, 1);
+            if (!_header) {
+                _header = b;
+                _length = 0;
+                _lengthBytes = 0;
+                continue;
+            }
+
+            _length |= (uint32_t)(b & 0x7F) << (7 * _lengthBytes++);
+            if (b & 0x80) {
+                if (_lengthBytes == 4)
+                    _disconnect();      // malformed
+                continue;
+            }
+
+            _body = true;
+            _remaining = _length;
+            _rxLen = 0;
+        }
+        else {
+            size_t  len = avail < _remaining ? avail : _remaining;
+
+            if (_length <= MQTT_RX_MAX) {
+                _client.recv(_rx + _rxLen, len);
+                _rxLen += len;
+            }
+            else {
+                uint8_t scratch[32];
+
+                if (len > sizeof(scratch))
+                    len = sizeof(scratch);
+                _client.recv(scratch, len);
+            }
+
+            _remaining -= len;
+        }
+
+        if (_remaining == 0) {
+            if (_length <= MQTT_RX_MAX)
+                _packet();
+            else
+                _skipped++;
+            _header = 0;
+            _body = false;
+        }
+    }
+}
+
+/**
+ * @brief   Handles the packet in _rx
+ * @note
+ * @param
+ * @retval
+ */
+void MqttClient::_packet()
+{
+    switch (_header & 0xF0) {
+        case MQTT_CONNACK:
+            if (_state != CONNECTING)
+                break;
+            if (_length >= 2 && _rx[1] == 0) {
+                _state = CONNECTED;
+                _subscribe();
+            }
+            else
+                _disconnect();          // refused, retried after MQTT_RECONNECT_MS
+            break;
+
+        case MQTT_PUBLISH:
+            _dispatch();
+            break;
+
+        case MQTT_PUBACK:
+            if (_length >= 2) {
+                uint16_t    id = (_rx[0] << 8) | _rx[1];
+
+                for (uint8_t i = 0; i < _inflightCount; i++) {
+                    if (_inflight[i] == id) {
+                        _inflight[i] = _inflight[--_inflightCount];
+                        _acknowledged++;
+                        break;
+                    }
+                }
+            }
+            break;
+
+        case MQTT_PINGRESP:
+            _pinging = false;
+            break;
+
+        default:                        // SUBACK, UNSUBACK
+            break;
+    }
+}
+
+/**
+ * @brief   Passes a received PUBLISH to the matching handlers
+ * @note    The topic is moved one byte to the front to terminate it in
+ *          place, over its length field.
+ * @param
+ * @retval
+ */
+void MqttClient::_dispatch()
+{
+    if (_length < 2)
+        return;
+
+    uint8_t     qos = (_header >> 1) & 0x03;
+    size_t      topicLen = (_rx[0] << 8) | _rx[1];
+    size_t      pos = 2 + topicLen + (qos ? 2 : 0);
+    uint16_t    id = 0;
+
+    if (pos > _length)
+        return;
+
+    if (qos)
+        id = (_rx[2 + topicLen] << 8) | _rx[3 + topicLen];
+
+    char*   topic = (char*)_rx + 1;
+
+    memmove(topic, _rx + 2, topicLen);
+    topic[topicLen] = '\0';
+    _received++;
+    for (uint8_t i = 0; i < _subscriptionCount; i++) {
+        if (matches(_subscriptions[i].filter, topic))
+            _subscriptions[i].handler(topic, _rx + pos, _length - pos, _ctx);
+    }
+
+    if (qos && _state >= CONNECTING && _reserve(4)) {
+        _put(MQTT_PUBACK);
+        _put(2);
+        _put16(id);
+    }
+}
+
+/**
+ * @brief   Makes room for len bytes in the transmit buffer
+ * @note    Sends the batch if it is too full.
+ * @param
+ * @retval  false if the batch could not be sent
+ */
+bool MqttClient::_reserve(size_t len)
+{
+    if (_txLen + len > MQTT_TX_MAX && !flush())
+        return false;
+
+    return len <= MQTT_TX_MAX;
+}
+
+/**
+ * @brief
+ * @note    TcpClient::send blocks until the data is buffered unless
+ *          UIP_ATTEMPTS_ON_WRITE limits it.
+ * @param
+ * @retval  Bytes sent or -1 if the connection is closed
+ */
+int MqttClient::_send(const uint8_t* buf, size_t len)
+{
+    size_t  sent = 0;
+
+    while (sent < len) {
+        int n = _client.send(buf + sent, len - sent);
+
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        sent += n;
+    }
+
+    return sent;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void MqttClient::_putString(const char* s, size_t len)
+{
+    _put16(len);
+    memcpy(_tx + _txLen, s, len);
+    _txLen += len;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void MqttClient::_putHeader(uint8_t type, size_t remaining)
+{
+    _put(type);
+    do {
+        uint8_t b = remaining & 0x7F;
+
+        remaining >>= 7;
+        _put(remaining ? b | 0x80 : b);
+    } while (remaining);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval  Packet id, never 0
+ */
+uint16_t MqttClient::_nextId()
+{
+    if (++_packetId == 0)
+        _packetId = 1;
+    return _packetId;
+}
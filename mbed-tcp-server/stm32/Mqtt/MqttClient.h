@@ -0,0 +1,178 @@
+/*
+ MqttClient.h - compact MQTT 3.1.1 client on top of TcpClient.
+
+ Nothing is allocated: the client owns one transmit buffer the size of a
+ TCP segment and one receive buffer for the largest incoming packet.
+ Publishes are packed into the transmit buffer and sent by poll() (or
+ flush(), or when the buffer is full), so all messages published between
+ two polls leave in as few segments as possible instead of one small
+ segment each.
+
+ Topics are given in two tables that must outlive the client:
+
+    topics          names published by index, publish(TOPIC_ADC, ...). Over
+                    MQTT 3.1.1 the name is written into every message, over
+                    MQTT-SN (MqttSnClient) the index is mapped to the 2 byte
+                    topic id registered with the gateway, so application
+                    code is the same for both.
+    subscriptions   filters (+ and # allowed) with their handler, subscribed
+                    again after every reconnect.
+
+ QoS 0 and 1 are supported. QoS 1 messages are acknowledged but not kept
+ for retransmission: those not acknowledged when the connection drops are
+ counted as lost(). Incoming QoS 1 messages are acknowledged after their
+ handler ran. The session is always clean.
+ */
+#ifndef MQTTCLIENT_H
+#define MQTTCLIENT_H
+
+#include "mbed.h"
+#include "TcpClient.h"
+
+#ifndef MQTT_TX_MAX
+#define MQTT_TX_MAX         UIP_SOCKET_DATALEN  // one segment of batched packets
+#endif
+
+#ifndef MQTT_RX_MAX
+#define MQTT_RX_MAX         256     // largest incoming packet, larger ones are skipped
+#endif
+
+#ifndef MQTT_KEEPALIVE_S
+#define MQTT_KEEPALIVE_S    60
+#endif
+
+#ifndef MQTT_TIMEOUT_MS
+#define MQTT_TIMEOUT_MS     5000    // for the TCP handshake, CONNACK and PINGRESP
+#endif
+
+#ifndef MQTT_RECONNECT_MS
+#define MQTT_RECONNECT_MS   5000
+#endif
+
+#ifndef MQTT_INFLIGHT
+#define MQTT_INFLIGHT       4       // unacknowledged QoS 1 publishes
+#endif
+
+#define MQTT_PORT           1883
+
+#define MQTT_ERROR          -1      // not connected or the message can't be sent
+#define MQTT_BUSY           -2      // MQTT_INFLIGHT QoS 1 messages unacknowledged
+
+// topic is zero terminated, payload is not; both are only valid during the call
+typedef void (*mqtt_handler_t)(const char* topic, const uint8_t* payload, size_t len, void* ctx);
+
+typedef struct
+{
+    const char*     filter;
+    uint8_t         qos;            // 0 or 1
+    mqtt_handler_t  handler;
+} mqtt_subscription_t;
+
+class UipEthernet;
+
+//     enum { TOPIC_ADC };
+//     const char* const           topics[] = { "stm32/adc" };
+//     const mqtt_subscription_t   subscriptions[] = { { "stm32/led/+", 0, onLed } };
+//     MqttClient  mqtt("stm32", topics, 1, subscriptions, 1);
+//
+//     mqtt.open(&net, "192.168.137.1");
+//     while (true) {
+//         mqtt.publish(TOPIC_ADC, "{\"adc\":42}", 10);
+//         mqtt.poll();                    // sends, receives, keeps alive, reconnects
+//     }
+class MqttClient
+{
+public:
+    MqttClient
+    (
+        const char*                 clientId,
+        const char* const*          topics,
+        uint8_t                     topicCount,
+        const mqtt_subscription_t*  subscriptions,
+        uint8_t                     subscriptionCount
+    );
+    void            setCredentials(const char* user, const char* password);
+    void            setWill(const char* topic, const char* message, uint8_t qos = 0, bool retain = true);
+    void            setContext(void* ctx)   { _ctx = ctx; }
+    int             open(UipEthernet* ethernet, const char* host, uint16_t port = MQTT_PORT, uint16_t keepAlive = MQTT_KEEPALIVE_S);
+    void            close();
+    void            poll();                 // call from the main loop
+    bool            connected()             { return _state == CONNECTED; }
+    int             publish(const char* topic, const void* payload, size_t len, uint8_t qos = 0, bool retain = false);
+    int             publish(uint8_t topic, const void* payload, size_t len, uint8_t qos = 0, bool retain = false);
+    bool            flush();                // sends the batched packets now
+    uint8_t         inflight()              { return _inflightCount; }
+    static bool     matches(const char* filter, const char* topic);
+
+    uint32_t        published()             { return _published; }
+    uint32_t        acknowledged()          { return _acknowledged; }   // QoS 1
+    uint32_t        lost()                  { return _lost; }           // QoS 1, connection dropped
+    uint32_t        received()              { return _received; }
+    uint32_t        segments()              { return _segments; }       // send() calls carrying packets
+    uint32_t        skipped()               { return _skipped; }        // larger than MQTT_RX_MAX
+    uint32_t        reconnects()            { return _reconnects; }
+private:
+    enum
+    {
+        CLOSED,
+        DISCONNECTED,                       // waiting to reconnect
+        OPENING,                            // TCP handshake running
+        CONNECTING,                         // CONNECT sent, waiting for CONNACK
+        CONNECTED
+    };
+
+    TcpClient                   _client;
+    const char*                 _clientId;
+    const char* const*          _topics;
+    uint8_t                     _topicCount;
+    const mqtt_subscription_t*  _subscriptions;
+    uint8_t                     _subscriptionCount;
+    const char*                 _user;
+    const char*                 _password;
+    const char*                 _willTopic;
+    const char*                 _willMessage;
+    uint8_t                     _willFlags;
+    void*                       _ctx;
+    const char*                 _host;
+    uint16_t                    _port;
+    uint16_t                    _keepAlive;
+    uint8_t                     _state;
+    Timer                       _timer;     // since connecting, the last reconnect attempt or PINGREQ
+    Timer                       _sent;      // since the last packet sent
+    bool                        _pinging;
+    uint16_t                    _packetId;
+    uint16_t                    _inflight[MQTT_INFLIGHT];
+    uint8_t                     _inflightCount;
+    uint8_t                     _tx[MQTT_TX_MAX];
+    size_t                      _txLen;
+    uint8_t                     _rx[MQTT_RX_MAX + 1];
+    size_t                      _rxLen;     // bytes of the current packet in _rx
+    uint32_t                    _remaining; // of the current packet still to read
+    uint32_t                    _length;    // remaining length of the current packet
+    uint8_t                     _header;    // first byte of the current packet, 0 if none
+    uint8_t                     _lengthBytes;
+    bool                        _body;      // the remaining length is complete
+    uint32_t                    _published;
+    uint32_t                    _acknowledged;
+    uint32_t                    _lost;
+    uint32_t                    _received;
+    uint32_t                    _segments;
+    uint32_t                    _skipped;
+    uint32_t                    _reconnects;
+
+    void                        _connect();
+    void                        _sendConnect();
+    void                        _disconnect();
+    void                        _subscribe();
+    void                        _receive();
+    void                        _packet();
+    void                        _dispatch();
+    bool                        _reserve(size_t len);
+    int                         _send(const uint8_t* buf, size_t len);
+    void                        _put(uint8_t b)     { _tx[_txLen++] = b; }
+    void                        _put16(uint16_t v)  { _put(v >> 8); _put(v & 0xFF); }
+    void                        _putString(const char* s, size_t len);
+    void                        _putHeader(uint8_t type, size_t remaining);
+    uint16_t                    _nextId();
+};
+#endif
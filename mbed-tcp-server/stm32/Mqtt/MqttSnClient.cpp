@@ -0,0 +1,604 @@
+/*
+ MqttSnClient.cpp - MQTT-SN 1.2 client on top of UdpSocket.
+ */
+#include "MqttSnClient.h"
+#include "UipEthernet.h"
+#include <string.h>
+
+#define MQTTSN_CONNECT      0x04
+#define MQTTSN_CONNACK      0x05
+#define MQTTSN_REGISTER     0x0A
+#define MQTTSN_REGACK       0x0B
+#define MQTTSN_PUBLISH      0x0C
+#define MQTTSN_PUBACK       0x0D
+#define MQTTSN_SUBSCRIBE    0x12
+#define MQTTSN_SUBACK       0x13
+#define MQTTSN_PINGREQ      0x16
+#define MQTTSN_PINGRESP     0x17
+#define MQTTSN_DISCONNECT   0x18
+
+#define MQTTSN_RETAIN       0x10
+#define MQTTSN_CLEAN        0x04
+#define MQTTSN_TOPIC_NORMAL 0x00
+#define MQTTSN_TOPIC_SHORT  0x02
+#define MQTTSN_TOPIC_TYPE   0x03
+
+#define MQTTSN_ACCEPTED     0x00
+#define MQTTSN_INVALID_ID   0x02
+
+#define MQTTSN_MIN(a, b)    ((a) < (b) ? (a) : (b))
+
+/**
+ * @brief
+ * @note    The tables are not copied and must outlive the client. Only the
+ *          first MQTTSN_TOPICS entries of each get an id.
+ * @param   clientId 1 to 23 characters, unique per gateway
+ * @param   topics Names published by index, may be NULL
+ * @param   subscriptions Filters subscribed on every connect, may be NULL
+ * @retval
+ */
+MqttSnClient::MqttSnClient
+(
+    const char*                 clientId,
+    const char* const*          topics,
+    uint8_t                     topicCount,
+    const mqtt_subscription_t*  subscriptions,
+    uint8_t                     subscriptionCount
+) :
+    _clientId(clientId),
+    _topics(topics),
+    _topicCount(MQTTSN_MIN(topicCount, MQTTSN_TOPICS)),
+    _subscriptions(subscriptions),
+    _subscriptionCount(MQTTSN_MIN(subscriptionCount, MQTTSN_TOPICS)),
+    _ctx(NULL),
+    _host(NULL),
+    _port(MQTTSN_PORT),
+    _keepAlive(MQTTSN_KEEPALIVE_S),
+    _state(CLOSED),
+    _step(0),
+    _tries(0),
+    _pending(false),
+    _pinging(false),
+    _msgId(0),
+    _remoteNext(0),
+    _txLen(0),
+    _published(0),
+    _received(0),
+    _batches(0),
+    _dropped(0),
+    _unknown(0),
+    _reconnects(0)
+{
+    memset(_topicIds, 0, sizeof(_topicIds));
+    memset(_subscriptionIds, 0, sizeof(_subscriptionIds));
+    memset(_remote, 0, sizeof(_remote));
+}
+
+/**
+ * @brief   Connects to the gateway
+ * @note    Connecting, registering and subscribing continue in poll().
+ * @param   gateway IP address or host name, a host name is resolved with
+ *          every request until the gateway answers
+ * @param   keepAlive Seconds between PINGREQs while nothing else is sent
+ * @retval  0 if successful, MQTT_ERROR if no UDP socket was available
+ */
+int MqttSnClient::open(UipEthernet* ethernet, const char* gateway, uint16_t port, uint16_t keepAlive)
+{
+    if (UipEthernet::ethernet != ethernet)
+        UipEthernet::ethernet = ethernet;
+
+    _host = gateway;
+    _port = port;
+    _keepAlive = keepAlive;
+    _gateway = SocketAddress();
+    if (_gateway.set_ip_address(gateway))
+        _gateway.set_port(port);
+    if (!_udp.begin(MQTTSN_LOCAL_PORT))
+        return MQTT_ERROR;
+
+    _timer.start();
+    _sent.start();
+    _reconnects = 0;
+    _start();
+    return 0;
+}
+
+/**
+ * @brief   Disconnects, the gateway drops the session
+ * @note    Batched messages are sent first.
+ * @param
+ * @retval
+ */
+void MqttSnClient::close()
+{
+    static const uint8_t    disconnect[] = { 0x02, MQTTSN_DISCONNECT };
+
+    if (_state == CONNECTED) {
+        flush();
+        _send(disconnect, sizeof(disconnect));
+    }
+
+    _disconnect();
+    _udp.stop();
+    _state = CLOSED;
+    _timer.stop();
+    _sent.stop();
+}
+
+/**
+ * @brief   Runs the client
+ * @note    Handles what the gateway sent, repeats unanswered requests,
+ *          keeps the connection alive and sends the batched messages.
+ * @param
+ * @retval
+ */
+void MqttSnClient::poll()
+{
+    if (_state == CLOSED)
+        return;
+
+    if (_state == DISCONNECTED) {
+        if (_timer.read_ms() >= MQTT_RECONNECT_MS)
+            _start();
+        return;
+    }
+
+    while (_udp.parsePacket() > 0) {
+        SocketAddress   from = _udp.remoteAddress();
+
+        if (!_gateway)
+            _gateway = from;            // the first answer to a host name
+        if (from == _gateway)
+            _reply(_udp.read(_rx, MQTTSN_RX_MAX));
+        _udp.flush();
+        if (_state < CONNECTING)
+            return;
+    }
+
+    if (_pending && _timer.read_ms() > MQTTSN_RETRY_MS) {
+        if (_tries >= MQTTSN_RETRIES) {
+            _disconnect();
+            return;
+        }
+
+        _request();
+    }
+
+    if (_state == CONNECTED && !_pending && _keepAlive && _sent.read_ms() >= _keepAlive * 750) {
+        _pinging = true;
+        _tries = 0;
+        _request();
+    }
+
+    flush();
+}
+
+/**
+ * @brief   Publishes a message with QoS 0
+ * @note    The message is batched with the others published before the next
+ *          poll().
+ * @param   topic Index into the topics table
+ * @retval  0 if successful, MQTT_ERROR if not connected, the topic has no id
+ *          or the message does not fit into MQTTSN_TX_MAX
+ */
+int MqttSnClient::publish(uint8_t topic, const void* payload, size_t len, bool retain)
+{
+    if (_state != CONNECTED || topic >= _topicCount || !_topicIds[topic])
+        return MQTT_ERROR;
+
+    size_t  size = 7 + len;
+
+    if (size > 255)
+        size += 2;                      // three byte length
+    if (size > MQTTSN_TX_MAX)
+        return MQTT_ERROR;
+
+    if (_txLen + size > MQTTSN_TX_MAX)
+        flush();
+
+    uint8_t*    msg = _tx + _txLen;
+
+    if (size > 255) {
+        *msg++ = 0x01;
+        *msg++ = size >> 8;
+    }
+
+    *msg++ = size & 0xFF;
+    *msg++ = MQTTSN_PUBLISH;
+    *msg++ = (retain ? MQTTSN_RETAIN : 0) | MQTTSN_TOPIC_NORMAL;
+    *msg++ = _topicIds[topic] >> 8;
+    *msg++ = _topicIds[topic] & 0xFF;
+    *msg++ = 0;                         // message id, 0 for QoS 0
+    *msg++ = 0;
+    memcpy(msg, payload, len);
+    _txLen += size;
+    _published++;
+    return 0;
+}
+
+/**
+ * @brief   Sends the batched messages
+ * @note    One datagram per message, up to MQTTSN_BATCH per sendmmsg call.
+ *          Messages the stack could not send are counted as dropped.
+ * @param
+ * @retval  true if every message was sent
+ */
+bool MqttSnClient::flush()
+{
+    size_t  pos = 0;
+    bool    ok = true;
+
+    while (pos < _txLen) {
+        udp_msg_t       msgs[MQTTSN_BATCH];
+        unsigned int    count = 0;
+
+        for (; count < MQTTSN_BATCH && pos < _txLen; count++) {
+            size_t  size = _tx[pos] == 0x01 ? (_tx[pos + 1] << 8) | _tx[pos + 2] : _tx[pos];
+
+            msgs[count].address = _gateway;
+            msgs[count].data = _tx + pos;
+            msgs[count].size = size;
+            pos += size;
+        }
+
+        nsapi_size_or_error_t   sent = _udp.sendmmsg(msgs, count);
+
+        _batches++;
+        if (sent < 0) {
+            // no socket or IPv6, nothing of the batch went out
+            _dropped += count;
+            ok = false;
+            continue;
+        }
+
+        for (unsigned int i = 0; i < count; i++) {
+            if (msgs[i].len != msgs[i].size) {
+                _dropped++;
+                ok = false;
+            }
+        }
+    }
+
+    if (_txLen)
+        _sent.reset();
+    _txLen = 0;
+    return ok;
+}
+
+/**
+ * @brief   Starts connecting
+ * @note    The topic ids are assigned anew by the gateway.
+ * @param
+ * @retval
+ */
+void MqttSnClient::_start()
+{
+    memset(_topicIds, 0, sizeof(_topicIds));
+    memset(_subscriptionIds, 0, sizeof(_subscriptionIds));
+    for (uint8_t i = 0; i < MQTTSN_REMOTE_TOPICS; i++)
+        _remote[i].id = 0;
+    _txLen = 0;
+    _state = CONNECTING;
+    _step = 0;
+    _tries = 0;
+    _request();
+}
+
+/**
+ * @brief   Gives up the connection, poll() reconnects
+ * @note    Batched messages are lost.
+ * @param
+ * @retval
+ */
+void MqttSnClient::_disconnect()
+{
+    if (_state >= CONNECTING)
+        _reconnects++;
+    _state = DISCONNECTED;
+    _pending = false;
+    _pinging = false;
+    _txLen = 0;
+    _timer.reset();
+}
+
+/**
+ * @brief   Sends the request of the current step
+ * @note    CONNECT, REGISTER, SUBSCRIBE or PINGREQ.
+ * @param
+ * @retval
+ */
+void MqttSnClient::_request()
+{
+    uint8_t     msg[255];
+    size_t      len = 2;
+    const char* name;
+
+    if (_state == CONNECTED) {
+        msg[1] = MQTTSN_PINGREQ;
+        name = "";
+    }
+    else
+    if (_state == CONNECTING) {
+        msg[1] = MQTTSN_CONNECT;
+        msg[len++] = MQTTSN_CLEAN;
+        msg[len++] = 0x01;              // protocol id
+        msg[len++] = _keepAlive >> 8;
+        msg[len++] = _keepAlive & 0xFF;
+        name = _clientId;
+    }
+    else {
+        if (_tries == 0 && ++_msgId == 0)
+            _msgId = 1;
+
+        if (_state == REGISTERING) {
+            msg[1] = MQTTSN_REGISTER;
+            msg[len++] = 0;             // topic id, assigned by the gateway
+            msg[len++] = 0;
+            name = _topics[_step];
+        }
+        else {
+            msg[1] = MQTTSN_SUBSCRIBE;
+            msg[len++] = (_subscriptions[_step].qos << 5) | MQTTSN_TOPIC_NORMAL;
+            name = _subscriptions[_step].filter;
+        }
+
+        msg[len++] = _msgId >> 8;
+        msg[len++] = _msgId & 0xFF;
+    }
+
+    size_t  nameLen = strlen(name);
+
+    if (len + nameLen > sizeof(msg)) {
+        _next();                        // skipped, it can't be sent
+        return;
+    }
+
+    memcpy(msg + len, name, nameLen);
+    len += nameLen;
+    msg[0] = len;
+
+    _pending = true;
+    _tries++;
+    _timer.reset();
+    _send(msg, len);
+}
+
+/**
+ * @brief   Moves on to the next request after an answer
+ * @note    CONNECT, then REGISTER for each topic, then SUBSCRIBE for each
+ *          subscription.
+ * @param
+ * @retval
+ */
+void MqttSnClient::_next()
+{
+    _pending = false;
+    _tries = 0;
+    if (_state == CONNECTING) {
+        _state = REGISTERING;
+        _step = 0;
+    }
+    else
+        _step++;
+
+    if (_state == REGISTERING && _step >= _topicCount) {
+        _state = SUBSCRIBING;
+        _step = 0;
+    }
+
+    if (_state == SUBSCRIBING && _step >= _subscriptionCount) {
+        _state = CONNECTED;
+        _sent.reset();
+        return;
+    }
+
+    _request();
+}
+
+/**
+ * @brief   Handles a datagram from the gateway
+ * @note
+ * @param   len Bytes in _rx
+ * @retval
+ */
+void MqttSnClient::_reply(size_t len)
+{
+    const uint8_t*  msg = _rx;
+    size_t          size = msg[0];
+
+    if (len < 2)
+        return;
+
+    if (size == 0x01) {
+        if (len < 4)
+            return;
+        size = (msg[1] << 8) | msg[2];
+        if (size > len)
+            return;
+        size -= 2;                      // skip the three byte length
+        msg += 2;
+    }
+    else
+    if (size > len)
+        return;
+
+    if (size < 2)
+        return;
+
+    uint8_t         type = msg[1];
+    const uint8_t*  body = msg + 2;
+
+    size -= 2;
+    switch (type) {
+        case MQTTSN_CONNACK:
+            if (_state != CONNECTING || size < 1)
+                break;
+            if (body[0] == MQTTSN_ACCEPTED)
+                _next();
+            else
+                _disconnect();          // rejected, retried after MQTT_RECONNECT_MS
+            break;
+
+        case MQTTSN_REGACK:
+            // topic id, message id, return code
+            if (_state != REGISTERING || size < 5 || ((body[2] << 8) | body[3]) != _msgId)
+                break;
+            if (body[4] == MQTTSN_ACCEPTED)
+                _topicIds[_step] = (body[0] << 8) | body[1];
+            _next();
+            break;
+
+        case MQTTSN_SUBACK:
+            // flags, topic id, message id, return code
+            if (_state != SUBSCRIBING || size < 6 || ((body[3] << 8) | body[4]) != _msgId)
+                break;
+            if (body[5] == MQTTSN_ACCEPTED)
+                _subscriptionIds[_step] = (body[1] << 8) | body[2];
+            _next();
+            break;
+
+        case MQTTSN_REGISTER:
+            // topic id, message id, name of a topic matching a wildcard
+            if (size >= 4 && size - 4 <= MQTTSN_TOPIC_MAX && _txLen + 7 <= MQTTSN_TX_MAX) {
+                uint16_t        id = (body[0] << 8) | body[1];
+                mqttsn_topic_t* topic = &_remote[_remoteNext];
+
+                for (uint8_t i = 0; i < MQTTSN_REMOTE_TOPICS; i++) {
+                    if (_remote[i].id == id || _remote[i].id == 0) {
+                        topic = &_remote[i];
+                        break;
+                    }
+                }
+
+                if (topic == &_remote[_remoteNext])
+                    _remoteNext = (_remoteNext + 1) % MQTTSN_REMOTE_TOPICS;
+                topic->id = id;
+                memcpy(topic->name, body + 4, size - 4);
+                topic->name[size - 4] = '\0';
+
+                uint8_t*    ack = _tx + _txLen;
+
+                ack[0] = 7;
+                ack[1] = MQTTSN_REGACK;
+                memcpy(ack + 2, body, 4);
+                ack[6] = MQTTSN_ACCEPTED;
+                _txLen += 7;
+            }
+            break;
+
+        case MQTTSN_PUBLISH:
+            _dispatch(body, size);
+            break;
+
+        case MQTTSN_PUBACK:
+            // only sent for QoS 0 publishes if the gateway lost our topic ids
+            if (size >= 5 && body[4] == MQTTSN_INVALID_ID && _state == CONNECTED)
+                _disconnect();
+            break;
+
+        case MQTTSN_PINGRESP:
+            if (_pinging) {
+                _pinging = false;
+                _pending = false;
+            }
+            break;
+
+        case MQTTSN_DISCONNECT:
+            _disconnect();
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief   Passes a received PUBLISH to the matching handlers
+ * @note
+ * @param   msg Flags, topic id, message id and data
+ * @retval
+ */
+void MqttSnClient::_dispatch(const uint8_t* msg, size_t len)
+{
+    if (len < 5)
+        return;
+
+    uint8_t     flags = msg[0];
+    uint16_t    id = (msg[1] << 8) | msg[2];
+    char        shortName[3];
+    const char* name;
+    uint8_t     rc = MQTTSN_ACCEPTED;
+
+    if ((flags & MQTTSN_TOPIC_TYPE) == MQTTSN_TOPIC_SHORT) {
+        shortName[0] = msg[1];
+        shortName[1] = msg[2];
+        shortName[2] = '\0';
+        name = shortName;
+    }
+    else
+        name = _name(id);
+
+    if (name) {
+        _received++;
+        for (uint8_t i = 0; i < _subscriptionCount; i++) {
+            if (MqttClient::matches(_subscriptions[i].filter, name))
+                _subscriptions[i].handler(name, msg + 5, len - 5, _ctx);
+        }
+    }
+    else {
+        _unknown++;
+        rc = MQTTSN_INVALID_ID;
+    }
+
+    if ((flags & 0x60) && _state >= CONNECTING && _txLen + 7 <= MQTTSN_TX_MAX) {
+        uint8_t*    ack = _tx + _txLen;
+
+        ack[0] = 7;
+        ack[1] = MQTTSN_PUBACK;
+        memcpy(ack + 2, msg + 1, 4);    // topic id, message id
+        ack[6] = rc;
+        _txLen += 7;
+    }
+}
+
+/**
+ * @brief   Sends one datagram to the gateway at once
+ * @note
+ * @param
+ * @retval
+ */
+bool MqttSnClient::_send(const uint8_t* msg, size_t len)
+{
+    int ok = _gateway ? _udp.beginPacket(_gateway) : _udp.beginPacket(_host, _port);
+
+    if (!ok)
+        return false;
+
+    _udp.write(msg, len);
+    _sent.reset();
+    return _udp.endPacket();
+}
+
+/**
+ * @brief   Name of a topic id the gateway assigned
+ * @note    Subscriptions without wildcards are named by their filter.
+ * @param
+ * @retval  NULL if the id is unknown
+ */
+const char* MqttSnClient::_name(uint16_t id)
+{
+    if (!id)
+        return NULL;
+
+    for (uint8_t i = 0; i < _subscriptionCount; i++) {
+        if (_subscriptionIds[i] == id)
+            return _subscriptions[i].filter;
+    }
+
+    for (uint8_t i = 0; i < MQTTSN_REMOTE_TOPICS; i++) {
+        if (_remote[i].id == id)
+            return _remote[i].name;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,151 @@
+/*
+ MqttSnClient.h - MQTT-SN 1.2 client on top of UdpSocket.
+
+ Talks to an MQTT-SN gateway (e.g. the Eclipse Paho MQTT-SN gateway in
+ front of mosquitto) with the same topics and subscriptions tables as
+ MqttClient. After connecting, every name of the topics table is
+ registered; from then on a publish carries the 2 byte topic id instead of
+ the name. Subscriptions without wildcards get their id with the SUBACK,
+ topics matching a wildcard are registered by the gateway before their
+ first message and kept in a table of MQTTSN_REMOTE_TOPICS names.
+
+ Publishes are QoS 0. They are collected in the transmit buffer and sent
+ by poll() as one sendmmsg batch, one datagram each. Incoming QoS 1
+ messages are acknowledged. CONNECT, REGISTER, SUBSCRIBE and PINGREQ are
+ sent one at a time and repeated every MQTTSN_RETRY_MS ms, after
+ MQTTSN_RETRIES unanswered attempts the client starts over.
+ */
+#ifndef MQTTSNCLIENT_H
+#define MQTTSNCLIENT_H
+
+#include "mbed.h"
+#include "UdpSocket.h"
+#include "MqttClient.h"
+
+#ifndef MQTTSN_TX_MAX
+#define MQTTSN_TX_MAX           256     // batched datagrams
+#endif
+
+#ifndef MQTTSN_BATCH
+#define MQTTSN_BATCH            8       // datagrams per sendmmsg call
+#endif
+
+#ifndef MQTTSN_RX_MAX
+#define MQTTSN_RX_MAX           128
+#endif
+
+#ifndef MQTTSN_RETRY_MS
+#define MQTTSN_RETRY_MS         3000
+#endif
+
+#ifndef MQTTSN_RETRIES
+#define MQTTSN_RETRIES          3
+#endif
+
+#ifndef MQTTSN_KEEPALIVE_S
+#define MQTTSN_KEEPALIVE_S      60
+#endif
+
+#ifndef MQTTSN_TOPICS
+#define MQTTSN_TOPICS           8       // entries of the topics and subscriptions tables that get an id
+#endif
+
+#ifndef MQTTSN_REMOTE_TOPICS
+#define MQTTSN_REMOTE_TOPICS    4       // topics registered by the gateway
+#endif
+
+#ifndef MQTTSN_TOPIC_MAX
+#define MQTTSN_TOPIC_MAX        32      // longest name registered by the gateway
+#endif
+
+#define MQTTSN_PORT             1885
+#define MQTTSN_LOCAL_PORT       1884
+
+class UipEthernet;
+
+class MqttSnClient
+{
+public:
+    MqttSnClient
+    (
+        const char*                 clientId,
+        const char* const*          topics,
+        uint8_t                     topicCount,
+        const mqtt_subscription_t*  subscriptions,
+        uint8_t                     subscriptionCount
+    );
+    void            setContext(void* ctx)   { _ctx = ctx; }
+    int             open(UipEthernet* ethernet, const char* gateway, uint16_t port = MQTTSN_PORT, uint16_t keepAlive = MQTTSN_KEEPALIVE_S);
+    void            close();
+    void            poll();                 // call from the main loop
+    bool            connected()             { return _state == CONNECTED; }
+    int             publish(uint8_t topic, const void* payload, size_t len, bool retain = false);
+    bool            flush();                // sends the batched datagrams now
+    uint16_t        topicId(uint8_t topic)  { return topic < MQTTSN_TOPICS ? _topicIds[topic] : 0; }
+
+    uint32_t        published()             { return _published; }
+    uint32_t        received()              { return _received; }
+    uint32_t        batches()               { return _batches; }        // sendmmsg calls
+    uint32_t        dropped()               { return _dropped; }        // not sent, e.g. no ARP entry yet
+    uint32_t        unknown()               { return _unknown; }        // messages to an unknown topic id
+    uint32_t        reconnects()            { return _reconnects; }
+private:
+    enum
+    {
+        CLOSED,
+        DISCONNECTED,                       // waiting to reconnect
+        CONNECTING,
+        REGISTERING,                        // topic _step
+        SUBSCRIBING,                        // subscription _step
+        CONNECTED
+    };
+
+    typedef struct
+    {
+        uint16_t    id;
+        char        name[MQTTSN_TOPIC_MAX + 1];
+    } mqttsn_topic_t;
+
+    UdpSocket                   _udp;
+    const char*                 _clientId;
+    const char* const*          _topics;
+    uint8_t                     _topicCount;
+    const mqtt_subscription_t*  _subscriptions;
+    uint8_t                     _subscriptionCount;
+    void*                       _ctx;
+    const char*                 _host;
+    SocketAddress               _gateway;   // unset until a host name is resolved
+    uint16_t                    _port;
+    uint16_t                    _keepAlive;
+    uint8_t                     _state;
+    uint8_t                     _step;
+    uint8_t                     _tries;     // of the pending request
+    bool                        _pending;   // a request waits for its answer
+    bool                        _pinging;
+    uint16_t                    _msgId;
+    Timer                       _timer;     // since the pending request or the last reconnect attempt
+    Timer                       _sent;      // since the last datagram sent
+    uint16_t                    _topicIds[MQTTSN_TOPICS];
+    uint16_t                    _subscriptionIds[MQTTSN_TOPICS];
+    mqttsn_topic_t              _remote[MQTTSN_REMOTE_TOPICS];
+    uint8_t                     _remoteNext;    // replaced next when the table is full
+    uint8_t                     _tx[MQTTSN_TX_MAX];
+    size_t                      _txLen;
+    uint8_t                     _rx[MQTTSN_RX_MAX + 1];
+    uint32_t                    _published;
+    uint32_t                    _received;
+    uint32_t                    _batches;
+    uint32_t                    _dropped;
+    uint32_t                    _unknown;
+    uint32_t                    _reconnects;
+
+    void                        _start();
+    void                        _disconnect();
+    void                        _request();
+    void                        _next();
+    void                        _reply(size_t len);
+    void                        _dispatch(const uint8_t* msg, size_t len);
+    bool                        _send(const uint8_t* msg, size_t len);
+    const char*                 _name(uint16_t id);
+};
+#endif
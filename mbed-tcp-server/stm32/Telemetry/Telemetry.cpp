@@ -0,0 +1,226 @@
+/*
+ Telemetry.cpp - streams timestamped ADC sample blocks to a subscriber.
+ */
+#include "Telemetry.h"
+#include "TcpClient.h"
+#include "UdpSocket.h"
+#include "SntpClient.h"
+#include "hal/us_ticker_api.h"
+
+/**
+ * @brief
+ * @note    The HAL analogin functions are used directly: AnalogIn takes a
+ *          mutex and must not be read from the Ticker interrupt.
+ * @param   pins TELEMETRY_CHANNELS analog pins
+ * @retval
+ */
+Telemetry::Telemetry(const PinName pins[TELEMETRY_CHANNELS]) :
+    _head(0),
+    _tail(0),
+    _seq(0),
+    _period(0),
+    _sent(0),
+    _tcp(NULL),
+    _udp(NULL),
+    _clock(NULL),
+    _blocks(0),
+    _overruns(0)
+{
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++) {
+        analogin_init(&_adc[i], pins[i]);
+        _latest[i] = 0;
+    }
+}
+
+/**
+ * @brief   Streams over a TCP connection
+ * @note    The connection stays open and belongs to the stream: it is
+ *          closed once the peer closes it or another client subscribes.
+ *          Unsubscribing hands it back to the caller.
+ * @param   period Sample period in us, 0 to unsubscribe
+ * @retval
+ */
+void Telemetry::subscribe(TcpClient* client, uint32_t period)
+{
+    if (_tcp && _tcp != client) {
+        TcpClient*  previous = _tcp;
+
+        unsubscribe();
+        previous->close();
+    }
+
+    if (!period) {
+        unsubscribe();
+        return;
+    }
+
+    _tcp = client;
+    _start(period);
+}
+
+/**
+ * @brief   Streams as datagrams to address
+ * @note    Repeating the subscription with the same period renews the
+ *          lease without restarting the stream.
+ * @param   period Sample period in us, 0 to unsubscribe
+ * @retval
+ */
+void Telemetry::subscribe(UdpSocket* socket, const SocketAddress& address, uint32_t period)
+{
+    if (_udp == socket && _peer == address && _period == period) {
+        _lease.reset();
+        return;
+    }
+
+    unsubscribe();
+    if (!period)
+        return;
+
+    _udp = socket;
+    _peer = address;
+    _lease.reset();
+    _lease.start();
+    _start(period);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void Telemetry::unsubscribe()
+{
+    _ticker.detach();
+    _period = 0;
+    _tcp = NULL;
+    _udp = NULL;
+    _lease.stop();
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void Telemetry::_initBlock(telemetry_block_t* block)
+{
+    block->header.sync[0] = 0xA5;
+    block->header.sync[1] = 0x5A;
+    block->header.id = TELEMETRY_ID;
+    block->header.channels = TELEMETRY_CHANNELS;
+    block->header.count = 0;
+    block->header.period = _period;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void Telemetry::_start(uint32_t period)
+{
+    _ticker.detach();
+    _period = period;
+    _head = _tail = 0;
+    _sent = 0;
+    _initBlock(&_ring[0]);
+    _ticker.attach_us(callback(this, &Telemetry::_sample), period);
+}
+
+/**
+ * @brief   Takes one sample of every channel
+ * @note    Runs in the Ticker interrupt. A completed block is handed to
+ *          poll() unless TELEMETRY_BLOCKS - 1 blocks are already waiting,
+ *          then it is dropped and refilled.
+ * @param
+ * @retval
+ */
+void Telemetry::_sample()
+{
+    telemetry_block_t*  block = &_ring[_head % TELEMETRY_BLOCKS];
+    uint16_t            n = block->header.count;
+
+    if (n == 0)
+        block->header.timestamp = us_ticker_read();
+
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++) {
+        uint16_t    value = analogin_read_u16(&_adc[i]);
+
+        block->samples[n][i] = value;
+        _latest[i] = value;
+    }
+
+    if (++n < TELEMETRY_BLOCK) {
+        block->header.count = n;
+        return;
+    }
+
+    block->header.count = n;
+    block->header.seq = _seq++;
+    if (_head + 1 - _tail < TELEMETRY_BLOCKS) {
+        _head = _head + 1;
+        block = &_ring[_head % TELEMETRY_BLOCKS];
+    }
+    else
+        _overruns++;
+
+    _initBlock(block);
+}
+
+/**
+ * @brief   Sends the completed blocks
+ * @note    A block the TCP connection could only take in part is finished
+ *          first on the next call, so the stream stays framed.
+ * @param
+ * @retval
+ */
+void Telemetry::poll()
+{
+    if (!_period)
+        return;
+
+    if (_tcp && !_tcp->connected()) {
+        TcpClient*  client = _tcp;
+
+        unsubscribe();
+        client->close();
+        return;
+    }
+
+    if (_udp && _lease.read_ms() > TELEMETRY_UDP_LEASE_MS) {
+        unsubscribe();
+        return;
+    }
+
+    while (_tail != _head) {
+        telemetry_block_t*  block = &_ring[_tail % TELEMETRY_BLOCKS];
+        size_t              len = sizeof(telemetry_header_t) + block->header.count * TELEMETRY_CHANNELS * sizeof(uint16_t);
+
+        // the ticker timestamp is converted here, not in the interrupt
+        if (_sent == 0)
+            block->header.time = _clock ? _clock->at(block->header.timestamp) : 0;
+
+        if (_tcp) {
+            int n = _tcp->send((const uint8_t*)block + _sent, len - _sent);
+
+            if (n <= 0)
+                return;
+            _sent += n;
+            if (_sent < len)
+                return;
+            _sent = 0;
+        }
+        else {
+            if (!_udp->beginPacket(_peer))
+                return;
+            _udp->write((const uint8_t*)block, len);
+            _udp->endPacket();
+        }
+
+        _tail = _tail + 1;
+        _blocks++;
+    }
+}
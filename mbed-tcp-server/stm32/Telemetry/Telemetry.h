@@ -0,0 +1,118 @@
+/*
+ Telemetry.h - streams timestamped ADC sample blocks to a subscriber.
+
+ A client subscribes with the command frame A5 5A 20 p, p being the sample
+ period in ms (0 unsubscribes), either on its TCP connection, which then
+ stays open and carries the samples, or as a UDP datagram to
+ TELEMETRY_PORT, which makes the device send the samples as datagrams to
+ the sender. UDP subscriptions expire after TELEMETRY_UDP_LEASE_MS unless
+ the subscribe datagram is repeated.
+
+ Each packet (or each block in the TCP stream) is one telemetry block:
+
+    offset  size
+    0       3       A5 5A 31
+    3       1       channels
+    4       2       samples per channel in this block (count)
+    6       2       block sequence number, gaps mean dropped blocks
+    8       4       us ticker at the first sample
+    12      4       sample period in us
+    16      8       time of the first sample in us since 1970, 0 until the
+                    clock set with setClock() is synchronized
+    24      2*n     count x channels samples, 16 bit left aligned ADC values
+
+ All multi-byte fields are little endian.
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "mbed.h"
+#include "hal/analogin_api.h"
+#include "SocketAddress.h"
+
+#define TELEMETRY_ID                0x31    // block frame id
+#define TELEMETRY_SUBSCRIBE         0x20    // subscribe command id
+
+#ifndef TELEMETRY_PORT
+#define TELEMETRY_PORT              62      // UDP subscriptions
+#endif
+
+#ifndef TELEMETRY_CHANNELS
+#define TELEMETRY_CHANNELS          2
+#endif
+
+#ifndef TELEMETRY_BLOCK
+#define TELEMETRY_BLOCK             64      // samples per channel and packet
+#endif
+
+#ifndef TELEMETRY_BLOCKS
+#define TELEMETRY_BLOCKS            4       // blocks buffered while sending
+#endif
+
+#ifndef TELEMETRY_UDP_LEASE_MS
+#define TELEMETRY_UDP_LEASE_MS      30000
+#endif
+
+typedef struct
+{
+    uint8_t     sync[2];
+    uint8_t     id;
+    uint8_t     channels;
+    uint16_t    count;
+    uint16_t    seq;
+    uint32_t    timestamp;
+    uint32_t    period;
+    uint64_t    time;
+} telemetry_header_t;
+
+typedef struct
+{
+    telemetry_header_t  header;
+    uint16_t            samples[TELEMETRY_BLOCK][TELEMETRY_CHANNELS];
+} telemetry_block_t;
+
+class TcpClient;
+class UdpSocket;
+class SntpClock;
+
+// Samples the channels from a Ticker interrupt into a ring of blocks, so
+// the sample clock does not depend on the main loop; poll() sends the
+// completed blocks. When the network falls behind and the ring is full the
+// newest block is dropped, its sequence number is skipped.
+class Telemetry
+{
+public:
+    Telemetry(const PinName pins[TELEMETRY_CHANNELS]);
+    void        subscribe(TcpClient* client, uint32_t period);
+    void        subscribe(UdpSocket* socket, const SocketAddress& address, uint32_t period);
+    void        unsubscribe();                          // a TCP subscriber is left open
+    void        setClock(SntpClock* clock)  { _clock = clock; }     // absolute block times
+    void        poll();                                 // call from the main loop
+    TcpClient*  subscriber()            { return _tcp; }
+    bool        running()               { return _period != 0; }
+    uint16_t    latest(uint8_t channel) { return _latest[channel]; }
+    uint32_t    blocks()                { return _blocks; }     // sent
+    uint32_t    overruns()              { return _overruns; }   // dropped, ring full
+private:
+    analogin_t          _adc[TELEMETRY_CHANNELS];
+    Ticker              _ticker;
+    telemetry_block_t   _ring[TELEMETRY_BLOCKS];
+    volatile uint32_t   _head;          // block being filled, written by the ISR
+    volatile uint32_t   _tail;          // oldest completed block, written by poll()
+    volatile uint16_t   _latest[TELEMETRY_CHANNELS];
+    uint16_t            _seq;
+    uint32_t            _period;        // us, 0 if not running
+    size_t              _sent;          // bytes of the tail block already queued (TCP)
+    TcpClient*          _tcp;
+    UdpSocket*          _udp;
+    SocketAddress       _peer;
+    SntpClock*          _clock;
+    Timer               _lease;
+    uint32_t            _blocks;
+    uint32_t            _overruns;
+
+    void                _start(uint32_t period);
+    void                _initBlock(telemetry_block_t* block);
+    void                _sample();
+};
+#endif
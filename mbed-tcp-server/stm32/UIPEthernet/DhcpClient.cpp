@@ -2,32 +2,122 @@
 // Author: Jordan Terrell - blog.jordanterrell.com
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include "UipEthernet.h"
 #include "DhcpClient.h"
 #include "utility/util.h"
 
 /**
- * @brief
- * @note
+ * @brief   Constructor
+ * @note    The client stays stopped until begin() or start() is called
  * @param
  * @retval
  */
+DhcpClient::DhcpClient() :
+    _dhcpLeaseTime(0),
+    _dhcpT1(0),
+    _dhcpT2(0),
+    _responseTimeout(4),
+    _retryCount(0),
+    _dhcp_state(STATE_DHCP_STOPPED),
+    _busy(false)
+{
+    memset(_dhcpMacAddr, 0, 6);
+    resetDhcpLease();
+}
+
+/**
+ * @brief   Obtains a lease and blocks until it is bound or the timeout expires
+ * @note    The state machine keeps running in the background (driven by
+ *          UipEthernet::tick) even if the timeout expires.
+ * @param   mac MAC address
+ * @param   timeout Time to wait for the lease in seconds
+ * @param   responseTimeout Initial retransmission timeout in seconds
+ * @retval  1 when a lease was bound, 0 otherwise
+ */
 int DhcpClient::begin(uint8_t* mac, unsigned long timeout, unsigned long responseTimeout)
 {
+    Timer   timer;
+
+    start(mac, responseTimeout);
+    timer.start();
+    while (!leased()) {
+        if ((unsigned long)(timer.read_ms() / 1000) > timeout) {
+#ifdef UIPETHERNET_DEBUG_UDP
+            printf("DhcpClient::begin(): timeout\r\n");
+#endif
+            return 0;
+        }
+
+        UipEthernet::ethernet->tick();
+    }
+
+    return 1;
+}
+
+/**
+ * @brief   Starts the non-blocking DHCP state machine
+ * @note    Uses INIT-REBOOT when a lease for this MAC address is cached,
+ *          otherwise starts with DISCOVER. Progress is made by checkLease().
+ * @param   mac MAC address
+ * @param   responseTimeout Initial retransmission timeout in seconds
+ * @retval
+ */
+void DhcpClient::start(uint8_t* mac, unsigned long responseTimeout)
+{
+    time_t  now = time(NULL);
+
     _dhcpLeaseTime = 0;
     _dhcpT1 = 0;
     _dhcpT2 = 0;
-    _lastCheck = 0;
-    _timeout = timeout;
     _responseTimeout = responseTimeout;
 
-    // zero out _dhcpMacAddr
-    memset(_dhcpMacAddr, 0, 6);
     resetDhcpLease();
-
     memcpy((void*)_dhcpMacAddr, (void*)mac, 6);
-    _dhcp_state = STATE_DHCP_START;
-    return requestDhcpLease();
+
+    // Pick an initial transaction ID
+    srand(now + 1);
+    _dhcpTransactionId = (rand() % 2000UL) + 1;
+    _dhcpInitialTransactionId = _dhcpTransactionId;
+    _requestStart = now;
+    _retryTimeout = _responseTimeout;
+    _retryCount = 0;
+
+    if (loadLease() && openSocket()) {
+        sendRequest(STATE_DHCP_REBOOT, now);
+    }
+    else {
+        resetDhcpLease();
+        _dhcp_state = STATE_DHCP_START;
+    }
+}
+
+/**
+ * @brief   Stops the state machine without releasing the lease
+ * @note
+ * @param
+ * @retval
+ */
+void DhcpClient::stop()
+{
+    _dhcpUdpSocket.stop();
+    _dhcp_state = STATE_DHCP_STOPPED;
+}
+
+/**
+ * @brief   Tells whether the network is configured from a valid lease
+ * @note    Renewing and rebinding keep the current address in use.
+ * @param
+ * @retval
+ */
+bool DhcpClient::leased()
+{
+    return
+        (
+            _dhcp_state == STATE_DHCP_LEASED ||
+            _dhcp_state == STATE_DHCP_RENEW ||
+            _dhcp_state == STATE_DHCP_REBIND
+        );
 }
 
 /**
@@ -42,147 +132,112 @@ void DhcpClient::resetDhcpLease()
     memset(_dhcpLocalIp, 0, 5 * 4);
 }
 
-//return:0 on error, 1 if request is sent and response is received
-int DhcpClient::requestDhcpLease()
+/**
+ * @brief   Opens the DHCP client socket if it is not open yet
+ * @note
+ * @param
+ * @retval  false if there was no free UDP connection
+ */
+bool DhcpClient::openSocket()
 {
+    if (_dhcpUdpSocket.begin(DHCP_CLIENT_PORT) == 0) {
 #ifdef UIPETHERNET_DEBUG_UDP
-    printf("requestDhcpLease(): begin\r\n");
+        printf("DhcpClient: Couldn't get a socket\r\n");
 #endif
-    uint8_t messageType = 0;
-    Timer           timer;
+        return false;
+    }
 
-    timer.reset();
-    timer.start();
+    return true;
+}
 
-    // Pick an initial transaction ID
-    srand(time(NULL)+ 1);
-    _dhcpTransactionId = (rand() % 2000UL) + 1;
-    _dhcpInitialTransactionId = _dhcpTransactionId;
+/**
+ * @brief   Arms the retransmission timer with exponential backoff
+ * @note
+ * @param
+ * @retval
+ */
+void DhcpClient::armRetry(time_t now)
+{
+    _retryAt = now + _retryTimeout;
+    if (_retryTimeout < DHCP_MAX_RETRY_TIMEOUT)
+        _retryTimeout <<= 1;
+    _retryCount++;
+}
 
-    _dhcpUdpSocket.stop();
-    if (_dhcpUdpSocket.begin(DHCP_CLIENT_PORT) == 0) {
-        // Couldn't get a socket
-#ifdef UIPETHERNET_DEBUG_UDP
-        printf("requestDhcpLease(): Couldn't get a socket\r\n");
-#endif
-        return 0;
+/**
+ * @brief   Sends a DHCPREQUEST appropriate for the given state
+ * @note    REQUEST (selecting), REBOOT, RENEW and REBIND differ only in
+ *          ciaddr, destination and options (see RFC 2131, table 4).
+ * @param   state One of STATE_DHCP_REQUEST/REBOOT/RENEW/REBIND
+ * @param   now Current time
+ * @retval
+ */
+void DhcpClient::sendRequest(uint8_t state, time_t now)
+{
+    if (state != _dhcp_state) {
+        _retryTimeout = _responseTimeout;
+        _retryCount = 0;
     }
 
-    presendDhcp();
-
-    volatile int    result = 0;
+    _dhcp_state = state;
+    _dhcpTransactionId++;
+    sendDhcpMessage(DHCP_REQUEST, now - _requestStart + 1);
+    armRetry(now);
+}
 
-    while (_dhcp_state != STATE_DHCP_LEASED) {
-        if (_dhcp_state == STATE_DHCP_START) {
-#ifdef UIPETHERNET_DEBUG_UDP
-            printf("_dhcp_state: STATE_DHCP_START\r\n");
-#endif
-            _dhcpTransactionId++;
+/**
+ * @brief   Applies the lease carried by a DHCPACK
+ * @note    The uIP configuration is only touched when the lease changed, so
+ *          renewing a lease keeps established connections alive.
+ * @param   now Current time
+ * @retval  DHCP_CHECK_RENEW_OK, DHCP_CHECK_REBIND_OK or DHCP_CHECK_BOUND
+ */
+int DhcpClient::bindLease(time_t now)
+{
+    int rc = _dhcp_state == STATE_DHCP_RENEW ? DHCP_CHECK_RENEW_OK :
+        _dhcp_state == STATE_DHCP_REBIND ? DHCP_CHECK_REBIND_OK : DHCP_CHECK_BOUND;
 
-            sendDhcpMessage(DHCP_DISCOVER, (timer.read_ms() / 1000 + 1));
-            _dhcp_state = STATE_DHCP_DISCOVER;
-        }
-        else
-        if (_dhcp_state == STATE_DHCP_REREQUEST) {
-#ifdef UIPETHERNET_DEBUG_UDP
-            printf("_dhcp_state: STATE_DHCP_REREQUEST\r\n");
-#endif
-            _dhcpTransactionId++;
-            sendDhcpMessage(DHCP_REQUEST, (timer.read_ms() / 1000 + 1));
-            _dhcp_state = STATE_DHCP_REQUEST;
-        }
-        else
-        if (_dhcp_state == STATE_DHCP_DISCOVER) {
-#ifdef UIPETHERNET_DEBUG_UDP
-            printf("_dhcp_state: STATE_DHCP_DISCOVER\r\n");
-#endif
-            uint32_t    respId;
-            messageType = parseDhcpResponse(_responseTimeout, respId);
-            if (messageType == DHCP_OFFER) {
-                // We'll use the transaction ID that the offer came with,
-                // rather than the one we were up to
-                _dhcpTransactionId = respId;
-                sendDhcpMessage(DHCP_REQUEST, (timer.read_ms() / 1000 + 1));
-                _dhcp_state = STATE_DHCP_REQUEST;
-            }
-        }
-        else
-        if (_dhcp_state == STATE_DHCP_REQUEST) {
 #ifdef UIPETHERNET_DEBUG_UDP
-            printf("_dhcp_state: STATE_DHCP_REQUEST\r\n");
+    printf("messageType: DHCP_ACK\r\n");
 #endif
-            uint32_t    respId;
-            messageType = parseDhcpResponse(_responseTimeout, respId);
-            if (messageType == DHCP_ACK) {
-#ifdef UIPETHERNET_DEBUG_UDP
-                printf("messageType: DHCP_ACK\r\n");
-#endif
-                _dhcp_state = STATE_DHCP_LEASED;
-                result = 1;
-
-                //use default lease time if we didn't get it
-                if (_dhcpLeaseTime == 0) {
-                    _dhcpLeaseTime = DEFAULT_LEASE;
-                }
+    //use default lease time if we didn't get it
+    if (_dhcpLeaseTime == 0) {
+        _dhcpLeaseTime = DEFAULT_LEASE;
+    }
 
-                //calculate T1 & T2 if we didn't get it
-                if (_dhcpT1 == 0) {
-                    //T1 should be 50% of _dhcpLeaseTime
-                    _dhcpT1 = _dhcpLeaseTime >> 1;
-                }
+    //calculate T1 & T2 if we didn't get it
+    if (_dhcpT1 == 0) {
+        //T1 should be 50% of _dhcpLeaseTime
+        _dhcpT1 = _dhcpLeaseTime >> 1;
+    }
 
-                if (_dhcpT2 == 0) {
-                    //T2 should be 87.5% (7/8ths) of _dhcpLeaseTime
-                    _dhcpT2 = _dhcpT1 << 1;
-                }
+    if (_dhcpT2 == 0) {
+        //T2 should be 87.5% (7/8ths) of _dhcpLeaseTime
+        _dhcpT2 = _dhcpLeaseTime - (_dhcpLeaseTime >> 3);
+    }
 
-                _renewInSec = _dhcpT1;
-                _rebindInSec = _dhcpT2;
-            }
-            else
-            if (messageType == DHCP_NAK) {
- #ifdef UIPETHERNET_DEBUG_UDP
-                printf("messageType: DHCP_NAK\r\n");
-#endif
-                _dhcp_state = STATE_DHCP_START;
-            }
-        }
+    _renewAt = now + _dhcpT1;
+    _rebindAt = now + _dhcpT2;
+    _expireAt = now + _dhcpLeaseTime;
+    _dhcp_state = STATE_DHCP_LEASED;
 
-        if (messageType == 255) {
-#ifdef UIPETHERNET_DEBUG_UDP
-            printf("DHCP_NAK: 255\r\n");
-#endif
-            messageType = 0;
-            _dhcp_state = STATE_DHCP_START;
-        }
+    // We're done with the socket until the next renewal
+    _dhcpUdpSocket.stop();
 
-        if ((result != 1) && ((timer.read_ms() / 1000) > _timeout)) {
-#ifdef UIPETHERNET_DEBUG_UDP
-            printf("requestDhcpLease(): timeout\r\n");
-#endif
-            break;
-        }
+    if
+    (
+        !(UipEthernet::ethernet->localIP() == getLocalIp()) ||
+        !(UipEthernet::ethernet->gatewayIP() == getGatewayIp()) ||
+        !(UipEthernet::ethernet->subnetMask() == getSubnetMask()) ||
+        !(UipEthernet::dnsServerAddress == getDnsServerIp())
+    ) {
+        UipEthernet::ethernet->set_network(getLocalIp(), getDnsServerIp(), getGatewayIp(), getSubnetMask());
+        saveLease();
     }
 
-    // We're done with the socket now
-    _dhcpUdpSocket.stop();
-    _dhcpTransactionId++;
-
-#ifdef UIPETHERNET_DEBUG_UDP
-    printf("requestDhcpLease(): %d\r\n", result);
-#endif
-    return result;
+    return rc;
 }
 
-/**
- * @brief
- * @note
- * @param
- * @retval
- */
-void DhcpClient::presendDhcp()
-{ }
-
 /**
  * @brief
  * @note
@@ -195,8 +250,13 @@ void DhcpClient::sendDhcpMessage(uint8_t messageType, uint16_t secondsElapsed)
     memset(buffer, 0, 32);
 
     IpAddress   dest_addr(255, 255, 255, 255);  // Broadcast address
+    bool        renewing = (_dhcp_state == STATE_DHCP_RENEW || _dhcp_state == STATE_DHCP_REBIND);
+
+    // RENEW is unicast to the server which granted the lease
+    if (_dhcp_state == STATE_DHCP_RENEW)
+        dest_addr = _dhcpDhcpServerIp;
 
-    if (-1 == _dhcpUdpSocket.beginPacket(dest_addr, DHCP_SERVER_PORT)) {
+    if (0 == _dhcpUdpSocket.beginPacket(dest_addr, DHCP_SERVER_PORT)) {
         // FIXME Need to return errors
         return;
     }
@@ -213,11 +273,14 @@ void DhcpClient::sendDhcpMessage(uint8_t messageType, uint16_t secondsElapsed)
     buffer[8] = ((secondsElapsed & 0xff00) >> 8);
     buffer[9] = (secondsElapsed & 0x00ff);
 
-    // flags
-    unsigned short  flags = htons(DHCP_FLAGSBROADCAST);
+    // flags: a bound client can receive unicast replies
+    unsigned short  flags = renewing ? 0 : htons(DHCP_FLAGSBROADCAST);
     memcpy(buffer + 10, &(flags), 2);
 
-    // ciaddr: already zeroed
+    // ciaddr: our address while renewing or rebinding, zero otherwise
+    if (renewing)
+        memcpy(buffer + 12, _dhcpLocalIp, 4);
+
     // yiaddr: already zeroed
     // siaddr: already zeroed
     // giaddr: already zeroed
@@ -264,7 +327,8 @@ void DhcpClient::sendDhcpMessage(uint8_t messageType, uint16_t secondsElapsed)
     //put data in ENC28J60 transmit buffer
     _dhcpUdpSocket.write(buffer, 30);
 
-    if (messageType == DHCP_REQUEST) {
+    // requested IP address only while selecting or rebooting (RFC 2131, 4.3.2)
+    if (messageType == DHCP_REQUEST && !renewing) {
         buffer[0] = dhcpRequestedIPaddr;
         buffer[1] = 0x04;
         buffer[2] = _dhcpLocalIp[0];
@@ -272,17 +336,21 @@ void DhcpClient::sendDhcpMessage(uint8_t messageType, uint16_t secondsElapsed)
         buffer[4] = _dhcpLocalIp[2];
         buffer[5] = _dhcpLocalIp[3];
 
-        buffer[6] = dhcpServerIdentifier;
-        buffer[7] = 0x04;
+        //put data in ENC28J60 transmit buffer
+        _dhcpUdpSocket.write(buffer, 6);
+    }
 
-        //buffer[8] = _dhcpDhcpServerIp[0];
-        buffer[8] = _dhcpLocalIp[0];
-        buffer[9] = _dhcpDhcpServerIp[1];
-        buffer[10] = _dhcpDhcpServerIp[2];
-        buffer[11] = _dhcpDhcpServerIp[3];
+    // server identifier only while selecting
+    if (messageType == DHCP_REQUEST && _dhcp_state == STATE_DHCP_REQUEST) {
+        buffer[0] = dhcpServerIdentifier;
+        buffer[1] = 0x04;
+        buffer[2] = _dhcpDhcpServerIp[0];
+        buffer[3] = _dhcpDhcpServerIp[1];
+        buffer[4] = _dhcpDhcpServerIp[2];
+        buffer[5] = _dhcpDhcpServerIp[3];
 
         //put data in ENC28J60 transmit buffer
-        _dhcpUdpSocket.write(buffer, 12);
+        _dhcpUdpSocket.write(buffer, 6);
     }
 
     buffer[0] = dhcpParamRequest;
@@ -307,20 +375,14 @@ void DhcpClient::sendDhcpMessage(uint8_t messageType, uint16_t secondsElapsed)
  * @param
  * @retval
  */
-uint8_t DhcpClient::parseDhcpResponse(unsigned long responseTimeout, uint32_t& transactionId)
+uint8_t DhcpClient::parseDhcpResponse(uint32_t& transactionId)
 {
     volatile uint8_t    type = 0;
     uint8_t             opt_len = 0;
-    Timer               timer;
-
-    timer.start();
-
-    while (_dhcpUdpSocket.parsePacket() <= 0) {
-        if (timer.read() > responseTimeout) {
-            return 255;
-        }
 
-        wait_ms(50);
+    // Don't wait for the response, checkLease() will come back later
+    if (_dhcpUdpSocket.parsePacket() <= 0) {
+        return 0;
     }
 
     // start reading in the packet
@@ -412,7 +474,6 @@ uint8_t DhcpClient::parseDhcpResponse(unsigned long responseTimeout, uint32_t& t
                     opt_len = _dhcpUdpSocket.read();
                     _dhcpUdpSocket.read((uint8_t*) &_dhcpLeaseTime, sizeof(_dhcpLeaseTime));
                     _dhcpLeaseTime = ntohl(_dhcpLeaseTime);
-                    _renewInSec = _dhcpLeaseTime;
                     break;
 
                 default:
@@ -434,60 +495,116 @@ uint8_t DhcpClient::parseDhcpResponse(unsigned long responseTimeout, uint32_t& t
 }
 
 /*
+    Advances the DHCP state machine without blocking.
+    Called from UipEthernet::tick().
     returns:
     0/DHCP_CHECK_NONE: nothing happened
     1/DHCP_CHECK_RENEW_FAIL: renew failed
     2/DHCP_CHECK_RENEW_OK: renew success
     3/DHCP_CHECK_REBIND_FAIL: rebind fail
     4/DHCP_CHECK_REBIND_OK: rebind success
+    5/DHCP_CHECK_BOUND: new lease bound
 */
 int DhcpClient::checkLease()
 {
-    time_t          now = time(NULL);
-    volatile int    rc = DHCP_CHECK_NONE;
-    if (_lastCheck != 0) {
-        //calc how many ms past the timeout we are
-        time_t  factor = now - _secTimeout;
-
-        //if on or passed the timeout, reduce the counters
-        if (factor >= 0) {
-            //next timeout should be now plus 1s
-            _secTimeout = now + 1;
-
-            //reduce the counters by that mouch
-            //if we can assume that the cycle time (factor) is fairly constant
-            //and if the remainder is less than cycle time * 2
-            //do it early instead of late
-            if (_renewInSec < factor * 2)
-                _renewInSec = 0;
+    // UdpSocket calls UipEthernet::tick() which calls us again
+    if (_busy || _dhcp_state == STATE_DHCP_STOPPED)
+        return DHCP_CHECK_NONE;
+
+    time_t      now = time(NULL);
+    int         rc = DHCP_CHECK_NONE;
+    uint8_t     messageType = 0;
+    uint32_t    respId;
+
+    _busy = true;
+    switch (_dhcp_state) {
+        case STATE_DHCP_START:
+#ifdef UIPETHERNET_DEBUG_UDP
+            printf("_dhcp_state: STATE_DHCP_START\r\n");
+#endif
+            if (!openSocket())
+                break;
+            if (_retryCount == 0)
+                _retryTimeout = _responseTimeout;
+            _dhcpTransactionId++;
+            _dhcp_state = STATE_DHCP_DISCOVER;
+            sendDhcpMessage(DHCP_DISCOVER, now - _requestStart + 1);
+            armRetry(now);
+            break;
+
+        case STATE_DHCP_DISCOVER:
+            messageType = parseDhcpResponse(respId);
+            if (messageType == DHCP_OFFER) {
+                // We'll use the transaction ID that the offer came with,
+                // rather than the one we were up to
+                _dhcpTransactionId = respId - 1;
+                sendRequest(STATE_DHCP_REQUEST, now);
+            }
             else
-                _renewInSec -= factor;
+            if (now >= _retryAt) {
+                _dhcp_state = STATE_DHCP_START;
+            }
+            break;
 
-            if (_rebindInSec < factor * 2)
-                _rebindInSec = 0;
+        case STATE_DHCP_REQUEST:
+        case STATE_DHCP_REBOOT:
+        case STATE_DHCP_RENEW:
+        case STATE_DHCP_REBIND:
+            messageType = parseDhcpResponse(respId);
+            if (messageType == DHCP_ACK) {
+                rc = bindLease(now);
+            }
             else
-                _rebindInSec -= factor;
-        }
+            if (messageType == DHCP_NAK) {
+#ifdef UIPETHERNET_DEBUG_UDP
+                printf("messageType: DHCP_NAK\r\n");
+#endif
+                rc = _dhcp_state == STATE_DHCP_RENEW ? DHCP_CHECK_RENEW_FAIL :
+                    _dhcp_state == STATE_DHCP_REBIND ? DHCP_CHECK_REBIND_FAIL : DHCP_CHECK_NONE;
+                resetDhcpLease();
+                _retryCount = 0;
+                _dhcp_state = STATE_DHCP_START;
+            }
+            else
+            if (_dhcp_state == STATE_DHCP_RENEW && now >= _rebindAt) {
+                rc = DHCP_CHECK_RENEW_FAIL;
+                sendRequest(STATE_DHCP_REBIND, now);
+            }
+            else
+            if (_dhcp_state == STATE_DHCP_REBIND && now >= _expireAt) {
+                // the lease is lost, this should basically restart completely
+                rc = DHCP_CHECK_REBIND_FAIL;
+                resetDhcpLease();
+                UipEthernet::ethernet->set_network(IpAddress(), IpAddress(), IpAddress(), IpAddress());
+                _retryCount = 0;
+                _dhcp_state = STATE_DHCP_START;
+            }
+            else
+            if (now >= _retryAt) {
+                if (_dhcp_state == STATE_DHCP_REQUEST ||
+                    (_dhcp_state == STATE_DHCP_REBOOT && _retryCount >= DHCP_REBOOT_ATTEMPTS)) {
+                    resetDhcpLease();
+                    _retryCount = 0;
+                    _dhcp_state = STATE_DHCP_START;
+                }
+                else {
+                    sendRequest(_dhcp_state, now);
+                }
+            }
+            break;
 
-        //if we have a lease but should renew, do it
-        if (_dhcp_state == STATE_DHCP_LEASED && _renewInSec <= 0) {
-            _dhcp_state = STATE_DHCP_REREQUEST;
-            rc = 1 + requestDhcpLease();
-        }
+        case STATE_DHCP_LEASED:
+            if (now >= _renewAt && openSocket()) {
+                _requestStart = now;
+                sendRequest(STATE_DHCP_RENEW, now);
+            }
+            break;
 
-        //if we have a lease or is renewing but should bind, do it
-        if ((_dhcp_state == STATE_DHCP_LEASED || _dhcp_state == STATE_DHCP_START) && _rebindInSec <= 0) {
-            //this should basically restart completely
-            _dhcp_state = STATE_DHCP_START;
-            resetDhcpLease();
-            rc = 3 + requestDhcpLease();
-        }
-    }
-    else {
-        _secTimeout = now + 1;
+        default:
+            break;
     }
 
-    _lastCheck = now;
+    _busy = false;
     return rc;
 }
 
@@ -546,6 +663,111 @@ IpAddress DhcpClient::getDnsServerIp()
     return IpAddress(_dhcpDnsServerIp);
 }
 
+#if UIP_DHCP_LEASE_CACHE && DEVICE_FLASH
+// no default: a sector the linker is free to fill would be erased
+#ifndef UIP_DHCP_LEASE_ADDRESS
+#error "UIP_DHCP_LEASE_CACHE needs UIP_DHCP_LEASE_ADDRESS, a flash sector reserved for it"
+#endif
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+static uint32_t leaseChecksum(const dhcp_lease_cache_t* lease)
+{
+    const uint8_t*  data = (const uint8_t*)lease;
+    uint32_t        sum = 0;
+
+    for (size_t i = 0; i < offsetof(dhcp_lease_cache_t, checksum); i++) {
+        sum = ((sum << 1) | (sum >> 31)) ^ data[i];
+    }
+
+    return sum;
+}
+#endif
+
+/**
+ * @brief   Restores the last lease from the cache for INIT-REBOOT
+ * @note
+ * @param
+ * @retval  true if a valid lease for our MAC address was found
+ */
+bool DhcpClient::loadLease()
+{
+#if UIP_DHCP_LEASE_CACHE && DEVICE_FLASH
+    FlashIAP            flash;
+    dhcp_lease_cache_t  lease;
+    int                 ret;
+
+    if (flash.init() != 0)
+        return false;
+    ret = flash.read(&lease, UIP_DHCP_LEASE_ADDRESS, sizeof(lease));
+    flash.deinit();
+
+    if
+    (
+        ret != 0 ||
+        lease.magic != DHCP_LEASE_MAGIC ||
+        lease.checksum != leaseChecksum(&lease) ||
+        memcmp(lease.macAddr, _dhcpMacAddr, 6) != 0
+    ) return false;
+
+    memcpy(_dhcpLocalIp, lease.localIp, 4);
+    memcpy(_dhcpSubnetMask, lease.subnetMask, 4);
+    memcpy(_dhcpGatewayIp, lease.gatewayIp, 4);
+    memcpy(_dhcpDhcpServerIp, lease.dhcpServerIp, 4);
+    memcpy(_dhcpDnsServerIp, lease.dnsServerIp, 4);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief   Stores the current lease in the cache
+ * @note    The sector is only rewritten when the lease differs from the
+ *          cached one, so renewals and reboots don't wear the flash.
+ * @param
+ * @retval
+ */
+void DhcpClient::saveLease()
+{
+#if UIP_DHCP_LEASE_CACHE && DEVICE_FLASH
+    FlashIAP            flash;
+    dhcp_lease_cache_t  cached;
+    uint8_t             buf[64];
+    dhcp_lease_cache_t* lease = (dhcp_lease_cache_t*)buf;
+
+    memset(buf, 0xFF, sizeof(buf));
+    lease->magic = DHCP_LEASE_MAGIC;
+    memcpy(lease->macAddr, _dhcpMacAddr, 6);
+    memcpy(lease->localIp, _dhcpLocalIp, 4);
+    memcpy(lease->subnetMask, _dhcpSubnetMask, 4);
+    memcpy(lease->gatewayIp, _dhcpGatewayIp, 4);
+    memcpy(lease->dhcpServerIp, _dhcpDhcpServerIp, 4);
+    memcpy(lease->dnsServerIp, _dhcpDnsServerIp, 4);
+    lease->checksum = leaseChecksum(lease);
+
+    if (flash.init() != 0)
+        return;
+
+    uint32_t    addr = UIP_DHCP_LEASE_ADDRESS;
+    uint32_t    page = flash.get_page_size();
+    uint32_t    len = ((sizeof(dhcp_lease_cache_t) + page - 1) / page) * page;
+
+    if
+    (
+        len <= sizeof(buf) &&
+        (flash.read(&cached, addr, sizeof(cached)) != 0 || memcmp(&cached, lease, sizeof(cached)) != 0) &&
+        flash.erase(addr, flash.get_sector_size(addr)) == 0
+    ) flash.program(buf, addr, len);
+
+    flash.deinit();
+#endif
+}
+
 /**
  * @brief
  * @note
@@ -14,6 +14,10 @@
 #define STATE_DHCP_LEASED       3
 #define STATE_DHCP_REREQUEST    4
 #define STATE_DHCP_RELEASE      5
+#define STATE_DHCP_REBOOT       6
+#define STATE_DHCP_RENEW        7
+#define STATE_DHCP_REBIND       8
+#define STATE_DHCP_STOPPED      9
 
 #define DHCP_FLAGSBROADCAST     0x8000
 
@@ -51,12 +55,16 @@
 
 #define HOST_NAME               "ENC28J"
 #define DEFAULT_LEASE           (900)   //default lease time in seconds
+#define DHCP_MAX_RETRY_TIMEOUT  (64)    //upper bound of the exponential retransmission backoff in seconds
+#define DHCP_REBOOT_ATTEMPTS    (2)     //INIT-REBOOT requests sent before falling back to DISCOVER
+#define DHCP_LEASE_MAGIC        0x44484350
 
 #define DHCP_CHECK_NONE         (0)
 #define DHCP_CHECK_RENEW_FAIL   (1)
 #define DHCP_CHECK_RENEW_OK     (2)
 #define DHCP_CHECK_REBIND_FAIL  (3)
 #define DHCP_CHECK_REBIND_OK    (4)
+#define DHCP_CHECK_BOUND        (5)
 
 enum
 {
@@ -141,6 +149,18 @@ typedef struct _RIP_MSG_FIXED
     uint8_t     chaddr[6];
 } RIP_MSG_FIXED;
 
+typedef struct
+{
+    uint32_t    magic;
+    uint8_t     macAddr[6];
+    uint8_t     localIp[4];
+    uint8_t     subnetMask[4];
+    uint8_t     gatewayIp[4];
+    uint8_t     dhcpServerIp[4];
+    uint8_t     dnsServerIp[4];
+    uint32_t    checksum;
+} dhcp_lease_cache_t;
+
 class   DhcpClient
 {
 private:
@@ -154,24 +174,33 @@ private:
     uint8_t     _dhcpDnsServerIp[4];
     uint32_t    _dhcpLeaseTime;
     uint32_t    _dhcpT1, _dhcpT2;
-    time_t      _renewInSec;
-    time_t      _rebindInSec;
-    time_t      _lastCheck;
-    time_t      _timeout;
+    time_t      _renewAt;
+    time_t      _rebindAt;
+    time_t      _expireAt;
+    time_t      _requestStart;
+    time_t      _retryAt;
+    time_t      _retryTimeout;
     time_t      _responseTimeout;
-    time_t      _secTimeout;
+    uint8_t     _retryCount;
     uint8_t     _dhcp_state;
+    bool        _busy;
     UdpSocket   _dhcpUdpSocket;
 
-    int         requestDhcpLease();
+    bool        openSocket();
     void        resetDhcpLease();
-    void        presendDhcp();
     void        sendDhcpMessage(uint8_t, uint16_t);
+    void        sendRequest(uint8_t state, time_t now);
+    void        armRetry(time_t now);
+    int         bindLease(time_t now);
     void        printByte(char* , uint8_t);
+    bool        loadLease();
+    void        saveLease();
 
-    uint8_t     parseDhcpResponse(unsigned long responseTimeout, uint32_t& transactionId);
+    uint8_t     parseDhcpResponse(uint32_t& transactionId);
 
 public:
+    DhcpClient();
+
     IpAddress   getLocalIp();
     IpAddress   getSubnetMask();
     IpAddress   getGatewayIp();
@@ -179,6 +208,10 @@ public:
     IpAddress   getDnsServerIp();
 
     int         begin(uint8_t* mac, unsigned long timeout = 60, unsigned long responseTimeout = 4);
+    void        start(uint8_t* mac, unsigned long responseTimeout = 4);
+    void        stop();
     int         checkLease();
+    uint8_t     state()     { return _dhcp_state; }
+    bool        leased();
 };
 #endif
@@ -0,0 +1,244 @@
+/*
+ DiagServer.cpp - UDP endpoint reporting the network counters.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "UipEthernet.h"
+#include "DiagServer.h"
+extern "C"
+{
+#include "utility/uip.h"
+#include "utility/uip_arp.h"
+#include "utility/ip6string.h"
+}
+#include <stdio.h>
+#include <stdarg.h>
+
+static const char* const    tcpStates[] =
+{
+    "CLOSED", "SYN_RCVD", "SYN_SENT", "ESTABLISHED", "FIN_WAIT_1", "FIN_WAIT_2", "CLOSING", "TIME_WAIT", "LAST_ACK"
+};
+
+/**
+ * @brief   Appends formatted text to the report
+ * @note    Keeps the report terminated and truncates it once full.
+ * @param
+ * @retval  New length of the report
+ */
+static size_t append(char* buf, size_t size, size_t len, const char* fmt, ...)
+{
+    va_list args;
+    int     n;
+
+    if (len + 1 >= size)
+        return len;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf + len, size - len, fmt, args);
+    va_end(args);
+    if (n < 0)
+        return len;
+
+    return (len + n < size) ? len + n : size - 1;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+DiagServer::DiagServer() :
+    _ethernet(NULL),
+    _requests(0)
+{ }
+
+/**
+ * @brief   Starts listening on the diagnostics port
+ * @note
+ * @param   ethernet Interface the counters are read from
+ * @param   port UDP port to listen on
+ * @retval  1 if successful, 0 if no UDP connection was available
+ */
+uint8_t DiagServer::open(UipEthernet* ethernet, uint16_t port)
+{
+    _ethernet = ethernet;
+    if (UipEthernet::ethernet != ethernet)
+        UipEthernet::ethernet = ethernet;
+    return _udp.begin(port);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void DiagServer::close()
+{
+    _udp.stop();
+}
+
+/**
+ * @brief   Answers a pending request with the report
+ * @note    The request payload is ignored. Does nothing when no datagram
+ *          is waiting, so it is cheap to call on every loop iteration.
+ * @param
+ * @retval
+ */
+void DiagServer::poll()
+{
+    char    reply[UIP_DIAG_REPLYLEN];
+    size_t  len;
+
+    if (_udp.parsePacket() <= 0)
+        return;
+
+    _requests++;
+
+    SocketAddress   remote = _udp.remoteAddress();
+
+    _udp.flush();
+    len = format(reply, sizeof(reply));
+    if (_udp.beginPacket(remote)) {
+        _udp.write((const uint8_t*)reply, len);
+        _udp.endPacket();
+    }
+}
+
+/**
+ * @brief   Writes the counters as text
+ * @note    Driver counters come from Enc28j60Eth, protocol counters from
+ *          uip_stat and the per connection counters from uip_conns[].
+ * @param   buf Buffer receiving the report
+ * @param   size Size of the buffer
+ * @retval  Length of the report, without the terminating zero
+ */
+size_t DiagServer::format(char* buf, size_t size)
+{
+    Enc28j60Eth&    eth = UipEthernet::ethernet->enc28j60Eth;
+    size_t          len = 0;
+
+    if (size == 0)
+        return 0;
+
+    buf[0] = '\0';
+    len = append
+        (
+            buf, size, len,
+            "eth rx %lu/%lu tx %lu/%lu txerr %lu latecol %lu spi %lu/%lu\n",
+            (unsigned long)eth.rxFrames(),
+            (unsigned long)eth.rxBytes(),
+            (unsigned long)eth.txFrames(),
+            (unsigned long)eth.txBytes(),
+            (unsigned long)eth.txErrors(),
+            (unsigned long)eth.txLateCollisions(),
+            (unsigned long)eth.spiTransactions(),
+            (unsigned long)eth.spiBytes()
+        );
+    len = append
+        (
+            buf, size, len,
+            "drop nomem %lu rxovf %lu crc %lu arpmiss %lu\n",
+            (unsigned long)UipEthernet::ethernet->dropsNoMemory(),
+            (unsigned long)eth.rxOverflows(),
+            (unsigned long)eth.rxCrcErrors(),
+            (unsigned long)uip_arp_misses
+        );
+#if UIP_STATISTICS
+    len = append
+        (
+            buf, size, len,
+            "ip rx %lu tx %lu drop %lu chkerr %lu\n",
+            (unsigned long)uip_stat.ip.recv,
+            (unsigned long)uip_stat.ip.sent,
+            (unsigned long)uip_stat.ip.drop,
+            (unsigned long)uip_stat.ip.chkerr
+        );
+    len = append
+        (
+            buf, size, len,
+            "tcp rx %lu tx %lu drop %lu chkerr %lu rexmit %lu syndrop %lu",
+            (unsigned long)uip_stat.tcp.recv,
+            (unsigned long)uip_stat.tcp.sent,
+            (unsigned long)uip_stat.tcp.drop,
+            (unsigned long)uip_stat.tcp.chkerr,
+            (unsigned long)uip_stat.tcp.rexmit,
+            (unsigned long)uip_stat.tcp.syndrop
+        );
+#if UIP_FAST_RETRANSMIT
+    len = append(buf, size, len, " fastrexmit %lu", (unsigned long)uip_fastrexmits);
+#endif
+#if UIP_SYN_COOKIES
+    len = append
+        (
+            buf, size, len,
+            " cookies %lu/%lu",
+            (unsigned long)uip_syncookies_sent,
+            (unsigned long)uip_syncookies_accepted
+        );
+#endif
+    len = append(buf, size, len, "\n");
+#if UIP_UDP
+    len = append
+        (
+            buf, size, len,
+            "udp rx %lu tx %lu drop %lu chkerr %lu\n",
+            (unsigned long)uip_stat.udp.recv,
+            (unsigned long)uip_stat.udp.sent,
+            (unsigned long)uip_stat.udp.drop,
+            (unsigned long)uip_stat.udp.chkerr
+        );
+#endif
+    for (uint8_t i = 0; i < UIP_CONNS; i++) {
+        struct uip_conn*    conn = &uip_conns[i];
+        uint8_t             state = conn->tcpstateflags & UIP_TS_MASK;
+
+        if (state == UIP_CLOSED)
+            continue;
+
+        char    raddr[44];
+#if UIP_CONF_IPV6
+        raddr[0] = '[';
+        strcpy(&raddr[1 + ip6tos(conn->ripaddr, &raddr[1])], "]");
+#else
+        snprintf
+        (
+            raddr, sizeof(raddr), "%u.%u.%u.%u",
+            uip_ipaddr1(conn->ripaddr),
+            uip_ipaddr2(conn->ripaddr),
+            uip_ipaddr3(conn->ripaddr),
+            uip_ipaddr4(conn->ripaddr)
+        );
+#endif
+        len = append
+            (
+                buf, size, len,
+                "conn %u %s %u %s:%u rx %lu/%lu tx %lu/%lu rexmit %u srtt %u\n",
+                i,
+                state <= UIP_LAST_ACK ? tcpStates[state] : "?",
+                htons(conn->lport),
+                raddr,
+                htons(conn->rport),
+                (unsigned long)conn->rxframes,
+                (unsigned long)conn->rxbytes,
+                (unsigned long)conn->txframes,
+                (unsigned long)conn->txbytes,
+                conn->rexmits,
+                conn->srtt >> 3
+            );
+    }
+#endif
+    return len;
+}
@@ -0,0 +1,47 @@
+/*
+ DiagServer.h - UDP endpoint reporting the network counters.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DIAGSERVER_h
+#define DIAGSERVER_h
+
+#include "UdpSocket.h"
+
+#ifndef UIP_DIAG_PORT
+#define UIP_DIAG_PORT       7007
+#endif
+
+#define UIP_DIAG_REPLYLEN   640     // text report, one line per counter group and connection
+
+class UipEthernet;
+
+// Answers any datagram sent to the diagnostics port with a plain text
+// report of the driver, IP, TCP and UDP counters and of every open TCP
+// connection, e.g. "echo | nc -u -w1 <ip> 7007".
+class DiagServer
+{
+public:
+    DiagServer();
+    uint8_t         open(UipEthernet* ethernet, uint16_t port = UIP_DIAG_PORT);
+    void            close();
+    void            poll();                             // call from the main loop
+    static size_t   format(char* buf, size_t size);     // writes the report, returns its length
+    uint32_t        requests()  { return _requests; }
+private:
+    UdpSocket       _udp;
+    UipEthernet*    _ethernet;
+    uint32_t        _requests;
+};
+#endif
@@ -0,0 +1,466 @@
+/*
+ NetThread.cpp - network thread owning the stack, fed by lock-free request queues.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "NetThread.h"
+#include "UipEthernet.h"
+#include "TcpClient.h"
+#include "UdpSocket.h"
+
+/**
+ * @brief   Queues a request on the channel
+ * @note    Only the thread owning the channel may post on it.
+ * @param
+ * @retval  false if the channel is not attached or full
+ */
+bool NetChannel::post(net_request_t* req)
+{
+    if (!_net)
+        return false;
+
+    if (!_queue.push(req)) {
+        _net->_rejected++;
+        return false;
+    }
+
+    _net->_wakeup();
+    return true;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+NetThread::NetThread(UipEthernet* ethernet, osPriority priority, uint32_t stackSize) :
+    _ethernet(ethernet),
+    _thread(priority, stackSize),
+    _doneFree(NET_FLAGS_DONE),
+    _rejected(0),
+    _numPending(0)
+{
+    for (uint8_t i = 0; i < UIP_NET_CHANNELS; i++)
+        _channels[i].store(NULL);
+}
+
+/**
+ * @brief   Starts the network thread
+ * @note    Configure the interface (set_network, connect) before, and from
+ *          then on use the sockets through this class only.
+ * @param
+ * @retval
+ */
+osStatus NetThread::start()
+{
+    if (UipEthernet::ethernet != _ethernet)
+        UipEthernet::ethernet = _ethernet;
+    return _thread.start(callback(this, &NetThread::_run));
+}
+
+/**
+ * @brief   Gives a thread its own request queue
+ * @note
+ * @param
+ * @retval  false if all UIP_NET_CHANNELS slots are taken
+ */
+bool NetThread::attach(NetChannel* channel)
+{
+    channel->_net = this;
+    for (uint8_t i = 0; i < UIP_NET_CHANNELS; i++) {
+        NetChannel* none = NULL;
+        if (_channels[i].compare_exchange_strong(none, channel))
+            return true;
+    }
+
+    channel->_net = NULL;
+    return false;
+}
+
+/**
+ * @brief   Queues a request
+ * @note    Safe from any thread or interrupt handler, never blocks.
+ * @param
+ * @retval  false if the queue is full
+ */
+bool NetThread::post(net_request_t* req)
+{
+    if (!_queue.push(req)) {
+        _rejected++;
+        return false;
+    }
+
+    _wakeup();
+    return true;
+}
+
+/**
+ * @brief   Posts a request and waits for its completion
+ * @note    Not to be called from the network thread itself.
+ * @param
+ * @retval
+ */
+nsapi_size_or_error_t NetThread::_submit(net_request_t* req)
+{
+    uint32_t    free = _doneFree.load();
+    uint32_t    bit;
+
+    do {
+        if (free == 0)
+            return NSAPI_ERROR_NO_MEMORY;
+        bit = free & -free;
+    } while (!_doneFree.compare_exchange_weak(free, free & ~bit));
+
+    req->flags = &_done;
+    req->flag = bit;
+
+    nsapi_size_or_error_t   result = NSAPI_ERROR_WOULD_BLOCK;
+
+    if (post(req)) {
+        _done.wait_any(bit);
+        result = req->result;
+    }
+
+    _doneFree.fetch_or(bit);
+    return result;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval  NSAPI_ERROR_OK, NSAPI_ERROR_NO_CONNECTION or NSAPI_ERROR_UNSUPPORTED for IPv6 peers
+ */
+nsapi_error_t NetThread::connect(TcpClient* client, const SocketAddress& address)
+{
+    net_request_t   req = { };
+
+    req.cmd = NET_CMD_CONNECT;
+    req.socket = client;
+    req.address = address;
+    return _submit(&req);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval  Number of bytes queued for sending, or a negative error
+ */
+nsapi_size_or_error_t NetThread::send(TcpClient* client, const void* data, nsapi_size_t size)
+{
+    net_request_t   req = { };
+
+    req.cmd = NET_CMD_SEND;
+    req.socket = client;
+    req.data = (void*)data;
+    req.size = size;
+    return _submit(&req);
+}
+
+/**
+ * @brief
+ * @note
+ * @param   timeout Milliseconds to wait for data, osWaitForever to wait until
+ *          data arrives or the connection is closed
+ * @retval  Number of bytes received, 0 once the connection is closed,
+ *          NSAPI_ERROR_WOULD_BLOCK on timeout
+ */
+nsapi_size_or_error_t NetThread::recv(TcpClient* client, void* data, nsapi_size_t size, uint32_t timeout)
+{
+    net_request_t   req = { };
+
+    req.cmd = NET_CMD_RECV;
+    req.socket = client;
+    req.data = data;
+    req.size = size;
+    req.timeout = timeout;
+    return _submit(&req);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+nsapi_error_t NetThread::close(TcpClient* client)
+{
+    net_request_t   req = { };
+
+    req.cmd = NET_CMD_CLOSE;
+    req.socket = client;
+    return _submit(&req);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval  Number of bytes sent, or a negative error
+ */
+nsapi_size_or_error_t NetThread::sendto(UdpSocket* socket, const SocketAddress& address, const void* data, nsapi_size_t size)
+{
+    net_request_t   req = { };
+
+    req.cmd = NET_CMD_SENDTO;
+    req.socket = socket;
+    req.address = address;
+    req.data = (void*)data;
+    req.size = size;
+    return _submit(&req);
+}
+
+/**
+ * @brief
+ * @note    Datagrams larger than size are truncated.
+ * @param
+ * @retval  Number of bytes received, NSAPI_ERROR_WOULD_BLOCK on timeout
+ */
+nsapi_size_or_error_t NetThread::recvfrom(UdpSocket* socket, SocketAddress* address, void* data, nsapi_size_t size, uint32_t timeout)
+{
+    net_request_t           req = { };
+    nsapi_size_or_error_t   result;
+
+    req.cmd = NET_CMD_RECVFROM;
+    req.socket = socket;
+    req.data = data;
+    req.size = size;
+    req.timeout = timeout;
+    result = _submit(&req);
+    if (result >= 0 && address)
+        *address = req.address;
+    return result;
+}
+
+/**
+ * @brief   Runs fn(ctx) on the network thread and waits for it to return
+ * @note    For socket calls without a request of their own, e.g.
+ *          TcpServer::accept().
+ * @param
+ * @retval
+ */
+nsapi_error_t NetThread::call(net_call_t fn, void* ctx)
+{
+    net_request_t   req = { };
+
+    req.cmd = NET_CMD_CALL;
+    req.fn = fn;
+    req.ctx = ctx;
+    return _submit(&req);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void NetThread::_complete(net_request_t* req, nsapi_size_or_error_t result)
+{
+    req->result = result;
+    if (req->flags)
+        req->flags->set(req->flag);
+}
+
+/**
+ * @brief   Completes a receive if data is available
+ * @note
+ * @param
+ * @retval  true if the request was completed
+ */
+bool NetThread::_tryRecv(net_request_t* req)
+{
+    if (req->cmd == NET_CMD_RECV) {
+        TcpClient*  client = (TcpClient*)req->socket;
+
+        if (client->available()) {
+            _complete(req, client->recv((uint8_t*)req->data, req->size));
+            return true;
+        }
+
+        if (!client->connected()) {
+            _complete(req, 0);
+            return true;
+        }
+
+        return false;
+    }
+
+    UdpSocket*  socket = (UdpSocket*)req->socket;
+
+    if (socket->parsePacket() <= 0)
+        return false;
+
+    req->address = socket->remoteAddress();
+
+    size_t  len = socket->read((uint8_t*)req->data, req->size);
+
+    socket->flush();
+    _complete(req, len);
+    return true;
+}
+
+/**
+ * @brief   Carries out a request on the network thread
+ * @note    Receives without data wait in _pending until data arrives or
+ *          they time out.
+ * @param
+ * @retval
+ */
+void NetThread::_execute(net_request_t* req)
+{
+    switch (req->cmd) {
+        case NET_CMD_CALL:
+            req->fn(req->ctx);
+            _complete(req, NSAPI_ERROR_OK);
+            break;
+
+        case NET_CMD_CONNECT:
+            if (req->address.get_ip_version() != NSAPI_IPv4) {
+                _complete(req, NSAPI_ERROR_UNSUPPORTED);
+                break;
+            }
+
+            _complete
+            (
+                req,
+                ((TcpClient*)req->socket)->connect
+                    (
+                        IpAddress((const uint8_t*)req->address.get_ip_bytes()),
+                        req->address.get_port()
+                    ) == 0 ? NSAPI_ERROR_OK : NSAPI_ERROR_NO_CONNECTION
+            );
+            break;
+
+        case NET_CMD_SEND:
+        {
+            int n = ((TcpClient*)req->socket)->send((const uint8_t*)req->data, req->size);
+            _complete(req, n < 0 ? NSAPI_ERROR_NO_CONNECTION : n);
+            break;
+        }
+
+        case NET_CMD_SENDTO:
+        {
+            nsapi_error_t   err = ((UdpSocket*)req->socket)->sendto(req->address, req->data, req->size);
+            _complete(req, err == NSAPI_ERROR_OK ? (nsapi_size_or_error_t)req->size : err);
+            break;
+        }
+
+        case NET_CMD_RECV:
+        case NET_CMD_RECVFROM:
+            if (_tryRecv(req))
+                break;
+
+            if (req->timeout == 0)
+                _complete(req, NSAPI_ERROR_WOULD_BLOCK);
+            else
+            if (_numPending == UIP_NET_PENDING)
+                _complete(req, NSAPI_ERROR_NO_MEMORY);
+            else {
+                req->deadline = _clock.read_ms() + req->timeout;
+                _pending[_numPending++] = req;
+            }
+            break;
+
+        case NET_CMD_CLOSE:
+            ((TcpClient*)req->socket)->stop();
+            _complete(req, NSAPI_ERROR_OK);
+            break;
+
+        default:
+            _complete(req, NSAPI_ERROR_PARAMETER);
+            break;
+    }
+}
+
+/**
+ * @brief   Completes waiting receives which got data or timed out
+ * @note
+ * @param
+ * @retval
+ */
+void NetThread::_poll()
+{
+    uint32_t    now = _clock.read_ms();
+    uint8_t     kept = 0;
+
+    for (uint8_t i = 0; i < _numPending; i++) {
+        net_request_t*  req = _pending[i];
+
+        if (_tryRecv(req))
+            continue;
+
+        if (req->timeout != osWaitForever && (int32_t)(now - req->deadline) >= 0) {
+            _complete(req, NSAPI_ERROR_WOULD_BLOCK);
+            continue;
+        }
+
+        _pending[kept++] = req;
+    }
+
+    _numPending = kept;
+}
+
+/**
+ * @brief   Executes the queued requests
+ * @note
+ * @param
+ * @retval  true if there was any
+ */
+bool NetThread::_drain()
+{
+    net_request_t*  req;
+    bool            busy = false;
+
+    while (_queue.pop(req)) {
+        _execute(req);
+        busy = true;
+    }
+
+    for (uint8_t i = 0; i < UIP_NET_CHANNELS; i++) {
+        NetChannel* channel = _channels[i].load();
+
+        if (channel) {
+            while (channel->_queue.pop(req)) {
+                _execute(req);
+                busy = true;
+            }
+        }
+    }
+
+    return busy;
+}
+
+/**
+ * @brief   Network thread body
+ * @note    Sleeps up to UIP_NET_POLL_MS between polls of the ENC28J60 while
+ *          no requests come in, a post wakes it at once.
+ * @param
+ * @retval
+ */
+void NetThread::_run()
+{
+    _clock.start();
+    for (;;) {
+        bool    busy = _drain();
+
+        _ethernet->tick();
+        if (_numPending)
+            _poll();
+        if (!busy)
+            _wake.wait_any(NET_FLAG_WAKE, UIP_NET_POLL_MS);
+    }
+}
@@ -0,0 +1,156 @@
+/*
+ NetThread.h - network thread owning the stack, fed by lock-free request queues.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NETTHREAD_h
+#define NETTHREAD_h
+
+#include "mbed.h"
+#include "SocketAddress.h"
+#include "utility/LockFreeQueue.h"
+#include "utility/uipethernet-conf.h"
+
+#ifndef UIP_NET_QUEUE_DEPTH
+#define UIP_NET_QUEUE_DEPTH     8       // requests posted by any thread
+#endif
+
+#ifndef UIP_NET_CHANNELS
+#define UIP_NET_CHANNELS        4       // attached single producer channels
+#endif
+
+#ifndef UIP_NET_CHANNEL_DEPTH
+#define UIP_NET_CHANNEL_DEPTH   4       // requests per channel
+#endif
+
+#ifndef UIP_NET_PENDING
+#define UIP_NET_PENDING         4       // receives waiting for data
+#endif
+
+#ifndef UIP_NET_POLL_MS
+#define UIP_NET_POLL_MS         2       // ENC28J60 poll interval while idle
+#endif
+
+#ifndef UIP_NET_STACK_SIZE
+#define UIP_NET_STACK_SIZE      2048
+#endif
+
+#define NET_FLAG_WAKE           0x01    // _wake: a request was posted
+#define NET_FLAGS_DONE          0x00ffffff  // _done: completion bits handed out by the blocking calls
+
+typedef enum
+{
+    NET_CMD_CALL,       // run fn(ctx)
+    NET_CMD_CONNECT,    // TcpClient* socket to address
+    NET_CMD_SEND,       // data, size on TcpClient* socket
+    NET_CMD_RECV,       // up to size bytes into data from TcpClient* socket
+    NET_CMD_SENDTO,     // datagram data, size to address on UdpSocket* socket
+    NET_CMD_RECVFROM,   // datagram into data, source into address from UdpSocket* socket
+    NET_CMD_CLOSE       // TcpClient* socket
+} net_cmd_t;
+
+typedef void (*net_call_t)(void* ctx);
+
+// A request belongs to the posting thread, which must keep it and its data
+// buffer alive until completion: the network thread stores result, then
+// sets flag in flags (if any). Receives wait up to timeout ms for data.
+typedef struct
+{
+    uint8_t                 cmd;        // net_cmd_t
+    void*                   socket;     // TcpClient* or UdpSocket*
+    SocketAddress           address;
+    void*                   data;
+    nsapi_size_t            size;
+    uint32_t                timeout;    // ms, receives only
+    net_call_t              fn;         // NET_CMD_CALL only
+    void*                   ctx;
+    EventFlags*             flags;
+    uint32_t                flag;
+    volatile nsapi_size_or_error_t  result;
+    uint32_t                deadline;   // set by the network thread
+} net_request_t;
+
+class UipEthernet;
+class TcpClient;
+class UdpSocket;
+class NetThread;
+
+// Request queue of a single producer thread, cheaper than the shared
+// queue because pushing needs no compare-and-swap.
+class NetChannel
+{
+public:
+    NetChannel() : _net(NULL) { }
+    bool    post(net_request_t* req);
+private:
+    SpscQueue<net_request_t*, UIP_NET_CHANNEL_DEPTH>    _queue;
+    NetThread*                                          _net;
+    friend class                                        NetThread;
+};
+
+// Runs tick() and every socket call in its own thread, so the stack's
+// globals (uip_buf, uip_conn, UipEthernet::ethernet ...) are only touched
+// there. Other threads post requests without locking and are woken
+// through EventFlags, they never wait for the SPI bus or a mutex.
+//
+//     NetThread       net_thread(&net);
+//     net_thread.start();
+//     ...
+//     // from any thread
+//     net_thread.send(client, buf, len);
+//
+// Once started, sockets must no longer be used directly by other threads.
+class NetThread
+{
+public:
+    NetThread(UipEthernet* ethernet, osPriority priority = osPriorityAboveNormal, uint32_t stackSize = UIP_NET_STACK_SIZE);
+    osStatus                start();
+    bool                    attach(NetChannel* channel);
+    bool                    post(net_request_t* req);
+
+    // blocking calls, the caller waits on an EventFlags bit only
+    nsapi_error_t           connect(TcpClient* client, const SocketAddress& address);
+    nsapi_size_or_error_t   send(TcpClient* client, const void* data, nsapi_size_t size);
+    nsapi_size_or_error_t   recv(TcpClient* client, void* data, nsapi_size_t size, uint32_t timeout = osWaitForever);
+    nsapi_error_t           close(TcpClient* client);
+    nsapi_size_or_error_t   sendto(UdpSocket* socket, const SocketAddress& address, const void* data, nsapi_size_t size);
+    nsapi_size_or_error_t   recvfrom(UdpSocket* socket, SocketAddress* address, void* data, nsapi_size_t size, uint32_t timeout = osWaitForever);
+    nsapi_error_t           call(net_call_t fn, void* ctx);
+
+    uint32_t                rejected()  { return _rejected; }   // posts refused, queue full
+private:
+    UipEthernet*            _ethernet;
+    Thread                  _thread;
+    EventFlags              _wake;
+    EventFlags              _done;
+    std::atomic<uint32_t>   _doneFree;      // completion bits not in use
+    std::atomic<uint32_t>   _rejected;
+    MpscQueue<net_request_t*, UIP_NET_QUEUE_DEPTH>  _queue;
+    std::atomic<NetChannel*>    _channels[UIP_NET_CHANNELS];
+    net_request_t*          _pending[UIP_NET_PENDING];  // receives waiting for data, oldest first
+    uint8_t                 _numPending;
+    Timer                   _clock;
+
+    void                    _run();
+    bool                    _drain();
+    void                    _execute(net_request_t* req);
+    bool                    _tryRecv(net_request_t* req);
+    void                    _poll();
+    void                    _complete(net_request_t* req, nsapi_size_or_error_t result);
+    nsapi_size_or_error_t   _submit(net_request_t* req);
+    void                    _wakeup()   { _wake.set(NET_FLAG_WAKE); }
+
+    friend class            NetChannel;
+};
+#endif
@@ -0,0 +1,300 @@
+/*
+ PowerPolicy.cpp - idle policy powering the ENC28J60 down between report windows.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PowerPolicy.h"
+#include "UipEthernet.h"
+#include "TcpClient.h"
+extern "C"
+{
+#include "utility/uip.h"
+#include "utility/uip_arp.h"
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+PowerPolicy::PowerPolicy() :
+    _ethernet(NULL),
+    _int(NULL),
+    _state(POWER_ACTIVE),
+    _idleState(POWER_STANDBY),
+    _period(0),
+    _window(0),
+    _scheduleStart(0),
+    _idleTimeout(UIP_POWER_IDLE_MS),
+    _lastActivity(0),
+    _lastRxFrames(0),
+    _enteredAt(0),
+    _powerDownUs(0),
+    _resumeUs(0),
+    _linkUpMs(0),
+    _wakeups(0),
+    _linkPending(false),
+    _patternOffset(0),
+    _patternMask(0)
+{
+    memset(_stateMs, 0, sizeof(_stateMs));
+}
+
+/**
+ * @brief   Takes over the interface
+ * @note    Call after connect(). Without the INT pin the controller is
+ *          polled every UIP_POWER_POLL_MS while in standby.
+ * @param   ethernet Interface to drive
+ * @param   intPin Pin wired to the ENC28J60 INT output, or NC
+ * @retval
+ */
+void PowerPolicy::open(UipEthernet* ethernet, PinName intPin)
+{
+    _ethernet = ethernet;
+    if (UipEthernet::ethernet != ethernet)
+        UipEthernet::ethernet = ethernet;
+
+    if (intPin != NC) {
+        _int = new InterruptIn(intPin);
+        _int->fall(callback(this, &PowerPolicy::_onInterrupt));
+    }
+
+    setWakeMagicPacket();
+    _clock.start();
+    _lastRxFrames = ethernet->enc28j60Eth.rxFrames();
+}
+
+/**
+ * @brief   Sets the report windows
+ * @note    The first window starts now.
+ * @param   period Milliseconds from one window to the next, 0 for none:
+ *          then only traffic, a wake pattern or wake() make it active and
+ *          POWER_OFF is replaced by POWER_STANDBY
+ * @param   window Milliseconds the interface is kept active in each period
+ * @retval
+ */
+void PowerPolicy::setSchedule(uint32_t period, uint32_t window)
+{
+    _period = period;
+    _window = window;
+    _scheduleStart = _clock.read_ms();
+}
+
+/**
+ * @brief   Sets the frames waking the interface from standby
+ * @note    See Enc28j60Eth::setWakePattern().
+ * @param
+ * @retval
+ */
+void PowerPolicy::setWakePattern(uint16_t offset, const uint8_t* pattern, uint64_t mask)
+{
+    _patternOffset = offset;
+    _patternMask = mask;
+    memcpy(_pattern, pattern, sizeof(_pattern));
+    if (_state == POWER_STANDBY)
+        _ethernet->enc28j60Eth.setWakePattern(_patternOffset, _pattern, _patternMask);
+}
+
+/**
+ * @brief   Wakes from standby on a magic packet for our MAC address
+ * @note    The window covers the sync bytes and the first 9 2/3 copies of
+ *          the address, broadcast magic packets match as well.
+ * @param   offset UIP_POWER_WOL_UDP or UIP_POWER_WOL_ETHER
+ * @retval
+ */
+void PowerPolicy::setWakeMagicPacket(uint16_t offset)
+{
+    uint8_t pattern[64];
+
+    memset(pattern, 0xff, 6);
+    for (uint8_t i = 6; i < sizeof(pattern); i++)
+        pattern[i] = uip_ethaddr.addr[(i - 6) % 6];
+    setWakePattern(offset, pattern, ~(uint64_t)0);
+}
+
+/**
+ * @brief   Runs the interface and applies the policy
+ * @note    Call from the main loop in place of tick().
+ * @param
+ * @retval  Milliseconds until something is due, 0 while active
+ */
+uint32_t PowerPolicy::poll()
+{
+    Enc28j60Eth&    enc = _ethernet->enc28j60Eth;
+    uint32_t        now = _clock.read_ms();
+    uint32_t        idle;
+
+    switch (_state) {
+        case POWER_ACTIVE:
+            _ethernet->tick();
+            if (enc.rxFrames() != _lastRxFrames || _busy() || enc.packetPending()) {
+                _lastRxFrames = enc.rxFrames();
+                _lastActivity = now;
+            }
+
+            if (_linkPending && enc.linkStatus()) {
+                _linkPending = false;
+                _linkUpMs = now - _enteredAt;
+            }
+
+            // nothing but a window ends POWER_OFF, so it needs a schedule
+            if (_idleState != POWER_ACTIVE && !_inWindow(now) && now - _lastActivity >= _idleTimeout)
+                _enter(_period || _idleState != POWER_OFF ? _idleState : POWER_STANDBY);
+            return 0;
+
+        case POWER_STANDBY:
+            if (enc.packetPending()) {
+                _wakeups++;
+                _enter(POWER_ACTIVE);
+                return 0;
+            }
+
+        // fall through
+        default:
+            if (_inWindow(now)) {
+                _enter(POWER_ACTIVE);
+                return 0;
+            }
+            break;
+    }
+
+    idle = _untilWindow(now);
+    if (_state == POWER_STANDBY && !_int && idle > UIP_POWER_POLL_MS)
+        idle = UIP_POWER_POLL_MS;
+    return idle;
+}
+
+/**
+ * @brief   Sleeps for the time returned by poll()
+ * @note    Returns early when the INT pin signals a received frame.
+ * @param
+ * @retval
+ */
+void PowerPolicy::wait(uint32_t ms)
+{
+    if (ms)
+        _events.wait_any(1, ms);
+}
+
+/**
+ * @brief
+ * @note    Call from the thread calling poll(). The interface goes idle
+ *          again UIP_POWER_IDLE_MS after the last traffic.
+ * @param
+ * @retval
+ */
+void PowerPolicy::wake()
+{
+    if (_state != POWER_ACTIVE)
+        _enter(POWER_ACTIVE);
+    _lastActivity = _clock.read_ms();
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+bool PowerPolicy::_inWindow(uint32_t now)
+{
+    return _period && (now - _scheduleStart) % _period < _window;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+uint32_t PowerPolicy::_untilWindow(uint32_t now)
+{
+    return _period ? _period - (now - _scheduleStart) % _period : osWaitForever;
+}
+
+/**
+ * @brief   Tells whether going idle would lose or delay traffic
+ * @note    Frames queued for sending, connections being opened or closed
+ *          and unacknowledged or unsent TCP data keep the interface active,
+ *          as do open connections with UIP_POWER_HOLD_CONNECTIONS.
+ * @param
+ * @retval
+ */
+bool PowerPolicy::_busy()
+{
+    if (_ethernet->enc28j60Eth.txBusy())
+        return true;
+
+    for (uint8_t i = 0; i < UIP_CONNS; i++) {
+        struct uip_conn*    conn = &uip_conns[i];
+        uint8_t             state = conn->tcpstateflags & UIP_TS_MASK;
+
+        if (state == UIP_CLOSED || state == UIP_TIME_WAIT)
+            continue;
+#if UIP_POWER_HOLD_CONNECTIONS
+        return true;
+#endif
+        if (state != UIP_ESTABLISHED || uip_outstanding(conn))
+            return true;
+
+        uip_userdata_t*     data = (uip_userdata_t*)conn->appstate;
+        if (data && data->packets_out[0] != NOBLOCK)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Switches the controller to another state
+ * @note    Measures how long the switch takes.
+ * @param
+ * @retval
+ */
+void PowerPolicy::_enter(power_state_t state)
+{
+    Enc28j60Eth&    enc = _ethernet->enc28j60Eth;
+    Timer           timer;
+
+    timer.start();
+    if (_state == POWER_OFF)
+        enc.powerOn();
+    else
+    if (_state == POWER_STANDBY)
+        enc.clearWakePattern();
+
+    if (state == POWER_STANDBY) {
+        enc.setWakePattern(_patternOffset, _pattern, _patternMask);
+        _powerDownUs = timer.read_us();
+    }
+    else
+    if (state == POWER_OFF) {
+        enc.powerOff();
+        _powerDownUs = timer.read_us();
+    }
+    else {
+        _resumeUs = timer.read_us();
+        _linkPending = (_state == POWER_OFF);
+    }
+
+    _events.clear(1);
+
+    uint32_t    now = _clock.read_ms();
+
+    _stateMs[_state] += now - _enteredAt;
+    _enteredAt = now;
+    _lastActivity = now;
+    _state = state;
+}
@@ -0,0 +1,117 @@
+/*
+ PowerPolicy.h - idle policy powering the ENC28J60 down between report windows.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef POWERPOLICY_h
+#define POWERPOLICY_h
+
+#include "mbed.h"
+#include "utility/uipethernet-conf.h"
+
+#ifndef UIP_POWER_IDLE_MS
+#define UIP_POWER_IDLE_MS           2000
+#endif
+
+#ifndef UIP_POWER_POLL_MS
+#define UIP_POWER_POLL_MS           100
+#endif
+
+#ifndef UIP_POWER_HOLD_CONNECTIONS
+#define UIP_POWER_HOLD_CONNECTIONS  0
+#endif
+
+#define UIP_POWER_WOL_UDP           42  // magic packet in a UDP datagram (wakeonlan)
+#define UIP_POWER_WOL_ETHER         14  // magic packet in an 0x0842 frame (etherwake)
+
+typedef enum
+{
+    POWER_ACTIVE,       // normal operation, tick() runs
+    POWER_STANDBY,      // receiving wake pattern frames only, no polling
+    POWER_OFF,          // ENC28J60 in power save, wakes at the next window only
+    POWER_STATES
+} power_state_t;
+
+class UipEthernet;
+
+// Drives the interface instead of calling tick() from the main loop. The
+// ENC28J60 is active during the report windows (window ms every period ms)
+// and after any traffic; once UIP_POWER_IDLE_MS pass without a frame it
+// goes to the idle state. In POWER_STANDBY it keeps receiving, but drops
+// every frame not matching the wake pattern (a magic packet for our MAC
+// by default), and a match wakes it up. In POWER_OFF nothing is received
+// until the next window. uIP and the socket buffers stay intact in either
+// state; it never goes idle with unacknowledged TCP data or frames queued
+// for sending.
+//
+//     PowerPolicy power;
+//     power.open(&net, PB_0);              // ENC28J60 INT pin, or NC to poll
+//     power.setSchedule(60000, 5000);      // awake 5 s every minute
+//     while (true) {
+//         uint32_t    idle = power.poll();
+//         ...
+//         power.wait(idle);
+//     }
+class PowerPolicy
+{
+public:
+    PowerPolicy();
+    void            open(UipEthernet* ethernet, PinName intPin = NC);
+    void            setSchedule(uint32_t period, uint32_t window);
+    void            setIdleState(power_state_t state)   { _idleState = state; }
+    void            setIdleTimeout(uint32_t ms)         { _idleTimeout = ms; }
+    void            setWakePattern(uint16_t offset, const uint8_t* pattern, uint64_t mask);
+    void            setWakeMagicPacket(uint16_t offset = UIP_POWER_WOL_UDP);
+    uint32_t        poll();                 // returns the ms the caller may sleep
+    void            wait(uint32_t ms);      // sleeps until then or the INT pin fires
+    void            wake();                 // go active now, e.g. to send a report
+    power_state_t   state()                 { return _state; }
+
+    // measurements, to trade energy against response time
+    uint32_t        powerDownUs()           { return _powerDownUs; }    // last transition to the idle state
+    uint32_t        resumeUs()              { return _resumeUs; }       // last transition back to active
+    uint32_t        linkUpMs()              { return _linkUpMs; }       // wake up to link up, after POWER_OFF
+    uint32_t        wakeups()               { return _wakeups; }        // wakes by a pattern match
+    uint32_t        timeIn(power_state_t s) { return _stateMs[s] + (s == _state ? _clock.read_ms() - _enteredAt : 0); }
+private:
+    UipEthernet*    _ethernet;
+    InterruptIn*    _int;
+    EventFlags      _events;
+    Timer           _clock;
+    power_state_t   _state;
+    power_state_t   _idleState;
+    uint32_t        _period;
+    uint32_t        _window;
+    uint32_t        _scheduleStart;
+    uint32_t        _idleTimeout;
+    uint32_t        _lastActivity;
+    uint32_t        _lastRxFrames;
+    uint32_t        _enteredAt;
+    uint32_t        _stateMs[POWER_STATES];
+    uint32_t        _powerDownUs;
+    uint32_t        _resumeUs;
+    uint32_t        _linkUpMs;
+    uint32_t        _wakeups;
+    bool            _linkPending;
+    uint16_t        _patternOffset;
+    uint64_t        _patternMask;
+    uint8_t         _pattern[64];
+
+    bool            _inWindow(uint32_t now);
+    uint32_t        _untilWindow(uint32_t now);
+    bool            _busy();
+    void            _enter(power_state_t state);
+    void            _onInterrupt()          { _events.set(1); }
+};
+#endif
@@ -0,0 +1,425 @@
+/*
+ SntpClient.cpp - SNTP client disciplining a local clock.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "UipEthernet.h"
+#include "SntpClient.h"
+#include <string.h>
+
+#define NTP_PACKET_LEN      48
+#define NTP_UNIX_OFFSET     2208988800UL    // seconds from 1900 to 1970
+#define NTP_MAX_RATE        ((int64_t)UIP_SNTP_MAX_PPM * 4295)  // ppm in 2^-32 units
+
+/**
+ * @brief   Reads an NTP timestamp
+ * @note    Seconds below NTP_UNIX_OFFSET are taken as era 1 (2036 on).
+ * @param
+ * @retval  us since 1970
+ */
+static uint64_t fromNtp(const uint8_t* p)
+{
+    uint32_t    sec = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    uint32_t    frac = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+    uint64_t    seconds = sec >= NTP_UNIX_OFFSET ? sec - NTP_UNIX_OFFSET : sec + 0x100000000ULL - NTP_UNIX_OFFSET;
+
+    return seconds * 1000000 + (((uint64_t)frac * 1000000) >> 32);
+}
+
+/**
+ * @brief   Writes an NTP timestamp
+ * @note
+ * @param   us us since 1970
+ * @retval
+ */
+static void toNtp(uint64_t us, uint8_t* p)
+{
+    uint32_t    sec = (uint32_t)(us / 1000000 + NTP_UNIX_OFFSET);
+    uint32_t    frac = (uint32_t)(((us % 1000000) << 32) / 1000000);
+
+    for (uint8_t i = 0; i < 4; i++) {
+        p[i] = sec >> (24 - 8 * i);
+        p[4 + i] = frac >> (24 - 8 * i);
+    }
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+SntpClock::SntpClock() :
+    _gen(0)
+{
+    memset(_state, 0, sizeof(_state));
+}
+
+/**
+ * @brief   Extrapolates the time at a ticker reading
+ * @note    The slew is applied at most at 1/2048 of the elapsed time.
+ *          Readings before the base (e.g. a timestamp taken in an interrupt
+ *          just before a rebase) are extrapolated backwards, unslewed.
+ * @param   slewed Receives the part of the slew applied, may be NULL
+ * @retval
+ */
+uint64_t SntpClock::_time(const clock_state_t* s, uint32_t ticks, int32_t* slewed)
+{
+    int32_t elapsed = (int32_t)(ticks - s->ticks);
+    int64_t time = (int64_t)s->base + elapsed + (((int64_t)elapsed * s->rate) >> 32);
+    int32_t applied = 0;
+
+    if (elapsed > 0 && s->slew) {
+        int32_t max = elapsed >> 11;
+
+        if (s->slew > 0)
+            applied = s->slew < max ? s->slew : max;
+        else
+            applied = -s->slew < max ? s->slew : -max;
+    }
+
+    if (slewed)
+        *slewed = applied;
+    return time + applied;
+}
+
+/**
+ * @brief   Time of a ticker reading
+ * @note    Interrupt safe.
+ * @param   ticks A us_ticker_read() value at most 30 minutes old
+ * @retval  us since 1970, 0 if the clock was not set yet
+ */
+uint64_t SntpClock::at(uint32_t ticks)
+{
+    uint32_t    gen;
+    uint64_t    time;
+
+    do {
+        gen = _gen;
+
+        const clock_state_t*    s = &_state[gen & 1];
+
+        time = s->base ? _time(s, ticks, NULL) : 0;
+    } while (gen != _gen);
+
+    return time;
+}
+
+/**
+ * @brief   Publishes new parameters
+ * @note    The spare copy is written, then made current, so a reader never
+ *          sees a half written state unless it was interrupted by two
+ *          updates, which it detects.
+ * @param
+ * @retval
+ */
+void SntpClock::_update(const clock_state_t* s)
+{
+    uint32_t    gen = _gen;
+
+    _state[(gen + 1) & 1] = *s;
+    _gen = gen + 1;
+}
+
+/**
+ * @brief   Steps the clock
+ * @note    The remaining slew is dropped, the rate kept.
+ * @param   ticks us_ticker_read() value time belongs to
+ * @param   time us since 1970
+ * @retval
+ */
+void SntpClock::set(uint32_t ticks, uint64_t time)
+{
+    clock_state_t   s = _state[_gen & 1];
+
+    s.ticks = ticks;
+    s.base = time ? time : 1;
+    s.slew = 0;
+    _update(&s);
+}
+
+/**
+ * @brief   Moves the base to now
+ * @note    Folds the elapsed time and the slew applied so far into the base,
+ *          so the ticker difference never overflows and parameter changes
+ *          take effect from now on.
+ * @param
+ * @retval
+ */
+void SntpClock::rebase()
+{
+    clock_state_t   s = _state[_gen & 1];
+    uint32_t        ticks = us_ticker_read();
+    int32_t         slewed;
+
+    if (!s.base)
+        return;
+
+    s.base = _time(&s, ticks, &slewed);
+    s.ticks = ticks;
+    s.slew -= slewed;
+    _update(&s);
+}
+
+/**
+ * @brief   Corrects an offset gradually
+ * @note    Replaces the slew still pending: the offset was measured against
+ *          the clock including what was slewed so far.
+ * @param   offset us, positive if the clock is behind
+ * @retval
+ */
+void SntpClock::slew(int32_t offset)
+{
+    rebase();
+
+    clock_state_t   s = _state[_gen & 1];
+
+    s.slew = offset;
+    _update(&s);
+}
+
+/**
+ * @brief
+ * @note
+ * @param   rate Frequency correction in 2^-32 units (4295 per ppm)
+ * @retval
+ */
+void SntpClock::setRate(int32_t rate)
+{
+    rebase();
+
+    clock_state_t   s = _state[_gen & 1];
+
+    s.rate = rate;
+    _update(&s);
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+SntpClient::SntpClient() :
+    _host(NULL),
+    _port(UIP_SNTP_PORT),
+    _waiting(false),
+    _retry(true),
+    _sentTicks(0),
+    _sentTime(0),
+    _refTicks(0),
+    _refTime(0),
+    _offset(0),
+    _delay(0),
+    _syncs(0),
+    _steps(0),
+    _timeouts(0),
+    _rejected(0)
+{
+    memset(_origin, 0, sizeof(_origin));
+}
+
+/**
+ * @brief   Starts synchronizing
+ * @note    A host name is resolved with every request until the server
+ *          answers, then its address is kept.
+ * @param   server IP address or host name
+ * @param   port Server port
+ * @retval  1 if successful, 0 if no UDP socket was available
+ */
+uint8_t SntpClient::open(UipEthernet* ethernet, const char* server, uint16_t port)
+{
+    if (UipEthernet::ethernet != ethernet)
+        UipEthernet::ethernet = ethernet;
+
+    _host = server;
+    _port = port;
+    _server = SocketAddress();
+    if (_server.set_ip_address(server))
+        _server.set_port(port);
+    _retry = true;
+    if (!_udp.begin(UIP_SNTP_PORT))
+        return 0;
+
+    _request();
+    return 1;
+}
+
+/**
+ * @brief
+ * @note    The clock keeps running.
+ * @param
+ * @retval
+ */
+void SntpClient::close()
+{
+    _udp.stop();
+    _timer.stop();
+    _host = NULL;
+    _waiting = false;
+}
+
+/**
+ * @brief   Handles the reply and sends the next request when due
+ * @note    The reply is timestamped as soon as it is seen, the time it
+ *          waited in the receive buffer counts as network delay, so poll
+ *          often for a small offset error.
+ * @param
+ * @retval
+ */
+void SntpClient::poll()
+{
+    if (!_host)
+        return;
+
+    if (_udp.parsePacket() > 0) {
+        _reply(us_ticker_read());
+        _udp.flush();
+    }
+
+    int ms = _timer.read_ms();
+
+    if (_waiting && ms > UIP_SNTP_RETRY_MS) {
+        _waiting = false;
+        _retry = true;
+        _timeouts++;
+    }
+
+    if (!_waiting && ms >= (_retry ? UIP_SNTP_RETRY_MS : UIP_SNTP_POLL_S * 1000))
+        _request();
+}
+
+/**
+ * @brief   Sends a request
+ * @note    The transmit timestamp is taken last, right before the packet
+ *          goes out. Before the first answer it holds the raw ticker, it
+ *          only serves to match the reply then.
+ * @param
+ * @retval
+ */
+void SntpClient::_request()
+{
+    uint8_t packet[NTP_PACKET_LEN];
+    int     ok;
+
+    _clock.rebase();
+    _timer.reset();
+    _timer.start();
+    _waiting = false;
+
+    memset(packet, 0, sizeof(packet));
+    packet[0] = 0x23;                           // LI 0, version 4, mode 3 (client)
+
+    ok = _server ? _udp.beginPacket(_server) : _udp.beginPacket(_host, _port);
+    if (!ok)
+        return;
+
+    _udp.write(packet, NTP_PACKET_LEN - 8);
+    _sentTicks = us_ticker_read();
+    _sentTime = _clock.at(_sentTicks);
+    toNtp(_sentTime ? _sentTime : _sentTicks, _origin);
+    _udp.write(_origin, 8);
+    _waiting = _udp.endPacket();
+}
+
+/**
+ * @brief   Checks a reply and computes offset and delay
+ * @note    Replies from another address, not answering the last request,
+ *          from an unsynchronized server (stratum 0, kiss-o'-death, or leap
+ *          indicator 3) are rejected.
+ * @param   ticks us ticker when the reply was seen
+ * @retval
+ */
+void SntpClient::_reply(uint32_t ticks)
+{
+    uint8_t packet[NTP_PACKET_LEN];
+
+    if
+    (
+        !_waiting ||
+        _udp.read(packet, NTP_PACKET_LEN) != NTP_PACKET_LEN ||
+        (_server && _udp.remoteAddress() != _server) ||
+        (packet[0] & 0x07) != 4 ||
+        (packet[0] >> 6) == 3 ||
+        packet[1] == 0 ||
+        packet[1] > 15 ||
+        memcmp(packet + 24, _origin, 8) != 0
+    ) {
+        _rejected++;
+        return;
+    }
+
+    _waiting = false;
+    _retry = false;
+    if (!_server)
+        _server = _udp.remoteAddress();
+
+    // before the first answer our time is counted from the request
+    uint64_t    t1 = _sentTime;
+    uint64_t    t4 = _sentTime ? _clock.at(ticks) : (uint32_t)(ticks - _sentTicks);
+    uint64_t    t2 = fromNtp(packet + 32);
+    uint64_t    t3 = fromNtp(packet + 40);
+    int64_t     offset = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+    int64_t     delay = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+
+    _delay = delay > 0 ? (uint32_t)delay : 0;
+    _discipline(ticks, t4, offset);
+}
+
+/**
+ * @brief   Corrects the clock
+ * @note    The frequency is estimated from the server time against the raw
+ *          ticker since the last answer, which slewing and steps do not
+ *          disturb, and smoothed over about 8 answers.
+ * @param   ticks us ticker of the reply
+ * @param   local Our time at ticks
+ * @param   offset Server time minus ours
+ * @retval
+ */
+void SntpClient::_discipline(uint32_t ticks, uint64_t local, int64_t offset)
+{
+    uint64_t    server = local + offset;
+    bool        synced = _clock.synced();
+
+    _syncs++;
+    _offset = offset > INT32_MAX ? INT32_MAX : offset < INT32_MIN ? INT32_MIN : (int32_t)offset;
+
+    uint32_t    dt = ticks - _refTicks;
+
+    int64_t     error = (int64_t)(server - _refTime) - dt;     // us the ticker fell behind
+
+    // beyond 1000 ppm the server must have been stepped, skip the sample
+    if (synced && dt >= 16000000 && dt < 0x80000000 && error < dt / 1000 && error > -(int64_t)(dt / 1000)) {
+        int64_t rate = _clock.rate();
+
+        rate += (error * 0x100000000LL / dt - rate) / 8;
+        if (rate > NTP_MAX_RATE)
+            rate = NTP_MAX_RATE;
+        if (rate < -NTP_MAX_RATE)
+            rate = -NTP_MAX_RATE;
+        _clock.setRate((int32_t)rate);
+    }
+
+    if (!synced || dt >= 16000000) {
+        _refTicks = ticks;
+        _refTime = server;
+    }
+
+    if (!synced || offset > UIP_SNTP_STEP_MS * 1000 || offset < -UIP_SNTP_STEP_MS * 1000) {
+        _steps++;
+        _clock.set(ticks, server);
+    }
+    else
+        _clock.slew((int32_t)offset);
+}
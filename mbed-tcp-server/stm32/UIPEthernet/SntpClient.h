@@ -0,0 +1,136 @@
+/*
+ SntpClient.h - SNTP client disciplining a local clock.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SNTPCLIENT_h
+#define SNTPCLIENT_h
+
+#include <atomic>
+#include "mbed.h"
+#include "hal/us_ticker_api.h"
+#include "UdpSocket.h"
+#include "utility/uipethernet-conf.h"
+
+#ifndef UIP_SNTP_POLL_S
+#define UIP_SNTP_POLL_S     64
+#endif
+
+#ifndef UIP_SNTP_RETRY_MS
+#define UIP_SNTP_RETRY_MS   2000
+#endif
+
+#ifndef UIP_SNTP_STEP_MS
+#define UIP_SNTP_STEP_MS    128
+#endif
+
+#ifndef UIP_SNTP_MAX_PPM
+#define UIP_SNTP_MAX_PPM    500
+#endif
+
+#define UIP_SNTP_PORT       123
+
+// Wall clock in us since 1970, extrapolated from the us ticker:
+//
+//     time = base + elapsed + elapsed * rate / 2^32 + slew so far
+//
+// where elapsed is the ticker since base was taken and rate the frequency
+// correction of the crystal. An offset is removed by slewing at 1/2048
+// (488 ppm) instead of stepping, so the clock never runs backwards. now()
+// and at() only read and may be called from interrupts; the parameters are
+// double buffered and a reader retries if they were replaced meanwhile.
+// Everything else must be called from one thread.
+class SntpClock
+{
+public:
+    SntpClock();
+    uint64_t        now()                   { return at(us_ticker_read()); }
+    uint64_t        at(uint32_t ticks);     // time of an earlier us_ticker_read() reading
+    bool            synced()                { return _state[_gen & 1].base != 0; }
+    void            set(uint32_t ticks, uint64_t time);     // step, time at ticks
+    void            slew(int32_t offset);   // us to add gradually
+    void            setRate(int32_t rate);  // 2^-32 units, positive if the crystal is slow
+    int32_t         rate()                  { return _state[_gen & 1].rate; }
+    void            rebase();               // at least every 30 minutes
+private:
+    typedef struct
+    {
+        uint32_t    ticks;                  // us ticker at base
+        uint64_t    base;                   // us since 1970, 0 if not set
+        int32_t     rate;
+        int32_t     slew;                   // us still to add, signed
+    } clock_state_t;
+
+    clock_state_t           _state[2];
+    std::atomic<uint32_t>   _gen;           // _state[_gen & 1] is current
+
+    static uint64_t         _time(const clock_state_t* s, uint32_t ticks, int32_t* slewed);
+    void                    _update(const clock_state_t* s);
+};
+
+class UipEthernet;
+
+// Asks an (S)NTP server for the time every UIP_SNTP_POLL_S seconds and
+// disciplines the clock: the first answer sets it, later offsets are
+// slewed (stepped above UIP_SNTP_STEP_MS) and the crystal's frequency
+// error is estimated from the server time against the raw ticker between
+// answers, so the clock stays close between polls.
+//
+//     SntpClient  sntp;
+//     sntp.open(&net, "192.168.137.1");
+//     while (true) {
+//         sntp.poll();
+//         uint64_t    us = sntp.clock().now();     // 0 until the first answer
+//     }
+class SntpClient
+{
+public:
+    SntpClient();
+    uint8_t         open(UipEthernet* ethernet, const char* server, uint16_t port = UIP_SNTP_PORT);
+    void            close();
+    void            poll();                 // call from the main loop
+    SntpClock&      clock()                 { return _clock; }
+
+    int32_t         offset()                { return _offset; }     // last measured, us
+    uint32_t        delay()                 { return _delay; }      // last round trip, us
+    uint32_t        syncs()                 { return _syncs; }
+    uint32_t        steps()                 { return _steps; }
+    uint32_t        timeouts()              { return _timeouts; }
+    uint32_t        rejected()              { return _rejected; }   // bad or unsynchronized replies
+private:
+    UdpSocket       _udp;
+    SntpClock       _clock;
+    const char*     _host;
+    SocketAddress   _server;
+    uint16_t        _port;
+    Timer           _timer;                 // since the last request
+    bool            _waiting;
+    bool            _retry;                 // the last request was not answered
+    uint32_t        _sentTicks;
+    uint64_t        _sentTime;              // our time at _sentTicks, 0 if not synced
+    uint8_t         _origin[8];             // transmit timestamp of the request
+    uint32_t        _refTicks;              // raw ticker and server time at the last answer
+    uint64_t        _refTime;
+    int32_t         _offset;
+    uint32_t        _delay;
+    uint32_t        _syncs;
+    uint32_t        _steps;
+    uint32_t        _timeouts;
+    uint32_t        _rejected;
+
+    void            _request();
+    void            _reply(uint32_t ticks);
+    void            _discipline(uint32_t ticks, uint64_t local, int64_t offset);
+};
+#endif
@@ -23,15 +23,18 @@ extern "C"
 #include "utility/uip-conf.h"
 #include "utility/uip.h"
 #include "utility/uip_arp.h"
+#include "utility/ip6string.h"
 #include "string.h"
 }
 #include "UipEthernet.h"
 #include "TcpClient.h"
 #include "DnsClient.h"
+#include "utility/uip_trace.h"
 
 #define UIP_TCP_PHYH_LEN    UIP_LLH_LEN + UIP_IPTCPH_LEN
 
 uip_userdata_t TcpClient::all_data[UIP_CONNS];
+uint32_t       TcpClient::_reclaimed = 0;
 
 /**
  * @brief
@@ -41,7 +44,9 @@ uip_userdata_t TcpClient::all_data[UIP_CONNS];
  */
 TcpClient::TcpClient() :
     data(NULL),
-    _instance(NULL)
+    _instance(NULL),
+    _pending(NULL),
+    _pendingPort(0)
 { }
 
 /**
@@ -52,7 +57,9 @@ TcpClient::TcpClient() :
  */
 TcpClient::TcpClient(uip_userdata_t* conn_data) :
     data(conn_data),
-    _instance(NULL)
+    _instance(NULL),
+    _pending(NULL),
+    _pendingPort(0)
 { }
 
 /**
@@ -133,6 +140,85 @@ int TcpClient::connect(const char* host, uint16_t port)
     return ret;
 }
 
+/**
+ * @brief   Starts connecting without waiting for the handshake
+ * @note    connecting() tells when the handshake is over, connected() how
+ *          it ended. connect() waits for it instead.
+ * @param
+ * @retval  0 if the SYN is on its way, 1 if no connection is free
+ */
+int TcpClient::startConnect(IpAddress ip, uint16_t port)
+{
+    stop();
+
+    uip_ipaddr_t    ipaddr;
+    uip_ip_addr(ipaddr, ip);
+
+    _pending = uip_connect(&ipaddr, htons(port));
+    if (!_pending)
+        return 1;
+
+    _pendingPort = _pending->lport;
+    return 0;
+}
+
+/**
+ * @brief   Starts connecting to a host name without waiting for the handshake
+ * @note    A numeric address is used as it is, a name is looked up first,
+ *          which waits for the DNS server like connect().
+ * @param
+ * @retval  0 if the SYN is on its way, 1 if not, a DnsClient error if the
+ *          name could not be resolved
+ */
+int TcpClient::startConnect(const char* host, uint16_t port)
+{
+    int         ret = 0;
+#if UIP_UDP
+    DnsClient   dns;
+    IpAddress   remote_addr;
+
+    dns.begin(UipEthernet::dnsServerAddress);
+    ret = dns.getHostByName(host, remote_addr);
+    if (ret == 1) {
+        return startConnect(remote_addr, port);
+    }
+#endif
+    return ret;
+}
+
+/**
+ * @brief   Follows the handshake started by startConnect()
+ * @note    Call it from the main loop; uIP gives up after UIP_MAXSYNRTX
+ *          retransmissions of the SYN.
+ * @param
+ * @retval  1 while the handshake runs, 0 once it is over
+ */
+uint8_t TcpClient::connecting()
+{
+    if (!_pending)
+        return 0;
+
+    UipEthernet::ethernet->tick();
+
+    // the slot was closed and handed to another connection meanwhile
+    if (_pending->lport != _pendingPort) {
+        _pending = NULL;
+        return 0;
+    }
+
+    switch (_pending->tcpstateflags & UIP_TS_MASK) {
+    case UIP_SYN_SENT:
+        return 1;
+
+    case UIP_ESTABLISHED:
+        data = (uip_userdata_t*)_pending->appstate;     // NULL if no socket was left
+        break;
+    }
+
+    _pending = NULL;
+    return 0;
+}
+
 /**
  * @brief
  * @note
@@ -141,6 +227,13 @@ int TcpClient::connect(const char* host, uint16_t port)
  */
 void TcpClient::stop()
 {
+    // a handshake still running is dropped without RST, the peer times out
+    if (_pending) {
+        if (_pending->lport == _pendingPort && (_pending->tcpstateflags & UIP_TS_MASK) == UIP_SYN_SENT)
+            _pending->tcpstateflags = UIP_CLOSED;
+        _pending = NULL;
+    }
+
     if (data && data->state)
     {
 #ifdef UIPETHERNET_DEBUG_CLIENT
@@ -256,7 +349,7 @@ int TcpClient::_write(uip_userdata_t* data, const uint8_t* buf, size_t size)
         if (data->packets_out[p] == NOBLOCK)
         {
 newpacket:
-            data->packets_out[p] = UipEthernet::ethernet->enc28j60Eth.allocBlock(UIP_SOCKET_DATALEN);
+            data->packets_out[p] = UipEthernet::ethernet->enc28j60Eth.allocBlock(UIP_SOCKET_DATALEN, MEMPOOL_TX_RESERVE);
             if (data->packets_out[p] == NOBLOCK)
             {
 #if UIP_ATTEMPTS_ON_WRITE > 0
@@ -452,9 +545,16 @@ IpAddress TcpClient::getRemoteIp()
  */
 const char* TcpClient::getpeername()
 {
+#if UIP_CONF_IPV6
+    static char buf[40];
+
+    ip6tos(data->ripaddr, buf);
+    return buf;
+#else
     static char buf[16];
 
     return getRemoteIp().toString(buf);
+#endif
 }
 
 /**
@@ -478,6 +578,8 @@ void TcpClient::close()
  */
 void uipclient_appcall()
 {
+    UIP_TRACE_SCOPE(UIP_TRACE_APPCALL);
+
     uint16_t            send_len = 0;
     uip_userdata_t*     u = (uip_userdata_t*)uip_conn->appstate;
     if (!u && uip_connected())
@@ -486,18 +588,27 @@ void uipclient_appcall()
         printf("UIPClient uip_connected\r\n");
         UIPClient::_dumpAllData();
 #endif
-        u = (uip_userdata_t*)TcpClient::_allocateData();
+        TcpServer*  server = TcpServer::_find(uip_conn->lport);
+
+        if (!server || server->_queued < server->_backlog)
+            u = (uip_userdata_t*)TcpClient::_allocateData();
         if (u) {
             uip_conn->appstate = u;
+            if (server)
+                server->_queue[server->_queued++] = u;
 #ifdef UIPETHERNET_DEBUG_CLIENT
             printf("UIPClient allocated state: %d", u->state);
 #endif
         }
-
+        else {
+            // accept queue full or no socket left, refuse instead of keeping a connection nobody serves
 #ifdef UIPETHERNET_DEBUG_CLIENT
-        else
             printf("UIPClient allocation failed\r\n");
 #endif
+            if (server)
+                server->_dropped++;
+            uip_abort();
+        }
     }
 
     if (u) {
@@ -509,7 +620,7 @@ void uipclient_appcall()
             if (uip_len && !(u->state & (UIP_CLIENT_CLOSE | UIP_CLIENT_REMOTECLOSED))) {
                 for (uint8_t i = 0; i < UIP_SOCKET_NUMPACKETS; i++) {
                     if (u->packets_in[i] == NOBLOCK) {
-                        u->packets_in[i] = UipEthernet::ethernet->enc28j60Eth.allocBlock(uip_len);
+                        u->packets_in[i] = UipEthernet::ethernet->enc28j60Eth.allocBlock(uip_len, MEMPOOL_TX_RESERVE);
                         if (u->packets_in[i] != NOBLOCK) {
                             UipEthernet::ethernet->enc28j60Eth.copyPacket
                                 (
@@ -526,8 +637,15 @@ void uipclient_appcall()
                     }
                 }
 
-                UipEthernet::packetState &= ~UIPETHERNET_FREEPACKET;
-                uip_stop();
+                // no block for the data: it is taken back from the ACK and the
+                // peer sends it again, a zero window would never be reopened
+                uint8_t*    nxt = uip_conn->rcv_nxt;
+                uint32_t    acked = ((uint32_t)nxt[0] << 24 | (uint32_t)nxt[1] << 16 | nxt[2] << 8 | nxt[3]) - uip_len;
+
+                nxt[0] = acked >> 24;
+                nxt[1] = acked >> 16;
+                nxt[2] = acked >> 8;
+                nxt[3] = acked;
             }
         }
 
@@ -547,6 +665,12 @@ finish_newdata:
             // drop outgoing packets not sent yet:
 
             TcpClient::_flushBlocks(&u->packets_out[0]);
+
+            // a dead or idle peer is not going to be served anymore, reclaim the slot:
+            if (uip_timedout() && uip_idletimedout()) {
+                TcpClient::_flushBlocks(&u->packets_in[0]);
+                TcpClient::_reclaimed++;
+            }
             if (u->packets_in[0] != NOBLOCK) {
                 ((uip_userdata_closed_t*)u)->lport = uip_conn->lport;
                 u->state |= UIP_CLIENT_REMOTECLOSED;
@@ -571,7 +695,8 @@ finish_newdata:
             TcpClient::_eatBlock(&u->packets_out[0]);
         }
 
-        if (uip_poll() || uip_rexmit())
+        // the next block goes out with the ACK of the last one, not a timer pulse later
+        if (uip_poll() || uip_rexmit() || uip_acked())
         {
 #ifdef UIPETHERNET_DEBUG_CLIENT
             //printf("UIPClient uip_poll\r\n");
@@ -646,10 +771,10 @@ uip_userdata_t* TcpClient::_allocateData()
     for (uint8_t sock = 0; sock < UIP_CONNS; sock++) {
         uip_userdata_t*     data = &TcpClient::all_data[sock];
         if (!data->state) {
+            TcpServer::_forget(data);
             data->pollTimer.reset();
             data->state = sock | UIP_CLIENT_CONNECTED;
-            data->ripaddr[0] = 0;
-            data->ripaddr[1] = 0;
+            memset(data->ripaddr, 0, sizeof(data->ripaddr));
             memset(data->packets_in, 0, sizeof(data->packets_in) / sizeof(data->packets_in[0]));
             memset(&data->packets_out, 0, sizeof(data->packets_out) / sizeof(data->packets_out[0]));
             data->out_pos = 0;
@@ -71,6 +71,9 @@ public:
     int                     open(UipEthernet* ethernet);
     int                     connect(IpAddress ip, uint16_t port);
     int                     connect(const char* host, uint16_t port);
+    int                     startConnect(IpAddress ip, uint16_t port);
+    int                     startConnect(const char* host, uint16_t port);
+    uint8_t                 connecting();
     int                     recv(uint8_t* buf, size_t size);
     void                    stop();
     uint8_t                 connected();
@@ -89,6 +92,7 @@ public:
     void                    close();
 
     static uip_userdata_t   all_data[UIP_CONNS];
+    static uint32_t         _reclaimed;
     static int             _write(uip_userdata_t* , const uint8_t* buf, size_t size);
 
 protected:
@@ -97,6 +101,8 @@ protected:
 private:
     uip_userdata_t*         data;
     TcpClient*              _instance;
+    struct uip_conn*        _pending;   // SYN sent by startConnect()
+    uint16_t                _pendingPort;
     static uip_userdata_t*  _allocateData();
     static size_t           _available(uip_userdata_t* );
     static uint8_t          _currentBlock(memhandle* blocks);
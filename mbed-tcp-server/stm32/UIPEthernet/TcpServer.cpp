@@ -22,6 +22,8 @@ extern "C"
 {
 #include "utility/uip-conf.h"
 }
+TcpServer*  TcpServer::_listeners[UIP_LISTENPORTS];
+
 /**
  * @brief
  * @note
@@ -29,7 +31,10 @@ extern "C"
  * @retval
  */
 TcpServer::TcpServer() :
-    _conns(1)
+    _port(0),
+    _backlog(1),
+    _queued(0),
+    _dropped(0)
 {}
 
 /**
@@ -38,22 +43,41 @@ TcpServer::TcpServer() :
  * @param
  * @retval
  */
+TcpServer::~TcpServer()
+{
+    for (uint8_t i = 0; i < UIP_LISTENPORTS; i++) {
+        if (_listeners[i] == this) {
+            _listeners[i] = NULL;
+            uip_unlisten(_port);
+        }
+    }
+}
+
+/**
+ * @brief   Returns the next connection from the accept queue
+ * @note    Connections are handed out in the order they were established,
+ *          as soon as they have data to read (or were closed with unread
+ *          data). Connections closed before sending anything are dropped
+ *          from the queue.
+ * @param
+ * @retval  New client or NULL
+ */
 TcpClient* TcpServer::accept()
 {
     TcpClient* result = NULL;
 
     UipEthernet::ethernet->tick();
-    for (uip_userdata_t * data = &TcpClient::all_data[0]; data < &TcpClient::all_data[_conns]; data++) {
-        if
-        (
-            data->packets_in[0] != NOBLOCK &&
-            (
-                ((data->state & UIP_CLIENT_CONNECTED) && uip_conns[data->state & UIP_CLIENT_SOCKETS].lport == _port) ||
-                ((data->state & UIP_CLIENT_REMOTECLOSED) && ((uip_userdata_closed_t*)data)->lport == _port)
-            )
-        ) {
-            data->ripaddr[0] =  uip_conns[data->state & UIP_CLIENT_SOCKETS].ripaddr[0];
-            data->ripaddr[1] =  uip_conns[data->state & UIP_CLIENT_SOCKETS].ripaddr[1];
+    for (uint8_t i = 0; i < _queued; i++) {
+        uip_userdata_t*     data = _queue[i];
+
+        if (!(data->state & (UIP_CLIENT_CONNECTED | UIP_CLIENT_REMOTECLOSED))) {
+            _remove(i--);
+            continue;
+        }
+
+        if (data->packets_in[0] != NOBLOCK) {
+            _remove(i);
+            uip_ipaddr_copy(data->ripaddr, uip_conns[data->state & UIP_CLIENT_SOCKETS].ripaddr);
             result = new TcpClient(data);
             result->setInstance(result);
             return result;
@@ -81,7 +105,7 @@ void TcpServer::open(UipEthernet* ethernet)
  * @param
  * @retval
  */
-void TcpServer::bind(uint8_t port)
+void TcpServer::bind(uint16_t port)
 {
     _port = htons(port);
 }
@@ -92,7 +116,7 @@ void TcpServer::bind(uint8_t port)
  * @param
  * @retval
  */
-void TcpServer::bind(const char* ip, uint8_t port)
+void TcpServer::bind(const char* ip, uint16_t port)
 {
     _port = htons(port);
 }
@@ -103,9 +127,23 @@ void TcpServer::bind(const char* ip, uint8_t port)
  * @param
  * @retval
  */
-void TcpServer::listen(uint8_t conns)
+void TcpServer::listen(uint8_t backlog)
 {
-    _conns = _conns < UIP_CONNS ? conns : UIP_CONNS;
+    uint8_t slot = UIP_LISTENPORTS;
+
+    _backlog = backlog == 0 ? 1 : backlog < UIP_CONNS ? backlog : UIP_CONNS;
+    for (uint8_t i = 0; i < UIP_LISTENPORTS; i++) {
+        if (_listeners[i] == this || (_listeners[i] && _listeners[i]->_port == _port)) {
+            slot = i;
+            break;
+        }
+
+        if (_listeners[i] == NULL && slot == UIP_LISTENPORTS)
+            slot = i;
+    }
+
+    if (slot < UIP_LISTENPORTS)
+        _listeners[slot] = this;
     uip_listen(_port);
     UipEthernet::ethernet->tick();
 }
@@ -130,10 +168,87 @@ size_t TcpServer::send(uint8_t c)
 size_t TcpServer::send(const uint8_t* buf, size_t size)
 {
     size_t  ret = 0;
-    for (uip_userdata_t * data = &TcpClient::all_data[0]; data < &TcpClient::all_data[_conns]; data++) {
+    for (uip_userdata_t * data = &TcpClient::all_data[0]; data < &TcpClient::all_data[UIP_CONNS]; data++) {
         if ((data->state & UIP_CLIENT_CONNECTED) && uip_conns[data->state & UIP_CLIENT_SOCKETS].lport == _port)
             ret += TcpClient::_write(data, buf, size);
     }
 
     return ret;
 }
+
+/**
+ * @brief   Number of SYNs answered with a SYN cookie
+ * @note
+ * @param
+ * @retval
+ */
+uint32_t TcpServer::synCookiesSent()
+{
+#if UIP_SYN_COOKIES
+    return uip_syncookies_sent;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief   Number of connections set up from a SYN cookie
+ * @note
+ * @param
+ * @retval
+ */
+uint32_t TcpServer::synCookiesAccepted()
+{
+#if UIP_SYN_COOKIES
+    return uip_syncookies_accepted;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief   Returns the server listening on a port
+ * @note
+ * @param   port Port in network byte order
+ * @retval
+ */
+TcpServer* TcpServer::_find(uint16_t port)
+{
+    for (uint8_t i = 0; i < UIP_LISTENPORTS; i++) {
+        if (_listeners[i] && _listeners[i]->_port == port)
+            return _listeners[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief   Removes a socket about to be reused from every accept queue
+ * @note
+ * @param
+ * @retval
+ */
+void TcpServer::_forget(uip_userdata_t* data)
+{
+    for (uint8_t i = 0; i < UIP_LISTENPORTS; i++) {
+        TcpServer*  server = _listeners[i];
+        if (server) {
+            for (uint8_t j = 0; j < server->_queued; j++) {
+                if (server->_queue[j] == data)
+                    server->_remove(j--);
+            }
+        }
+    }
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void TcpServer::_remove(uint8_t i)
+{
+    for (_queued--; i < _queued; i++)
+        _queue[i] = _queue[i + 1];
+}
@@ -27,15 +27,32 @@ class TcpServer
 {
 public:
     TcpServer();
+    ~TcpServer();
     void        open(UipEthernet* ethernet);
-    void        bind(uint8_t port);
-    void        bind(const char* ip, uint8_t port);
-    void        listen(uint8_t conns);
+    void        bind(uint16_t port);
+    void        bind(const char* ip, uint16_t port);
+    void        listen(uint8_t backlog);
     TcpClient*  accept();
     size_t      send(uint8_t);
     size_t      send(const uint8_t* buf, size_t size);
+    uint32_t    reclaimed()     { return TcpClient::_reclaimed; }   // connections dropped by keep-alive or idle timeout
+    uint8_t     pending()       { return _queued; }                 // connections waiting in the accept queue
+    uint32_t    dropped()       { return _dropped; }                // connections refused with the queue full
+    static uint32_t synCookiesSent();
+    static uint32_t synCookiesAccepted();
 private:
-    uint16_t    _port;
-    uint8_t     _conns;
+    uint16_t        _port;
+    uint8_t         _backlog;
+    uip_userdata_t* _queue[UIP_CONNS];
+    uint8_t         _queued;
+    uint32_t        _dropped;
+
+    static TcpServer*   _listeners[UIP_LISTENPORTS];
+    static TcpServer*   _find(uint16_t port);
+    static void         _forget(uip_userdata_t* data);
+    void                _remove(uint8_t i);
+
+    friend class        TcpClient;
+    friend void         uipclient_appcall();
 };
 #endif
@@ -19,6 +19,7 @@
 #include "UipEthernet.h"
 #include "UdpSocket.h"
 #include "DnsClient.h"
+#include "utility/PacketCapture.h"
 
 extern "C"
 {
@@ -27,8 +28,15 @@ extern "C"
 #include "utility/uip_arp.h"
 }
 #if UIP_UDP
-#define UIP_ARPHDRSIZE  42
 #define UDPBUF          ((struct uip_udpip_hdr*) &uip_buf[UIP_LLH_LEN])
+#define ETHBUF          ((struct uip_eth_hdr*) &uip_buf[0])
+
+typedef struct
+{
+    uip_ipaddr_t        ripaddr;
+    struct uip_eth_hdr  ethhdr;     // prebuilt ethernet header, valid if resolved
+    bool                resolved;
+} udp_batch_peer_t;
 
 /**
  * @brief
@@ -81,6 +89,8 @@ uint8_t UdpSocket::begin(uint16_t port)
     if (_uip_udp_conn) {
         uip_udp_bind(_uip_udp_conn, htons(port));
         _uip_udp_conn->appstate = &appdata;
+        appdata.bound = true;
+        _listen(_uip_udp_conn);
         return 1;
     }
 
@@ -94,8 +104,8 @@ void UdpSocket::stop()
         uip_udp_remove(_uip_udp_conn);
         _uip_udp_conn->appstate = NULL;
         _uip_udp_conn = NULL;
-        UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.packet_in);
-        UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.packet_next);
+        UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.in.packet);
+        _flushQueue(&appdata);
         UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.packet_out);
         memset(&appdata, 0, sizeof(appdata));
     }
@@ -117,20 +127,61 @@ void UdpSocket::close()
 
 // Returns 1 if successful, 0 if there was a problem with the supplied IP address or port
 int UdpSocket::beginPacket(IpAddress ip, uint16_t port)
+{
+    uip_ipaddr_t    ripaddr;
+
+    if (!ip) {
+        port = 0;
+    }
+
+    uip_ip_addr(ripaddr, ip);
+    return _beginPacket(ripaddr, port);
+}
+
+/**
+ * @brief   Starts building up a packet to an IPv4 or IPv6 address
+ * @note
+ * @param
+ * @retval  1 if successful, 0 if there was a problem with the address
+ */
+int UdpSocket::beginPacket(const SocketAddress& address)
+{
+    uip_ipaddr_t    ripaddr;
+
+    if (!_toUip(address, ripaddr))
+        return 0;
+
+    return _beginPacket(ripaddr, address.get_port());
+}
+
+/**
+ * @brief   Starts building up a packet to the given uIP address
+ * @note    Shared by beginPacket and sendto, IPv6 addresses reach the
+ *          connection without going through IpAddress. A socket bound with
+ *          begin() keeps taking datagrams from any peer, the destination is
+ *          put on the connection only while the datagram is built.
+ * @param   ripaddr Remote address
+ * @param   port Remote port, 0 to keep the current destination
+ * @retval  1 if successful, 0 otherwise
+ */
+int UdpSocket::_beginPacket(uip_ipaddr_t ripaddr, uint16_t port)
 {
     UipEthernet::ethernet->tick();
-    if (ip && port) {
-        uip_ipaddr_t    ripaddr;
-        uip_ip_addr(&ripaddr, ip);
+    if (port) {
 #ifdef UIPETHERNET_DEBUG_UDP
         printf("udp beginPacket, ");
 #endif
+        if (_uip_udp_conn && appdata.bound) {
+            appdata.out_rport = htons(port);
+            uip_ipaddr_copy(appdata.out_ripaddr, ripaddr);
+        }
+        else
         if (_uip_udp_conn) {
             _uip_udp_conn->rport = htons(port);
-            uip_ipaddr_copy(_uip_udp_conn->ripaddr, &ripaddr);
+            uip_ipaddr_copy(_uip_udp_conn->ripaddr, ripaddr);
         }
         else {
-            _uip_udp_conn = uip_udp_new(&ripaddr, htons(port));
+            _uip_udp_conn = uip_udp_new((uip_ipaddr_t*)ripaddr, htons(port));
             if (_uip_udp_conn)
             {
 #ifdef UIPETHERNET_DEBUG_UDP
@@ -148,8 +199,7 @@ int UdpSocket::beginPacket(IpAddress ip, uint16_t port)
         }
 
 #ifdef UIPETHERNET_DEBUG_UDP
-        char buf[16];
-        printf("rip: %s, port: %d\r\n", ip.toString(buf), port);
+        printf("rport: %d\r\n", port);
 #endif
     }
 
@@ -206,6 +256,7 @@ int UdpSocket::endPacket()
         appdata.send = true;
         UipEthernet::ethernet->enc28j60Eth.resizeBlock(appdata.packet_out, 0, appdata.out_pos);
         uip_udp_periodic_conn(_uip_udp_conn);
+        _listen(_uip_udp_conn);
         if (uip_len > 0) {
             _send(&appdata);
             return 1;
@@ -246,25 +297,31 @@ int UdpSocket::parsePacket()
 {
     UipEthernet::ethernet->tick();
 #ifdef UIPETHERNET_DEBUG_UDP
-    if (appdata.packet_in != NOBLOCK) {
-        printf("udp parsePacket freeing previous packet: %d\r\n", appdata.packet_in);
+    if (appdata.in.packet != NOBLOCK) {
+        printf("udp parsePacket freeing previous packet: %d\r\n", appdata.in.packet);
     }
 #endif
-    UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.packet_in);
-
-    appdata.packet_in = appdata.packet_next;
-    appdata.packet_next = NOBLOCK;
+    UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.in.packet);
+    appdata.in.packet = NOBLOCK;
+
+    // pop the oldest datagram from the receive queue
+    if (appdata.next_count > 0) {
+        appdata.in = appdata.packets_next[appdata.next_head];
+        appdata.packets_next[appdata.next_head].packet = NOBLOCK;
+        appdata.next_head = (appdata.next_head + 1) % UIP_UDP_NUMPACKETS;
+        appdata.next_count--;
+    }
 
 #ifdef UIPETHERNET_DEBUG_UDP
-    if (appdata.packet_in != NOBLOCK) {
-        printf("udp parsePacket received packet: %d", appdata.packet_in);
+    if (appdata.in.packet != NOBLOCK) {
+        printf("udp parsePacket received packet: %d", appdata.in.packet);
     }
 #endif
 
-    int size = UipEthernet::ethernet->enc28j60Eth.blockSize(appdata.packet_in);
+    int size = UipEthernet::ethernet->enc28j60Eth.blockSize(appdata.in.packet);
 #ifdef UIPETHERNET_DEBUG_UDP
-    if (appdata.packet_in != NOBLOCK) {
-        printf(", size: %d\r\n", size);
+    if (appdata.in.packet != NOBLOCK) {
+        printf(", size: %d, queued: %d\r\n", size, appdata.next_count);
     }
 #endif
     return size;
@@ -274,7 +331,7 @@ int UdpSocket::parsePacket()
 size_t UdpSocket::available()
 {
     UipEthernet::ethernet->tick();
-    return UipEthernet::ethernet->enc28j60Eth.blockSize(appdata.packet_in);
+    return UipEthernet::ethernet->enc28j60Eth.blockSize(appdata.in.packet);
 }
 
 // Read a single byte from the current packet. Returns -1 if no byte is available.
@@ -294,14 +351,14 @@ int UdpSocket::read()
 size_t UdpSocket::read(unsigned char* buffer, size_t len)
 {
     UipEthernet::ethernet->tick();
-    if (appdata.packet_in != NOBLOCK) {
-        memaddress  read = UipEthernet::ethernet->enc28j60Eth.readPacket(appdata.packet_in, 0, buffer, len);
-        if (read == UipEthernet::ethernet->enc28j60Eth.blockSize(appdata.packet_in)) {
-            UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.packet_in);
-            appdata.packet_in = NOBLOCK;
+    if (appdata.in.packet != NOBLOCK) {
+        memaddress  read = UipEthernet::ethernet->enc28j60Eth.readPacket(appdata.in.packet, 0, buffer, len);
+        if (read == UipEthernet::ethernet->enc28j60Eth.blockSize(appdata.in.packet)) {
+            UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.in.packet);
+            appdata.in.packet = NOBLOCK;
         }
         else
-            UipEthernet::ethernet->enc28j60Eth.resizeBlock(appdata.packet_in, read);
+            UipEthernet::ethernet->enc28j60Eth.resizeBlock(appdata.in.packet, read);
         return read;
     }
 
@@ -312,9 +369,9 @@ size_t UdpSocket::read(unsigned char* buffer, size_t len)
 int UdpSocket::peek()
 {
     UipEthernet::ethernet->tick();
-    if (appdata.packet_in != NOBLOCK) {
+    if (appdata.in.packet != NOBLOCK) {
         unsigned char   c;
-        if (UipEthernet::ethernet->enc28j60Eth.readPacket(appdata.packet_in, 0, &c, 1) == 1)
+        if (UipEthernet::ethernet->enc28j60Eth.readPacket(appdata.in.packet, 0, &c, 1) == 1)
             return c;
     }
 
@@ -325,53 +382,109 @@ int UdpSocket::peek()
 void UdpSocket::flush()
 {
     UipEthernet::ethernet->tick();
-    UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.packet_in);
-    appdata.packet_in = NOBLOCK;
+    UipEthernet::ethernet->enc28j60Eth.freeBlock(appdata.in.packet);
+    appdata.in.packet = NOBLOCK;
 }
 
 // Return the IP address of the host who sent the current incoming packet
 IpAddress UdpSocket::remoteIP()
 {
+    if (appdata.in.rport)
+        return ip_addr_uip(appdata.in.ripaddr);
     return _uip_udp_conn ? ip_addr_uip(_uip_udp_conn->ripaddr) : IpAddress();
 }
 
 // Return the port of the host who sent the current incoming packet
 uint16_t UdpSocket::remotePort()
 {
+    if (appdata.in.rport)
+        return ntohs(appdata.in.rport);
     return _uip_udp_conn ? ntohs(_uip_udp_conn->rport) : 0;
 }
 
+/**
+ * @brief   Returns the address of the host who sent the current incoming packet
+ * @note    An IPv6 address when the stack runs on IPv6.
+ * @param
+ * @retval
+ */
+SocketAddress UdpSocket::remoteAddress()
+{
+#if UIP_CONF_IPV6
+    if (appdata.in.rport)
+        return SocketAddress(appdata.in.ripaddr, NSAPI_IPv6, remotePort());
+    return _uip_udp_conn ? SocketAddress(_uip_udp_conn->ripaddr, NSAPI_IPv6, remotePort()) : SocketAddress();
+#else
+    uint32_t    address_bytes = remoteIP();
+
+    return SocketAddress(&address_bytes, NSAPI_IPv4, remotePort());
+#endif
+}
+
+/**
+ * @brief   Converts a SocketAddress to a uIP address
+ * @note
+ * @param
+ * @retval  false if the address can't be used with the stack's IP version
+ */
+bool UdpSocket::_toUip(const SocketAddress& address, uip_ipaddr_t ripaddr)
+{
+    switch (address.get_ip_version()) {
+        case NSAPI_IPv4:
+            uip_ip_addr(ripaddr, IpAddress(address.get_addr().bytes));
+            return true;
+#if UIP_CONF_IPV6
+        case NSAPI_IPv6:
+            memcpy(ripaddr, address.get_addr().bytes, sizeof(uip_ipaddr_t));
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
 // UIP callback function
 void uipudp_appcall()
 {
     if (uip_udp_userdata_t * data = (uip_udp_userdata_t *) (uip_udp_conn->appstate)) {
         if (uip_newdata()) {
-            if (data->packet_next == NOBLOCK) {
-                uip_udp_conn->rport = UDPBUF->srcport;
-                uip_ipaddr_copy(uip_udp_conn->ripaddr, UDPBUF->srcipaddr);
-                data->packet_next = UipEthernet::ethernet->enc28j60Eth.allocBlock(ntohs(UDPBUF->udplen) - UIP_UDPH_LEN);
+            if (data->next_count < UIP_UDP_NUMPACKETS) {
+                uip_udp_datagram_t*     next = &data->packets_next
+                    [
+                        (data->next_head + data->next_count) % UIP_UDP_NUMPACKETS
+                    ];
+                next->packet = UipEthernet::ethernet->enc28j60Eth.allocBlock(ntohs(UDPBUF->udplen) - UIP_UDPH_LEN, MEMPOOL_TX_RESERVE);
 
                 //if we are unable to allocate memory the packet is dropped. udp doesn't guarantee packet delivery
-                if (data->packet_next != NOBLOCK) {
+                if (next->packet != NOBLOCK) {
+                    next->rport = UDPBUF->srcport;
+                    uip_ipaddr_copy(next->ripaddr, UDPBUF->srcipaddr);
+
                     //discard Linklevel and IP and udp-header and any trailing bytes:
                     UipEthernet::ethernet->enc28j60Eth.copyPacket
                         (
-                            data->packet_next,
+                            next->packet,
                             0,
                             UipEthernet::inPacket,
                             UIP_UDP_PHYH_LEN,
-                            UipEthernet::ethernet->enc28j60Eth.blockSize(data->packet_next)
+                            UipEthernet::ethernet->enc28j60Eth.blockSize(next->packet)
                         );
+                    data->next_count++;
 #ifdef UIPETHERNET_DEBUG_UDP
                     printf
                     (
-                        "udp, uip_newdata received packet: %d, size: %d\r\n",
-                        data->packet_next,
-                        UipEthernet::ethernet->enc28j60Eth.blockSize(data->packet_next)
+                        "udp, uip_newdata received packet: %d, size: %d, queued: %d\r\n",
+                        next->packet,
+                        UipEthernet::ethernet->enc28j60Eth.blockSize(next->packet),
+                        data->next_count
                     );
 #endif
                 }
+                else
+                    data->drops_nomem++;
             }
+            else
+                data->drops_full++;
         }
 
         if (uip_poll() && data->send)
@@ -387,11 +500,189 @@ void uipudp_appcall()
 #endif
             UipEthernet::uipPacket = data->packet_out;
             UipEthernet::uipHeaderLen = UIP_UDP_PHYH_LEN;
+
+            // uip_process builds the header from the connection, _listen()
+            // clears it again
+            if (data->bound) {
+                uip_udp_conn->rport = data->out_rport;
+                uip_ipaddr_copy(uip_udp_conn->ripaddr, data->out_ripaddr);
+            }
+
             uip_udp_send(data->out_pos - (UIP_UDP_PHYH_LEN));
         }
     }
 }
 
+/**
+ * @brief   Sends a batch of datagrams (sendmmsg)
+ * @note    The frames are assembled here instead of going through
+ *          uip_process: the ARP table is consulted once per destination,
+ *          the UDP checksum is computed from RAM rather than read back over
+ *          SPI and the payload of the next frame is written into the
+ *          ENC28J60 while the previous one is on the wire. Datagrams to a
+ *          destination without ARP entry are not sent (len = 0); a single
+ *          ARP request is issued for it so that a retry succeeds.
+ * @param   msgs Array of messages, address, data and size must be set
+ * @param   count Number of elements in msgs
+ * @retval  Number of datagrams sent or NSAPI_ERROR_NO_SOCKET
+ */
+nsapi_size_or_error_t UdpSocket::sendmmsg(udp_msg_t* msgs, unsigned int count)
+{
+#if UIP_CONF_IPV6
+    // the frames are assembled with an IPv4 header
+    return NSAPI_ERROR_UNSUPPORTED;
+#else
+    udp_batch_peer_t    peers[UIP_UDP_BATCH_PEERS];
+    uint8_t             numPeers = 0;
+    uint8_t             hdr[UIP_UDP_PHYH_LEN];
+    struct uip_udpip_hdr*   iphdr = (struct uip_udpip_hdr*) &hdr[UIP_LLH_LEN];
+    unsigned int        sent = 0;
+
+    UipEthernet::ethernet->tick();
+    if (!_uip_udp_conn) {
+        _uip_udp_conn = uip_udp_new(NULL, 0);
+        if (!_uip_udp_conn)
+            return NSAPI_ERROR_NO_SOCKET;
+        _uip_udp_conn->appstate = &appdata;
+    }
+
+    // messages after a failed allocation stay unsent
+    for (unsigned int i = 0; i < count; i++)
+        msgs[i].len = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        uint16_t        size = msgs[i].size;
+        uip_ipaddr_t    ripaddr;
+        memhandle       packet;
+
+        if (size > UIP_UDP_MAXDATALEN - UIP_IPUDPH_LEN)
+            continue;
+
+        if (!_toUip(msgs[i].address, ripaddr))
+            continue;
+
+        // resolve the destination once per batch
+        udp_batch_peer_t*   peer = NULL;
+        for (uint8_t p = 0; p < numPeers; p++) {
+            if (uip_ipaddr_cmp(peers[p].ripaddr, ripaddr)) {
+                peer = &peers[p];
+                break;
+            }
+        }
+
+        if (!peer) {
+            peer = &peers[numPeers < UIP_UDP_BATCH_PEERS ? numPeers++ : i % UIP_UDP_BATCH_PEERS];
+            uip_ipaddr_copy(peer->ripaddr, ripaddr);
+            uip_ipaddr_copy(UDPBUF->destipaddr, ripaddr);
+            uip_len = UIP_IPUDPH_LEN;
+            uip_arp_out();
+
+            // an unknown next hop replaces the probe with an ARP request; the
+            // length alone does not tell, a resolved probe is 42 bytes too
+            peer->resolved = ETHBUF->type != HTONS(UIP_ETHTYPE_ARP);
+            if (peer->resolved) {
+                memcpy(&peer->ethhdr, ETHBUF, sizeof(struct uip_eth_hdr));
+            }
+            else {
+                // uip_buf now holds an ARP request
+#ifdef UIPETHERNET_DEBUG_UDP
+                printf("udp sendmmsg, ARP request for datagram %d\r\n", i);
+#endif
+                UipEthernet::packetState &= ~UIPETHERNET_SENDPACKET;
+                UipEthernet::ethernet->network_send();
+            }
+
+            uip_len = 0;
+        }
+
+        if (!peer->resolved)
+            continue;
+
+        packet = UipEthernet::ethernet->enc28j60Eth.allocBlock(UIP_UDP_PHYH_LEN + size);
+        if (packet == NOBLOCK)
+            break;
+
+        // stage the payload while the previous frame is being transmitted
+        UipEthernet::ethernet->enc28j60Eth.writePacket(packet, UIP_UDP_PHYH_LEN, (uint8_t*)msgs[i].data, size);
+
+        memcpy(hdr, &peer->ethhdr, sizeof(struct uip_eth_hdr));
+        iphdr->vhl = 0x45;
+        iphdr->tos = 0;
+        iphdr->len[0] = (UIP_IPUDPH_LEN + size) >> 8;
+        iphdr->len[1] = (UIP_IPUDPH_LEN + size) & 0xff;
+
+        uint16_t    ipid = uip_nextipid();
+        iphdr->ipid[0] = ipid >> 8;
+        iphdr->ipid[1] = ipid & 0xff;
+        iphdr->ipoffset[0] = iphdr->ipoffset[1] = 0;
+        iphdr->ttl = _uip_udp_conn->ttl;
+        iphdr->proto = UIP_PROTO_UDP;
+        iphdr->ipchksum = 0;
+        uip_ipaddr_copy(iphdr->srcipaddr, uip_hostaddr);
+        uip_ipaddr_copy(iphdr->destipaddr, ripaddr);
+        iphdr->srcport = _uip_udp_conn->lport;
+        iphdr->destport = htons(msgs[i].address.get_port());
+        iphdr->udplen = htons(size + UIP_UDPH_LEN);
+        iphdr->udpchksum = 0;
+
+        uint16_t    sum = UipEthernet::chksum(0, (uint8_t*)iphdr, UIP_IPH_LEN);
+        iphdr->ipchksum = ~((sum == 0) ? 0xffff : htons(sum));
+#if UIP_UDP_CHECKSUMS
+        // pseudo header, UDP header and payload
+        sum = size + UIP_UDPH_LEN + UIP_PROTO_UDP;
+        sum = UipEthernet::chksum(sum, (uint8_t*)iphdr->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+        sum = UipEthernet::chksum(sum, (uint8_t*) &iphdr->srcport, UIP_UDPH_LEN);
+        sum = UipEthernet::chksum(sum, (uint8_t*)msgs[i].data, size);
+        iphdr->udpchksum = ~((sum == 0) ? 0xffff : htons(sum));
+        if (iphdr->udpchksum == 0) {
+            iphdr->udpchksum = 0xffff;
+        }
+#endif
+        UipEthernet::ethernet->enc28j60Eth.writePacket(packet, 0, hdr, UIP_UDP_PHYH_LEN);
+        UIP_CAPTURE(CAPTURE_TX, hdr, UIP_UDP_PHYH_LEN, UIP_UDP_PHYH_LEN + size);
+        UipEthernet::ethernet->enc28j60Eth.sendPacket(packet);
+
+        msgs[i].len = size;
+        sent++;
+    }
+
+    return sent;
+#endif
+}
+
+/**
+ * @brief   Frees all datagrams waiting in the receive queue
+ * @note
+ * @param
+ * @retval
+ */
+void UdpSocket::_flushQueue(uip_udp_userdata_t* data)
+{
+    while (data->next_count > 0) {
+        UipEthernet::ethernet->enc28j60Eth.freeBlock(data->packets_next[data->next_head].packet);
+        data->packets_next[data->next_head].packet = NOBLOCK;
+        data->next_head = (data->next_head + 1) % UIP_UDP_NUMPACKETS;
+        data->next_count--;
+    }
+}
+
+/**
+ * @brief   Restores the receive filter of a bound socket
+ * @note    Called after every uip_process run that may have sent from it,
+ *          the connection accepts any remote address and port again.
+ * @param   conn The connection uip_process ran for
+ * @retval
+ */
+void UdpSocket::_listen(struct uip_udp_conn* conn)
+{
+    uip_udp_userdata_t*     data = (uip_udp_userdata_t*)conn->appstate;
+
+    if (data && data->bound) {
+        conn->rport = 0;
+        memset(conn->ripaddr, 0, sizeof(uip_ipaddr_t));
+    }
+}
+
 /**
  * @brief
  * @note
@@ -401,7 +692,7 @@ void uipudp_appcall()
 void UdpSocket::_send(uip_udp_userdata_t* data)
 {
     uip_arp_out();  //add arp
-    if (uip_len == UIP_ARPHDRSIZE) {
+    if (uip_arp_replaced()) {
         UipEthernet::uipPacket = NOBLOCK;
         UipEthernet::packetState &= ~UIPETHERNET_SENDPACKET;
 #ifdef UIPETHERNET_DEBUG_UDP
@@ -469,12 +760,9 @@ nsapi_size_or_error_t UdpSocket::sendto(const char* host, uint16_t port, const v
  */
 nsapi_size_or_error_t UdpSocket::sendto(const SocketAddress& address, const void* data, size_t size)
 {
-    IpAddress   ip_addr(address.get_addr().bytes);
-    uint16_t    port = address.get_port();
-
     _remote_addr = address;
 
-    if (beginPacket(ip_addr, port) == 0) {
+    if (beginPacket(address) == 0) {
         stop();
         return NSAPI_ERROR_NO_ADDRESS;
     }
@@ -493,15 +781,16 @@ nsapi_size_or_error_t UdpSocket::sendto(const SocketAddress& address, const void
 }
 
 /**
- * @brief
- * @note
- * @param
- * @retval
+ * @brief   Receives the oldest queued datagram
+ * @note    Waits up to the socket timeout for a datagram to arrive.
+ *          Datagrams larger than size are truncated.
+ * @param   address Source address of the datagram (may be NULL)
+ * @param   data Receive buffer
+ * @param   size Size of the receive buffer
+ * @retval  Number of bytes received or NSAPI_ERROR_WOULD_BLOCK
  */
 nsapi_size_or_error_t UdpSocket::recvfrom(SocketAddress* address, void* data, size_t size)
 {
-    *address = _remote_addr;
-
     Timer   timer;
     int     success;
 
@@ -511,26 +800,47 @@ nsapi_size_or_error_t UdpSocket::recvfrom(SocketAddress* address, void* data, si
     } while (!success && (timer.read_ms() < _timeout_ms));
 
     if (!success) {
-        stop();
         return NSAPI_ERROR_WOULD_BLOCK;
     }
 
-    size_t      n;
-    size_t      recv_count = 0;
-    uint8_t*    pos = (uint8_t*)data;
+    if (address) {
+        *address = remoteAddress();
+    }
 
-    do {
-        if (recv_count + available() <= size) {
-            n = read(pos, available());
-            pos += n;
-            recv_count += n;
-        }
-        else {
-            return NSAPI_ERROR_NO_MEMORY;
-        }
-    } while ((available() > 0) && (recv_count < size));
+    size_t  recv_count = read((uint8_t*)data, size);
 
     flush();
 
-    return NSAPI_ERROR_OK;
+    return recv_count;
+}
+
+/**
+ * @brief   Receives up to count datagrams in one call (recvmmsg)
+ * @note    Waits up to the socket timeout for the first datagram only, the
+ *          remaining ones are taken from the receive queue without waiting.
+ * @param   msgs Array of messages, data and size must be set by the caller
+ * @param   count Number of elements in msgs
+ * @retval  Number of datagrams received or NSAPI_ERROR_WOULD_BLOCK
+ */
+nsapi_size_or_error_t UdpSocket::recvmmsg(udp_msg_t* msgs, unsigned int count)
+{
+    unsigned int    received = 0;
+
+    if (count == 0)
+        return 0;
+
+    nsapi_size_or_error_t   ret = recvfrom(&msgs[0].address, msgs[0].data, msgs[0].size);
+
+    if (ret < 0)
+        return ret;
+
+    msgs[received++].len = ret;
+    while (received < count && appdata.next_count > 0 && parsePacket() > 0) {
+        msgs[received].address = remoteAddress();
+        msgs[received].len = read((uint8_t*)msgs[received].data, msgs[received].size);
+        flush();
+        received++;
+    }
+
+    return received;
 }
@@ -34,15 +34,45 @@ extern "C"
 #define UIP_UDP_PHYH_LEN        UIP_LLH_LEN + UIP_IPUDPH_LEN
 #define UIP_UDP_MAXPACKETSIZE   UIP_UDP_MAXDATALEN + UIP_UDP_PHYH_LEN
 
+#ifndef UIP_UDP_NUMPACKETS
+#define UIP_UDP_NUMPACKETS      4
+#endif
+
+typedef struct
+{
+    memhandle       packet;
+    uint16_t        rport;      /**< The remote port, in network byte order. */
+    uip_ipaddr_t    ripaddr;    /**< The IP address of the remote host. */
+} uip_udp_datagram_t;
+
 typedef struct
 {
-    memaddress  out_pos;
-    memhandle   packet_next;
-    memhandle   packet_in;
-    memhandle   packet_out;
-    bool        send;
+    memaddress          out_pos;
+    uip_udp_datagram_t  packets_next[UIP_UDP_NUMPACKETS];   // receive queue (ring)
+    uint8_t             next_head;
+    uint8_t             next_count;
+    uip_udp_datagram_t  in;                                 // datagram being read
+    memhandle           packet_out;
+    bool                send;
+    bool                bound;                              // begin() called, datagrams from any peer are taken
+    uint16_t            out_rport;                          // destination of packet_out if bound, network byte order
+    uip_ipaddr_t        out_ripaddr;
+    uint32_t            drops_full;                         // dropped, receive queue full
+    uint32_t            drops_nomem;                        // dropped, no MemPool block
 } uip_udp_userdata_t;
 
+typedef struct
+{
+    SocketAddress   address;    // source (recvmmsg) or destination (sendmmsg) address
+    void*           data;       // receive or send buffer
+    nsapi_size_t    size;       // size of the buffer
+    nsapi_size_t    len;        // bytes received (truncated to size) or sent
+} udp_msg_t;
+
+#ifndef UIP_UDP_BATCH_PEERS
+#define UIP_UDP_BATCH_PEERS     4   // destinations resolved once per sendmmsg call
+#endif
+
 class UipEthernet;
 
 class UdpSocket :  public Udp
@@ -69,6 +99,10 @@ public:
     // Returns 1 if successful, 0 if there was a problem resolving the hostname or port
     int         beginPacket(const char* host, uint16_t port);
 
+    // Start building up a packet to send to the remote host at address (IPv4 or IPv6)
+    // Returns 1 if successful, 0 if the address can't be used
+    int         beginPacket(const SocketAddress& address);
+
     // Finish off this packet and send it
     // Returns 1 if the packet was sent successfully, 0 if there was an error
     int         endPacket();
@@ -108,17 +142,37 @@ public:
     // Return the port of the host who sent the current incoming packet
     uint16_t    remotePort();
 
+    // Return the address and port of the host who sent the current incoming packet
+    SocketAddress   remoteAddress();
+
     // Send data to the specified host and port.
     nsapi_size_or_error_t sendto (const char *host, uint16_t port, const void *data, size_t size);
     // Send data to the specified address.
     nsapi_size_or_error_t sendto (const SocketAddress &address, const void *data, size_t size);
     // Receive a datagram and store the source address in address if it's not NULL.
     nsapi_size_or_error_t recvfrom (SocketAddress *address, void *data, size_t size);
+    // Receive up to count queued datagrams. Waits for the first one only.
+    // Returns the number of datagrams received.
+    nsapi_size_or_error_t recvmmsg (udp_msg_t *msgs, unsigned int count);
+    // Send count datagrams, possibly to different peers, in one pipelined batch.
+    // Returns the number of datagrams sent, msgs[i].len is 0 for those not sent.
+    nsapi_size_or_error_t sendmmsg (udp_msg_t *msgs, unsigned int count);
+
+    // Number of datagrams waiting in the receive queue
+    uint8_t     queued()                { return appdata.next_count; }
+    // Datagrams dropped because the receive queue was full
+    uint32_t    droppedQueueFull()      { return appdata.drops_full; }
+    // Datagrams dropped because no MemPool block was available
+    uint32_t    droppedNoMemory()       { return appdata.drops_nomem; }
 
 private:
     friend void     uipudp_appcall();
 
     friend class    UipEthernet;
+    int             _beginPacket(uip_ipaddr_t ripaddr, uint16_t port);
+    static bool     _toUip(const SocketAddress& address, uip_ipaddr_t ripaddr);
     static void     _send(uip_udp_userdata_t* data);
+    static void     _listen(struct uip_udp_conn* conn);
+    static void     _flushQueue(uip_udp_userdata_t* data);
 };
 #endif
@@ -22,6 +22,8 @@
 #include "UipEthernet.h"
 #include "utility/Enc28j60Eth.h"
 #include "UdpSocket.h"
+#include "utility/PacketCapture.h"
+#include "utility/uip_trace.h"
 
 extern "C"
 {
@@ -29,12 +31,14 @@ extern "C"
 #include "utility/uip.h"
 #include "utility/uip_arp.h"
 #include "utility/uip_timer.h"
+#include "utility/ip6string.h"
 }
 #define ETH_HDR ((struct uip_eth_hdr*) &uip_buf[0])
 
 UipEthernet* UipEthernet::  ethernet = NULL;
 memhandle UipEthernet::     inPacket(NOBLOCK);
 memhandle UipEthernet::     uipPacket(NOBLOCK);
+uint32_t UipEthernet::      _dropsNoMemory(0);
 uint8_t UipEthernet::       uipHeaderLen(0);
 uint8_t UipEthernet::       packetState(0);
 IpAddress UipEthernet::     dnsServerAddress;
@@ -47,6 +51,9 @@ IpAddress UipEthernet::     dnsServerAddress;
  */
 void enc28j60_mempool_block_move_callback(memaddress dest, memaddress src, memaddress len)
 {
+    // don't move a frame which is being transmitted
+    while (UipEthernet::ethernet->enc28j60Eth.txBusy());
+
     //as ENC28J60 DMA is unable to copy single byte:
     if (len == 1) {
         UipEthernet::ethernet->enc28j60Eth.writeByte(dest, UipEthernet::ethernet->enc28j60Eth.readByte(src));
@@ -102,16 +109,22 @@ UipEthernet::UipEthernet(const uint8_t mac[6], PinName mosi, PinName miso, PinNa
     _dns(),
     _gateway(),
     _subnet()
+#if UIP_CONF_IPV6
+    ,_autoconf(true)
+#endif
 {
     for (uint8_t i = 0; i < 6; i++)
         _mac[i] = mac[i];
 }
 
 /**
- * @brief
- * @note
- * @param
- * @retval
+ * @brief   Initializes the interface and obtains the network configuration
+ * @note    If no local IP address has been set, DHCP is started. The DHCP
+ *          state machine runs in the background (driven by tick()) and also
+ *          handles lease renewal, so with timeout = 0 the function returns
+ *          immediately and the address is configured as soon as it's leased.
+ * @param   timeout Time to wait for a DHCP lease in seconds
+ * @retval  0 when configured, -1 if no lease was obtained within timeout
  */
 int UipEthernet::connect(unsigned long timeout)
 {
@@ -121,30 +134,42 @@ int UipEthernet::connect(unsigned long timeout)
     // Initialise the basic info
     init(_mac);
 
-    // If no local IP address has been set ask DHCP server to provide one
-    if (_ip == IpAddress()) {
-        // Now try to get our config info from a DHCP server
-        int ret = dhcpClient.begin((uint8_t*)_mac, timeout);
+#if UIP_CONF_IPV6
+    // The link-local address is usable at once, the global one once a
+    // router has advertised its prefix (SLAAC)
+    Timer   timer;
 
-        if (ret == 1) {
-            // We've successfully found a DHCP server and got our configuration info, so set things
-            // accordingly
-            set_network
-            (
-                dhcpClient.getLocalIp(),
-                dhcpClient.getDnsServerIp(),
-                dhcpClient.getGatewayIp(),
-                dhcpClient.getSubnetMask()
-            );
+    timer.start();
+    while (!uip_nd6_configured() && timer.read() < timeout)
+        tick();
 
-            return 0;
+    return uip_nd6_configured() ? 0 : -1;
+#else
+    // If no local IP address has been set ask DHCP server to provide one
+    if (_ip == IpAddress()) {
+        if (timeout == 0) {
+            dhcpClient.start((uint8_t*)_mac);
+            return -1;
         }
 
-        return -1;
+        // DhcpClient applies the configuration (set_network) once leased
+        return dhcpClient.begin((uint8_t*)_mac, timeout) == 1 ? 0 : -1;
     }
     else {
         return 0;
     }
+#endif
+}
+
+/**
+ * @brief   Tells whether the DHCP client holds a valid lease
+ * @note
+ * @param
+ * @retval
+ */
+bool UipEthernet::dhcpLeased()
+{
+    return dhcpClient.leased();
 }
 
 /**
@@ -155,6 +180,7 @@ int UipEthernet::connect(unsigned long timeout)
  */
 void UipEthernet::disconnect()
 {
+     dhcpClient.stop();
      ethernet = NULL;
 }
 
@@ -166,12 +192,43 @@ void UipEthernet::disconnect()
  */
 void UipEthernet::set_network(const char *ip_address, const char *netmask, const char *gateway)
 {
+#if UIP_CONF_IPV6
+    // Static IPv6 configuration instead of SLAAC. The prefix length is
+    // taken from "address/len", or from netmask given either as length
+    // ("64", "/64") or as mask ("ffff:ffff:ffff:ffff::").
+    uip_ipaddr_t    ipaddr;
+    int_fast16_t    prefixLen;
+
+    if (stoip6_prefix(ip_address, ipaddr, &prefixLen) != 0)
+        return;
+    uip_sethostaddr(ipaddr);
+
+    if (netmask && strchr(netmask, ':')) {
+        stoip6(netmask, strlen(netmask), ipaddr);
+    }
+    else {
+        if (prefixLen < 0)
+            prefixLen = netmask ? strtoul(netmask + (*netmask == '/'), NULL, 10) : 64;
+        memset(ipaddr, 0, sizeof(ipaddr));
+        for (int i = 0; i < prefixLen && i < 128; i++)
+            ((uint8_t*)ipaddr)[i >> 3] |= 0x80 >> (i & 7);
+    }
+    uip_setnetmask(ipaddr);
+
+    memset(ipaddr, 0, sizeof(ipaddr));
+    if (gateway)
+        stoip6(gateway, strlen(gateway), ipaddr);
+    uip_setdraddr(ipaddr);
+
+    _autoconf = false;
+#else
     _ip = IpAddress(ip_address, strlen(ip_address));
     _dns = _ip;
     _dns[3] = 1;
     _gateway = IpAddress(gateway, strlen(gateway));
     _subnet = IpAddress(netmask, strlen(netmask));
     set_network(_ip, _dns, _gateway, _subnet);
+#endif
 }
 
 /**
@@ -313,8 +370,14 @@ IpAddress UipEthernet::dnsServerIP()
  */
 const char* UipEthernet::get_ip_address()
 {
+#if UIP_CONF_IPV6
+    static char buf[40];
+    ip6tos(uip_hostaddr, buf);
+    return buf;
+#else
     static char buf[16];
     return localIP().toString(buf);
+#endif
 }
 
 /**
@@ -325,8 +388,14 @@ const char* UipEthernet::get_ip_address()
  */
 const char* UipEthernet::get_netmask()
 {
+#if UIP_CONF_IPV6
+    static char buf[40];
+    ip6tos(uip_netmask, buf);
+    return buf;
+#else
     static char buf[16];
     return subnetMask().toString(buf);
+#endif
 }
 
 /**
@@ -337,8 +406,14 @@ const char* UipEthernet::get_netmask()
  */
 const char* UipEthernet::get_gateway()
 {
+#if UIP_CONF_IPV6
+    static char buf[40];
+    ip6tos(uip_draddr, buf);
+    return buf;
+#else
     static char buf[16];
     return gatewayIP().toString(buf);
+#endif
 }
 
 /**
@@ -349,6 +424,9 @@ const char* UipEthernet::get_gateway()
  */
 void UipEthernet::tick()
 {
+    // free sent frames and start the staged one
+    enc28j60Eth.pollTx();
+
     if (inPacket == NOBLOCK) {
         inPacket = enc28j60Eth.receivePacket();
 #ifdef UIPETHERNET_DEBUG
@@ -363,7 +441,12 @@ void UipEthernet::tick()
         uip_len = enc28j60Eth.blockSize(inPacket);
         if (uip_len > 0) {
             enc28j60Eth.readPacket(inPacket, 0, (uint8_t*)uip_buf, UIP_BUFSIZE);
+            UIP_CAPTURE(CAPTURE_RX, uip_buf, uip_len < UIP_BUFSIZE ? uip_len : UIP_BUFSIZE, uip_len);
+#if UIP_CONF_IPV6
+            if (ETH_HDR->type == HTONS(UIP_ETHTYPE_IP6)) {
+#else
             if (ETH_HDR->type == HTONS(UIP_ETHTYPE_IP)) {
+#endif
                 uipPacket = inPacket;   //required for upper_layer_checksum of in_packet!
 #ifdef UIPETHERNET_DEBUG
                 printf("readPacket type IP, uip_len: %d\r\n", uip_len);
@@ -407,15 +490,13 @@ void UipEthernet::tick()
         }
         else {
             uip_userdata_t*     data = (uip_userdata_t*)uip_conn->appstate;
-            if (data != NULL) {
-                if (data->pollTimer.read_ms() >= UIP_CLIENT_TIMEOUT) {
-                    uip_process(UIP_POLL_REQUEST);
-                    data->pollTimer.stop();
-                    data->pollTimer.reset();
-                }
-            }
-            else
+
+            // uip_len still holds the last frame sent, nothing to do unless polled
+            if (data == NULL || data->pollTimer.read_ms() < UIP_CLIENT_TIMEOUT)
                 continue;
+            uip_process(UIP_POLL_REQUEST);
+            data->pollTimer.stop();
+            data->pollTimer.reset();
         }
 
         // If the above function invocation resulted in data that
@@ -429,9 +510,19 @@ void UipEthernet::tick()
 
     if (periodic) {
         periodicTimer.reset();
+        enc28j60Eth.checkRxErrors();
+#if UIP_CONF_IPV6
+        // age the neighbor cache, solicit routers until one answers
+        uip_neighbor_periodic();
+        uip_nd6_periodic();
+        if (uip_len > 0) {
+            network_send();
+        }
+#endif
 #if UIP_UDP
         for (int i = 0; i < UIP_UDP_CONNS; i++) {
             uip_udp_periodic(i);
+            UdpSocket::_listen(&uip_udp_conns[i]);
 
             // If the above function invocation resulted in data that
             // should be sent out on the Enc28J60Network, the global variable
@@ -442,6 +533,11 @@ void UipEthernet::tick()
         }
 #endif // UIP_UDP
     }
+
+#if UIP_UDP
+    // renew, rebind or acquire the DHCP lease without blocking the application
+    dhcpClient.checkLease();
+#endif
 }
 
 /**
@@ -452,12 +548,21 @@ void UipEthernet::tick()
  */
 bool UipEthernet::network_send()
 {
+    if ((packetState & UIPETHERNET_SENDPACKET) && uip_arp_replaced()) {
+        // uip_buf holds an ARP request (neighbor solicitation) instead of the
+        // headers of the staged frame, the segment is retransmitted later
+        enc28j60Eth.freeBlock(uipPacket);
+        uipPacket = NOBLOCK;
+        packetState &= ~UIPETHERNET_SENDPACKET;
+    }
+
     if (packetState & UIPETHERNET_SENDPACKET)
     {
 #ifdef UIPETHERNET_DEBUG
         printf("Enc28J60Network_send uipPacket: %d, hdrlen: %d\r\n", inPacket, uipHeaderLen);
 #endif
         enc28j60Eth.writePacket(uipPacket, 0, uip_buf, uipHeaderLen);
+        UIP_CAPTURE(CAPTURE_TX, uip_buf, uipHeaderLen, enc28j60Eth.blockSize(uipPacket));
         packetState &= ~UIPETHERNET_SENDPACKET;
         goto sendandfree;
     }
@@ -468,17 +573,27 @@ bool UipEthernet::network_send()
 #ifdef UIPETHERNET_DEBUG
         printf("Enc28J60Network_send uip_buf (uip_len): %d, packet: %d\r\n", uip_len, uipPacket);
 #endif
-        enc28j60Eth.writePacket(uipPacket, 0, uip_buf, uip_len);
+        if (uip_len > UIP_BUFSIZE && inPacket != NOBLOCK) {
+            // a reply longer than uip_buf (ICMP echo), the payload beyond
+            // uip_buf is still in the received frame at the same offset
+            enc28j60Eth.writePacket(uipPacket, 0, uip_buf, UIP_BUFSIZE);
+            enc28j60Eth.copyPacket(uipPacket, UIP_BUFSIZE, inPacket, UIP_BUFSIZE, uip_len - UIP_BUFSIZE);
+        }
+        else {
+            enc28j60Eth.writePacket(uipPacket, 0, uip_buf, uip_len);
+        }
+        UIP_CAPTURE(CAPTURE_TX, uip_buf, uip_len < UIP_BUFSIZE ? uip_len : UIP_BUFSIZE, uip_len);
         goto sendandfree;
     }
 
 #ifdef UIPETHERNET_DEBUG
         printf("Enc28J60Network_send return false\r\n");
 #endif
+    _dropsNoMemory++;
     return false;
 sendandfree:
+    // the block is queued and freed by the driver once the frame is sent
     enc28j60Eth.sendPacket(uipPacket);
-    Enc28j60Eth::freeBlock(uipPacket);
     uipPacket = NOBLOCK;
     return true;
 }
@@ -498,6 +613,12 @@ void UipEthernet::init(const uint8_t* mac)
 
     uip_init();
     uip_arp_init();
+#if UIP_CONF_IPV6
+    uip_nd6_start(_autoconf);
+#endif
+#if UIP_SYN_COOKIES
+    uip_syncookie_secret = us_ticker_read() ^ ((uint32_t)mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5]);
+#endif
 }
 
 /**
@@ -577,6 +698,8 @@ UipEthernet::upper_layer_chksum(uint8_t proto)
 uip_tcpchksum()
 #endif
 {
+    UIP_TRACE_SCOPE(UIP_TRACE_CHKSUM);
+
     uint16_t    upper_layer_len;
     uint16_t    sum;
 
@@ -602,9 +725,15 @@ uip_tcpchksum()
 #if UIP_UDP
     switch (proto) {
         //    case UIP_PROTO_ICMP:
-        //    case UIP_PROTO_ICMP6:
         //      upper_layer_memlen = upper_layer_len;
         //      break;
+#if UIP_CONF_IPV6
+        case UIP_PROTO_ICMP6:
+            // whatever fits into uip_buf, the rest is summed in the ENC28J60
+            upper_layer_memlen = upper_layer_len < UIP_BUFSIZE - UIP_IPH_LEN - UIP_LLH_LEN ?
+                upper_layer_len : UIP_BUFSIZE - UIP_IPH_LEN - UIP_LLH_LEN;
+            break;
+#endif
         case UIP_PROTO_UDP:
             upper_layer_memlen = UIP_UDPH_LEN;
             break;
@@ -688,4 +817,21 @@ uint16_t uip_udpchksum()
     return sum;
 }
 
+#if UIP_CONF_IPV6
+
+/**
+ * @brief   Checksum of the ICMPv6 message, pseudo header included
+ * @note    Takes the same path as TCP and UDP: the part in uip_buf is
+ *          summed by the CPU, the rest is read from the frame in the ENC28J60.
+ * @param
+ * @retval
+ */
+uint16_t uip_icmp6chksum()
+{
+    uint16_t    sum = UipEthernet::ethernet->upper_layer_chksum(UIP_PROTO_ICMP6);
+
+    return sum;
+}
+#endif
+
 #endif
@@ -51,6 +51,7 @@ public:
 
     int               connect(unsigned long timeout = 60);
     void              disconnect();
+    bool              dhcpLeased();
     void              set_network(uint8_t octet1, uint8_t octet2, uint8_t octet3, uint8_t octet4);
     void              set_network(IpAddress ip);
     void              set_network(IpAddress ip, IpAddress dns);
@@ -68,6 +69,7 @@ public:
     static uint16_t   chksum(uint16_t sum, const uint8_t* data, uint16_t len);
     static uint16_t   ipchksum();
     bool              stoip4(const char *ip4addr, size_t len, void *dest);
+    uint32_t          dropsNoMemory()   { return _dropsNoMemory; }
 private:
     uint8_t *const    _mac;
     IpAddress         _ip;
@@ -78,6 +80,7 @@ private:
     static memhandle  uipPacket;
     static uint8_t    uipHeaderLen;
     static uint8_t    packetState;
+    static uint32_t   _dropsNoMemory;
     DhcpClient        dhcpClient;
     Timer             periodicTimer;
     void              init(const uint8_t* mac);
@@ -93,9 +96,9 @@ private:
     friend uint16_t   uip_udpchksum();
     friend void       uipclient_appcall();
     friend void       uipudp_appcall();
-
 #if UIP_CONF_IPV6
-    uint16_t          uip_icmp6chksum();
+    friend uint16_t   uip_icmp6chksum();
+    bool              _autoconf;
 #endif
 };
 
@@ -31,10 +31,23 @@ extern "C"
 #include "enc28j60.h"
 #include "uip.h"
 }
+#include "uip_trace.h"
 
 // Static member initialization
 uint16_t    Enc28j60Eth::nextPacketPtr;
 uint8_t     Enc28j60Eth::bank = 0xff;
+memhandle   Enc28j60Eth::txQueue[ENC28J60_TXQUEUE];
+uint8_t     Enc28j60Eth::txCount = 0;
+uint32_t    Enc28j60Eth::_txFrames = 0;
+uint32_t    Enc28j60Eth::_txErrors = 0;
+uint32_t    Enc28j60Eth::_txLateCollisions = 0;
+uint32_t    Enc28j60Eth::_rxFrames = 0;
+uint32_t    Enc28j60Eth::_spiTransactions = 0;
+uint32_t    Enc28j60Eth::_spiBytes = 0;
+uint32_t    Enc28j60Eth::_rxBytes = 0;
+uint32_t    Enc28j60Eth::_txBytes = 0;
+uint32_t    Enc28j60Eth::_rxOverflows = 0;
+uint32_t    Enc28j60Eth::_rxCrcErrors = 0;
 struct      memblock Enc28j60Eth::receivePkt;
 
 /**
@@ -57,7 +70,7 @@ Enc28j60Eth::Enc28j60Eth(PinName mosi, PinName miso, PinName sclk, PinName cs) :
  */
 void Enc28j60Eth::init(uint8_t* macaddr)
 {
-    MemPool::init();            // 1 byte in between RX_STOP_INIT and pool to allow prepending of controlbyte
+    MemPool::init();            // blocks keep head room for the controlbyte and tail room for the status vector
     
     // initialize SPI interface
     _cs = 1;
@@ -73,6 +86,7 @@ void Enc28j60Eth::init(uint8_t* macaddr)
     // The CLKRDY does not work. See Rev. B4 Silicon Errata point.
     // Just wait.
     wait_ms(50);
+    bank = 0;                   // ECON1 is cleared by the reset
 
     // do bank 0 stuff
     // initialize receive buffer
@@ -109,9 +123,7 @@ void Enc28j60Eth::init(uint8_t* macaddr)
     // in binary these poitions are:11 0000 0011 1111
     // This is hex 303F->EPMM0=0x3f,EPMM1=0x30
     //TODO define specific pattern to receive dhcp-broadcast packages instead of setting ERFCON_BCEN!
-    writeReg(ERXFCON, ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_PMEN | ERXFCON_BCEN);
-    writeRegPair(EPMM0, 0x303f);
-    writeRegPair(EPMCSL, 0xf7f9);
+    clearWakePattern();
 
     //
     //
@@ -146,9 +158,6 @@ void Enc28j60Eth::init(uint8_t* macaddr)
     // no loopback of transmitted frames
     phyWrite(PHCON2, PHCON2_HDLDIS);
 
-    // switch to bank 0
-    setBank(ECON1);
-
     // enable interrutps
     writeOp(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE | EIE_PKTIE);
 
@@ -173,27 +182,25 @@ memhandle Enc28j60Eth::receivePacket()
     //if( !(readReg(EIR) & EIR_PKTIF) ){
     // The above does not work. See Rev. B4 Silicon Errata point 6.
     if (readReg(EPKTCNT) != 0) {
+        UIP_TRACE_SCOPE(UIP_TRACE_RECEIVEPACKET);
         uint16_t    readPtr = nextPacketPtr +
             6 > RXEND_INIT ? nextPacketPtr +
             6 -
             RXEND_INIT +
             RXSTART_INIT : nextPacketPtr +
             6;
+        uint8_t     header[6 + 1];  // readBuffer appends a terminating zero
+
         // Set the read pointer to the start of the received packet
         writeRegPair(ERDPTL, nextPacketPtr);
 
-        // read the next packet pointer
-        nextPacketPtr = readOp(ENC28J60_READ_BUF_MEM, 0);
-        nextPacketPtr |= readOp(ENC28J60_READ_BUF_MEM, 0) << 8;
-
-        // read the packet length (see datasheet page 43)
-        len = readOp(ENC28J60_READ_BUF_MEM, 0);
-        len |= readOp(ENC28J60_READ_BUF_MEM, 0) << 8;
+        // read next packet pointer, packet length and receive status
+        // in a single burst (see datasheet page 43)
+        readBuffer(6, header);
+        nextPacketPtr = header[0] | (header[1] << 8);
+        len = header[2] | (header[3] << 8);
         len -= 4;   //remove the CRC count
-        // read the receive status (see datasheet page 43)
-        rxstat = readOp(ENC28J60_READ_BUF_MEM, 0);
-
-        //rxstat |= readOp(ENC28J60_READ_BUF_MEM, 0) << 8;
+        rxstat = header[4];
 #ifdef ENC28J60DEBUG
         printf
         (
@@ -215,11 +222,15 @@ memhandle Enc28j60Eth::receivePacket()
         // The ERXFCON.CRCEN is set by default. Normally we should not
         // need to check this.
         if ((rxstat & 0x80) != 0) {
+            _rxFrames++;
+            _rxBytes += len;
             receivePkt.begin = readPtr;
             receivePkt.size = len;
             return UIP_RECEIVEBUFFERHANDLE;
         }
 
+        _rxCrcErrors++;
+
         // Move the RX read pointer to the start of the next received packet
         // This frees the memory we just read out
         setERXRDPT();
@@ -228,6 +239,22 @@ memhandle Enc28j60Eth::receivePacket()
     return(NOBLOCK);
 }
 
+/**
+ * @brief   Counts and acknowledges receive buffer overflows
+ * @note    The ENC28J60 sets EIR.RXERIF when a frame was dropped because
+ *          the receive buffer or EPKTCNT was full. Called periodically
+ *          from UipEthernet::tick().
+ * @param
+ * @retval
+ */
+void Enc28j60Eth::checkRxErrors()
+{
+    if (readOp(ENC28J60_READ_CTRL_REG, EIR) & EIR_RXERIF) {
+        _rxOverflows++;
+        writeOp(ENC28J60_BIT_FIELD_CLR, EIR, EIR_RXERIF);
+    }
+}
+
 /**
  * @brief
  * @note
@@ -251,23 +278,20 @@ size_t Enc28j60Eth::blockSize(memhandle handle)
 }
 
 /**
- * @brief
- * @note
- * @param
+ * @brief   Programs the TX pointers for a frame and sets TXRTS
+ * @note    The control byte and the status vector go to the head and tail
+ *          room MemPool keeps around every block, so no data of a
+ *          neighbouring block has to be saved and restored. The control
+ *          byte itself is written along with the header by writePacket().
+ * @param   handle Block holding the frame
  * @retval
  */
-void Enc28j60Eth::sendPacket(memhandle handle)
+void Enc28j60Eth::startTx(memhandle handle)
 {
     memblock*   packet = &blocks[handle];
     uint16_t    start = packet->begin - 1;
     uint16_t    end = start + packet->size;
 
-    // backup data at control-byte position
-    uint8_t     data = readByte(start);
-    // write control-byte (if not 0 anyway)
-    if (data)
-        writeByte(start, 0);
-
 #ifdef ENC28J60DEBUG
     printf("sendPacket(%d) [%d-%d]: ", handle, start, end);
     for (uint16_t i = start; i <= end; i++) {
@@ -283,17 +307,106 @@ void Enc28j60Eth::sendPacket(memhandle handle)
     // Set the TXND pointer to correspond to the packet size given
     writeRegPair(ETXNDL, end);
 
-    // send the contents of the transmit buffer onto the network
+    // clear the flags of the previous frame and send the contents of the transmit buffer onto the network
+    writeOp(ENC28J60_BIT_FIELD_CLR, EIR, EIR_TXIF | EIR_TXERIF);
     writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
+}
 
-    // Reset the transmit logic problem. See Rev. B4 Silicon Errata point 12.
-    if ((readReg(EIR) & EIR_TXERIF)) {
-        writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRTS);
+/**
+ * @brief   Advances the transmit queue
+ * @note    Once the frame in flight is done its block is freed, the TX
+ *          error and late collision counters are updated and the staged
+ *          frame, if any, is started. Called from UipEthernet::tick() and
+ *          whenever the driver needs a free slot in the queue.
+ * @param
+ * @retval  true if a frame is still on the wire
+ */
+bool Enc28j60Eth::pollTx()
+{
+    if (txCount == 0)
+        return false;
+
+    if (txBusy())
+        return true;
+
+    if (readOp(ENC28J60_READ_CTRL_REG, EIR) & EIR_TXERIF) {
+        _txErrors++;
+        if (readOp(ENC28J60_READ_CTRL_REG, ESTAT) & ESTAT_LATECOL)
+            _txLateCollisions++;
+
+        writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
+        writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST);
+        writeOp(ENC28J60_BIT_FIELD_CLR, ESTAT, ESTAT_LATECOL | ESTAT_TXABRT);
     }
 
-    //restore data on control-byte position
-    if (data)
-        writeByte(start, data);
+    _txFrames++;
+    _txBytes += blocks[txQueue[0]].size;
+    freeBlock(txQueue[0]);
+    for (uint8_t i = 1; i < txCount; i++)
+        txQueue[i - 1] = txQueue[i];
+    txQueue[--txCount] = NOBLOCK;
+
+    if (txCount) {
+        startTx(txQueue[0]);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Tells whether the controller is still transmitting a frame
+ * @note    Touches the hardware only, the queue is left alone so that it
+ *          is safe to call while MemPool is compacting.
+ * @param
+ * @retval
+ */
+bool Enc28j60Eth::txBusy()
+{
+    if (readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_TXRTS) {
+        // Reset the transmit logic problem. See Rev. B4 Silicon Errata point 12.
+        if (readOp(ENC28J60_READ_CTRL_REG, EIR) & EIR_TXERIF) {
+            writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRTS);
+            return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Waits until all queued frames are sent and their blocks freed
+ * @note
+ * @param
+ * @retval
+ */
+void Enc28j60Eth::waitTx()
+{
+    while (pollTx());
+}
+
+/**
+ * @brief   Queues a frame for transmission
+ * @note    The block is owned by the driver from now on and freed once
+ *          the frame is sent. Up to ENC28J60_TXQUEUE frames are kept in
+ *          the TX region: while one is on the wire the next one waits
+ *          staged and is started as soon as the first completes. The call
+ *          blocks only if the queue is full.
+ * @param   handle Block holding the frame
+ * @retval
+ */
+void Enc28j60Eth::sendPacket(memhandle handle)
+{
+    UIP_TRACE_SCOPE(UIP_TRACE_SENDPACKET);
+
+    while (txCount == ENC28J60_TXQUEUE)
+        pollTx();
+
+    txQueue[txCount++] = handle;
+    if (txCount == 1)
+        startTx(handle);
 }
 
 /**
@@ -344,11 +457,12 @@ uint16_t Enc28j60Eth::writePacket(memhandle handle, memaddress position, uint8_t
     memblock*   packet = &blocks[handle];
     uint16_t    start = packet->begin + position;
 
-    writeRegPair(EWRPTL, start);
+    // the per packet control byte in front of the frame is written in the same burst
+    writeRegPair(EWRPTL, position == 0 ? start - 1 : start);
 
     if (len > packet->size - position)
         len = packet->size - position;
-    writeBuffer(len, buffer);
+    writeBuffer(len, buffer, position == 0);
     return len;
 }
 
@@ -364,15 +478,16 @@ uint8_t Enc28j60Eth::readByte(uint16_t addr)
 
     writeRegPair(ERDPTL, addr);
 
-    _cs = 0;
+    select();
 
     // issue read command
     _spi.write(ENC28J60_READ_BUF_MEM);
 
     // read data
     result = _spi.write(0x00);
-    
-    _cs = 1;
+    _spiBytes += 2;
+
+    deselect();
     
     return(result);
 }
@@ -387,15 +502,16 @@ void Enc28j60Eth::writeByte(uint16_t addr, uint8_t data)
 {
     writeRegPair(EWRPTL, addr);
 
-    _cs = 0;
+    select();
 
     // issue write command
     _spi.write(ENC28J60_WRITE_BUF_MEM);
 
     // write data
     _spi.write(data);
-    
-    _cs = 1;
+    _spiBytes += 2;
+
+    deselect();
 }
 
 /**
@@ -450,7 +566,7 @@ uint8_t Enc28j60Eth::readOp(uint8_t op, uint8_t address)
 {
     uint8_t result;
 
-    _cs = 0;
+    select();
 
     // issue read command
     _spi.write(op | (address & ADDR_MASK));
@@ -459,10 +575,13 @@ uint8_t Enc28j60Eth::readOp(uint8_t op, uint8_t address)
     result = _spi.write(0x00);
 
     // do dummy read if needed (for mac and mii, see datasheet page 29)
-    if (address & 0x80)
+    if (address & 0x80) {
         result = _spi.write(0x00);
+        _spiBytes++;
+    }
 
-    _cs = 1;
+    _spiBytes += 2;
+    deselect();
     return(result);
 }
 
@@ -474,15 +593,16 @@ uint8_t Enc28j60Eth::readOp(uint8_t op, uint8_t address)
  */
 void Enc28j60Eth::writeOp(uint8_t op, uint8_t address, uint8_t data)
 {
-    _cs = 0;
+    select();
 
     // issue write command
     _spi.write(op | (address & ADDR_MASK));
 
     // write data
     _spi.write(data);
-    
-    _cs = 1;
+    _spiBytes += 2;
+
+    deselect();
 }
 
 /**
@@ -493,11 +613,12 @@ void Enc28j60Eth::writeOp(uint8_t op, uint8_t address, uint8_t data)
  */
 void Enc28j60Eth::readBuffer(uint16_t len, uint8_t* data)
 {
-    _cs = 0;
+    select();
 
     // issue read command
     _spi.write(ENC28J60_READ_BUF_MEM);
- 
+    _spiBytes += len + 1;
+
     // read data
     while (len) {
         len--;
@@ -507,7 +628,7 @@ void Enc28j60Eth::readBuffer(uint16_t len, uint8_t* data)
 
     *data = '\0';
     
-    _cs = 1;
+    deselect();
 }
 
 /**
@@ -516,12 +637,19 @@ void Enc28j60Eth::readBuffer(uint16_t len, uint8_t* data)
  * @param
  * @retval
  */
-void Enc28j60Eth::writeBuffer(uint16_t len, uint8_t* data)
+void Enc28j60Eth::writeBuffer(uint16_t len, uint8_t* data, bool controlByte)
 {
-    _cs = 0;
+    select();
 
     // issue write command
     _spi.write(ENC28J60_WRITE_BUF_MEM);
+    _spiBytes += len + 1;
+
+    // per packet control byte: use the MACON3 settings
+    if (controlByte) {
+        _spi.write(0x00);
+        _spiBytes++;
+    }
 
     // write data
     while (len) {
@@ -530,7 +658,7 @@ void Enc28j60Eth::writeBuffer(uint16_t len, uint8_t* data)
         data++;
     }
 
-    _cs = 1;
+    deselect();
 }
 
 /**
@@ -541,11 +669,27 @@ void Enc28j60Eth::writeBuffer(uint16_t len, uint8_t* data)
  */
 void Enc28j60Eth::setBank(uint8_t address)
 {
+    // EIE, EIR, ESTAT, ECON2 and ECON1 are mapped into every bank
+    if ((address & ADDR_MASK) >= EIE)
+        return;
+
     // set the bank (if needed)
     if ((address & BANK_MASK) != bank) {
-        // set the bank
-        writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, (ECON1_BSEL1 | ECON1_BSEL0));
-        writeOp(ENC28J60_BIT_FIELD_SET, ECON1, (address & BANK_MASK) >> 5);
+        if (bank == 0xff) {
+            writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, (ECON1_BSEL1 | ECON1_BSEL0));
+            writeOp(ENC28J60_BIT_FIELD_SET, ECON1, (address & BANK_MASK) >> 5);
+        }
+        else {
+            // touch only the bits which change, one transaction in most cases
+            uint8_t clr = (bank & ~address & BANK_MASK) >> 5;
+            uint8_t set = (~bank & address & BANK_MASK) >> 5;
+
+            if (clr)
+                writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, clr);
+            if (set)
+                writeOp(ENC28J60_BIT_FIELD_SET, ECON1, set);
+        }
+
         bank = (address & BANK_MASK);
     }
 }
@@ -667,10 +811,11 @@ uint16_t Enc28j60Eth::chksum(uint16_t sum, memhandle handle, memaddress pos, uin
     uint16_t    i;
 
     len = setReadPtr(handle, pos, len) - 1;
-    _cs = 0;
+    select();
 
     // issue read command
     spdr = _spi.write(ENC28J60_READ_BUF_MEM);
+    _spiBytes += len + 2;
     for (i = 0; i < len; i += 2) {
         // read data
         spdr = _spi.write(0x00);
@@ -692,39 +837,121 @@ uint16_t Enc28j60Eth::chksum(uint16_t sum, memhandle handle, memaddress pos, uin
         }
     }
 
-    _cs = 1;
+    deselect();
 
     /* Return sum in host byte order. */
     return sum;
 }
 
 /**
- * @brief
- * @note
+ * @brief   Puts the controller to sleep
+ * @note    Sequence of the datasheet (section 16.2): stop reception, let
+ *          the frame being received and the queued transmissions complete,
+ *          then set VRPS and PWRSV. Registers and buffer memory, hence the
+ *          MemPool blocks, are retained; no frames are received while off.
  * @param
  * @retval
  */
 void Enc28j60Eth::powerOff()
 {
+    Timer   timer;
+
+    waitTx();
     writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_RXEN);
-    wait_ms(50);
+    timer.start();
+    while ((readReg(ESTAT) & ESTAT_RXBUSY) && timer.read_us() < 2000);  // a full frame takes 1.2 ms
     writeOp(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_VRPS);
-    wait_ms(50);
     writeOp(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_PWRSV);
 }
 
 /**
- * @brief
- * @note
+ * @brief   Wakes the controller up
+ * @note    The PHY needs 300 us to stabilize before reception is enabled
+ *          again; the link partner takes many more milliseconds to bring
+ *          the link back up (see linkStatus()).
  * @param
  * @retval
  */
 void Enc28j60Eth::powerOn()
 {
+    Timer   timer;
+
     writeOp(ENC28J60_BIT_FIELD_CLR, ECON2, ECON2_PWRSV);
-    wait_ms(50);
+    wait_us(300);
+    timer.start();
+    while (!(readReg(ESTAT) & ESTAT_CLKRDY) && timer.read_us() < 1000);
     writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_RXEN);
-    wait_ms(50);
+}
+
+/**
+ * @brief   Accepts only frames matching a pattern
+ * @note    Uses the pattern match filter: the frame bytes offset to
+ *          offset + 63, counted from the destination address, selected by
+ *          mask (bit i for byte i) must have the same IP checksum as the
+ *          selected pattern bytes. Other frames are dropped by the
+ *          controller and no longer raise the INT pin, so the host can sleep
+ *          until a matching (e.g. magic) packet arrives.
+ * @param   offset Offset of the 64 byte window, even
+ * @param   pattern 64 bytes, the ones not selected by mask are ignored
+ * @param   mask Bytes of the window to compare
+ * @retval
+ */
+void Enc28j60Eth::setWakePattern(uint16_t offset, const uint8_t* pattern, uint64_t mask)
+{
+    uint32_t    sum = 0;
+    uint8_t     n = 0;
+
+    for (uint8_t i = 0; i < 64; i++) {
+        if (mask & ((uint64_t)1 << i)) {
+            sum += (n & 1) ? pattern[i] : pattern[i] << 8;
+            n++;
+        }
+    }
+
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    writeReg(ERXFCON, ERXFCON_CRCEN | ERXFCON_PMEN);
+    writeRegPair(EPMM0, mask);
+    writeRegPair(EPMM2, mask >> 16);
+    writeRegPair(EPMM4, mask >> 32);
+    writeRegPair(EPMM6, mask >> 48);
+    writeRegPair(EPMCSL, ~sum);
+    writeRegPair(EPMOL, offset);
+}
+
+/**
+ * @brief   Restores the normal receive filter
+ * @note
+ * @param
+ * @retval
+ */
+void Enc28j60Eth::clearWakePattern()
+{
+#if UIP_CONF_IPV6
+    // IPv6 has no broadcast, neighbor discovery uses the 33:33:xx:xx:xx:xx
+    // multicast addresses (all nodes, all routers, solicited-node)
+    writeReg(ERXFCON, ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_MCEN);
+#else
+    writeReg(ERXFCON, ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_PMEN | ERXFCON_BCEN);
+    writeRegPair(EPMM0, 0x303f);
+    writeRegPair(EPMM2, 0);
+    writeRegPair(EPMM4, 0);
+    writeRegPair(EPMM6, 0);
+    writeRegPair(EPMCSL, 0xf7f9);
+    writeRegPair(EPMOL, 0);
+#endif
+}
+
+/**
+ * @brief   Tells whether received frames are waiting in the buffer
+ * @note    One register read, cheap enough to poll while idle.
+ * @param
+ * @retval
+ */
+bool Enc28j60Eth::packetPending()
+{
+    return readReg(EPKTCNT) != 0;
 }
 
 /**
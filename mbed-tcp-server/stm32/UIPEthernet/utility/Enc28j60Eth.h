@@ -31,6 +31,11 @@
 
 #define UIP_RECEIVEBUFFERHANDLE 0xff
 
+// frames kept in the TX region: one on the wire and the ones staged behind it
+#ifndef ENC28J60_TXQUEUE
+#define ENC28J60_TXQUEUE        2
+#endif
+
 //#define ENC28J60DEBUG
 
 class Enc28j60Eth : public MemPool
@@ -40,19 +45,34 @@ private:
     DigitalOut      _cs;
     static uint16_t nextPacketPtr;
     static uint8_t  bank;
+    static memhandle txQueue[ENC28J60_TXQUEUE];
+    static uint8_t  txCount;
+    static uint32_t _txFrames;
+    static uint32_t _txErrors;
+    static uint32_t _txLateCollisions;
+    static uint32_t _rxFrames;
+    static uint32_t _spiTransactions;
+    static uint32_t _spiBytes;
+    static uint32_t _rxBytes;
+    static uint32_t _txBytes;
+    static uint32_t _rxOverflows;
+    static uint32_t _rxCrcErrors;
 
     static struct memblock  receivePkt;
 
     uint16_t    setReadPtr(memhandle handle, memaddress position, uint16_t len);
     void        setERXRDPT();
     void        readBuffer(uint16_t len, uint8_t* data);
-    void        writeBuffer(uint16_t len, uint8_t* data);
+    void        writeBuffer(uint16_t len, uint8_t* data, bool controlByte = false);
+    void        select()    { _cs = 0; _spiTransactions++; }
+    void        deselect()  { _cs = 1; }
     void        setBank(uint8_t address);
     uint8_t     readReg(uint8_t address);
     void        writeReg(uint8_t address, uint8_t data);
     void        phyWrite(uint8_t address, uint16_t data);
     uint16_t    phyRead(uint8_t address);
     void        clkout(uint8_t clk);
+    void        startTx(memhandle handle);
 
     friend void enc28j60_mempool_block_move_callback(memaddress, memaddress, memaddress);
 public:
@@ -61,12 +81,29 @@ public:
     void        powerOn();
     void        powerOff();
     bool        linkStatus();
+    void        setWakePattern(uint16_t offset, const uint8_t* pattern, uint64_t mask);
+    void        clearWakePattern();
+    bool        packetPending();
 
     void        init(uint8_t* macaddr);
     memhandle   receivePacket();
     void        freePacket();
     size_t      blockSize(memhandle handle);
     void        sendPacket(memhandle handle);
+    bool        pollTx();
+    bool        txBusy();
+    void        waitTx();
+    uint32_t    txFrames()          { return _txFrames; }
+    uint32_t    txErrors()          { return _txErrors; }
+    uint32_t    txLateCollisions()  { return _txLateCollisions; }
+    uint32_t    rxFrames()          { return _rxFrames; }
+    uint32_t    spiTransactions()   { return _spiTransactions; }
+    uint32_t    spiBytes()          { return _spiBytes; }
+    uint32_t    rxBytes()           { return _rxBytes; }
+    uint32_t    txBytes()           { return _txBytes; }
+    uint32_t    rxOverflows()       { return _rxOverflows; }
+    uint32_t    rxCrcErrors()       { return _rxCrcErrors; }
+    void        checkRxErrors();
     uint16_t    readPacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len);
     uint16_t    writePacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len);
     void        copyPacket(memhandle dest, memaddress dest_pos, memhandle src, memaddress src_pos, uint16_t len);
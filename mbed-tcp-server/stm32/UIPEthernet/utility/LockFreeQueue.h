@@ -0,0 +1,162 @@
+/*
+ LockFreeQueue.h - bounded lock-free queues for passing requests between threads.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Both queues hold N items, N a power of two, and never block: push()
+// returns false when the queue is full, pop() when it is empty. Indices are
+// free running 32 bit counters, the std::atomic operations compile to
+// LDREX/STREX on Cortex-M3 and up (no critical sections, no RTOS calls), so
+// producers may also be interrupt handlers.
+
+// One producer, one consumer.
+template<typename T, uint32_t N>
+class SpscQueue
+{
+public:
+    SpscQueue() : _head(0), _tail(0)
+    {
+        static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+    }
+
+    /**
+     * @brief   Appends an item
+     * @note    Producer side only.
+     * @param
+     * @retval  false if the queue is full
+     */
+    bool push(const T& item)
+    {
+        uint32_t    tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail - _head.load(std::memory_order_acquire) == N)
+            return false;
+
+        _items[tail & (N - 1)] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief   Removes the oldest item
+     * @note    Consumer side only.
+     * @param
+     * @retval  false if the queue is empty
+     */
+    bool pop(T& item)
+    {
+        uint32_t    head = _head.load(std::memory_order_relaxed);
+
+        if (head == _tail.load(std::memory_order_acquire))
+            return false;
+
+        item = _items[head & (N - 1)];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool        empty() const   { return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire); }
+    uint32_t    size() const    { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+private:
+    T                       _items[N];
+    std::atomic<uint32_t>   _head;      // next item to pop, written by the consumer
+    std::atomic<uint32_t>   _tail;      // next free slot, written by the producer
+};
+
+// Any number of producers, one consumer. Each slot carries a sequence
+// number telling whether it is free for the producer claiming position pos
+// (seq == pos) or holds the item for the consumer at pos (seq == pos + 1);
+// producers claim a position with one compare-and-swap on the tail.
+template<typename T, uint32_t N>
+class MpscQueue
+{
+public:
+    MpscQueue() : _tail(0), _head(0)
+    {
+        static_assert((N & (N - 1)) == 0, "MpscQueue size must be a power of two");
+        for (uint32_t i = 0; i < N; i++)
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief   Appends an item
+     * @note    Safe from any thread or interrupt handler.
+     * @param
+     * @retval  false if the queue is full
+     */
+    bool push(const T& item)
+    {
+        uint32_t    pos = _tail.load(std::memory_order_relaxed);
+        cell_t*     cell;
+
+        for (;;) {
+            cell = &_cells[pos & (N - 1)];
+
+            int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else
+            if (diff < 0)
+                return false;   // the slot still holds the item pushed N positions ago
+            else
+                pos = _tail.load(std::memory_order_relaxed);
+        }
+
+        cell->item = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief   Removes the oldest item
+     * @note    Consumer side only. An item whose producer was preempted
+     *          between claiming and filling its slot is not visible yet, nor
+     *          are the items behind it.
+     * @param
+     * @retval  false if the queue is empty
+     */
+    bool pop(T& item)
+    {
+        cell_t*     cell = &_cells[_head & (N - 1)];
+
+        if ((int32_t)(cell->seq.load(std::memory_order_acquire) - (_head + 1)) < 0)
+            return false;
+
+        item = cell->item;
+        cell->seq.store(_head + N, std::memory_order_release);
+        _head++;
+        return true;
+    }
+
+    bool        empty() const   { return (int32_t)(_cells[_head & (N - 1)].seq.load(std::memory_order_acquire) - (_head + 1)) < 0; }
+private:
+    typedef struct
+    {
+        std::atomic<uint32_t>   seq;
+        T                       item;
+    } cell_t;
+
+    cell_t                  _cells[N];
+    std::atomic<uint32_t>   _tail;      // next position to claim, shared by the producers
+    uint32_t                _head;      // next position to pop, consumer only
+};
+#endif
@@ -17,6 +17,7 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "MemPool.h"
+#include "uip_trace.h"
 #include <string.h>
 
 #define POOLOFFSET  1
@@ -37,28 +38,34 @@ void MemPool::init() {
 }
 
 /**
- * @brief
- * @note
- * @param
- * @retval
+ * @brief   Allocates a block of size bytes
+ * @note    The pool is compacted if no gap is big enough.
+ * @param   size Size of the block
+ * @param   keep Bytes that must stay free after the allocation
+ * @retval  Handle of the block, NOBLOCK if there is no room
  */
-memhandle MemPool::allocBlock(memaddress size) {
+memhandle MemPool::allocBlock(memaddress size, memaddress keep) {
+    UIP_TRACE_SCOPE(UIP_TRACE_ALLOCBLOCK);
+
     memblock*   best = NULL;
     memhandle   cur = POOLSTART;
     memblock*   block = &blocks[POOLSTART];
     memaddress  bestsize = MEMPOOL_SIZE + 1;
+    memaddress  footprint = size + MEMPOOL_BLOCK_HEADROOM + MEMPOOL_BLOCK_TAILROOM;
+
+    if (keep && freeSize() < footprint + keep)
+        goto notfound;
 
     do {
         memhandle   next = block->nextblock;
-        memaddress  freesize = (next == NOBLOCK ? blocks[POOLSTART].begin + MEMPOOL_SIZE : blocks[next].begin) -
-            block->begin -
-            block->size;
-        if (freesize == size) {
+        memaddress  freesize = (next == NOBLOCK ? blocks[POOLSTART].begin + MEMPOOL_SIZE : blocks[next].begin - MEMPOOL_BLOCK_HEADROOM) -
+            blockEnd(cur);
+        if (freesize == footprint) {
             best = &blocks[cur];
             goto found;
         }
 
-        if (freesize > size && freesize < bestsize) {
+        if (freesize > footprint && freesize < bestsize) {
             bestsize = freesize;
             best = &blocks[cur];
         }
@@ -81,21 +88,23 @@ collect:
 
         memhandle   next;
         while ((next = block->nextblock) != NOBLOCK) {
-            memaddress      dest = block->begin + block->size;
+            memaddress      dest = blockEnd(cur) + MEMPOOL_BLOCK_HEADROOM;
             memblock*       nextblock = &blocks[next];
             memaddress*     src = &nextblock->begin;
             if (dest != *src)
             {
 #ifdef MEMPOOL_MEMBLOCK_MV
-                MEMPOOL_MEMBLOCK_MV(dest, *src, nextblock->size);
+                // the head room travels with the block
+                MEMPOOL_MEMBLOCK_MV(dest - MEMPOOL_BLOCK_HEADROOM, *src - MEMPOOL_BLOCK_HEADROOM, nextblock->size + MEMPOOL_BLOCK_HEADROOM);
 #endif
                 *src = dest;
             }
 
             block = nextblock;
+            cur = next;
         }
 
-        if (blocks[POOLSTART].begin + MEMPOOL_SIZE - block->begin - block->size >= size)
+        if (blocks[POOLSTART].begin + MEMPOOL_SIZE - blockEnd(cur) >= footprint)
             best = block;
         else
             goto notfound;
@@ -110,11 +119,11 @@ found:
                 continue;
             }
 
-            memaddress  address = best->begin + best->size;
+            memaddress  address = blockEnd(best - blocks);
 #ifdef MEMBLOCK_ALLOC
             MEMBLOCK_ALLOC(address, size);
 #endif
-            block->begin = address;
+            block->begin = address + MEMPOOL_BLOCK_HEADROOM;
             block->size = size;
             block->nextblock = best->nextblock;
             best->nextblock = cur;
@@ -181,6 +190,31 @@ void MemPool::resizeBlock(memhandle handle, memaddress position, memaddress size
     block->size = size;
 }
 
+/**
+ * @brief   Bytes not taken by any block
+ * @note    Head and tail room count as taken.
+ * @param
+ * @retval  Free bytes, possibly split over several gaps
+ */
+memaddress MemPool::freeSize() {
+    memaddress  used = 0;
+
+    for (memhandle cur = blocks[POOLSTART].nextblock; cur != NOBLOCK; cur = blocks[cur].nextblock)
+        used += blocks[cur].size + MEMPOOL_BLOCK_HEADROOM + MEMPOOL_BLOCK_TAILROOM;
+    return MEMPOOL_SIZE - used;
+}
+
+/**
+ * @brief   First address behind a block including its tail room
+ * @note    The pool start has neither head nor tail room.
+ * @param
+ * @retval
+ */
+memaddress MemPool::blockEnd(memhandle handle) {
+    memblock*   block = &blocks[handle];
+    return block->begin + block->size + (handle == POOLSTART ? 0 : MEMPOOL_BLOCK_TAILROOM);
+}
+
 /**
  * @brief
  * @note
@@ -26,6 +26,14 @@
 
 #include "mempool_conf.h"
 
+// bytes kept free in front of and behind every block
+#ifndef MEMPOOL_BLOCK_HEADROOM
+#define MEMPOOL_BLOCK_HEADROOM  0
+#endif
+#ifndef MEMPOOL_BLOCK_TAILROOM
+#define MEMPOOL_BLOCK_TAILROOM  0
+#endif
+
 struct memblock
 {
     memaddress  begin;
@@ -40,10 +48,12 @@ class   MemPool
 #endif
 protected:
     static struct memblock  blocks[MEMPOOL_NUM_MEMBLOCKS + 1];
+    static memaddress   blockEnd(memhandle);
 public:
 
     void                init();
-    static memhandle    allocBlock(memaddress);
+    static memhandle    allocBlock(memaddress size, memaddress keep = 0);
+    static memaddress   freeSize();
     static void         freeBlock(memhandle);
     static void         resizeBlock(memhandle handle, memaddress position);
     static void         resizeBlock(memhandle handle, memaddress position, memaddress size);
@@ -0,0 +1,171 @@
+/*
+ PacketCapture.cpp - in-RAM capture ring for the ENC28J60 frames.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PacketCapture.h"
+#include "hal/us_ticker_api.h"
+
+// pcapng block types (see draft-ietf-opsawg-pcapng)
+#define PCAPNG_SHB          0x0A0D0D0A  // section header block
+#define PCAPNG_IDB          0x00000001  // interface description block
+#define PCAPNG_EPB          0x00000006  // enhanced packet block
+#define PCAPNG_MAGIC        0x1A2B3C4D  // byte order magic
+#define PCAPNG_LINKTYPE_ETH 1
+#define PCAPNG_OPT_FLAGS    2           // epb_flags, direction in bits 0-1
+
+#if UIP_CAPTURE_FRAMES > 0
+capture_record_t    PacketCapture::_ring[UIP_CAPTURE_FRAMES];
+#endif
+uint16_t            PacketCapture::_head = 0;
+uint16_t            PacketCapture::_count = 0;
+uint32_t            PacketCapture::_overwritten = 0;
+uint32_t            PacketCapture::_lastTicks = 0;
+uint32_t            PacketCapture::_tsHigh = 0;
+bool                PacketCapture::_enabled = true;
+
+/**
+ * @brief   Discards all recorded frames
+ * @note
+ * @param
+ * @retval
+ */
+void PacketCapture::clear()
+{
+    _head = 0;
+    _count = 0;
+    _overwritten = 0;
+}
+
+/**
+ * @brief   Records a frame
+ * @note    Overwrites the oldest record once the ring is full. The 32 bit
+ *          microsecond ticker is extended to 64 bits here, which holds as
+ *          long as at least one frame is seen every 71 minutes.
+ * @param   dir CAPTURE_RX or CAPTURE_TX
+ * @param   data Start of the frame (Ethernet header) in RAM
+ * @param   len Bytes available at data
+ * @param   origLen Length of the whole frame
+ * @retval
+ */
+void PacketCapture::record(uint8_t dir, const uint8_t* data, uint16_t len, uint16_t origLen)
+{
+#if UIP_CAPTURE_FRAMES > 0
+    if (!_enabled)
+        return;
+
+    uint32_t    ticks = us_ticker_read();
+
+    if (ticks < _lastTicks)
+        _tsHigh++;
+    _lastTicks = ticks;
+
+    capture_record_t*   rec = &_ring[_head];
+
+    rec->tsHigh = _tsHigh;
+    rec->tsLow = ticks;
+    rec->origLen = origLen;
+    rec->capLen = len < UIP_CAPTURE_SNAPLEN ? len : UIP_CAPTURE_SNAPLEN;
+    rec->dir = dir;
+    memcpy(rec->data, data, rec->capLen);
+
+    if (++_head == UIP_CAPTURE_FRAMES)
+        _head = 0;
+    if (_count < UIP_CAPTURE_FRAMES)
+        _count++;
+    else
+        _overwritten++;
+#endif
+}
+
+/**
+ * @brief   Writes the ring as a pcapng section, oldest frame first
+ * @note    Uses the native byte order, the section header tells readers
+ *          which one it is. Timestamps use the default microsecond
+ *          resolution of pcapng.
+ * @param   write Called with consecutive pieces of the file
+ * @param   ctx Passed to write
+ * @retval  Number of bytes written
+ */
+size_t PacketCapture::dump(capture_writer_t write, void* ctx)
+{
+    uint32_t    shb[7] = { PCAPNG_SHB, sizeof(shb), PCAPNG_MAGIC, 0x00000001, 0xffffffff, 0xffffffff, sizeof(shb) };
+    uint32_t    idb[5] = { PCAPNG_IDB, sizeof(idb), PCAPNG_LINKTYPE_ETH, UIP_CAPTURE_SNAPLEN, sizeof(idb) };
+    size_t      total = 0;
+
+    write(shb, sizeof(shb), ctx);
+    write(idb, sizeof(idb), ctx);
+    total += sizeof(shb) + sizeof(idb);
+#if UIP_CAPTURE_FRAMES > 0
+    static const uint8_t    pad[3] = { 0, 0, 0 };
+    uint16_t                i = (_head + UIP_CAPTURE_FRAMES - _count) % UIP_CAPTURE_FRAMES;
+
+    for (uint16_t n = 0; n < _count; n++) {
+        capture_record_t*   rec = &_ring[i];
+        uint32_t            padded = (rec->capLen + 3) & ~3;
+        uint32_t            blockLen = 28 + padded + 12 + 4;
+        uint32_t            head[7] = { PCAPNG_EPB, blockLen, 0, rec->tsHigh, rec->tsLow, rec->capLen, rec->origLen };
+        uint32_t            tail[4] = { PCAPNG_OPT_FLAGS | (4 << 16), rec->dir, 0, blockLen };
+
+        write(head, sizeof(head), ctx);
+        write(rec->data, rec->capLen, ctx);
+        if (padded != rec->capLen)
+            write(pad, padded - rec->capLen, ctx);
+        write(tail, sizeof(tail), ctx);
+        total += blockLen;
+
+        if (++i == UIP_CAPTURE_FRAMES)
+            i = 0;
+    }
+#endif
+    return total;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+static void hexWriter(const void* data, size_t len, void* ctx)
+{
+    const uint8_t*  p = (const uint8_t*)data;
+    size_t*         column = (size_t*)ctx;
+
+    while (len--) {
+        printf("%02x", *p++);
+        if (++(*column) == 32) {
+            printf("\r\n");
+            *column = 0;
+        }
+    }
+}
+
+/**
+ * @brief   Prints the dump as hex on the console
+ * @note    The lines between "-----BEGIN PCAPNG-----" and
+ *          "-----END PCAPNG-----" hold the pcapng file, 32 bytes a line.
+ * @param
+ * @retval
+ */
+void PacketCapture::dumpHex()
+{
+    size_t  column = 0;
+
+    printf("\r\n-----BEGIN PCAPNG-----\r\n");
+    dump(hexWriter, &column);
+    if (column)
+        printf("\r\n");
+    printf("-----END PCAPNG-----\r\n");
+}
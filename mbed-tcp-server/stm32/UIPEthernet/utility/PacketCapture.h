@@ -0,0 +1,90 @@
+/*
+ PacketCapture.h - in-RAM capture ring for the ENC28J60 frames.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PACKETCAPTURE_h
+#define PACKETCAPTURE_h
+
+#include "mbed.h"
+#include "uipethernet-conf.h"
+
+#ifndef UIP_CAPTURE_FRAMES
+#define UIP_CAPTURE_FRAMES      0
+#endif
+
+#ifndef UIP_CAPTURE_SNAPLEN
+#define UIP_CAPTURE_SNAPLEN     64
+#endif
+
+#if UIP_CAPTURE_SNAPLEN > 255
+#error "UIP_CAPTURE_SNAPLEN must not exceed 255 bytes"
+#endif
+
+#define CAPTURE_RX              1   // pcapng epb_flags direction: inbound
+#define CAPTURE_TX              2   // pcapng epb_flags direction: outbound
+
+#if UIP_CAPTURE_FRAMES > 0
+#define UIP_CAPTURE(dir, data, len, origlen)    PacketCapture::record(dir, data, len, origlen)
+#else
+#define UIP_CAPTURE(dir, data, len, origlen)
+#endif
+
+// called with consecutive pieces of the dump, ctx is passed through
+typedef void (*capture_writer_t)(const void* data, size_t len, void* ctx);
+
+typedef struct
+{
+    uint32_t    tsHigh;         // microseconds since boot, upper 32 bits
+    uint32_t    tsLow;          // microseconds since boot, lower 32 bits
+    uint16_t    origLen;        // length of the frame on the wire
+    uint8_t     capLen;         // bytes kept in data
+    uint8_t     dir;            // CAPTURE_RX or CAPTURE_TX
+    uint8_t     data[UIP_CAPTURE_SNAPLEN];
+} capture_record_t;
+
+// Flight recorder for the Ethernet frames: keeps the first
+// UIP_CAPTURE_SNAPLEN bytes of the last UIP_CAPTURE_FRAMES frames with a
+// microsecond timestamp. Only the bytes already in MCU RAM are recorded
+// (the frame header and whatever payload uip_buf holds), so recording
+// costs no SPI traffic. dump() writes the ring as a pcapng section that
+// Wireshark opens as is, e.g. straight into a TcpClient:
+//
+//   PacketCapture::dump(writeToClient, client);
+//
+// dumpHex() prints the same bytes as hex lines between markers on the
+// console; tools/capture2pcap.py turns such a log back into a file.
+class PacketCapture
+{
+public:
+    static void     start()     { _enabled = true; }
+    static void     stop()      { _enabled = false; }
+    static void     clear();
+    static void     record(uint8_t dir, const uint8_t* data, uint16_t len, uint16_t origLen);
+    static size_t   dump(capture_writer_t write, void* ctx);
+    static void     dumpHex();
+    static uint16_t count()         { return _count; }
+    static uint32_t overwritten()   { return _overwritten; }
+private:
+#if UIP_CAPTURE_FRAMES > 0
+    static capture_record_t _ring[UIP_CAPTURE_FRAMES];
+#endif
+    static uint16_t         _head;
+    static uint16_t         _count;
+    static uint32_t         _overwritten;
+    static uint32_t         _lastTicks;
+    static uint32_t         _tsHigh;
+    static bool             _enabled;
+};
+#endif
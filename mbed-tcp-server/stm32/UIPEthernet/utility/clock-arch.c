@@ -21,6 +21,7 @@
  */
 #include <time.h>
 #include "clock-arch.h"
+#include "hal/us_ticker_api.h"
 
 /**
  * @brief
@@ -31,3 +32,13 @@
 clock_time_t clock_time(void) {
     return(clock_time_t) time(NULL);
 }
+
+/**
+ * @brief   Millisecond clock used for TCP round trip time sampling
+ * @note    Wraps together with the microsecond ticker.
+ * @param
+ * @retval
+ */
+clock_time_t clock_time_ms(void) {
+    return(clock_time_t) (us_ticker_read() / 1000);
+}
@@ -16,6 +16,7 @@
 #ifndef ENC28J60_H
 #define ENC28J60_H
 #include <inttypes.h>
+#include "uipethernet-conf.h"
 
 // ENC28J60 Control Registers
 // Control register definitions are a combination of address,
@@ -244,10 +245,20 @@
 // Use the lower segment of the buffer memory for the receive buffer, starting at address 0000h.
 // For example, use the range (0000h to n) for the receive buffer, and ((n + 1) to 8191) for the transmit buffer.
 #define RXSTART_INIT    0x0
+// Size of the receive buffer for the profiles selectable by ENC28J60_BUFFER_PROFILE
+#define ENC28J60_BUFFER_TX_HEAVY    0x0800  // 2 KB RX, 6 KB TX
+#define ENC28J60_BUFFER_BALANCED    0x1000  // 4 KB RX, 4 KB TX
+#define ENC28J60_BUFFER_RX_HEAVY    0x1800  // 6 KB RX, 2 KB TX
+#ifndef ENC28J60_BUFFER_PROFILE
+#define ENC28J60_BUFFER_PROFILE     ENC28J60_BUFFER_TX_HEAVY
+#endif
 // Receive buffer end. Make sure this is an odd value (See Rev. B1,B4,B5,B7 Silicon Errata 'Memory (Ethernet Buffer)')
-#define RXEND_INIT    (0x1FFF - 0x1800) // 0x1800 = 512 * 12
+#define RXEND_INIT      (RXSTART_INIT + ENC28J60_BUFFER_PROFILE - 1)
+#if (RXEND_INIT & 1) == 0
+#error "ENC28J60_BUFFER_PROFILE must be even"
+#endif
 // Start TX buffer RXEND_INIT + 1
-#define TXSTART_INIT    RXEND_INIT + 1
+#define TXSTART_INIT    (RXEND_INIT + 1)
 // end TX buffer at end of mem
 #define TXEND_INIT      0x1FFF
 //
@@ -17,13 +17,27 @@ typedef uint8_t     memhandle;
 #define NUM_TCP_MEMBLOCKS   0
 #endif
 #if UIP_UDP and UIP_UDP_CONNS
-#define NUM_UDP_MEMBLOCKS   (3 * UIP_UDP_CONNS)
+#define NUM_UDP_MEMBLOCKS   ((UIP_UDP_NUMPACKETS + 2) * UIP_UDP_CONNS)
 #else
 #define NUM_UDP_MEMBLOCKS   0
 #endif
-#define MEMPOOL_NUM_MEMBLOCKS   (NUM_TCP_MEMBLOCKS + NUM_UDP_MEMBLOCKS)
-#define MEMPOOL_STARTADDRESS    (TXSTART_INIT + 1)
-#define MEMPOOL_SIZE            (TXEND_INIT - TXSTART_INIT)
+// the frame being assembled by UipEthernet, the one in flight and the staged one
+#define NUM_TX_MEMBLOCKS        3
+#define MEMPOOL_NUM_MEMBLOCKS   (NUM_TCP_MEMBLOCKS + NUM_UDP_MEMBLOCKS + NUM_TX_MEMBLOCKS)
+#define MEMPOOL_STARTADDRESS    TXSTART_INIT
+#define MEMPOOL_SIZE            (TXEND_INIT - TXSTART_INIT + 1)
+// room for the per packet control byte and the 7 byte TX status vector
+#define MEMPOOL_BLOCK_HEADROOM  1
+#define MEMPOOL_BLOCK_TAILROOM  7
+
+// kept free by the socket buffers: a segment can always be sent and its
+// blocks freed again by the ACK (largest IP and TCP header, IPv6)
+#define MEMPOOL_TX_RESERVE      (UIP_LLH_LEN + 60 + UIP_TCP_MSS + MEMPOOL_BLOCK_HEADROOM + MEMPOOL_BLOCK_TAILROOM)
+
+// the TX region must at least hold one full sized frame
+#if MEMPOOL_SIZE < MAX_FRAMELEN + MEMPOOL_BLOCK_HEADROOM + MEMPOOL_BLOCK_TAILROOM
+#error "ENC28J60_BUFFER_PROFILE leaves too little memory for transmitting"
+#endif
 
 void  enc28j60_mempool_block_move_callback(memaddress, memaddress, memaddress);
 
@@ -62,6 +62,15 @@ typedef uint8_t         u8_t;
  */
 typedef uint16_t        u16_t;
 
+/**
+ * 32 bit datatype
+ *
+ * This typedef defines the 32-bit type used for byte counters.
+ *
+ * \hideinitializer
+ */
+typedef uint32_t        u32_t;
+
 /**
  * Statistics datatype
  *
@@ -70,7 +79,7 @@ typedef uint16_t        u16_t;
  *
  * \hideinitializer
  */
-typedef unsigned short  uip_stats_t;
+typedef uint32_t        uip_stats_t;
 
 /**
  * Maximum number of TCP connections.
@@ -93,8 +102,13 @@ typedef unsigned short  uip_stats_t;
  * \hideinitializer
  */
 
+#if UIP_CONF_IPV6
+/* room for a router advertisement with prefix and link-layer options */
+#define UIP_CONF_BUFFER_SIZE    160
+#else
 #define UIP_CONF_BUFFER_SIZE    98
 //#define UIP_CONF_BUFFER_SIZE     118
+#endif
 
 /**
  * The TCP maximum segment size.
@@ -161,7 +175,7 @@ typedef unsigned short  uip_stats_t;
  *
  * \hideinitializer
  */
-#define UIP_CONF_STATISTICS 0
+#define UIP_CONF_STATISTICS 1
 //#define UIP_CONF_LLH_LEN 0
 typedef void*   uip_tcp_appstate_t;
 void            uipclient_appcall(void);
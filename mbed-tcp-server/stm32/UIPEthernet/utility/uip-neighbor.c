@@ -0,0 +1,533 @@
+/**
+ * \addtogroup uipneighbor
+ * @{
+ */
+/**
+ * \file
+ * Neighbor cache and neighbor discovery for IPv6.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the uIP TCP/IP stack
+ *
+ */
+#include "uip-neighbor.h"
+#include "uip_arp.h"
+
+#include <string.h>
+
+#if UIP_CONF_IPV6
+
+#if UIP_NEIGHBOR_ENTRIES > 254
+#error "UIP_NEIGHBOR_ENTRIES must be less than 255"
+#endif
+
+#if (UIP_NEIGHBOR_BUCKETS & (UIP_NEIGHBOR_BUCKETS - 1)) != 0
+#error "UIP_NEIGHBOR_BUCKETS must be a power of two"
+#endif
+
+#define NEIGHBOR_NONE       0xff    /* end of a bucket chain */
+
+#define ND6_HOPLIMIT        255     /* hop limit of all neighbor discovery messages */
+#define ND6_NSLEN           32      /* solicitation with a source link-layer address option */
+#define ND6_RSLEN           16      /* router solicitation with a source link-layer address option */
+#define ND6_RA_OPTIONS      16      /* offset of the options in a router advertisement */
+#define ND6_NA_OPTIONS      24      /* offset of the options in a neighbor advertisement */
+#define ND6_PIO_LEN         32
+#define ND6_PIO_AUTONOMOUS  0x40
+
+struct neighbor_entry
+{
+    uip_ipaddr_t                ipaddr;
+    struct uip_neighbor_addr    addr;
+    u16_t                       time;
+    u8_t                        used;
+    u8_t                        next;   /* next entry in the same bucket */
+};
+
+static struct neighbor_entry    entries[UIP_NEIGHBOR_ENTRIES];
+static u8_t                     buckets[UIP_NEIGHBOR_BUCKETS];
+
+uip_ipaddr_t                    uip_lladdr;
+
+static u8_t                     nd6_configured;
+static u8_t                     nd6_prefixlen;
+static u8_t                     nd6_rs_left;
+static u16_t                    nd6_rs_timer;
+
+#define IPBUF   ((struct uip_icmpip_hdr*) &uip_buf[UIP_LLH_LEN])
+#define ETHBUF  ((struct uip_eth_hdr*) &uip_buf[0])
+#define ICMPBUF (&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+/*---------------------------------------------------------------------------*/
+static u8_t neighbor_hash(uip_ipaddr_t ipaddr) {
+    const u8_t*     a = (const u8_t*)ipaddr;
+
+    /* The low bytes of the interface identifier are the most random
+       ones, for SLAAC addresses they are taken from the MAC address. */
+    return (a[14] ^ a[15]) & (UIP_NEIGHBOR_BUCKETS - 1);
+}
+
+/*---------------------------------------------------------------------------*/
+static u8_t neighbor_find(uip_ipaddr_t ipaddr) {
+    u8_t    n;
+
+    for (n = buckets[neighbor_hash(ipaddr)]; n != NEIGHBOR_NONE; n = entries[n].next) {
+        if (uip_ipaddr_cmp(entries[n].ipaddr, ipaddr)) {
+            return n;
+        }
+    }
+
+    return NEIGHBOR_NONE;
+}
+
+/*---------------------------------------------------------------------------*/
+static void neighbor_unlink(u8_t n) {
+    u8_t*   link = &buckets[neighbor_hash(entries[n].ipaddr)];
+
+    while (*link != n) {
+        link = &entries[*link].next;
+    }
+
+    *link = entries[n].next;
+    entries[n].used = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+static u8_t ipaddr_unspecified(uip_ipaddr_t ipaddr) {
+    u8_t    i;
+
+    for (i = 0; i < 8; ++i) {
+        if (ipaddr[i] != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+static u8_t neighbor_onlink(uip_ipaddr_t ipaddr) {
+    if (uip_ip6addr_linklocal(ipaddr)) {
+        return 1;
+    }
+
+    return nd6_prefixlen != 0 && uip_ipaddr_maskcmp(ipaddr, uip_hostaddr, uip_netmask);
+}
+
+/*---------------------------------------------------------------------------*/
+void uip_neighbor_init(void) {
+    memset(entries, 0, sizeof(entries));
+    memset(buckets, NEIGHBOR_NONE, sizeof(buckets));
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Age the neighbor cache.
+ *
+ * Called on every periodic timer tick. Entries not refreshed within
+ * UIP_NEIGHBOR_MAXAGE seconds are dropped, the next packet to such a
+ * neighbor is replaced by a neighbor solicitation.
+ */
+void uip_neighbor_periodic(void) {
+    u8_t    n;
+
+    for (n = 0; n < UIP_NEIGHBOR_ENTRIES; ++n) {
+        if (entries[n].used && ++entries[n].time >= UIP_TICKS(UIP_NEIGHBOR_MAXAGE)) {
+            neighbor_unlink(n);
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Add or refresh a neighbor.
+ *
+ * When the cache is full the entry confirmed longest ago is recycled.
+ */
+void uip_neighbor_add(uip_ipaddr_t ipaddr, struct uip_neighbor_addr* addr) {
+    u8_t    n, i, oldest;
+
+    if (ipaddr_unspecified(ipaddr) || ((u8_t*)ipaddr)[0] == 0xff) {
+        return;
+    }
+
+    n = neighbor_find(ipaddr);
+    if (n == NEIGHBOR_NONE) {
+        oldest = 0;
+        for (i = 0; i < UIP_NEIGHBOR_ENTRIES; ++i) {
+            if (!entries[i].used) {
+                n = i;
+                break;
+            }
+
+            if (entries[i].time > entries[oldest].time) {
+                oldest = i;
+            }
+        }
+
+        if (n == NEIGHBOR_NONE) {
+            n = oldest;
+            neighbor_unlink(n);
+        }
+
+        uip_ipaddr_copy(entries[n].ipaddr, ipaddr);
+        i = neighbor_hash(ipaddr);
+        entries[n].next = buckets[i];
+        entries[n].used = 1;
+        buckets[i] = n;
+    }
+
+    memcpy(&entries[n].addr, addr, sizeof(struct uip_neighbor_addr));
+    entries[n].time = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+void uip_neighbor_update(uip_ipaddr_t ipaddr) {
+    u8_t    n = neighbor_find(ipaddr);
+
+    if (n != NEIGHBOR_NONE) {
+        entries[n].time = 0;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+struct uip_neighbor_addr* uip_neighbor_lookup(uip_ipaddr_t ipaddr) {
+    u8_t    n = neighbor_find(ipaddr);
+
+    return n == NEIGHBOR_NONE ? NULL : &entries[n].addr;
+}
+
+/*---------------------------------------------------------------------------*/
+static void nd6_ipheader(u16_t len) {
+    IPBUF->vtc = 0x60;
+    IPBUF->tcf = 0;
+    IPBUF->flow = 0;
+    IPBUF->len[0] = len >> 8;
+    IPBUF->len[1] = len & 0xff;
+    IPBUF->proto = UIP_PROTO_ICMP6;
+    IPBUF->ttl = ND6_HOPLIMIT;
+
+    memcpy(ETHBUF->src.addr, uip_ethaddr.addr, 6);
+    ETHBUF->type = HTONS(UIP_ETHTYPE_IP6);
+}
+
+/*---------------------------------------------------------------------------*/
+static void nd6_lladdr_option(u8_t* opt, u8_t type) {
+    opt[0] = type;
+    opt[1] = 1;     /* in units of 8 bytes */
+    memcpy(&opt[2], uip_ethaddr.addr, 6);
+}
+
+/*---------------------------------------------------------------------------*/
+static void nd6_solicit(uip_ipaddr_t target) {
+    u8_t*   icmp = ICMPBUF;
+    u8_t*   dest = (u8_t*)IPBUF->destipaddr;
+
+    /* Ask the target's solicited-node group ff02::1:ffXX:XXXX. */
+    ETHBUF->dest.addr[0] = 0x33;
+    ETHBUF->dest.addr[1] = 0x33;
+    ETHBUF->dest.addr[2] = 0xff;
+    memcpy(&ETHBUF->dest.addr[3], &((u8_t*)target)[13], 3);
+
+    nd6_ipheader(ND6_NSLEN);
+    uip_ipaddr_copy(IPBUF->srcipaddr, uip_neighbor_srcaddr(target));
+    memset(dest, 0, 16);
+    dest[0] = 0xff;
+    dest[1] = 0x02;
+    dest[11] = 0x01;
+    dest[12] = 0xff;
+    memcpy(&dest[13], &((u8_t*)target)[13], 3);
+
+    icmp[0] = ICMP6_NEIGHBOR_SOLICITATION;
+    icmp[1] = 0;
+    memset(&icmp[4], 0, 4);
+    memcpy(&icmp[8], target, 16);
+    nd6_lladdr_option(&icmp[24], ICMP6_OPTION_SOURCE_LINK_ADDRESS);
+    IPBUF->icmpchksum = 0;
+    IPBUF->icmpchksum = ~uip_icmp6chksum();
+
+    uip_len = UIP_LLH_LEN + UIP_IPH_LEN + ND6_NSLEN;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Strip the Ethernet header of a received IPv6 packet.
+ *
+ * Like ARP the cache learns the link-layer address of on-link senders
+ * from every packet they send.
+ */
+void uip_neighbor_ipin(void) {
+    uip_len -= sizeof(struct uip_eth_hdr);
+
+    if (neighbor_onlink(IPBUF->srcipaddr)) {
+        uip_neighbor_add(IPBUF->srcipaddr, (struct uip_neighbor_addr*) &ETHBUF->src);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Prepend the Ethernet header to an outgoing IPv6 packet.
+ *
+ * If the next hop (the destination when on-link or when no router is
+ * known, the default router otherwise) is not in the cache, the packet
+ * is replaced by a neighbor solicitation for it and we rely on TCP to
+ * retransmit the packet, like uip_arp_out() does.
+ */
+void uip_neighbor_out(void) {
+    struct uip_neighbor_addr*   n;
+    uip_ipaddr_t                nexthop;
+    u8_t*                       dest = (u8_t*)IPBUF->destipaddr;
+
+    if (dest[0] == 0xff) {
+        /* Multicast: 33:33 followed by the low 32 bits of the group. */
+        ETHBUF->dest.addr[0] = 0x33;
+        ETHBUF->dest.addr[1] = 0x33;
+        memcpy(&ETHBUF->dest.addr[2], &dest[12], 4);
+    }
+    else {
+        if (neighbor_onlink(IPBUF->destipaddr) || ipaddr_unspecified(uip_draddr)) {
+            uip_ipaddr_copy(nexthop, IPBUF->destipaddr);
+        }
+        else {
+            uip_ipaddr_copy(nexthop, uip_draddr);
+        }
+
+        n = uip_neighbor_lookup(nexthop);
+        if (n == NULL) {
+            ++uip_arp_misses;
+            nd6_solicit(nexthop);
+            return;
+        }
+
+        memcpy(ETHBUF->dest.addr, n->addr.addr, 6);
+    }
+
+    memcpy(ETHBUF->src.addr, uip_ethaddr.addr, 6);
+    ETHBUF->type = HTONS(UIP_ETHTYPE_IP6);
+
+    uip_len += sizeof(struct uip_eth_hdr);
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Start stateless address autoconfiguration.
+ *
+ * The link-local address fe80::/64 plus the modified EUI-64 of the MAC
+ * address is used as host address until a router advertises a prefix.
+ * Duplicate address detection is not done.
+ *
+ * \param autoconf 0 to keep the statically set host address, netmask
+ * and default router, only the link-local address is configured then.
+ */
+void uip_nd6_start(u8_t autoconf) {
+    u8_t*   ll = (u8_t*)uip_lladdr;
+    u8_t    i;
+
+    memset(uip_lladdr, 0, sizeof(uip_lladdr));
+    ll[0] = 0xfe;
+    ll[1] = 0x80;
+    ll[8] = uip_ethaddr.addr[0] ^ 0x02;
+    ll[9] = uip_ethaddr.addr[1];
+    ll[10] = uip_ethaddr.addr[2];
+    ll[11] = 0xff;
+    ll[12] = 0xfe;
+    ll[13] = uip_ethaddr.addr[3];
+    ll[14] = uip_ethaddr.addr[4];
+    ll[15] = uip_ethaddr.addr[5];
+
+    if (!autoconf) {
+        nd6_prefixlen = 0;
+        for (i = 0; i < 128 && (((u8_t*)uip_netmask)[i >> 3] & (0x80 >> (i & 7))); ++i) {
+            ++nd6_prefixlen;
+        }
+
+        nd6_configured = 1;
+        nd6_rs_left = 0;
+        return;
+    }
+
+    uip_ipaddr_copy(uip_hostaddr, uip_lladdr);
+    memset(uip_netmask, 0, sizeof(uip_netmask));
+    memset(uip_draddr, 0, sizeof(uip_draddr));
+
+    nd6_configured = 0;
+    nd6_prefixlen = 0;
+    nd6_rs_left = UIP_ND6_RS_COUNT;
+    nd6_rs_timer = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Send router solicitations until a router answers.
+ *
+ * Leaves a router solicitation to ff02::2 in uip_buf (uip_len > 0,
+ * Ethernet header included) when one is due.
+ */
+void uip_nd6_periodic(void) {
+    u8_t*   icmp = ICMPBUF;
+    u8_t*   dest = (u8_t*)IPBUF->destipaddr;
+
+    uip_len = 0;
+    if (nd6_rs_left == 0) {
+        return;
+    }
+
+    if (nd6_rs_timer > 0) {
+        --nd6_rs_timer;
+        return;
+    }
+
+    --nd6_rs_left;
+    nd6_rs_timer = UIP_TICKS(UIP_ND6_RS_INTERVAL);
+
+    memset(ETHBUF->dest.addr, 0, 6);
+    ETHBUF->dest.addr[0] = 0x33;
+    ETHBUF->dest.addr[1] = 0x33;
+    ETHBUF->dest.addr[5] = 0x02;
+
+    nd6_ipheader(ND6_RSLEN);
+    uip_ipaddr_copy(IPBUF->srcipaddr, uip_lladdr);
+    memset(dest, 0, 16);
+    dest[0] = 0xff;
+    dest[1] = 0x02;
+    dest[15] = 0x02;
+
+    icmp[0] = ICMP6_ROUTER_SOLICITATION;
+    icmp[1] = 0;
+    memset(&icmp[4], 0, 4);
+    nd6_lladdr_option(&icmp[8], ICMP6_OPTION_SOURCE_LINK_ADDRESS);
+    IPBUF->icmpchksum = 0;
+    IPBUF->icmpchksum = ~uip_icmp6chksum();
+
+    uip_len = UIP_LLH_LEN + UIP_IPH_LEN + ND6_RSLEN;
+}
+
+/*---------------------------------------------------------------------------*/
+static void nd6_prefix(u8_t* opt) {
+    u8_t*   host = (u8_t*)uip_hostaddr;
+
+    /* Only /64 prefixes with the autonomous flag and a valid lifetime
+       can be combined with the EUI-64 interface identifier. */
+    if (opt[1] << 3 != ND6_PIO_LEN || opt[2] != 64 || !(opt[3] & ND6_PIO_AUTONOMOUS)) {
+        return;
+    }
+
+    if ((opt[4] | opt[5] | opt[6] | opt[7]) == 0 || uip_ip6addr_linklocal(&opt[16])) {
+        return;
+    }
+
+    memcpy(host, &opt[16], 8);
+    memcpy(&host[8], &((u8_t*)uip_lladdr)[8], 8);
+    uip_ip6addr(uip_netmask, 0xffff, 0xffff, 0xffff, 0xffff, 0, 0, 0, 0);
+
+    nd6_prefixlen = 64;
+    nd6_configured = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Process a router or neighbor advertisement in uip_buf.
+ *
+ * A router advertisement with a non-zero lifetime makes its sender the
+ * default router, its prefix information configures the host address.
+ * Lifetimes are not tracked, the configuration is kept until the next
+ * advertisement changes it. Options beyond uip_buf are ignored.
+ */
+void uip_nd6_input(void) {
+    u8_t*   icmp = ICMPBUF;
+    u8_t*   opt;
+    u16_t   len, pos;
+
+    len = (uip_len < UIP_BUFSIZE - UIP_LLH_LEN ? uip_len : UIP_BUFSIZE - UIP_LLH_LEN) - UIP_IPH_LEN;
+
+    /* Neighbor discovery messages never pass a router. */
+    if (IPBUF->ttl != ND6_HOPLIMIT || icmp[1] != 0) {
+        return;
+    }
+
+    if (icmp[0] == ICMP6_ROUTER_ADVERTISEMENT) {
+        if (!uip_ip6addr_linklocal(IPBUF->srcipaddr)) {
+            return;
+        }
+
+        if (icmp[6] | icmp[7]) {
+            uip_ipaddr_copy(uip_draddr, IPBUF->srcipaddr);
+            nd6_rs_left = 0;
+        }
+
+        pos = ND6_RA_OPTIONS;
+    }
+    else
+    if (icmp[0] == ICMP6_NEIGHBOR_ADVERTISEMENT) {
+        pos = ND6_NA_OPTIONS;
+    }
+    else {
+        return;
+    }
+
+    while (pos + 2 <= len && icmp[pos + 1] != 0 && pos + (icmp[pos + 1] << 3) <= len) {
+        opt = &icmp[pos];
+        switch (opt[0]) {
+            case ICMP6_OPTION_SOURCE_LINK_ADDRESS:
+                if (icmp[0] == ICMP6_ROUTER_ADVERTISEMENT) {
+                    uip_neighbor_add(IPBUF->srcipaddr, (struct uip_neighbor_addr*) &opt[2]);
+                }
+                break;
+
+            case ICMP6_OPTION_TARGET_LINK_ADDRESS:
+                if (icmp[0] == ICMP6_NEIGHBOR_ADVERTISEMENT) {
+                    uip_neighbor_add((u16_t*) &icmp[8], (struct uip_neighbor_addr*) &opt[2]);
+                }
+                break;
+
+            case ICMP6_OPTION_PREFIX_INFO:
+                if (icmp[0] == ICMP6_ROUTER_ADVERTISEMENT) {
+                    nd6_prefix(opt);
+                }
+                break;
+        }
+
+        pos += opt[1] << 3;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+u8_t uip_nd6_configured(void) {
+    return nd6_configured;
+}
+
+/*---------------------------------------------------------------------------*/
+u8_t uip_nd6_prefixlen(void) {
+    return nd6_prefixlen;
+}
+
+#endif /* UIP_CONF_IPV6 */
+
+/** @} */
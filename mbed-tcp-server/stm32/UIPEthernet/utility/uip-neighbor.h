@@ -0,0 +1,128 @@
+/**
+ * \addtogroup uip
+ * @{
+ */
+/**
+ * \defgroup uipneighbor uIP IPv6 neighbor discovery
+ * @{
+ *
+ * The IPv6 counterpart of the ARP module: a neighbor cache mapping
+ * IPv6 addresses to Ethernet addresses, neighbor solicitations for
+ * unknown next hops and stateless address autoconfiguration (SLAAC,
+ * RFC 4862) from router advertisements.
+ *
+ * The cache is indexed: entries are chained off UIP_NEIGHBOR_BUCKETS
+ * hash buckets keyed on the low bits of the interface identifier, so a
+ * lookup touches one or two entries instead of scanning the table.
+ */
+/**
+ * \file
+ * Neighbor cache and neighbor discovery for IPv6.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the uIP TCP/IP stack
+ *
+ */
+#ifndef __UIP_NEIGHBOR_H__
+#define __UIP_NEIGHBOR_H__
+
+#include "uip.h"
+
+#ifndef UIP_NEIGHBOR_ENTRIES
+#define UIP_NEIGHBOR_ENTRIES    8   /* cached neighbors */
+#endif
+
+#ifndef UIP_NEIGHBOR_BUCKETS
+#define UIP_NEIGHBOR_BUCKETS    8   /* hash buckets, a power of two */
+#endif
+
+#ifndef UIP_NEIGHBOR_MAXAGE
+#define UIP_NEIGHBOR_MAXAGE     120 /* seconds an entry is kept without being confirmed */
+#endif
+
+#ifndef UIP_ND6_RS_COUNT
+#define UIP_ND6_RS_COUNT        3   /* router solicitations sent at startup */
+#endif
+
+#ifndef UIP_ND6_RS_INTERVAL
+#define UIP_ND6_RS_INTERVAL     4   /* seconds between router solicitations */
+#endif
+
+#define ICMP6_ROUTER_SOLICITATION       133
+#define ICMP6_ROUTER_ADVERTISEMENT      134
+#define ICMP6_NEIGHBOR_SOLICITATION     135
+#define ICMP6_NEIGHBOR_ADVERTISEMENT    136
+
+#define ICMP6_OPTION_SOURCE_LINK_ADDRESS    1
+#define ICMP6_OPTION_TARGET_LINK_ADDRESS    2
+#define ICMP6_OPTION_PREFIX_INFO            3
+
+struct uip_neighbor_addr
+{
+    struct uip_eth_addr addr;
+};
+
+/* Link-local address (fe80::/64 plus the EUI-64 of the MAC address). */
+extern uip_ipaddr_t uip_lladdr;
+
+#define uip_ip6addr_linklocal(a)    (((u8_t*)(a))[0] == 0xfe && (((u8_t*)(a))[1] & 0xc0) == 0x80)
+
+/* Source address for packets to a: the link-local address for link-local
+   destinations, the (autoconfigured) host address otherwise. */
+#define uip_neighbor_srcaddr(a)     (uip_ip6addr_linklocal(a) ? uip_lladdr : uip_hostaddr)
+
+void                        uip_neighbor_init(void);
+void                        uip_neighbor_add(uip_ipaddr_t ipaddr, struct uip_neighbor_addr* addr);
+void                        uip_neighbor_update(uip_ipaddr_t ipaddr);
+struct uip_neighbor_addr*   uip_neighbor_lookup(uip_ipaddr_t ipaddr);
+void                        uip_neighbor_periodic(void);
+
+/* Counterparts of uip_arp_ipin() and uip_arp_out(): strip the Ethernet
+   header of a received IPv6 packet, and prepend one to an outgoing packet
+   or replace the packet with a neighbor solicitation for its next hop. */
+void                        uip_neighbor_ipin(void);
+void                        uip_neighbor_out(void);
+
+/* Stateless address autoconfiguration. uip_nd6_start() configures the
+   link-local address and, unless the host address, netmask and default
+   router were set statically (autoconf = 0), starts soliciting routers;
+   uip_nd6_periodic(),
+   called on every periodic timer tick like uip_neighbor_periodic(),
+   leaves a router solicitation in uip_buf when one is due.
+   uip_nd6_input() handles router and neighbor advertisements. */
+void                        uip_nd6_start(u8_t autoconf);
+void                        uip_nd6_periodic(void);
+void                        uip_nd6_input(void);
+u8_t                        uip_nd6_configured(void);
+u8_t                        uip_nd6_prefixlen(void);
+#endif /* __UIP_NEIGHBOR_H__ */
+
+/** @} */
+/** @} */
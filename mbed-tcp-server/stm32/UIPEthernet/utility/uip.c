@@ -79,6 +79,8 @@
 #include "uip.h"
 #include "uipopt.h"
 #include "uip_arch.h"
+#include "uip_clock.h"
+#include "uip_trace.h"
 
 #if UIP_CONF_IPV6
 #include "uip-neighbor.h"
@@ -175,10 +177,21 @@ struct uip_udp_conn*        uip_udp_conn;
 struct uip_udp_conn         uip_udp_conns[UIP_UDP_CONNS];
 #endif /* UIP_UDP */
 
+#if UIP_FAST_RETRANSMIT
+uip_stats_t                 uip_fastrexmits;    /* Segments resent on three duplicate ACKs. */
+#endif /* UIP_FAST_RETRANSMIT */
+
 static u16_t                ipid;           /* Ths ipid variable is an increasing
                 number that is used for the IP ID
                 field. */
 
+#if UIP_SYN_COOKIES
+uip_stats_t                 uip_syncookies_sent;        /* SYNACKs answered with a cookie. */
+uip_stats_t                 uip_syncookies_accepted;    /* Connections set up from a cookie. */
+unsigned long               uip_syncookie_secret;       /* Key of the cookie hash. */
+static u16_t                syncookie_ticks;            /* Periodic timer ticks, the cookie epoch. */
+#endif /* UIP_SYN_COOKIES */
+
 /**
  * @brief
  * @note
@@ -189,6 +202,16 @@ void uip_setipid(u16_t id) {
     ipid = id;
 }
 
+/**
+ * @brief   Returns the IP ID for a datagram built outside of uip_process
+ * @note
+ * @param
+ * @retval
+ */
+u16_t uip_nextipid(void) {
+    return ++ipid;
+}
+
 static u8_t     iss[4];     /* The iss variable is used for the TCP
                 initial sequence number. */
 
@@ -230,6 +253,7 @@ static u16_t    tmp16;
 #define ICMP6_NEIGHBOR_ADVERTISEMENT        136
 
 #define ICMP6_FLAG_S                        (1 << 6)
+#define ICMP6_FLAG_O                        (1 << 5)
 #define ICMP6_OPTION_SOURCE_LINK_ADDRESS    1
 #define ICMP6_OPTION_TARGET_LINK_ADDRESS    2
 
@@ -239,6 +263,14 @@ static u16_t    tmp16;
 #define FBUF    ((struct uip_tcpip_hdr*) &uip_reassbuf[0])
 #define ICMPBUF ((struct uip_icmpip_hdr*) &uip_buf[UIP_LLH_LEN])
 #define UDPBUF  ((struct uip_udpip_hdr*) &uip_buf[UIP_LLH_LEN])
+
+/* Source address of packets to addr. IPv6 answers link-local peers
+   from the link-local address. */
+#if UIP_CONF_IPV6
+#define SRCADDR(addr)   uip_neighbor_srcaddr(addr)
+#else /* UIP_CONF_IPV6 */
+#define SRCADDR(addr)   uip_hostaddr
+#endif /* UIP_CONF_IPV6 */
 #if UIP_STATISTICS == 1
 struct uip_stats    uip_stat;
 #define UIP_STAT(s) s
@@ -404,6 +436,113 @@ u16_t uip_udpchksum(void) {
 #endif /* UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 
+#if UIP_SYN_COOKIES
+/*---------------------------------------------------------------------------*/
+/* Decrements a sequence number in network byte order. */
+static void seqno_dec(u8_t* seqno) {
+    if (seqno[3]-- == 0) {
+        if (seqno[2]-- == 0) {
+            if (seqno[1]-- == 0) {
+                --seqno[0];
+            }
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Computes the SYN cookie, our initial sequence number, for the segment
+   in uip_buf: a keyed hash of both endpoints, the peer's initial
+   sequence number isn and the epoch. The cookie stays valid for two
+   epochs of 64 seconds. */
+static void syncookie(u8_t* cookie, u8_t* isn, u8_t epoch) {
+    unsigned long   h = uip_syncookie_secret + epoch;
+    u8_t*           p = (u8_t*) &BUF->srcipaddr;
+    u8_t            i;
+
+    /* source and destination address and port */
+    for (i = 0; i < 12 + 4; ++i) {
+        h += i < 12 ? p[i] : isn[i - 12];
+        h += h << 10;
+        h ^= (h & 0xffffffffUL) >> 6;
+    }
+
+    h += h << 3;
+    h ^= (h & 0xffffffffUL) >> 11;
+    h += h << 15;
+
+    cookie[0] = h >> 24;
+    cookie[1] = h >> 16;
+    cookie[2] = h >> 8;
+    cookie[3] = h;
+}
+
+#define syncookie_epoch()   ((u8_t) (syncookie_ticks / UIP_TICKS(64)))
+#endif /* UIP_SYN_COOKIES */
+
+/*---------------------------------------------------------------------------*/
+/* Feeds a round trip time sample in milliseconds into the RFC 6298
+   estimator and derives the retransmission timeout in timer pulses:
+   RTO = SRTT + max(G, 4 * RTTVAR), at least UIP_RTO_MIN. */
+static void uip_rtt_sample(struct uip_conn* conn, u16_t rtt) {
+    u16_t   rto;
+    int16_t   err;
+
+    if (rtt > UIP_RTT_MAX) {
+        return;
+    }
+
+    if (rtt == 0) {
+        rtt = 1;
+    }
+
+    if (conn->srtt == 0) {
+
+        /* First sample: SRTT = R, RTTVAR = R / 2 */
+        conn->srtt = rtt << 3;
+        conn->rttvar = rtt << 1;
+    }
+    else {
+
+        /* SRTT += (R - SRTT) / 8, RTTVAR += (|R - SRTT| - RTTVAR) / 4 */
+        err = (int16_t) rtt - (int16_t) (conn->srtt >> 3);
+        conn->srtt += err;
+        if (err < 0) {
+            err = -err;
+        }
+
+        conn->rttvar += err - (conn->rttvar >> 2);
+    }
+
+    rto = (conn->srtt >> 3) + (conn->rttvar > UIP_PERIODIC_TIMEOUT ? conn->rttvar : UIP_PERIODIC_TIMEOUT);
+    if (rto < UIP_RTO_MIN) {
+        rto = UIP_RTO_MIN;
+    }
+
+    rto = (rto + UIP_PERIODIC_TIMEOUT - 1) / UIP_PERIODIC_TIMEOUT;
+    conn->rto = rto > 0xff ? 0xff : rto;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Finds a connection for a new peer: an unused one or the oldest one in
+   TIME_WAIT. */
+static struct uip_conn* uip_freeconn(void) {
+    register struct uip_conn*   conn = 0;
+
+    for (c = 0; c < UIP_CONNS; ++c) {
+        if (uip_conns[c].tcpstateflags == UIP_CLOSED) {
+            return &uip_conns[c];
+        }
+
+        if (uip_conns[c].tcpstateflags == UIP_TIME_WAIT) {
+            if (conn == 0 || uip_conns[c].timer > conn->timer) {
+                conn = &uip_conns[c];
+            }
+        }
+    }
+
+    return conn;
+}
+
 /*---------------------------------------------------------------------------*/
 void uip_init(void) {
     for (c = 0; c < UIP_LISTENPORTS; ++c) {
@@ -491,10 +630,19 @@ again:
 
     conn->len = 1;      /* TCP length of the SYN is one. */
     conn->nrtx = 0;
+    conn->kaprobes = 0;
+    conn->idle = conn->quiet = 0;
+#if UIP_STATISTICS
+    conn->rxframes = conn->txframes = 0;
+    conn->rxbytes = conn->txbytes = 0;
+    conn->rexmits = 0;
+#endif
     conn->timer = 1;    /* Send the SYN next time around. */
     conn->rto = UIP_RTO;
-    conn->sa = 0;
-    conn->sv = 16;      /* Initial value of the RTT variance. */
+    conn->srtt = 0;
+    conn->rttvar = 0;
+    conn->dupacks = 0;
+    conn->rtt_start = clock_time_ms();
     conn->lport = htons(lastport);
     conn->rport = rport;
     uip_ipaddr_copy(&conn->ripaddr, ripaddr);
@@ -723,8 +871,26 @@ static void uip_add_rcv_nxt(u16_t n) {
 }
 
 /*---------------------------------------------------------------------------*/
+#if UIP_TRACE
+static void uip_process_body(u8_t flag);
+
+void uip_process(u8_t flag) {
+    UIP_TRACE_BEGIN(UIP_TRACE_PROCESS);
+    uip_process_body(flag);
+    UIP_TRACE_END(UIP_TRACE_PROCESS);
+}
+
+static void uip_process_body(u8_t flag) {
+#else
 void uip_process(u8_t flag) {
+#endif
     register struct uip_conn*   uip_connr = uip_conn;
+#if UIP_FAST_RETRANSMIT
+    u8_t                        fastrexmit = 0;
+#endif
+#if UIP_KEEPALIVE_IDLE
+    u8_t                        kaprobe = 0;
+#endif
 
 #if UIP_UDP
     if (flag == UIP_UDP_SEND_CONN) {
@@ -756,6 +922,12 @@ void uip_process(u8_t flag) {
         }
 #endif /* UIP_REASSEMBLY */
 
+#if UIP_SYN_COOKIES
+        if (uip_connr == &uip_conns[0]) {
+            ++syncookie_ticks;
+        }
+#endif /* UIP_SYN_COOKIES */
+
         /* Increase the initial sequence number. */
 
         if (++iss[3] == 0) {
@@ -810,7 +982,8 @@ void uip_process(u8_t flag) {
                     }
 
                     /* Exponential backoff. */
-                    uip_connr->timer = UIP_RTO << (uip_connr->nrtx > 4 ? 4 : uip_connr->nrtx);
+                    tmp16 = (u16_t) uip_connr->rto << (uip_connr->nrtx > 4 ? 4 : uip_connr->nrtx);
+                    uip_connr->timer = tmp16 > 0xff ? 0xff : tmp16;
                     ++(uip_connr->nrtx);
 
                     /* Ok, so we need to retransmit. We do this differently
@@ -820,6 +993,7 @@ void uip_process(u8_t flag) {
          SYNACK that we sent earlier and in LAST_ACK we have to
          retransmit our FINACK. */
                     UIP_STAT(++uip_stat.tcp.rexmit);
+                    UIP_STAT(++uip_connr->rexmits);
                     switch (uip_connr->tcpstateflags & UIP_TS_MASK) {
                         case UIP_SYN_RCVD:
                             /* In the SYN_RCVD state, we should retransmit our
@@ -853,6 +1027,29 @@ void uip_process(u8_t flag) {
             }
             else
             if ((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+#if UIP_IDLE_TIMEOUT
+                if (++(uip_connr->quiet) >= UIP_TICKS(UIP_IDLE_TIMEOUT)) {
+                    goto idle_timedout;
+                }
+#endif
+#if UIP_KEEPALIVE_IDLE
+                /* Probe a silent peer with a segment it has to ACK,
+           give up after UIP_KEEPALIVE_PROBES unanswered probes. */
+                if
+                (
+                    ++(uip_connr->idle) >=
+                        UIP_TICKS(UIP_KEEPALIVE_IDLE) +
+                        uip_connr->kaprobes * UIP_TICKS(UIP_KEEPALIVE_INTERVAL)
+                ) {
+                    if (uip_connr->kaprobes == UIP_KEEPALIVE_PROBES) {
+                        goto idle_timedout;
+                    }
+
+                    ++(uip_connr->kaprobes);
+                    kaprobe = 1;
+                    goto tcp_send_ack;
+                }
+#endif
 
                 /* If there was no need for a retransmission, we poll the
            application for new data. */
@@ -863,6 +1060,16 @@ void uip_process(u8_t flag) {
         }
 
         goto drop;
+
+#if UIP_KEEPALIVE_IDLE || UIP_IDLE_TIMEOUT
+idle_timedout:
+        uip_connr->tcpstateflags = UIP_CLOSED;
+        uip_connr->kaprobes = UIP_IDLE_REAPED;
+        uip_flags = UIP_TIMEDOUT;
+        UIP_APPCALL();
+        BUF->flags = TCP_RST | TCP_ACK;
+        goto tcp_send_nodata;
+#endif
     }
 
 #if UIP_UDP
@@ -1003,7 +1210,12 @@ void uip_process(u8_t flag) {
        address) as well. However, we will cheat here and accept all
        multicast packets that are sent to the ff02::/16 addresses. */
 
-        if (!uip_ipaddr_cmp(BUF->destipaddr, uip_hostaddr) && BUF->destipaddr[0] != HTONS(0xff02)) {
+        if
+        (
+            !uip_ipaddr_cmp(BUF->destipaddr, uip_hostaddr)
+        &&  !uip_ipaddr_cmp(BUF->destipaddr, uip_lladdr)
+        &&  BUF->destipaddr[0] != HTONS(0xff02)
+        ) {
             UIP_STAT(++uip_stat.ip.drop);
             goto drop;
         }
@@ -1112,25 +1324,44 @@ void uip_process(u8_t flag) {
     /* If we get a neighbor solicitation for our address we should send
      a neighbor advertisement message back. */
     if (ICMPBUF->type == ICMP6_NEIGHBOR_SOLICITATION) {
-        if (uip_ipaddr_cmp(ICMPBUF->icmp6data, uip_hostaddr)) {
+        if
+        (
+            uip_ipaddr_cmp(ICMPBUF->icmp6data, uip_hostaddr)
+        ||  uip_ipaddr_cmp(ICMPBUF->icmp6data, uip_lladdr)
+        ) {
             if (ICMPBUF->options[0] == ICMP6_OPTION_SOURCE_LINK_ADDRESS) {
 
                 /* Save the sender's address in our neighbor list. */
-                uip_neighbor_add(ICMPBUF->srcipaddr, &(ICMPBUF->options[2]));
+                uip_neighbor_add(ICMPBUF->srcipaddr, (struct uip_neighbor_addr*) &(ICMPBUF->options[2]));
             }
 
             /* We should now send a neighbor advertisement back to where the
-     neighbor solicication came from. */
+     neighbor solicication came from. A solicitation from the
+     unspecified address (duplicate address detection) is answered
+     to all nodes. */
             ICMPBUF->type = ICMP6_NEIGHBOR_ADVERTISEMENT;
-            ICMPBUF->flags = ICMP6_FLAG_S;  /* Solicited flag. */
+            ICMPBUF->flags = ICMP6_FLAG_S | ICMP6_FLAG_O;   /* Solicited, override flags. */
 
             ICMPBUF->reserved1 = ICMPBUF->reserved2 = ICMPBUF->reserved3 = 0;
 
-            uip_ipaddr_copy(ICMPBUF->destipaddr, ICMPBUF->srcipaddr);
-            uip_ipaddr_copy(ICMPBUF->srcipaddr, uip_hostaddr);
+            if (uip_ipaddr_cmp(ICMPBUF->srcipaddr, all_zeroes_addr)) {
+                ICMPBUF->flags = ICMP6_FLAG_O;
+                uip_ip6addr(ICMPBUF->destipaddr, 0xff02, 0, 0, 0, 0, 0, 0, 1);
+            }
+            else {
+                uip_ipaddr_copy(ICMPBUF->destipaddr, ICMPBUF->srcipaddr);
+            }
+
+            uip_ipaddr_copy(ICMPBUF->srcipaddr, ICMPBUF->icmp6data);
             ICMPBUF->options[0] = ICMP6_OPTION_TARGET_LINK_ADDRESS;
             ICMPBUF->options[1] = 1;        /* Options length, 1 = 8 bytes. */
             memcpy(&(ICMPBUF->options[2]), &uip_ethaddr, sizeof(uip_ethaddr));
+
+            /* Target and option, any further options are dropped. */
+            uip_len = UIP_IPH_LEN + 32;
+            ICMPBUF->len[0] = 0;
+            ICMPBUF->len[1] = 32;
+            ICMPBUF->ttl = 255;
             ICMPBUF->icmpchksum = 0;
             ICMPBUF->icmpchksum = ~uip_icmp6chksum();
             goto send;
@@ -1139,15 +1370,35 @@ void uip_process(u8_t flag) {
         goto drop;
     }
     else
+    if
+    (
+        ICMPBUF->type == ICMP6_ROUTER_ADVERTISEMENT
+    ||  ICMPBUF->type == ICMP6_NEIGHBOR_ADVERTISEMENT
+    ) {
+        uip_nd6_input();
+        goto drop;
+    }
+    else
     if (ICMPBUF->type == ICMP6_ECHO) {
 
         /* ICMP echo (i.e., ping) processing. This is simple, we only
        change the ICMP type from ECHO to ECHO_REPLY and update the
-       ICMP checksum before we return the packet. */
+       ICMP checksum before we return the packet. Echo requests to a
+       multicast group are answered from our own address. */
         ICMPBUF->type = ICMP6_ECHO_REPLY;
 
-        uip_ipaddr_copy(BUF->destipaddr, BUF->srcipaddr);
-        uip_ipaddr_copy(BUF->srcipaddr, uip_hostaddr);
+        if (BUF->destipaddr[0] == HTONS(0xff02)) {
+            uip_ipaddr_copy(BUF->destipaddr, SRCADDR(BUF->srcipaddr));
+        }
+
+        /* Swap IP addresses. */
+        for (c = 0; c < 8; ++c) {
+            tmp16 = BUF->destipaddr[c];
+            BUF->destipaddr[c] = BUF->srcipaddr[c];
+            BUF->srcipaddr[c] = tmp16;
+        }
+
+        ICMPBUF->ttl = UIP_TTL;
         ICMPBUF->icmpchksum = 0;
         ICMPBUF->icmpchksum = ~uip_icmp6chksum();
 
@@ -1249,7 +1500,7 @@ udp_send:
     BUF->srcport = uip_udp_conn->lport;
     BUF->destport = uip_udp_conn->rport;
 
-    uip_ipaddr_copy(BUF->srcipaddr, uip_hostaddr);
+    uip_ipaddr_copy(BUF->srcipaddr, SRCADDR(uip_udp_conn->ripaddr));
     uip_ipaddr_copy(BUF->destipaddr, uip_udp_conn->ripaddr);
 
     uip_appdata = &uip_buf[UIP_LLH_LEN + UIP_IPTCPH_LEN];
@@ -1300,6 +1551,12 @@ udp_send:
      destined for a connection in LISTEN. If the SYN flag isn't set,
      it is an old packet and we send a RST. */
     if ((BUF->flags & TCP_CTL) != TCP_SYN) {
+#if UIP_SYN_COOKIES
+        /* It may also complete a handshake answered with a SYN cookie. */
+        if ((BUF->flags & (TCP_SYN | TCP_RST | TCP_FIN | TCP_ACK)) == TCP_ACK) {
+            goto syncookie_ack;
+        }
+#endif /* UIP_SYN_COOKIES */
         goto reset;
     }
 
@@ -1360,11 +1617,130 @@ reset:
 
     /* Swap IP addresses. */
     uip_ipaddr_copy(BUF->destipaddr, BUF->srcipaddr);
-    uip_ipaddr_copy(BUF->srcipaddr, uip_hostaddr);
+    uip_ipaddr_copy(BUF->srcipaddr, SRCADDR(BUF->destipaddr));
 
     /* And send out the RST packet! */
     goto tcp_send_noconn;
 
+#if UIP_SYN_COOKIES
+    /* This label will be jumped to if a SYN arrived for a listening port
+     but all connections are in use. We answer with a SYNACK whose
+     sequence number is the cookie and keep no state. */
+syncookie_synack:
+    {
+        u8_t    cookie[4];
+
+        syncookie(cookie, BUF->seqno, syncookie_epoch());
+        UIP_LOG("tcp: no unused connections, sending SYN cookie.");
+        ++uip_syncookies_sent;
+
+        /* Acknowledge the peer's SYN and use the cookie as our sequence number. */
+        for (c = 0; c < 4; ++c) {
+            BUF->ackno[c] = BUF->seqno[c];
+            BUF->seqno[c] = cookie[c];
+        }
+
+        if (++BUF->ackno[3] == 0) {
+            if (++BUF->ackno[2] == 0) {
+                if (++BUF->ackno[1] == 0) {
+                    ++BUF->ackno[0];
+                }
+            }
+        }
+
+        tmp16 = BUF->srcport;
+        BUF->srcport = BUF->destport;
+        BUF->destport = tmp16;
+
+        uip_ipaddr_copy(BUF->destipaddr, BUF->srcipaddr);
+        uip_ipaddr_copy(BUF->srcipaddr, SRCADDR(BUF->destipaddr));
+
+        BUF->flags = TCP_SYN | TCP_ACK;
+        BUF->wnd[0] = ((UIP_RECEIVE_WINDOW) >> 8);
+        BUF->wnd[1] = ((UIP_RECEIVE_WINDOW) & 0xff);
+        BUF->optdata[0] = TCP_OPT_MSS;
+        BUF->optdata[1] = TCP_OPT_MSS_LEN;
+        BUF->optdata[2] = (UIP_TCP_MSS) / 256;
+        BUF->optdata[3] = (UIP_TCP_MSS) & 255;
+        uip_len = UIP_IPTCPH_LEN + TCP_OPT_MSS_LEN;
+        BUF->tcpoffset = ((UIP_TCPH_LEN + TCP_OPT_MSS_LEN) / 4) << 4;
+        goto tcp_send_noconn;
+    }
+
+    /* This label will be jumped to if an ACK arrived which matches no
+     connection. If it acknowledges a valid cookie for a listening port
+     the connection is created in SYN_RCVD and the ACK processed as
+     usual. */
+syncookie_ack:
+    for (c = 0; c < UIP_LISTENPORTS; ++c) {
+        if (BUF->destport == uip_listenports[c])
+            break;
+    }
+
+    if (c == UIP_LISTENPORTS) {
+        goto reset;
+    }
+
+    {
+        u8_t    isn[4];
+        u8_t    ours[4];
+        u8_t    cookie[4];
+        u8_t    epoch = syncookie_epoch();
+
+        memcpy(isn, BUF->seqno, 4);
+        seqno_dec(isn);
+        memcpy(ours, BUF->ackno, 4);
+        seqno_dec(ours);
+
+        syncookie(cookie, isn, epoch);
+        if (memcmp(cookie, ours, 4) != 0) {
+            syncookie(cookie, isn, epoch - 1);
+            if (memcmp(cookie, ours, 4) != 0) {
+                goto reset;
+            }
+        }
+
+        uip_connr = uip_freeconn();
+        if (uip_connr == 0) {
+
+            /* Still no connection to spare. The peer considers the
+             connection established and never retransmits a bare ACK,
+             so reset it: the client fails at once and can connect
+             again instead of waiting for its first data to time out. */
+            UIP_STAT(++uip_stat.tcp.syndrop);
+            goto reset;
+        }
+
+        ++uip_syncookies_accepted;
+
+        uip_connr->rto = uip_connr->timer = UIP_RTO;
+        uip_connr->srtt = 0;
+        uip_connr->rttvar = 0;
+        uip_connr->dupacks = 0;
+
+        /* The SYNACK was sent without state, don't take a sample. */
+        uip_connr->nrtx = 1;
+        uip_connr->kaprobes = 0;
+        uip_connr->idle = uip_connr->quiet = 0;
+#if UIP_STATISTICS
+        uip_connr->rxframes = uip_connr->txframes = 0;
+        uip_connr->rxbytes = uip_connr->txbytes = 0;
+        uip_connr->rexmits = 0;
+#endif
+        uip_connr->lport = BUF->destport;
+        uip_connr->rport = BUF->srcport;
+        uip_ipaddr_copy(uip_connr->ripaddr, BUF->srcipaddr);
+        uip_connr->tcpstateflags = UIP_SYN_RCVD;
+        memcpy(uip_connr->snd_nxt, ours, 4);
+        uip_connr->len = 1;
+        memcpy(uip_connr->rcv_nxt, BUF->seqno, 4);
+
+        /* The peer's MSS option was not kept. */
+        uip_connr->initialmss = uip_connr->mss = UIP_SYNCOOKIE_MSS;
+        goto found;
+    }
+#endif /* UIP_SYN_COOKIES */
+
     /* This label will be jumped to if we matched the incoming packet
      with a connection in LISTEN. In that case, we should create a new
      connection and send a SYNACK in return. */
@@ -1375,21 +1751,12 @@ found_listen:
      TIME_WAIT are kept track of and we'll use the oldest one if no
      CLOSED connections are found. Thanks to Eddie C. Dost for a very
      nice algorithm for the TIME_WAIT search. */
-    uip_connr = 0;
-    for (c = 0; c < UIP_CONNS; ++c) {
-        if (uip_conns[c].tcpstateflags == UIP_CLOSED) {
-            uip_connr = &uip_conns[c];
-            break;
-        }
-
-        if (uip_conns[c].tcpstateflags == UIP_TIME_WAIT) {
-            if (uip_connr == 0 || uip_conns[c].timer > uip_connr->timer) {
-                uip_connr = &uip_conns[c];
-            }
-        }
-    }
+    uip_connr = uip_freeconn();
 
     if (uip_connr == 0) {
+#if UIP_SYN_COOKIES
+        goto syncookie_synack;
+#endif /* UIP_SYN_COOKIES */
 
         /* All connections are used already, we drop packet and hope that
        the remote end will retransmit the packet at a time when we
@@ -1403,9 +1770,18 @@ found_listen:
 
     /* Fill in the necessary fields for the new connection. */
     uip_connr->rto = uip_connr->timer = UIP_RTO;
-    uip_connr->sa = 0;
-    uip_connr->sv = 4;
+    uip_connr->srtt = 0;
+    uip_connr->rttvar = 0;
+    uip_connr->dupacks = 0;
+    uip_connr->rtt_start = clock_time_ms();
     uip_connr->nrtx = 0;
+#if UIP_STATISTICS
+    uip_connr->rxframes = uip_connr->txframes = 0;
+    uip_connr->rxbytes = uip_connr->txbytes = 0;
+    uip_connr->rexmits = 0;
+#endif
+    uip_connr->kaprobes = 0;
+    uip_connr->idle = uip_connr->quiet = 0;
     uip_connr->lport = BUF->destport;
     uip_connr->rport = BUF->srcport;
     uip_ipaddr_copy(uip_connr->ripaddr, BUF->srcipaddr);
@@ -1490,6 +1866,11 @@ tcp_send_syn:
 found:
     uip_conn = uip_connr;
     uip_flags = 0;
+    UIP_STAT(++uip_connr->rxframes);
+
+    /* The peer is alive. */
+    uip_connr->idle = 0;
+    uip_connr->kaprobes = 0;
 
     /* We do a very naive form of TCP reset processing; we just accept
      any RST and kill our connection. We should in fact check if the
@@ -1558,21 +1939,11 @@ found:
 
             /* Do RTT estimation, unless we have done retransmissions. */
             if (uip_connr->nrtx == 0) {
-                signed char m;
-                m = uip_connr->rto - uip_connr->timer;
-
-                /* This is taken directly from VJs original code in his paper */
-                m = m - (uip_connr->sa >> 3);
-                uip_connr->sa += m;
-                if (m < 0) {
-                    m = -m;
-                }
-
-                m = m - (uip_connr->sv >> 2);
-                uip_connr->sv += m;
-                uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
+                uip_rtt_sample(uip_connr, (u16_t) clock_time_ms() - uip_connr->rtt_start);
             }
 
+            uip_connr->dupacks = 0;
+
             /* Set the acknowledged flag. */
             uip_flags = UIP_ACKDATA;
 
@@ -1580,8 +1951,29 @@ found:
             uip_connr->timer = uip_connr->rto;
 
             /* Reset length of outstanding data. */
+            if ((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+                UIP_STAT(uip_connr->txbytes += uip_connr->len);
+            }
+
             uip_connr->len = 0;
         }
+#if UIP_FAST_RETRANSMIT
+        else
+        if
+        (
+            uip_len == 0
+        &&  !(BUF->flags & (TCP_SYN | TCP_FIN))
+        &&  BUF->ackno[0] == uip_connr->snd_nxt[0]
+        &&  BUF->ackno[1] == uip_connr->snd_nxt[1]
+        &&  BUF->ackno[2] == uip_connr->snd_nxt[2]
+        &&  BUF->ackno[3] == uip_connr->snd_nxt[3]
+        ) {
+            /* A duplicate ACK: the peer still waits for the outstanding segment. */
+            if (++(uip_connr->dupacks) == 3) {
+                fastrexmit = 1;
+            }
+        }
+#endif /* UIP_FAST_RETRANSMIT */
     }
 
     /* Do different things depending on in what state the connection is. */
@@ -1747,6 +2139,7 @@ found:
             if (uip_len > 0 && !(uip_connr->tcpstateflags & UIP_STOPPED)) {
                 uip_flags |= UIP_NEWDATA;
                 uip_add_rcv_nxt(uip_len);
+                UIP_STAT(uip_connr->rxbytes += uip_len);
             }
 
             /* Check if the available buffer space advertised by the other end
@@ -1784,7 +2177,25 @@ found:
        put into the uip_appdata and the length of the data should be
        put into uip_len. If the application don't have any data to
        send, uip_len must be set to 0. */
+#if UIP_FAST_RETRANSMIT
+            if (fastrexmit) {
+
+                /* Resend the segment now, the retransmission timer is
+           restarted. No RTT sample is taken from the retransmitted
+           segment. */
+                UIP_STAT(++uip_stat.tcp.rexmit);
+                UIP_STAT(++uip_connr->rexmits);
+                ++uip_fastrexmits;
+                ++(uip_connr->nrtx);
+                uip_connr->timer = uip_connr->rto;
+                uip_flags = UIP_REXMIT;
+                UIP_APPCALL();
+                goto apprexmit;
+            }
+#endif /* UIP_FAST_RETRANSMIT */
+
             if (uip_flags & (UIP_NEWDATA | UIP_ACKDATA)) {
+                uip_connr->quiet = 0;
                 uip_slen = 0;
                 UIP_APPCALL();
 
@@ -1829,6 +2240,8 @@ found:
                         /* Remember how much data we send out now so that we know
          when everything has been acknowledged. */
                         uip_connr->len = uip_slen;
+                        uip_connr->rtt_start = clock_time_ms();
+                        uip_connr->dupacks = 0;
                     }
                     else {
 
@@ -1969,13 +2382,28 @@ tcp_send:
     BUF->seqno[2] = uip_connr->snd_nxt[2];
     BUF->seqno[3] = uip_connr->snd_nxt[3];
 
+#if UIP_KEEPALIVE_IDLE
+    if (kaprobe) {
+        /* A keep-alive probe carries SND.NXT - 1 so that the peer
+       answers with an ACK. */
+        if (BUF->seqno[3]-- == 0) {
+            if (BUF->seqno[2]-- == 0) {
+                if (BUF->seqno[1]-- == 0) {
+                    --BUF->seqno[0];
+                }
+            }
+        }
+    }
+#endif
+
     BUF->proto = UIP_PROTO_TCP;
 
     BUF->srcport = uip_connr->lport;
     BUF->destport = uip_connr->rport;
 
-    uip_ipaddr_copy(BUF->srcipaddr, uip_hostaddr);
+    uip_ipaddr_copy(BUF->srcipaddr, SRCADDR(uip_connr->ripaddr));
     uip_ipaddr_copy(BUF->destipaddr, uip_connr->ripaddr);
+    UIP_STAT(++uip_connr->txframes);
 
     if (uip_connr->tcpstateflags & UIP_STOPPED) {
 
@@ -2041,6 +2469,21 @@ drop:
     return;
 }
 
+#if UIP_CONF_IPV6
+/*---------------------------------------------------------------------------*/
+u8_t uip_ip6addr_maskcmp(const u16_t* addr1, const u16_t* addr2, const u16_t* mask) {
+    u8_t    i;
+
+    for (i = 0; i < 8; ++i) {
+        if ((addr1[i] & mask[i]) != (addr2[i] & mask[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+#endif /* UIP_CONF_IPV6 */
+
 /*---------------------------------------------------------------------------*/
 u16_t htons(u16_t val) {
     return HTONS(val);
@@ -196,6 +196,14 @@ void    uip_init(void);
  */
 void    uip_setipid(u16_t id);
 
+/**
+ * Returns the next IP ID.
+ *
+ * This function may be used by code assembling IP datagrams on its own,
+ * so that they share the ID sequence with UIP.
+ */
+u16_t   uip_nextipid(void);
+
 /** @} */
 
 /**
@@ -721,6 +729,17 @@ void    uip_send(const void* data, int len);
 
 #define uip_timedout()  (uip_flags & UIP_TIMEDOUT)
 
+/**
+ * Has the connection been reset because the peer stopped answering
+ * keep-alive probes or because it was idle for too long?
+ *
+ * Only valid together with uip_timedout().
+ *
+ * \hideinitializer
+ */
+#define uip_idletimedout()  (uip_conn->kaprobes == UIP_IDLE_REAPED)
+#define UIP_IDLE_REAPED     0xff
+
 /**
  * Do we need to retransmit previously data?
  *
@@ -982,11 +1001,16 @@ void    uip_send(const void* data, int len);
  * \hideinitializer
  */
 
+#if !UIP_CONF_IPV6
 #define uip_ipaddr_maskcmp(addr1, addr2, mask) \
         ( \
             ((((u16_t*)addr1)[0] & ((u16_t*)mask)[0]) == (((u16_t*)addr2)[0] & ((u16_t*)mask)[0])) \
         &&  ((((u16_t*)addr1)[1] & ((u16_t*)mask)[1]) == (((u16_t*)addr2)[1] & ((u16_t*)mask)[1])) \
         )
+#else /* !UIP_CONF_IPV6 */
+u8_t    uip_ip6addr_maskcmp(const u16_t* addr1, const u16_t* addr2, const u16_t* mask);
+#define uip_ipaddr_maskcmp(addr1, addr2, mask)  uip_ip6addr_maskcmp((u16_t*)addr1, (u16_t*)addr2, (u16_t*)mask)
+#endif /* !UIP_CONF_IPV6 */
 
 /**
  * Mask out the network part of an IP address.
@@ -1210,12 +1234,24 @@ struct uip_conn
     u16_t               len;            /**< Length of the data that was previously sent. */
     u16_t               mss;            /**< Current maximum segment size for the connection. */
     u16_t               initialmss;     /**< Initial maximum segment size for the connection. */
-    u8_t                sa;             /**< Retransmission time-out calculation state variable. */
-    u8_t                sv;             /**< Retransmission time-out calculation state variable. */
+    u16_t               srtt;           /**< Smoothed round trip time in ms, scaled by 8 (0: no sample yet). */
+    u16_t               rttvar;         /**< Round trip time variation in ms, scaled by 4. */
+    u16_t               rtt_start;      /**< Millisecond clock when the timed segment was sent. */
+    u8_t                dupacks;        /**< Number of duplicate ACKs received in a row. */
     u8_t                rto;            /**< Retransmission time-out. */
     u8_t                tcpstateflags;  /**< TCP state and flags. */
     u8_t                timer;          /**< The retransmission timer. */
     u8_t                nrtx;           /**< The number of retransmissions for the last segment sent. */
+    u8_t                kaprobes;       /**< The number of unanswered keep-alive probes. */
+    u16_t               idle;           /**< Timer ticks since the last segment from the peer. */
+    u16_t               quiet;          /**< Timer ticks since data was last sent or received. */
+#if UIP_STATISTICS
+    u32_t               rxframes;       /**< Segments received on the connection. */
+    u32_t               txframes;       /**< Segments sent, retransmissions included. */
+    u32_t               rxbytes;        /**< Payload bytes received. */
+    u32_t               txbytes;        /**< Payload bytes sent and acknowledged. */
+    u16_t               rexmits;        /**< Retransmitted segments. */
+#endif
 
     /** The application state. */
     uip_tcp_appstate_t  appstate;
@@ -1232,6 +1268,20 @@ extern struct uip_conn*     uip_conn;
 /* The array containing all UIP connections. */
 extern struct uip_conn      uip_conns[UIP_CONNS];
 
+#if UIP_FAST_RETRANSMIT
+/* Segments resent on three duplicate ACKs. */
+extern uip_stats_t          uip_fastrexmits;
+#endif /* UIP_FAST_RETRANSMIT */
+
+#if UIP_SYN_COOKIES
+/* SYNACKs answered with a cookie and connections set up from one. */
+extern uip_stats_t          uip_syncookies_sent;
+extern uip_stats_t          uip_syncookies_accepted;
+
+/* Key of the cookie hash, to be set to a random value before uip_listen(). */
+extern unsigned long        uip_syncookie_secret;
+#endif /* UIP_SYN_COOKIES */
+
 /**
  * \addtogroup uiparch
  * @{
@@ -1612,6 +1662,18 @@ u16_t   uip_tcpchksum(void);
  * to by uip_appdata.
  */
 u16_t   uip_udpchksum(void);
+
+#if UIP_CONF_IPV6
+/**
+ * Calculate the ICMPv6 checksum of the packet in uip_buf.
+ *
+ * The part of the message which did not fit into uip_buf is summed
+ * from the frame in the Ethernet controller's memory.
+ *
+ * \return The ICMPv6 checksum of the ICMPv6 message in uip_buf.
+ */
+u16_t   uip_icmp6chksum(void);
+#endif /* UIP_CONF_IPV6 */
 #endif /* __UIP_H__ */
 
 /** @} */
@@ -58,6 +58,8 @@
 
 #include <string.h>
 
+#if !UIP_CONF_IPV6
+
 struct arp_hdr
 {
     struct uip_eth_hdr  ethhdr;
@@ -104,6 +106,8 @@ static u8_t                         i, c;
 static u8_t                         arptime;
 static u8_t                         tmpage;
 
+u32_t                               uip_arp_misses;
+
 #define BUF     ((struct arp_hdr*) &uip_buf[0])
 #define IPBUF   ((struct ethip_hdr*) &uip_buf[0])
 /*-----------------------------------------------------------------------------------*/
@@ -381,6 +385,7 @@ void uip_arp_out(void) {
 
             /* The destination address was not in our ARP table, so we
 	 overwrite the IP packet with an ARP request. */
+            ++uip_arp_misses;
             memset(BUF->ethhdr.dest.addr, 0xff, 6);
             memset(BUF->dhwaddr.addr, 0x00, 6);
             memcpy(BUF->ethhdr.src.addr, uip_ethaddr.addr, 6);
@@ -412,6 +417,11 @@ void uip_arp_out(void) {
     uip_len += sizeof(struct uip_eth_hdr);
 }
 
+#else /* !UIP_CONF_IPV6 */
+
+u32_t                               uip_arp_misses;
+#endif /* !UIP_CONF_IPV6 */
+
 /*-----------------------------------------------------------------------------------*/
 /** @} */
 /** @} */
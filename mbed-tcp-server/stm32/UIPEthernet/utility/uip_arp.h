@@ -51,6 +51,9 @@
 
 extern struct uip_eth_addr  uip_ethaddr;
 
+/* Number of IP packets dropped and replaced by an ARP request. */
+extern u32_t                uip_arp_misses;
+
 /**
  * The Ethernet header.
  */
@@ -65,6 +68,44 @@ struct uip_eth_hdr
 #define UIP_ETHTYPE_IP  0x0800
 #define UIP_ETHTYPE_IP6 0x86dd
 
+#if UIP_CONF_IPV6
+#include "uip-neighbor.h"
+
+/* With IPv6 the neighbor cache takes the place of the ARP table. There
+   are no ARP packets, neighbor solicitations are ICMPv6 messages handled
+   by uip_process(). */
+#define uip_arp_init()      uip_neighbor_init()
+#define uip_arp_ipin()      uip_neighbor_ipin()
+#define uip_arp_arpin()     (uip_len = 0)
+#define uip_arp_out()       uip_neighbor_out()
+#define uip_arp_timer()     uip_neighbor_periodic()
+
+/* Length of the neighbor solicitation uip_neighbor_out() leaves in uip_buf. */
+#define UIP_ND6_NSFRAMELEN  86
+
+/* True after uip_arp_out() when the packet in uip_buf has been replaced
+   by a neighbor solicitation for its next hop. */
+#define uip_arp_replaced() \
+        ( \
+            uip_len == UIP_ND6_NSFRAMELEN \
+        &&  uip_buf[UIP_LLH_LEN + 6] == UIP_PROTO_ICMP6 \
+        &&  uip_buf[UIP_LLH_LEN + UIP_IPH_LEN] == ICMP6_NEIGHBOR_SOLICITATION \
+        )
+#else /* UIP_CONF_IPV6 */
+
+/* Length of an ARP request with its Ethernet header. */
+#define UIP_ARPHDRSIZE      42
+
+/* True after uip_arp_out() when the packet in uip_buf has been replaced
+   by an ARP request for its destination. An IP packet of 28 bytes (UDP
+   without payload) is 42 bytes long with its Ethernet header as well, so
+   the type decides. */
+#define uip_arp_replaced() \
+        ( \
+            uip_len == UIP_ARPHDRSIZE \
+        &&  ((struct uip_eth_hdr*) &uip_buf[0])->type == HTONS(UIP_ETHTYPE_ARP) \
+        )
+
 /* The uip_arp_init() function must be called before any of the other
    ARP functions. */
 void    uip_arp_init(void);
@@ -100,6 +141,7 @@ void    uip_arp_out(void);
 /* The uip_arp_timer() function should be called every ten seconds. It
    is responsible for flushing old entries in the ARP table. */
 void    uip_arp_timer(void);
+#endif /* UIP_CONF_IPV6 */
 
 /** @} */
 
@@ -70,6 +70,7 @@ void            uip_clock_init(void);
  * \return The current clock time, measured in system ticks.
  */
 clock_time_t    clock_time(void);
+clock_time_t    clock_time_ms(void);
 
 /**
  * A second, measured in system clock time.
@@ -109,21 +109,21 @@ bool UIPDebug::uip_debug_printcon(struct uip_conn* lhs, struct uip_conn* rhs) {
         changed = true;
     }
 
-    if (lhs->sa != rhs->sa) {
-        printf(" sa: ");
-        printf("%d", lhs->sa);
+    if (lhs->srtt != rhs->srtt) {
+        printf(" srtt: ");
+        printf("%d", lhs->srtt);
         printf(" -> ");
-        printf("%d", rhs->sa);
-        lhs->sa = rhs->sa;
+        printf("%d", rhs->srtt);
+        lhs->srtt = rhs->srtt;
         changed = true;
     }
 
-    if (lhs->sv != rhs->sv) {
-        printf(" sv: ");
-        printf("%d", lhs->sv);
+    if (lhs->rttvar != rhs->rttvar) {
+        printf(" rttvar: ");
+        printf("%d", lhs->rttvar);
         printf(" -> ");
-        printf("%d\r\n", rhs->sv);
-        lhs->sv = rhs->sv;
+        printf("%d\r\n", rhs->rttvar);
+        lhs->rttvar = rhs->rttvar;
         changed = true;
     }
 
@@ -0,0 +1,229 @@
+/*
+ uip_trace.cpp - cycle counter trace points for the stack's hot paths.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "uip_trace.h"
+#include <stdio.h>
+#include <atomic>
+#if defined(__MBED__)
+#include "mbed.h"
+#include "hal/us_ticker_api.h"
+#else
+#include <chrono>
+#endif
+
+typedef struct
+{
+    uint32_t    ticks;
+    uint8_t     id;
+    uint8_t     phase;
+} uip_trace_ev_t;
+
+static volatile uint32_t    traceHead = 0;
+static volatile uint8_t     traceEnabled = 1;
+#if UIP_TRACE
+static const char* const    traceNames[UIP_TRACE_POINTS] =
+{
+    "receivePacket", "uip_process", "upper_layer_chksum", "allocBlock", "sendPacket", "uipclient_appcall"
+};
+
+static uip_trace_ev_t       traceRing[UIP_TRACE_EVENTS];
+static uint8_t              traceStarted = 0;
+
+/**
+ * @brief   Reads the trace clock
+ * @note    DWT CYCCNT on Cortex-M3 and up, the microsecond ticker on
+ *          targets without it and std::chrono (nanoseconds) on the host.
+ * @param
+ * @retval
+ */
+static inline uint32_t traceTicks()
+{
+#if defined(__MBED__) && defined(DWT_CTRL_CYCCNTENA_Msk)
+    return DWT->CYCCNT;
+#elif defined(__MBED__)
+    return us_ticker_read();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+static uint32_t traceTicksPerUs()
+{
+#if defined(__MBED__) && defined(DWT_CTRL_CYCCNTENA_Msk)
+    return SystemCoreClock / 1000000;
+#elif defined(__MBED__)
+    return 1;
+#else
+    return 1000;
+#endif
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+static void traceStart()
+{
+#if defined(__MBED__) && defined(DWT_CTRL_CYCCNTENA_Msk)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    traceStarted = 1;
+}
+#endif
+
+/**
+ * @brief   Appends an event to the trace ring
+ * @note    Lock-free for a single producer, the network thread: the slot
+ *          is filled before the head is published, the oldest events are
+ *          overwritten once the ring is full. Not to be called from ISRs.
+ * @param   id One of the UIP_TRACE_* trace points
+ * @param   phase UIP_TRACE_PH_BEGIN or UIP_TRACE_PH_END
+ * @retval
+ */
+void uip_trace_event(uint8_t id, uint8_t phase)
+{
+#if UIP_TRACE
+    if (!traceEnabled)
+        return;
+
+    if (!traceStarted)
+        traceStart();
+
+    uint32_t        head = traceHead;
+    uip_trace_ev_t* ev = &traceRing[head & (UIP_TRACE_EVENTS - 1)];
+
+    ev->ticks = traceTicks();
+    ev->id = id;
+    ev->phase = phase;
+    std::atomic_signal_fence(std::memory_order_release);
+    traceHead = head + 1;
+#else
+    (void)id;
+    (void)phase;
+#endif
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void uip_trace_enable(uint8_t on)
+{
+    traceEnabled = on;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void uip_trace_clear(void)
+{
+    traceHead = 0;
+}
+
+/**
+ * @brief   Writes the ring in Chrome trace-event JSON
+ * @note    Loads in chrome://tracing, Perfetto or speedscope. Tracing is
+ *          paused while exporting. Timestamps are microseconds relative to
+ *          the oldest event; the 32 bit clock may wrap between events as
+ *          long as no two consecutive events are a full wrap apart.
+ * @param   write Called with consecutive pieces of the JSON text
+ * @param   ctx Passed to write
+ * @retval  Number of bytes written
+ */
+size_t uip_trace_export(uip_trace_writer_t write, void* ctx)
+{
+    char        line[112];
+    size_t      total = 0;
+    int         len;
+
+    len = snprintf(line, sizeof(line), "{\"traceEvents\":[\n");
+    write(line, len, ctx);
+    total += len;
+#if UIP_TRACE
+    uint8_t     enabled = traceEnabled;
+
+    traceEnabled = 0;
+    std::atomic_signal_fence(std::memory_order_acquire);
+
+    uint32_t    end = traceHead;
+    uint32_t    count = end < UIP_TRACE_EVENTS ? end : UIP_TRACE_EVENTS;
+    uint32_t    perUs = traceTicksPerUs();
+    uint32_t    prev = traceRing[(end - count) & (UIP_TRACE_EVENTS - 1)].ticks;
+    uint64_t    elapsed = 0;
+
+    for (uint32_t i = end - count; i != end; i++) {
+        uip_trace_ev_t* ev = &traceRing[i & (UIP_TRACE_EVENTS - 1)];
+
+        elapsed += (uint32_t)(ev->ticks - prev);
+        prev = ev->ticks;
+        len = snprintf
+            (
+                line, sizeof(line),
+                "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu.%03lu,\"pid\":1,\"tid\":1}\n",
+                i == end - count ? "" : ",",
+                ev->id < UIP_TRACE_POINTS ? traceNames[ev->id] : "?",
+                ev->phase,
+                (unsigned long)(elapsed / perUs),
+                (unsigned long)((elapsed % perUs) * 1000 / perUs)
+            );
+        write(line, len, ctx);
+        total += len;
+    }
+
+    traceEnabled = enabled;
+#endif
+    len = snprintf(line, sizeof(line), "],\"displayTimeUnit\":\"ns\"}\n");
+    write(line, len, ctx);
+    return total + len;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+static void printWriter(const void* data, size_t len, void* ctx)
+{
+    (void)ctx;
+    printf("%.*s", (int)len, (const char*)data);
+}
+
+/**
+ * @brief   Prints the trace JSON on the console
+ * @note
+ * @param
+ * @retval
+ */
+void uip_trace_print(void)
+{
+    uip_trace_export(printWriter, NULL);
+}
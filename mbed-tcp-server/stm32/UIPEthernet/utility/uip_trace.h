@@ -0,0 +1,92 @@
+/*
+ uip_trace.h - cycle counter trace points for the stack's hot paths.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UIP_TRACE_H
+#define UIP_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "uipethernet-conf.h"
+
+#ifndef UIP_TRACE
+#define UIP_TRACE               0
+#endif
+
+#ifndef UIP_TRACE_EVENTS
+#define UIP_TRACE_EVENTS        256
+#endif
+
+#if (UIP_TRACE_EVENTS & (UIP_TRACE_EVENTS - 1)) != 0
+#error "UIP_TRACE_EVENTS must be a power of two"
+#endif
+
+/* trace points */
+#define UIP_TRACE_RECEIVEPACKET 0   /* Enc28j60Eth::receivePacket, frame pending */
+#define UIP_TRACE_PROCESS       1   /* uip_process */
+#define UIP_TRACE_CHKSUM        2   /* UipEthernet::upper_layer_chksum */
+#define UIP_TRACE_ALLOCBLOCK    3   /* MemPool::allocBlock, compaction included */
+#define UIP_TRACE_SENDPACKET    4   /* Enc28j60Eth::sendPacket */
+#define UIP_TRACE_APPCALL       5   /* uipclient_appcall */
+#define UIP_TRACE_POINTS        6
+
+#define UIP_TRACE_PH_BEGIN      'B'
+#define UIP_TRACE_PH_END        'E'
+
+/* called with consecutive pieces of the export, ctx is passed through */
+typedef void (*uip_trace_writer_t)(const void* data, size_t len, void* ctx);
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void    uip_trace_event(uint8_t id, uint8_t phase);
+void    uip_trace_enable(uint8_t on);
+void    uip_trace_clear(void);
+size_t  uip_trace_export(uip_trace_writer_t write, void* ctx);
+void    uip_trace_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if UIP_TRACE
+#define UIP_TRACE_BEGIN(id) uip_trace_event(id, UIP_TRACE_PH_BEGIN)
+#define UIP_TRACE_END(id)   uip_trace_event(id, UIP_TRACE_PH_END)
+#else
+#define UIP_TRACE_BEGIN(id)
+#define UIP_TRACE_END(id)
+#endif
+
+#ifdef __cplusplus
+#if UIP_TRACE
+// Records the begin and end of the enclosing block, whichever way it is left
+class UipTraceScope
+{
+public:
+    UipTraceScope(uint8_t id) : _id(id)     { uip_trace_event(_id, UIP_TRACE_PH_BEGIN); }
+    ~UipTraceScope()                        { uip_trace_event(_id, UIP_TRACE_PH_END); }
+private:
+    uint8_t _id;
+};
+
+#define UIP_TRACE_SCOPE(id) UipTraceScope uip_trace_scope(id)
+#else
+#define UIP_TRACE_SCOPE(id)
+#endif
+#endif
+
+#endif
@@ -1,10 +1,30 @@
 #ifndef UIPETHERNET_CONF_H
 #define UIPETHERNET_CONF_H
 
-/* for TCP */
+/* for TCP
+ * every connection costs about 180 bytes of RAM: the uIP connection, the
+ * socket state and UIP_SOCKET_NUMPACKETS * 2 MemPool blocks. The demo in
+ * main.cpp needs 6 with all its services, see APP_CONNECTIONS there. */
 
 #define UIP_SOCKET_NUMPACKETS   5
-#define UIP_MAX_CONNECTIONS     4
+#define UIP_MAX_CONNECTIONS     6
+
+/* split of the 8 KB ENC28J60 buffer memory between the receive ring and the
+ * transmit region, which holds the MemPool with every socket block:
+ * ENC28J60_BUFFER_TX_HEAVY (2 KB RX, 6 KB TX), ENC28J60_BUFFER_BALANCED
+ * (4 KB RX, 4 KB TX) or ENC28J60_BUFFER_RX_HEAVY (6 KB RX, 2 KB TX).
+ * Any other even size of the receive ring in bytes may be given as well,
+ * also with -D; tools/buffer_sweep.cpp compares the profiles. */
+
+#ifndef ENC28J60_BUFFER_PROFILE
+#define ENC28J60_BUFFER_PROFILE ENC28J60_BUFFER_TX_HEAVY
+#endif
+
+/* set to 1 to run the stack on IPv6 instead of IPv4: the link-local and a
+ * global address are autoconfigured (SLAAC) from router advertisements,
+ * next hops are resolved by neighbor discovery. DHCP and DNS stay IPv4 only. */
+
+#define UIP_CONF_IPV6           0
 
 /* for UDP
  * set UIP_CONF_UDP to 0 to disable UDP (saves aprox. 5kb flash) */
@@ -13,6 +33,10 @@
 #define UIP_CONF_BROADCAST      1
 #define UIP_CONF_UDP_CONNS      4
 
+/* number of received datagrams queued per UDP socket before new ones are dropped */
+
+#define UIP_UDP_NUMPACKETS      4
+
 /* number of attempts on write before returning number of bytes sent so far
  * set to -1 to block until connection is closed by timeout */
 
@@ -23,6 +47,86 @@
 
 #define UIP_CONNECT_TIMEOUT     -1
 
+/* set to 1 to cache the last DHCP lease in flash so that a reboot can use
+ * INIT-REBOOT instead of a full DISCOVER. The sector at UIP_DHCP_LEASE_ADDRESS
+ * is erased on every new lease; it must be kept out of the application, e.g.
+ * for the last 1 KB sector of a 64 KB STM32F103C8 in mbed_app.json:
+ *     "target_overrides": { "*": { "target.mbed_rom_size": "0xFC00" } }
+ * and -DUIP_DHCP_LEASE_ADDRESS=0x0800FC00 in the build flags. */
+
+#define UIP_DHCP_LEASE_CACHE    0
+
+/* answer SYNs with SYN cookies when all connections are in use, so that
+ * bursts of connecting clients are set up once a connection frees up */
+
+#define UIP_SYN_COOKIES         1
+
+/* TCP keep-alive: after UIP_KEEPALIVE_IDLE seconds without a segment from the
+ * peer a probe is sent every UIP_KEEPALIVE_INTERVAL seconds, the connection is
+ * dropped after UIP_KEEPALIVE_PROBES unanswered probes. Set to 0 to disable. */
+
+#define UIP_KEEPALIVE_IDLE      60
+#define UIP_KEEPALIVE_INTERVAL  10
+#define UIP_KEEPALIVE_PROBES    5
+
+/* drop connections which exchanged no data for this many seconds and free
+ * their buffers, even if the peer is still alive. Set to 0 to disable. */
+
+#define UIP_IDLE_TIMEOUT        0
+
+/* UDP port answering with the network counters (see DiagServer) */
+
+#define UIP_DIAG_PORT           7007
+
+/* keep the first UIP_CAPTURE_SNAPLEN bytes of the last UIP_CAPTURE_FRAMES
+ * received and sent frames in RAM for a pcapng dump (see PacketCapture).
+ * Takes UIP_CAPTURE_FRAMES * (UIP_CAPTURE_SNAPLEN + 12) bytes of RAM.
+ * Set to 0 to disable. */
+
+#define UIP_CAPTURE_FRAMES      0
+#define UIP_CAPTURE_SNAPLEN     64
+
+/* record begin and end of receivePacket, uip_process, upper_layer_chksum,
+ * allocBlock, sendPacket and uipclient_appcall in a ring of UIP_TRACE_EVENTS
+ * events (8 bytes each), exported as Chrome trace JSON by uip_trace_export().
+ * Set to 0 to disable. */
+
+#define UIP_TRACE               0
+#define UIP_TRACE_EVENTS        256
+
+/* network thread (see NetThread): UIP_NET_QUEUE_DEPTH requests posted by any
+ * thread plus UIP_NET_CHANNEL_DEPTH for each of UIP_NET_CHANNELS attached
+ * threads are queued lock-free, UIP_NET_PENDING receives may wait for data.
+ * The thread polls the ENC28J60 every UIP_NET_POLL_MS ms while idle. */
+
+#define UIP_NET_QUEUE_DEPTH     8
+#define UIP_NET_CHANNELS        4
+#define UIP_NET_CHANNEL_DEPTH   4
+#define UIP_NET_PENDING         4
+#define UIP_NET_POLL_MS         2
+#define UIP_NET_STACK_SIZE      2048
+
+/* idle policy (see PowerPolicy): outside the report windows the ENC28J60
+ * goes to standby or power save once no frame was received for
+ * UIP_POWER_IDLE_MS ms. Without the INT pin it is polled every
+ * UIP_POWER_POLL_MS ms in standby. With UIP_POWER_HOLD_CONNECTIONS set to 1
+ * it stays active as long as a TCP connection is open. */
+
+#define UIP_POWER_IDLE_MS       2000
+#define UIP_POWER_POLL_MS       100
+#define UIP_POWER_HOLD_CONNECTIONS  0
+
+/* SNTP (see SntpClient): the server is asked every UIP_SNTP_POLL_S seconds,
+ * or every UIP_SNTP_RETRY_MS ms until it answers. Offsets up to
+ * UIP_SNTP_STEP_MS ms are slewed, larger ones stepped. The frequency
+ * correction is limited to UIP_SNTP_MAX_PPM. Keep UIP_SNTP_POLL_S below 30
+ * minutes, the clock extends the 32 bit us ticker only that far. */
+
+#define UIP_SNTP_POLL_S         64
+#define UIP_SNTP_RETRY_MS       2000
+#define UIP_SNTP_STEP_MS        128
+#define UIP_SNTP_MAX_PPM        500
+
 /* periodic timer for uip (in ms) */
 
 #define UIP_PERIODIC_TIMEOUT    250
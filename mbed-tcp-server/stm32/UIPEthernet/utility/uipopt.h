@@ -286,6 +286,30 @@
 
 #define UIP_RTO 3
 
+/**
+ * The lower bound of the retransmission timeout in milliseconds.
+ *
+ * The timeout is computed from millisecond round trip time samples as
+ * in RFC 6298 but retransmissions are still driven by the periodic
+ * timer, so there is no point in going below UIP_PERIODIC_TIMEOUT.
+ */
+#ifndef UIP_RTO_MIN
+#define UIP_RTO_MIN UIP_PERIODIC_TIMEOUT
+#endif
+
+/**
+ * Round trip time samples above this many milliseconds are discarded.
+ */
+#define UIP_RTT_MAX 4000
+
+/**
+ * Retransmit the outstanding segment on the third duplicate ACK
+ * instead of waiting for the retransmission timer (RFC 5681).
+ */
+#ifndef UIP_FAST_RETRANSMIT
+#define UIP_FAST_RETRANSMIT 1
+#endif
+
 /**
  * The maximum number of times a segment should be retransmitted
  * before the connection should be aborted.
@@ -341,6 +365,52 @@
 
 #define UIP_TIME_WAIT_TIMEOUT   120
 
+/**
+ * TCP keep-alive.
+ *
+ * After UIP_KEEPALIVE_IDLE seconds without a segment from the peer an
+ * empty probe is sent every UIP_KEEPALIVE_INTERVAL seconds. When
+ * UIP_KEEPALIVE_PROBES probes are left unanswered the connection is
+ * reset and the application is told that it timed out. Set
+ * UIP_KEEPALIVE_IDLE to 0 to disable keep-alive.
+ */
+#ifndef UIP_KEEPALIVE_IDLE
+#define UIP_KEEPALIVE_IDLE      0
+#endif
+#ifndef UIP_KEEPALIVE_INTERVAL
+#define UIP_KEEPALIVE_INTERVAL  10
+#endif
+#ifndef UIP_KEEPALIVE_PROBES
+#define UIP_KEEPALIVE_PROBES    5
+#endif
+
+/**
+ * Answer SYNs with a SYN cookie when all connections are in use.
+ *
+ * The connection is then only set up when the peer's ACK arrives, so
+ * bursts of connecting clients are absorbed instead of dropped; if none
+ * is free by then either, the peer is reset. The peer's MSS option is
+ * not kept, UIP_SYNCOOKIE_MSS is used instead.
+ */
+#ifndef UIP_SYN_COOKIES
+#define UIP_SYN_COOKIES     0
+#endif
+#define UIP_SYNCOOKIE_MSS   (UIP_TCP_MSS < 536 ? UIP_TCP_MSS : 536)
+
+/**
+ * Time in seconds after which an established connection without any
+ * data exchanged in either direction is reset, even if the peer
+ * answers keep-alive probes. Set to 0 to disable.
+ */
+#ifndef UIP_IDLE_TIMEOUT
+#define UIP_IDLE_TIMEOUT        0
+#endif
+
+/**
+ * Number of periodic timer invocations in s seconds.
+ */
+#define UIP_TICKS(s)    ((s) * 1000UL / UIP_PERIODIC_TIMEOUT)
+
 /** @} */
 
 /*------------------------------------------------------------------------------*/
@@ -8,12 +8,28 @@
 #define UIPETHERNET_FREEPACKET  1
 #define UIPETHERNET_SENDPACKET  2
 
+#if UIP_CONF_IPV6
+// IpAddress holds IPv4 addresses only, they map to ::ffff:a.b.c.d
+#define uip_ip_addr(addr, ip) \
+    do { \
+        ((u16_t *) (addr))[0] = 0; \
+        ((u16_t *) (addr))[1] = 0; \
+        ((u16_t *) (addr))[2] = 0; \
+        ((u16_t *) (addr))[3] = 0; \
+        ((u16_t *) (addr))[4] = 0; \
+        ((u16_t *) (addr))[5] = 0xffff; \
+        ((u16_t *) (addr))[6] = (((ip[1]) << 8) | (ip[0])); \
+        ((u16_t *) (addr))[7] = (((ip[3]) << 8) | (ip[2])); \
+    } while (0)
+#define ip_addr_uip(a)  IpAddress(a[6] & 0xFF, a[6] >> 8, a[7] & 0xFF, a[7] >> 8)
+#else
 #define uip_ip_addr(addr, ip) \
     do { \
         ((u16_t *) (addr))[0] = (((ip[1]) << 8) | (ip[0])); \
         ((u16_t *) (addr))[1] = (((ip[3]) << 8) | (ip[2])); \
     } while (0)
-#define ip_addr_uip(a)  IpAddress(a[0] & 0xFF, a[0] >> 8, a[1] & 0xFF, a[1] >> 8)   //TODO this is not IPV6 capable
+#define ip_addr_uip(a)  IpAddress(a[0] & 0xFF, a[0] >> 8, a[1] & 0xFF, a[1] >> 8)
+#endif
 
 #define uip_seteth_addr(eaddr) \
     do { \
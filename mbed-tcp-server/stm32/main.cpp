@@ -9,20 +9,61 @@
 #include "UipEthernet.h"
 #include "TcpServer.h"
 #include "TcpClient.h"
+#include "DiagServer.h"
+#include "UdpSocket.h"
+#include "SntpClient.h"
+#include "FrameCodec.h"
+
+// demo services, each one left out saves flash, RAM and TCP connections
+#ifndef APP_TELEMETRY
+#define APP_TELEMETRY   1                   // ADC sample blocks to a TCP or UDP subscriber
+#endif
+#ifndef APP_HTTP
+#define APP_HTTP        1                   // web page and JSON API
+#endif
+#ifndef APP_MQTT
+#define APP_MQTT        1                   // ADC values to and commands from a broker
+#endif
+
+#if APP_TELEMETRY
+#include "Telemetry.h"
+#endif
+#if APP_HTTP
+#include "HttpServer.h"
+#include "www_assets.h"
+#endif
+#if APP_MQTT
+#include "MqttClient.h"
+#endif
 
 // IP Settings
 #define IP      "192.168.137.120"
 #define GATEWAY "192.168.137.1"
 #define NETMASK "255.255.255.0"
+#define NTP     GATEWAY                     // PC sharing its connection, running an NTP server
+#define BROKER  GATEWAY                     // and an MQTT broker (mosquitto)
 #define PORT    61
+#define PORT_BACKLOG    2                   // clients on PORT waiting to be accepted
+#define HTTP_PORT   80
+
+// TCP connections open at the same time: the clients waiting on PORT, the
+// telemetry subscriber that stays connected after them, the HTTP ones kept
+// alive and the broker
+#define APP_CONNECTIONS (PORT_BACKLOG + APP_TELEMETRY + APP_HTTP * HTTP_CONNECTIONS + APP_MQTT)
+
+#if APP_CONNECTIONS > UIP_MAX_CONNECTIONS
+#error "UIP_MAX_CONNECTIONS in uipethernet-conf.h is too small for the enabled demo services"
+#endif
 
 const uint8_t   MAC[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
 UipEthernet     net(MAC,PB_5, PB_4, PB_3, PA_15);   // mac, mosi, miso, sck, cs
 TcpServer       server;                         // Ethernet server
+DiagServer      diag;                           // network counters on UDP port UIP_DIAG_PORT
+SntpClient      sntp;                           // wall clock for the timestamps
 TcpClient*      client;
 uint8_t         recvData[1024];
 const char      sendData[] = {0xA5, 0x5A, 0x40, 'O', 'K'};
-char            adcArr[] = {0xA5, 0x5A, 0x30, 0x00, 0x00};
+char            adcArr[13] = {0xA5, 0x5A, 0x30, 0x00, 0x00};  // values, then time of the reading (us since 1970, LE)
 
 DigitalOut led1(PB_12);
 DigitalOut led2(PB_13);
@@ -33,6 +74,225 @@ Serial pc(PA_2, PA_3);
 
 Timer t1;
 
+#if APP_TELEMETRY
+const PinName   adcPins[TELEMETRY_CHANNELS] = { PA_0, PA_1 };
+Telemetry       telemetry(adcPins);             // sample blocks pushed to a subscriber
+UdpSocket       telemetryUdp;                   // UDP subscriptions on TELEMETRY_PORT
+#endif
+
+// command handlers, ctx is the client the frame came from
+void onLed(uint8_t id, const uint8_t* data, uint8_t len, void* ctx)
+{
+    if (id == 0x01)
+        led1 = int(data[0]);
+    else
+        led2 = int(data[0]);
+}
+
+void onAdc(uint8_t id, const uint8_t* data, uint8_t len, void* ctx)
+{
+    ((TcpClient*)ctx)->send((uint8_t*)adcArr, sizeof(adcArr));     // send adc data if client wants it
+}
+
+void onPwm(uint8_t id, const uint8_t* data, uint8_t len, void* ctx)
+{
+    led3 = (float)(int(data[0]) / 100.0);                           // read pwm value and write LED
+}
+
+#if APP_TELEMETRY
+void onSubscribe(uint8_t id, const uint8_t* data, uint8_t len, void* ctx)
+{
+    telemetry.subscribe((TcpClient*)ctx, data[0] * 1000);           // sample period in ms, 0 stops
+}
+
+void onUdpSubscribe(uint8_t id, const uint8_t* data, uint8_t len, void* ctx)
+{
+    UdpSocket*  socket = (UdpSocket*)ctx;
+
+    telemetry.subscribe(socket, socket->remoteAddress(), data[0] * 1000);
+}
+#endif
+
+const frame_command_t   commands[] =
+{
+    { 0x01, onLed },
+    { 0x02, onLed },
+    { 0x10, onAdc },
+    { 0x30, onPwm },
+#if APP_TELEMETRY
+    { TELEMETRY_SUBSCRIBE, onSubscribe }
+#endif
+};
+
+#if APP_TELEMETRY
+const frame_command_t   udpCommands[] =
+{
+    { TELEMETRY_SUBSCRIBE, onUdpSubscribe }
+};
+#endif
+
+#if APP_HTTP
+// web page, the static files are in www_assets.h and only the state is
+// formatted per request
+int onStatus(const http_request_t* request, char* body, size_t size, void* ctx)
+{
+    return snprintf
+        (
+            body, size,
+            "{\"led\":[%d,%d],\"pwm\":%d,\"adc\":[%d,%d]}",
+            led1.read(), led2.read(), (int)(led3.read() * 100 + 0.5f), adcArr[3], adcArr[4]
+        );
+}
+
+int onLedToggle(const http_request_t* request, char* body, size_t size, void* ctx)
+{
+    switch (HttpServer::param(request->query, "id", 0)) {
+        case 1:     led1 = !led1; break;
+        case 2:     led2 = !led2; break;
+        default:    return -400;
+    }
+
+    return onStatus(request, body, size, ctx);
+}
+
+int onPwmSet(const http_request_t* request, char* body, size_t size, void* ctx)
+{
+    int val = HttpServer::param(request->query, "val", -1);
+
+    if (val < 0 || val > 100)
+        return -400;
+
+    led3 = (float)(val / 100.0);
+    return onStatus(request, body, size, ctx);
+}
+
+const http_route_t      routes[] =
+{
+    { HTTP_GET | HTTP_HEAD, "/api/status", onStatus },
+    { HTTP_POST, "/api/led", onLedToggle },
+    { HTTP_POST, "/api/pwm", onPwmSet }
+};
+
+HttpServer      http(routes, sizeof(routes) / sizeof(routes[0]), wwwAssets, wwwAssetsCount);
+#endif
+
+#if APP_MQTT
+// MQTT, the ADC values are published every second, the LEDs and the PWM
+// can be set by publishing to stm32/led/1, stm32/led/2 (0 or 1) and
+// stm32/pwm (0 - 100). stm32/bench starts a burst for tools/mqtt_bench.
+enum { TOPIC_ADC, TOPIC_BENCH_DATA, TOPIC_BENCH_DONE };
+
+const char* const   topics[] = { "stm32/adc", "stm32/bench/data", "stm32/bench/done" };
+uint32_t            benchLeft;                  // messages still to publish
+uint32_t            benchSeq;
+uint32_t            benchPublished;             // counters when the burst started
+uint32_t            benchSegments;
+uint8_t             benchPayload[128];
+size_t              benchSize;
+
+// the payloads are short numbers, copied to terminate them
+int mqttInt(const uint8_t* payload, size_t len)
+{
+    char    text[12];
+
+    if (len >= sizeof(text))
+        len = sizeof(text) - 1;
+    memcpy(text, payload, len);
+    text[len] = '\0';
+    return atoi(text);
+}
+
+void onMqttLed(const char* topic, const uint8_t* payload, size_t len, void* ctx)
+{
+    int on = mqttInt(payload, len) != 0;
+
+    if (strcmp(topic, "stm32/led/1") == 0)
+        led1 = on;
+    else
+    if (strcmp(topic, "stm32/led/2") == 0)
+        led2 = on;
+}
+
+void onMqttPwm(const char* topic, const uint8_t* payload, size_t len, void* ctx)
+{
+    int val = mqttInt(payload, len);
+
+    if (val >= 0 && val <= 100)
+        led3 = (float)(val / 100.0);
+}
+
+void onMqttBench(const char* topic, const uint8_t* payload, size_t len, void* ctx);
+
+const mqtt_subscription_t   subscriptions[] =
+{
+    { "stm32/led/+", 0, onMqttLed },
+    { "stm32/pwm", 0, onMqttPwm },
+    { "stm32/bench", 0, onMqttBench }
+};
+
+MqttClient      mqtt("stm32", topics, sizeof(topics) / sizeof(topics[0]), subscriptions, sizeof(subscriptions) / sizeof(subscriptions[0]));
+
+// "count size": publishes count messages of size bytes, each starting with
+// its sequence number (LE)
+void onMqttBench(const char* topic, const uint8_t* payload, size_t len, void* ctx)
+{
+    char            text[24];
+    unsigned long   count = 0;
+    int             size = 0;
+
+    if (len >= sizeof(text))
+        len = sizeof(text) - 1;
+    memcpy(text, payload, len);
+    text[len] = '\0';
+    benchLeft = sscanf(text, "%lu %d", &count, &size) == 2 && size >= 4 ? count : 0;
+    benchSize = size < (int)sizeof(benchPayload) ? size : sizeof(benchPayload);
+    memset(benchPayload, 'x', sizeof(benchPayload));
+    benchSeq = 0;
+    benchPublished = mqtt.published();
+    benchSegments = mqtt.segments();
+}
+
+// publishes the next messages of a burst, they are batched into segments
+// until the next mqtt.poll()
+void bench()
+{
+    for (uint8_t i = 0; i < 16 && benchLeft; i++) {
+        memcpy(benchPayload, &benchSeq, sizeof(benchSeq));
+        if (mqtt.publish(TOPIC_BENCH_DATA, benchPayload, benchSize) < 0)
+            return;
+        benchSeq++;
+        if (--benchLeft == 0) {
+            char    done[24];
+            int     len;
+
+            mqtt.flush();
+            len = snprintf(done, sizeof(done), "%lu %lu", (unsigned long)(mqtt.published() - benchPublished), (unsigned long)(mqtt.segments() - benchSegments));
+            mqtt.publish(TOPIC_BENCH_DONE, done, len);
+        }
+    }
+}
+#endif
+
+FrameCodec      codec(commands, sizeof(commands) / sizeof(commands[0]), 0, 2);  // A5 5A id val
+#if APP_TELEMETRY
+FrameCodec      subCodec(commands, sizeof(commands) / sizeof(commands[0]), 0, 2);   // commands from the subscriber
+FrameCodec      udpCodec(udpCommands, 1, 0, 2);
+
+// feeds everything the client sent to the codec
+void serve(TcpClient* client, FrameCodec& codec)
+{
+    size_t  recvLen;
+
+    codec.setContext(client);
+    while ((recvLen = client->available()) > 0) {
+        if (recvLen > sizeof(recvData))
+            recvLen = sizeof(recvData);
+        client->recv(recvData, recvLen);            // read incoming data from socket
+        codec.feed(recvData, recvLen);
+    }
+}
+#endif
+
 int main()
 {
     
@@ -54,18 +314,42 @@ int main()
 
     server.bind(PORT);
 
-    server.listen(4);                   // max client count 
+    server.listen(PORT_BACKLOG);        // max client count 
     pc.printf("Start listening!\r\n");
 
+    diag.open(&net);
+    sntp.open(&net, NTP);
+#if APP_TELEMETRY
+    telemetry.setClock(&sntp.clock());
+    telemetryUdp.begin(TELEMETRY_PORT);
+#endif
+#if APP_HTTP
+    http.open(&net, HTTP_PORT);
+#endif
+#if APP_MQTT
+    mqtt.open(&net, BROKER);                    // reconnects in mqtt.poll()
+#endif
+
     t1.start();
 
     while (true) {
         client = server.accept();               // accept client if exist
+        diag.poll();                            // answer diagnostics requests
+        sntp.poll();                            // keep the clock synchronized
 
+#if APP_TELEMETRY
+        // while streaming the ADC belongs to the sampling interrupt
+        uint8_t adcVal = telemetry.running() ? telemetry.latest(0) * 100 / 65535 : (uint8_t)(pot1.read() * 100);
+        uint8_t adcVal2 = telemetry.running() ? telemetry.latest(1) * 100 / 65535 : (uint8_t)(pot2.read() * 100);
+#else
         uint8_t adcVal = (uint8_t)(pot1.read() * 100);
         uint8_t adcVal2 = (uint8_t)(pot2.read() * 100);
+#endif
         adcArr[3] = adcVal;
         adcArr[4] = adcVal2;
+
+        uint64_t    now = sntp.clock().now();  // 0 until the NTP server answered
+        memcpy(adcArr + 5, &now, sizeof(now));
  
         if (client) {                   // check client is exist
             size_t  recvLen;
@@ -74,46 +358,77 @@ int main()
             pc.printf("\r\n----------------------------------\r\n");
             pc.printf("Client with IP address %s connected.\n\r", client->getpeername());
 
-            // read incoming data from client and toggle leds
+            // read incoming data from client and run every command in it,
+            // frames may be pipelined or split across segments
+            codec.reset();
+            codec.setContext(client);
             if ((recvLen = client->available()) > 0) 
             {
                 pc.printf("%d bytes received:\r\n", recvLen);
-                client->recv(recvData, recvLen);            // read incoming data from socket
-                for (int i = 0; i < recvLen; i++)
-                    pc.printf(" 0x%.2X", recvData[i]);
-
-                // check incoming data length and first two bytes
-                if(recvLen > 2 && (recvData[0] == 0xA5 && recvData[1] == 0x5A))
-                {
-                    switch(recvData[2]){
-                        case 0x01:
-                            led1 = int(recvData[3]);
-                            break;
-                        case 0x02:
-                            led2 = int(recvData[3]);
-                            break;
-                        case 0x10:
-                            client->send((uint8_t*)adcArr, 5);      // send adc data if client wants it
-                            break;
-                        case 0x30:
-                            led3 = (float)(int(recvData[3]) / 100.0);       //read pwm value and write LED
-                            break;
-
-                    }
+                while ((recvLen = client->available()) > 0) {
+                    if (recvLen > sizeof(recvData))
+                        recvLen = sizeof(recvData);
+                    client->recv(recvData, recvLen);        // read incoming data from socket
+                    for (size_t i = 0; i < recvLen; i++)
+                        pc.printf(" 0x%.2X", recvData[i]);
+                    codec.feed(recvData, recvLen);
                 }
 
                 pc.printf("\r\n");
 
                 // send ok data
-                client->send((uint8_t*)sendData, strlen(sendData));
+                client->send((uint8_t*)sendData, sizeof(sendData));
             }
  
-            pc.printf("Client with IP address %s disconnected.\r\n", client->getpeername());
-            client->close();
+#if APP_TELEMETRY
+            if (client == telemetry.subscriber()) {
+                pc.printf("Client with IP address %s subscribed.\r\n", client->getpeername());
+            }
+            else
+#endif
+            {
+                pc.printf("Client with IP address %s disconnected.\r\n", client->getpeername());
+                client->close();
+            }
+        }
+
+#if APP_TELEMETRY
+        // commands arriving later on the subscriber's connection
+        TcpClient*  subscriber = telemetry.subscriber();
+        if (subscriber && subscriber->available()) {
+            serve(subscriber, subCodec);
+            if (subscriber != telemetry.subscriber())
+                subscriber->close();                // unsubscribed
         }
 
+        // UDP subscriptions and their renewals
+        if (telemetryUdp.parsePacket() > 0) {
+            size_t  len = telemetryUdp.read(recvData, sizeof(recvData));
+
+            udpCodec.reset();
+            udpCodec.setContext(&telemetryUdp);
+            udpCodec.feed(recvData, len);
+            telemetryUdp.flush();
+        }
+
+        telemetry.poll();                           // send completed sample blocks
+#endif
+#if APP_HTTP
+        http.poll();                                // web page
+#endif
+#if APP_MQTT
+        bench();
+        mqtt.poll();                                // sends the batched publishes
+#endif
+
         if(t1.read_ms() > 1000)
         {
+#if APP_MQTT
+            char    json[32];
+            int     len = snprintf(json, sizeof(json), "{\"adc\":[%d,%d]}", adcArr[3], adcArr[4]);
+
+            mqtt.publish(TOPIC_ADC, json, len);
+#endif
             led4 = !led4;
             t1.reset();
         }
@@ -0,0 +1,65 @@
+/*
+ www_assets.h - web pages compiled by tools/http_assets.py, do not edit.
+ */
+#ifndef WWW_ASSETS_H
+#define WWW_ASSETS_H
+
+#include "HttpServer.h"
+
+static const uint8_t www_index_html[710] =
+{
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xad, 0x55, 0x6d, 0x6f, 0xda, 0x30,
+    0x10, 0xfe, 0xce, 0xaf, 0xb8, 0x59, 0x9a, 0x14, 0x34, 0x20, 0x84, 0xed, 0xc3, 0x04, 0x49, 0xaa,
+    0x96, 0x56, 0x5b, 0xa5, 0x55, 0x45, 0x02, 0xad, 0xaa, 0xa6, 0x7d, 0x30, 0xb1, 0x21, 0xde, 0x1c,
+    0x27, 0x73, 0x6c, 0x5e, 0x56, 0xf1, 0xdf, 0x77, 0x4e, 0x78, 0x29, 0x6a, 0x69, 0xa7, 0x69, 0xf9,
+    0x90, 0x23, 0x8f, 0x7d, 0xcf, 0x3d, 0xbe, 0x3b, 0x1f, 0xe1, 0x9b, 0xcb, 0xdb, 0xe1, 0xe4, 0x7e,
+    0x74, 0x05, 0xa9, 0xc9, 0x64, 0xdc, 0x08, 0x77, 0x86, 0x53, 0x86, 0x26, 0xe3, 0x86, 0x42, 0x92,
+    0x52, 0x5d, 0x72, 0x13, 0x11, 0x6b, 0x66, 0xed, 0x8f, 0x64, 0x07, 0x2b, 0x9a, 0xf1, 0x88, 0x2c,
+    0x04, 0x5f, 0x16, 0xb9, 0x36, 0x04, 0x92, 0x5c, 0x19, 0xae, 0x70, 0xdb, 0x52, 0x30, 0x93, 0x46,
+    0x8c, 0x2f, 0x44, 0xc2, 0xdb, 0xd5, 0x47, 0x0b, 0x84, 0x12, 0x46, 0x50, 0xd9, 0x2e, 0x13, 0x2a,
+    0x79, 0x14, 0x38, 0x12, 0x23, 0x8c, 0xe4, 0xf1, 0x78, 0x72, 0xf3, 0xbe, 0x07, 0x93, 0xe1, 0x08,
+    0xc6, 0x5c, 0x2f, 0xb8, 0x0e, 0xfd, 0x1a, 0x6f, 0x84, 0xa5, 0x59, 0x3b, 0x3b, 0xcd, 0xd9, 0x1a,
+    0x1e, 0x60, 0x86, 0xec, 0xed, 0x19, 0xcd, 0x84, 0x5c, 0xf7, 0xa1, 0xa4, 0xaa, 0x6c, 0x97, 0x5c,
+    0x8b, 0xd9, 0x00, 0x0c, 0x5f, 0x99, 0x36, 0x95, 0x62, 0xae, 0xfa, 0x90, 0x60, 0x7c, 0xae, 0x07,
+    0xb0, 0x69, 0x18, 0x3a, 0x95, 0x1c, 0xdd, 0x32, 0xaa, 0xe7, 0x02, 0x57, 0xa8, 0x35, 0x79, 0x85,
+    0x33, 0x04, 0x0b, 0xca, 0x98, 0x50, 0xf3, 0x3e, 0x7c, 0x28, 0x56, 0x10, 0xf4, 0x8a, 0xd5, 0x31,
+    0x8b, 0xe4, 0x33, 0xe3, 0xf6, 0x86, 0xfe, 0x56, 0x42, 0xe8, 0x6f, 0xd3, 0xe1, 0xb4, 0xb8, 0xe4,
+    0x04, 0xf1, 0x67, 0x2e, 0x65, 0x0e, 0x77, 0xb9, 0x96, 0xec, 0x0d, 0x2e, 0x07, 0x0e, 0xd5, 0xee,
+    0xd5, 0x8b, 0x6f, 0xe7, 0xf6, 0x77, 0x4a, 0x15, 0x5c, 0xd0, 0xd2, 0x1d, 0x07, 0x91, 0xed, 0x5a,
+    0xa5, 0xc9, 0x59, 0x1d, 0x87, 0x86, 0xc5, 0x5f, 0x38, 0x83, 0x00, 0x2e, 0xad, 0xb6, 0x99, 0xc5,
+    0x53, 0x33, 0x07, 0x82, 0x60, 0x11, 0x91, 0x9c, 0x61, 0x82, 0xda, 0x3b, 0x2c, 0x0e, 0x85, 0x2a,
+    0xac, 0x01, 0xb3, 0x2e, 0x30, 0xdf, 0x53, 0x6b, 0x4c, 0xae, 0x08, 0x2c, 0xa8, 0xb4, 0xf8, 0xe9,
+    0x48, 0x2a, 0x0a, 0x02, 0xb9, 0x4a, 0xa4, 0x48, 0x7e, 0x46, 0xc4, 0xe4, 0xf3, 0xb9, 0xe4, 0x5e,
+    0xd0, 0x24, 0x71, 0xcd, 0xe1, 0x1b, 0x7d, 0x1c, 0xb6, 0x77, 0x22, 0x6c, 0xef, 0x3f, 0x84, 0xed,
+    0x3d, 0x1f, 0x76, 0x74, 0x77, 0x73, 0x14, 0xad, 0x58, 0x66, 0x27, 0x83, 0x29, 0x9b, 0x4d, 0xb9,
+    0x26, 0xbb, 0x7d, 0x5f, 0xa9, 0x24, 0x90, 0x09, 0x15, 0x91, 0x2e, 0x5a, 0xba, 0x8a, 0x48, 0xd0,
+    0xed, 0x92, 0x18, 0x5e, 0x12, 0x88, 0xe1, 0xe0, 0x7c, 0x4d, 0xb5, 0xa4, 0x8f, 0x14, 0x22, 0x97,
+    0xf7, 0xbc, 0xba, 0xf3, 0xcb, 0xe1, 0x91, 0x3a, 0xca, 0x92, 0xee, 0x23, 0x79, 0x3b, 0xec, 0x50,
+    0x96, 0xda, 0xdb, 0xdf, 0x95, 0xb4, 0x4c, 0xb4, 0x28, 0x4c, 0xdc, 0x98, 0x59, 0x95, 0x18, 0x91,
+    0x2b, 0x28, 0xd3, 0x7c, 0xe9, 0x95, 0x4d, 0x78, 0x68, 0x00, 0x3e, 0x2c, 0x4f, 0x6c, 0x86, 0xbd,
+    0xd9, 0x99, 0x73, 0x73, 0x25, 0xb9, 0xfb, 0x79, 0xb1, 0xbe, 0x66, 0x5e, 0x5d, 0xea, 0x66, 0xc7,
+    0x75, 0xdf, 0xb0, 0xbe, 0x3e, 0x10, 0x41, 0xd9, 0x41, 0xf8, 0x5b, 0xf7, 0x3b, 0x9c, 0x01, 0xb9,
+    0xa7, 0x8a, 0x09, 0x02, 0x7d, 0x20, 0xe3, 0x5c, 0x31, 0x4b, 0x06, 0xaf, 0xf2, 0xf5, 0x4e, 0xf0,
+    0x05, 0xff, 0xc2, 0xe7, 0xaa, 0xf4, 0x94, 0x0e, 0x51, 0x78, 0x07, 0x04, 0xde, 0xbe, 0xe6, 0x5e,
+    0xa5, 0xf1, 0xa9, 0x3f, 0xc2, 0xee, 0x78, 0x7f, 0x4b, 0x11, 0x9c, 0xa0, 0x08, 0x0e, 0x14, 0x9b,
+    0x43, 0xe6, 0x35, 0xff, 0x65, 0x79, 0x69, 0x3c, 0x9c, 0x51, 0x69, 0xce, 0x5a, 0x60, 0xb5, 0xdc,
+    0x95, 0x61, 0xc6, 0x4d, 0x92, 0x7a, 0x08, 0xb4, 0xdc, 0x64, 0xa8, 0xd6, 0xfb, 0x5b, 0x0b, 0x1b,
+    0x8c, 0x91, 0x72, 0xe5, 0xed, 0x79, 0x3c, 0x8d, 0x6e, 0xc8, 0x66, 0xac, 0x46, 0xd2, 0xce, 0x8f,
+    0x32, 0x57, 0x5e, 0x73, 0xb0, 0xdf, 0xe7, 0x0a, 0xdc, 0x3c, 0x0a, 0xbc, 0xed, 0x7f, 0xc1, 0x6a,
+    0xbf, 0x5a, 0x05, 0x19, 0xdd, 0x8e, 0x27, 0xa4, 0x05, 0xc4, 0xa7, 0x85, 0xf0, 0xb1, 0x0e, 0x67,
+    0xae, 0x95, 0x50, 0x37, 0x6e, 0x73, 0x33, 0x66, 0xef, 0x5d, 0xf5, 0xe6, 0x49, 0x47, 0x5c, 0x3d,
+    0xc3, 0xce, 0xae, 0x3c, 0x5f, 0x2a, 0x96, 0xbb, 0x2a, 0xcd, 0x4e, 0x75, 0x07, 0x2a, 0xfa, 0x3d,
+    0xdb, 0xa7, 0xab, 0x03, 0x59, 0x69, 0xa8, 0xb1, 0x25, 0x41, 0xf5, 0x38, 0xd5, 0xaf, 0xdd, 0xc4,
+    0x44, 0x87, 0x47, 0x07, 0x3f, 0x92, 0xf1, 0xac, 0x23, 0x6c, 0x5a, 0x80, 0x77, 0xb0, 0x8b, 0x14,
+    0x38, 0x24, 0xb7, 0xbd, 0x1f, 0xfa, 0xdb, 0xf1, 0xe8, 0xd7, 0xff, 0x21, 0x7f, 0x00, 0xac, 0x80,
+    0xf3, 0xf9, 0x5b, 0x06, 0x00, 0x00,
+};
+
+static const http_asset_t  wwwAssets[] =
+{
+    { "/index.html", "\"9a4c97ad\"", "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Encoding: gzip\r\nContent-Length: 710\r\nETag: \"9a4c97ad\"\r\nCache-Control: no-cache\r\n", 145, www_index_html, 710 },
+    { "/", "\"9a4c97ad\"", "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Encoding: gzip\r\nContent-Length: 710\r\nETag: \"9a4c97ad\"\r\nCache-Control: no-cache\r\n", 145, www_index_html, 710 }
+};
+
+static const uint8_t       wwwAssetsCount = 2;
+#endif
@@ -0,0 +1,503 @@
+/*
+ buffer_sweep.cpp - the ENC28J60 RX/TX split profiles under the demo's workload, run on a PC.
+
+ Builds UIPEthernet and uIP unchanged on top of the fake ENC28J60, once per
+ peers modelled here for DURATION_MS, then SETTLE_MS with no new load:
+ peers modelled here for DURATION_MS:
+
+    http        HTTP_CLIENTS connections asking for RESPONSE bytes, written
+                by the application in SEND_CHUNK pieces, one after the other
+    upload      one connection streaming UPLOAD_RATE bytes per ms to the
+                board, read as it comes
+    udp         bursts of UDP_BURST datagrams of UDP_SIZE bytes every
+                UDP_PERIOD_MS, drained by the application as it loops
+
+ The fake has no SPI timing, the peers set the pace. A bigger receive ring
+ takes longer UDP bursts without overflowing, a bigger transmit region gives
+ MemPool room for the socket blocks. Printed per run:
+
+    responses           answered, and the worst time from request to the
+                        last byte of the response
+    loop stall          longest application loop, TcpClient::send() ticks the
+                        stack itself while MemPool has no block for the data
+    short writes        send() calls that returned less than asked
+    frames, no memory   frames UipEthernet could not allocate a block for
+    udp                 datagrams received, dropped with the socket queue
+                        full or without a MemPool block
+    rx overflows        frames that found the receive ring full
+    peer resent         segments the peers had to retransmit
+
+ Checked: every byte the board acknowledged reached the application, and
+ no frame was malformed. Starved services are reported, not failed.
+
+    S=../stm32/UIPEthernet
+    for p in ENC28J60_BUFFER_TX_HEAVY ENC28J60_BUFFER_BALANCED ENC28J60_BUFFER_RX_HEAVY; do
+        gcc -c -funsigned-char -w -DENC28J60_BUFFER_PROFILE=$p -Ihost -I$S/utility $S/utility/uip.c \
+            $S/utility/uip_arp.c $S/utility/uip_timer.c $S/utility/stoip4.c $S/utility/ip4tos.c \
+            $S/utility/stoip6.c $S/utility/ip6tos.c $S/utility/common_functions.c
+        g++ -std=gnu++11 -funsigned-char -w -DENC28J60_BUFFER_PROFILE=$p -Ihost -I$S -I$S/utility \
+            -o buffer_sweep buffer_sweep.cpp host/Enc28j60Fake.cpp $S/UipEthernet.cpp $S/UdpSocket.cpp \
+            $S/TcpClient.cpp $S/TcpServer.cpp $S/DhcpClient.cpp $S/DnsClient.cpp $S/IpAddress.cpp \
+            $S/SocketAddress.cpp $S/utility/MemPool.cpp \
+            uip.o uip_arp.o uip_timer.o stoip4.o ip4tos.o stoip6.o ip6tos.o common_functions.o
+        ./buffer_sweep
+    done
+ */
+#include <algorithm>
+#include <vector>
+
+#include "UipEthernet.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "UdpSocket.h"
+#include "Enc28j60Fake.h"
+
+#define DURATION_MS     3000
+#define HTTP_CLIENTS    2
+#define RESPONSE        4096
+#define SEND_CHUNK      1024
+#define UDP_BURST       6
+#define UDP_SIZE        512
+#define UDP_PERIOD_MS   50
+#define UPLOAD_RATE     100         // bytes per ms
+#define PEER_MSS        512
+#define PEER_RTO_MS     200
+#define SETTLE_MS       500         // after DURATION_MS, without new requests or data
+
+static const uint8_t    boardMac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+static const uint8_t    peerMac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t    boardIp[4] = { 192, 168, 1, 10 };
+static const uint8_t    peerIp[4] = { 192, 168, 1, 1 };
+static const uint16_t   httpPort = 80;
+static const uint16_t   uploadPort = 61;
+static const uint16_t   udpPort = 62;
+
+enum { TCP_FIN = 0x01, TCP_SYN = 0x02, TCP_RST = 0x04, TCP_PSH = 0x08, TCP_ACK = 0x10 };
+
+// the peer's end of a TCP connection
+struct Peer
+{
+    uint16_t    port;
+    uint16_t    boardPort;
+    uint32_t    seq;            // next byte to send, unacknowledged ones included
+    uint32_t    una;            // oldest unacknowledged byte
+    uint32_t    rcvNxt;
+    uint32_t    iss;            // first byte after the SYN
+    uint16_t    window;         // advertised by the board
+    bool        established;
+    size_t      toSend;         // bytes the peer application still has to send
+    size_t      received;       // bytes of the current response
+    Timer       rexmit;
+    Timer       request;
+};
+
+struct Stats
+{
+    int         responses;
+    int         worstResponseMs;
+    int         worstLoopMs;
+    int         shortWrites;
+    size_t      uploaded;
+    int         udpSent;
+    int         udpReceived;
+    int         peerResent;
+    int         badFrames;
+};
+
+static Peer     peers[HTTP_CLIENTS + 1];    // the HTTP clients, then the upload
+static Stats    stats;
+static Timer    udpTimer;
+static Timer    uploadTimer;
+static size_t   uploadDue;
+static bool     settling;                   // no new load, what is in flight is delivered
+static int      failures;
+
+static uint32_t sum16(const uint8_t* p, size_t len, uint32_t sum)
+{
+    for (size_t i = 0; i < len; i += 2)
+        sum += (p[i] << 8) + (i + 1 < len ? p[i + 1] : 0);
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Ethernet and IPv4 header of a frame from the peer, returns the payload
+static uint8_t* ipFrame(frame_t& f, uint8_t protocol, size_t len)
+{
+    uint8_t*    ip;
+    uint16_t    sum;
+
+    f.assign(34 + len, 0);
+    ip = &f[14];
+    memcpy(&f[0], boardMac, 6);
+    memcpy(&f[6], peerMac, 6);
+    f[12] = 0x08;
+    ip[0] = 0x45;
+    ip[2] = (20 + len) >> 8;
+    ip[3] = 20 + len;
+    ip[8] = 64;
+    ip[9] = protocol;
+    memcpy(ip + 12, peerIp, 4);
+    memcpy(ip + 16, boardIp, 4);
+    sum = ~fold(sum16(ip, 20, 0));
+    ip[10] = sum >> 8;
+    ip[11] = sum;
+    return ip + 20;
+}
+
+// Puts a segment of the peer on the wire, a SYN with the MSS option
+static void segment(Peer& p, uint8_t flags, uint32_t seq, size_t len)
+{
+    frame_t     f;
+    size_t      hdrLen = flags & TCP_SYN ? 24 : 20;
+    uint8_t*    tcp = ipFrame(f, 6, hdrLen + len);
+    uint16_t    sum;
+
+    tcp[0] = p.port >> 8;
+    tcp[1] = p.port;
+    tcp[2] = p.boardPort >> 8;
+    tcp[3] = p.boardPort;
+    put32(tcp + 4, seq);
+    put32(tcp + 8, p.rcvNxt);
+    tcp[12] = hdrLen << 2;
+    tcp[13] = flags;
+    tcp[14] = 0x10;                     // 4 KB window
+    if (flags & TCP_SYN) {
+        tcp[20] = 2;                    // MSS
+        tcp[21] = 4;
+        tcp[22] = PEER_MSS >> 8;
+        tcp[23] = PEER_MSS & 0xff;
+    }
+
+    memset(tcp + hdrLen, 'a' + (seq & 15), len);
+    sum = ~fold(sum16(tcp, hdrLen + len, sum16(tcp - 8, 8, 6 + hdrLen + len)));
+    tcp[16] = sum >> 8;
+    tcp[17] = sum;
+    wireRx.push_back(f);
+}
+
+static void datagram(size_t len)
+{
+    frame_t     f;
+    uint8_t*    udp = ipFrame(f, 17, 8 + len);
+    uint16_t    sum;
+
+    udp[0] = 50000 >> 8;
+    udp[1] = 50000 & 0xff;
+    udp[2] = udpPort >> 8;
+    udp[3] = udpPort;
+    udp[4] = (8 + len) >> 8;
+    udp[5] = 8 + len;
+    memset(udp + 8, 'u', len);
+    sum = ~fold(sum16(udp, 8 + len, sum16(udp - 8, 8, 17 + 8 + len)));
+    udp[6] = sum >> 8;
+    udp[7] = sum;
+    wireRx.push_back(f);
+}
+
+// ARP request for the board, which also enters the peer into its table
+static void arpRequest()
+{
+    frame_t f(42);
+
+    memset(&f[0], 0xff, 6);
+    memcpy(&f[6], peerMac, 6);
+    f[12] = 0x08;
+    f[13] = 0x06;
+    f[15] = 1;
+    f[16] = 0x08;
+    f[18] = 6;
+    f[19] = 4;
+    f[21] = 1;
+    memcpy(&f[22], peerMac, 6);
+    memcpy(&f[28], peerIp, 4);
+    memcpy(&f[38], boardIp, 4);
+    wireRx.push_back(f);
+}
+
+static void open(Peer& p, uint16_t port, uint16_t boardPort)
+{
+    p.port = port;
+    p.boardPort = boardPort;
+    p.seq = p.una = port * 1000;
+    p.established = false;
+    p.toSend = 0;
+    p.received = 0;
+    segment(p, TCP_SYN, p.seq++, 0);
+    p.una = p.iss = p.seq;
+}
+
+// Sends what the peer application has for the board, one segment in
+// flight as uIP acknowledges them one by one
+static void transmit(Peer& p)
+{
+    if (!p.established)
+        return;
+
+    if (p.seq != p.una) {
+        if (p.rexmit.read_ms() < PEER_RTO_MS)
+            return;
+        stats.peerResent++;
+        p.toSend += p.seq - p.una;
+        p.seq = p.una;
+    }
+
+    size_t  len = std::min(std::min(p.toSend, (size_t)PEER_MSS), (size_t)p.window);
+
+    if (len == 0)
+        return;
+    segment(p, TCP_ACK | TCP_PSH, p.seq, len);
+    p.seq += len;
+    p.toSend -= len;
+    p.rexmit.reset();
+    p.rexmit.start();
+}
+
+// The HTTP client asks for the next response once the last one is complete
+static void respond(Peer& p, size_t len)
+{
+    p.received += len;
+    if (p.received < RESPONSE)
+        return;
+
+    int ms = p.request.read_ms();
+
+    stats.responses++;
+    stats.worstResponseMs = std::max(stats.worstResponseMs, ms);
+    p.received -= RESPONSE;
+    if (!settling)
+        p.toSend += 16;
+    p.request.reset();
+}
+
+// The other end of the wire: takes the board's frames and sends the peers'
+static void wire()
+{
+    while (!wireTx.empty()) {
+        frame_t f = wireTx.front();
+
+        wireTx.pop_front();
+        if (f[12] != 0x08 || f[13] != 0x00 || f[23] != 6)
+            continue;
+
+        const uint8_t*  ip = &f[14];
+        const uint8_t*  tcp = ip + 20;
+        size_t          ipLen = ip[2] << 8 | ip[3];
+        size_t          hdrLen = (tcp[12] >> 4) * 4;
+        uint16_t        port = tcp[2] << 8 | tcp[3];
+        Peer*           p = NULL;
+
+        if (14 + ipLen > f.size() || fold(sum16(tcp, ipLen - 20, sum16(ip + 12, 8, 6 + ipLen - 20))) != 0xffff) {
+            stats.badFrames++;
+            continue;
+        }
+
+        for (int i = 0; i <= HTTP_CLIENTS; i++) {
+            if (peers[i].port == port)
+                p = &peers[i];
+        }
+
+        if (!p || (tcp[13] & TCP_RST))
+            continue;
+
+        uint8_t     flags = tcp[13];
+        uint32_t    seq = get32(tcp + 4);
+        uint32_t    ack = get32(tcp + 8);
+        size_t      len = ipLen - 20 - hdrLen;
+
+        p->window = tcp[14] << 8 | tcp[15];
+        if (flags & TCP_SYN) {
+            p->rcvNxt = seq + 1;
+            p->established = true;
+            segment(*p, TCP_ACK, p->seq, 0);
+            continue;
+        }
+
+        if ((flags & TCP_ACK) && (int32_t)(ack - p->una) > 0 && (int32_t)(ack - p->seq) <= 0)
+            p->una = ack;
+        if (len == 0)
+            continue;
+        if (seq == p->rcvNxt) {
+            p->rcvNxt += len;
+            if (p != &peers[HTTP_CLIENTS])
+                respond(*p, len);
+        }
+
+        segment(*p, TCP_ACK, p->seq, 0);
+    }
+
+    if (!settling) {
+        size_t  due = uploadTimer.read_ms() * UPLOAD_RATE;
+
+        peers[HTTP_CLIENTS].toSend += due - uploadDue;
+        uploadDue = due;
+    }
+
+    for (int i = 0; i <= HTTP_CLIENTS; i++)
+        transmit(peers[i]);
+
+    if (!settling && udpTimer.read_ms() >= UDP_PERIOD_MS) {
+        udpTimer.reset();
+        for (int i = 0; i < UDP_BURST; i++)
+            datagram(UDP_SIZE);
+        stats.udpSent += UDP_BURST;
+    }
+}
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+// an HTTP connection of the application: how much of the response is left
+struct Response
+{
+    TcpClient*  client;
+    size_t      left;
+};
+
+int main()
+{
+    UipEthernet eth(boardMac, NC, NC, NC, NC);
+    TcpServer   http;
+    TcpServer   upload;
+    UdpSocket   udp;
+    Response    responses[HTTP_CLIENTS] = { };
+    TcpClient*  uploader = NULL;
+    uint8_t     buf[SEND_CHUNK];
+    Timer       run;
+    Timer       loop;
+
+    eth.set_network("192.168.1.10", "255.255.255.0", "192.168.1.1");
+    eth.connect();
+    http.open(&eth);
+    http.bind(httpPort);
+    http.listen(HTTP_CLIENTS);
+    upload.open(&eth);
+    upload.bind(uploadPort);
+    upload.listen(1);
+    udp.begin(udpPort);
+    arpRequest();
+    wirePeer = wire;
+    eth.tick();
+
+    for (int i = 0; i < HTTP_CLIENTS; i++) {
+        open(peers[i], 40000 + i, httpPort);
+        peers[i].toSend = 16;           // the first request
+        peers[i].request.start();
+    }
+
+    open(peers[HTTP_CLIENTS], 41000, uploadPort);
+    udpTimer.start();
+    uploadTimer.start();
+    run.start();
+    memset(buf, 'x', sizeof(buf));
+
+    while (run.read_ms() < DURATION_MS + SETTLE_MS) {
+        settling = run.read_ms() >= DURATION_MS;
+        loop.reset();
+        loop.start();
+        eth.tick();
+
+        TcpClient*  client = http.accept();
+
+        for (int i = 0; client && i < HTTP_CLIENTS; i++) {
+            if (!responses[i].client) {
+                responses[i].client = client;
+                client = NULL;
+            }
+        }
+
+        if (!uploader)
+            uploader = upload.accept();
+
+        for (int i = 0; i < HTTP_CLIENTS; i++) {
+            Response&   r = responses[i];
+
+            if (!r.client)
+                continue;
+
+            // a request starts the next response
+            while (r.client->available()) {
+                r.client->recv(buf, sizeof(buf));
+                r.left += RESPONSE;
+            }
+
+            if (r.left) {
+                size_t  len = std::min(r.left, (size_t)SEND_CHUNK);
+                int     sent = r.client->send(buf, len);
+
+                if (sent < (int)len)
+                    stats.shortWrites++;
+                if (sent > 0)
+                    r.left -= sent;
+            }
+        }
+
+        while (uploader && uploader->available()) {
+            int len = uploader->recv(buf, sizeof(buf));
+
+            if (len <= 0)
+                break;
+            stats.uploaded += len;
+        }
+
+        while (udp.parsePacket() > 0) {
+            udp.flush();
+            stats.udpReceived++;
+        }
+
+        stats.worstLoopMs = std::max(stats.worstLoopMs, loop.read_ms());
+    }
+
+    printf
+        (
+            "ENC28J60_BUFFER_PROFILE %d: %d bytes RX, %d bytes TX, %d s\n",
+            ENC28J60_BUFFER_PROFILE, RXEND_INIT - RXSTART_INIT + 1, TXEND_INIT - TXSTART_INIT + 1, DURATION_MS / 1000
+        );
+    printf("  %-40s %d, worst %d ms\n", "responses", stats.responses, stats.worstResponseMs);
+    printf("  %-40s %d ms\n", "loop stall", stats.worstLoopMs);
+    printf("  %-40s %d\n", "short writes", stats.shortWrites);
+    printf("  %-40s %lu\n", "frames, no memory", (unsigned long)eth.dropsNoMemory());
+    printf
+        (
+            "  %-40s %zu bytes, %lu acknowledged\n",
+            "uploaded",
+            stats.uploaded,
+            (unsigned long)(peers[HTTP_CLIENTS].una - peers[HTTP_CLIENTS].iss)
+        );
+    printf
+        (
+            "  %-40s %d of %d, %lu queue full, %lu no memory\n",
+            "udp received",
+            stats.udpReceived,
+            stats.udpSent,
+            (unsigned long)udp.droppedQueueFull(),
+            (unsigned long)udp.droppedNoMemory()
+        );
+    printf("  %-40s %lu\n", "rx overflows", (unsigned long)eth.enc28j60Eth.rxOverflows());
+    printf("  %-40s %d\n", "peer resent", stats.peerResent);
+    check(stats.uploaded == peers[HTTP_CLIENTS].una - peers[HTTP_CLIENTS].iss, "every byte the board acknowledged reached the application");
+    check(stats.badFrames == 0, "no malformed frame");
+    wirePeer = NULL;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Convert a PacketCapture dump from the STM32 TCP server into a capture file.
+
+The input is either a console log holding one or more hex dumps printed by
+PacketCapture::dumpHex() (between "-----BEGIN PCAPNG-----" and
+"-----END PCAPNG-----"), or the raw bytes of PacketCapture::dump() received
+over TCP. The output is a pcapng file Wireshark opens directly, or with
+--pcap a classic libpcap file for tools that only read that format.
+
+    python3 capture2pcap.py console.log capture.pcapng
+    python3 capture2pcap.py --pcap console.log capture.pcap
+
+pcap_replay.cpp feeds the --pcap output back into the stack on a PC.
+"""
+import argparse
+import binascii
+import struct
+import sys
+
+BEGIN = "-----BEGIN PCAPNG-----"
+END = "-----END PCAPNG-----"
+
+SHB = 0x0A0D0D0A
+IDB = 0x00000001
+EPB = 0x00000006
+MAGIC = 0x1A2B3C4D
+
+
+def sections_from_log(text):
+    """Returns the pcapng sections found between the dump markers."""
+    sections = []
+    lines = None
+    for line in text.splitlines():
+        line = line.strip()
+        if line == BEGIN:
+            lines = []
+        elif line == END and lines is not None:
+            sections.append(binascii.unhexlify("".join(lines)))
+            lines = None
+        elif lines is not None and line:
+            lines.append(line)
+    return sections
+
+
+def frames(section):
+    """Yields (timestamp_us, original_length, data) for each packet block."""
+    pos = 0
+    order = "<"
+    while pos + 12 <= len(section):
+        btype, = struct.unpack_from(order + "I", section, pos)
+        if btype == SHB:
+            magic, = struct.unpack_from("<I", section, pos + 8)
+            order = "<" if magic == MAGIC else ">"
+        blen, = struct.unpack_from(order + "I", section, pos + 4)
+        if blen < 12 or pos + blen > len(section):
+            raise ValueError("truncated block at offset %d" % pos)
+        if btype == EPB:
+            _, ts_high, ts_low, cap_len, orig_len = struct.unpack_from(order + "5I", section, pos + 8)
+            data = section[pos + 28:pos + 28 + cap_len]
+            yield (ts_high << 32) | ts_low, orig_len, data
+        pos += blen
+
+
+def write_pcap(out, sections, snaplen=65535):
+    out.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, snaplen, 1))
+    count = 0
+    for section in sections:
+        for ts, orig_len, data in frames(section):
+            out.write(struct.pack("<IIII", ts // 1000000, ts % 1000000, len(data), orig_len))
+            out.write(data)
+            count += 1
+    return count
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="console log or raw pcapng dump, - for stdin")
+    parser.add_argument("output", help="file to write")
+    parser.add_argument("--pcap", action="store_true", help="write a classic pcap file instead of pcapng")
+    args = parser.parse_args()
+
+    if args.input == "-":
+        raw = sys.stdin.buffer.read()
+    else:
+        with open(args.input, "rb") as f:
+            raw = f.read()
+
+    if len(raw) >= 4 and struct.unpack_from("<I", raw)[0] == SHB:
+        sections = [raw]
+    else:
+        sections = sections_from_log(raw.decode("ascii", "replace"))
+    if not sections:
+        sys.exit("no capture found in %s" % args.input)
+
+    with open(args.output, "wb") as out:
+        if args.pcap:
+            count = write_pcap(out, sections)
+        else:
+            count = 0
+            for section in sections:
+                out.write(section)
+                count += sum(1 for _ in frames(section))
+
+    print("%d frames in %d dump(s) written to %s" % (count, len(sections), args.output))
+
+
+if __name__ == "__main__":
+    main()
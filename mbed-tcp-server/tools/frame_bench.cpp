@@ -0,0 +1,199 @@
+/*
+ frame_bench.cpp - fuzz and throughput test of FrameCodec, run on a PC.
+
+ For both frame layouts, with and without CRC, encodes a stream of frames
+ with random ids and data, separated by random bytes, corrupts the CRC of
+ every tenth frame and feeds the stream in random pieces, down to single
+ bytes. Every intact frame must reach its handler in order with its data,
+ every corrupted one must be counted as a CRC error. Then checks that the
+ parser finds its way back after random garbage and measures how many
+ frames per second it decodes.
+
+    g++ -O2 -std=c++11 -I../stm32/FrameCodec -o frame_bench frame_bench.cpp ../stm32/FrameCodec/FrameCodec.cpp
+    ./frame_bench
+
+ The same test applies to pyside2-stm32/stm32/FrameCodec, a copy of it.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "FrameCodec.h"
+
+struct received_t
+{
+    uint8_t                 id;
+    std::vector<uint8_t>    data;
+};
+
+static uint32_t                 seed = 12345;
+static int                      failures;
+static std::vector<received_t>  received;
+
+static uint32_t rnd(uint32_t n)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % n;
+}
+
+static void onFrame(uint8_t id, const uint8_t* data, uint8_t len, void*)
+{
+    received_t  r;
+
+    r.id = id;
+    r.data.assign(data, data + len);
+    received.push_back(r);
+}
+
+static void onCount(uint8_t, const uint8_t*, uint8_t, void*)
+{ }
+
+static const frame_command_t    commands[] = { { 0x01, onFrame }, { 0x02, onFrame }, { 0x10, onFrame }, { 0x80, onFrame } };
+static const frame_command_t    counted[] = { { 0x01, onCount }, { 0x02, onCount }, { 0x10, onCount }, { 0x80, onCount } };
+
+#define COMMANDS    (sizeof(commands) / sizeof(commands[0]))
+#define FIXED_BODY  2               // A5 5A id val of the TCP server
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+// Encodes count frames of the layout; the intact ones are appended to
+// expected, returns the number of corrupted ones.
+static uint32_t generate(uint8_t flags, uint32_t count, std::vector<uint8_t>& stream, std::vector<received_t>* expected)
+{
+    FrameCodec  encoder(commands, COMMANDS, flags, FIXED_BODY);
+    uint32_t    corrupted = 0;
+
+    for (uint32_t f = 0; f < count; f++) {
+        // bytes between the frames, without sync byte
+        for (uint32_t i = rnd(4); i > 0; i--) {
+            uint8_t c = rnd(256);
+
+            stream.push_back(c == FRAME_SYNC1 ? 0 : c);
+        }
+
+        received_t  r;
+        uint8_t     len = (flags & FRAME_LEN) ? rnd(FRAME_MAXBODY) : FIXED_BODY - 1;
+        uint8_t     frame[FRAME_MAXBODY + 4];
+
+        r.id = commands[rnd(COMMANDS)].id;
+        for (uint8_t i = 0; i < len; i++)
+            r.data.push_back(rnd(256));
+
+        size_t  n = encoder.encode(frame, sizeof(frame), r.id, r.data.data(), len);
+
+        if ((flags & FRAME_CRC) && rnd(10) == 0) {
+            frame[n - 1] ^= 1 << rnd(8);
+            corrupted++;
+        }
+        else
+        if (expected)
+            expected->push_back(r);
+        stream.insert(stream.end(), frame, frame + n);
+    }
+
+    return corrupted;
+}
+
+static void test(uint8_t flags, const char* name)
+{
+    std::vector<uint8_t>    stream;
+    std::vector<received_t> expected;
+    uint32_t                corrupted = generate(flags, 20000, stream, &expected);
+    FrameCodec              codec(commands, COMMANDS, flags, FIXED_BODY);
+    size_t                  dispatched = 0;
+
+    printf("\n%s\n", name);
+    received.clear();
+    for (size_t pos = 0; pos < stream.size(); ) {
+        size_t  n = 1 + rnd(64);
+
+        if (n > stream.size() - pos)
+            n = stream.size() - pos;
+
+        // a fifth of the pieces byte by byte
+        if (rnd(5) == 0) {
+            for (size_t i = 0; i < n; i++)
+                dispatched += codec.feed(stream[pos + i]);
+        }
+        else
+            dispatched += codec.feed(&stream[pos], n);
+        pos += n;
+    }
+
+    bool    same = received.size() == expected.size() && dispatched == expected.size();
+
+    for (size_t i = 0; same && i < expected.size(); i++)
+        same = received[i].id == expected[i].id && received[i].data == expected[i].data;
+    check(same, "every intact frame dispatched in order with its data");
+    check(codec.crcErrors() == corrupted && codec.unknown() == 0 && codec.badLength() == 0, "every corrupted frame counted as CRC error");
+
+    // random garbage, then a filler longer than any body and a frame
+    for (int round = 0; round < 1000; round++) {
+        uint8_t garbage[256];
+        size_t  n = rnd(sizeof(garbage));
+
+        for (size_t i = 0; i < n; i++)
+            garbage[i] = rnd(3) == 0 ? FRAME_SYNC1 : rnd(3) == 0 ? FRAME_SYNC2 : rnd(256);
+        codec.feed(garbage, n);
+    }
+
+    uint8_t filler[FRAME_MAXBODY + 3];
+    uint8_t frame[FRAME_MAXBODY + 4];
+    uint8_t data[FIXED_BODY - 1] = { 0x42 };
+
+    memset(filler, 0, sizeof(filler));
+    codec.feed(filler, sizeof(filler));
+    received.clear();
+    codec.feed(frame, codec.encode(frame, sizeof(frame), 0x10, data, sizeof(data)));
+    check(received.size() == 1 && received[0].id == 0x10 && received[0].data[0] == 0x42, "back in sync after random garbage");
+
+    // throughput, frames without gaps or errors, no copying in the handler
+    std::vector<uint8_t>    clean;
+    FrameCodec              bench(counted, COMMANDS, flags, FIXED_BODY);
+    size_t                  frames = 0;
+    int                     rounds = 0;
+
+    for (uint32_t f = 0; f < 100000; f++) {
+        uint8_t len = (flags & FRAME_LEN) ? rnd(FRAME_MAXBODY) : FIXED_BODY - 1;
+        uint8_t body[FRAME_MAXBODY];
+
+        for (uint8_t i = 0; i < len; i++)
+            body[i] = rnd(256);
+        clean.insert(clean.end(), frame, frame + bench.encode(frame, sizeof(frame), commands[rnd(COMMANDS)].id, body, len));
+    }
+
+    clock_t start = clock();
+
+    do {
+        frames += bench.feed(clean.data(), clean.size());
+        rounds++;
+    } while (clock() - start < CLOCKS_PER_SEC / 2);
+
+    double  s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("  %.1f Mframes/s, %.1f MB/s\n", frames / s / 1e6, (double)rounds * clean.size() / s / 1e6);
+}
+
+int main()
+{
+    static const uint8_t    check9[] = "123456789";
+
+    printf("CRC-8\n");
+    check(FrameCodec::crc8(0, check9, 9) == 0xF4, "check value of \"123456789\" is 0xF4");
+
+    test(0, "TCP server layout, A5 5A id val");
+    test(FRAME_CRC, "TCP server layout with CRC");
+    test(FRAME_LEN, "UART layout, A5 5A len id data");
+    test(FRAME_LEN | FRAME_CRC, "UART layout with CRC");
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/*
+ Enc28j60Fake.cpp - ENC28J60 replacement for running the network stack on a PC.
+
+ Replaces utility/Enc28j60Eth.cpp; UipEthernet.cpp, MemPool.cpp and uIP run
+ unchanged. Transmitting is immediate. The receive ring only keeps account
+ of the bytes in use, the frame being read is copied to its start.
+ */
+#include "Enc28j60Eth.h"
+#include "Enc28j60Fake.h"
+extern "C"
+{
+#include "uip_clock.h"
+}
+
+std::deque<frame_t> wireRx;
+std::deque<frame_t> wireTx;
+void                (*wirePeer)();
+
+static std::deque<frame_t>  rxRing;     // received, the first one being read
+static size_t               rxUsed;     // bytes of the receive ring in use
+
+static uint8_t      mem[0x2000];
+static uint16_t     dmaStart, dmaEnd, dmaDest;
+
+uint16_t        Enc28j60Eth::nextPacketPtr;
+uint8_t         Enc28j60Eth::bank;
+memhandle       Enc28j60Eth::txQueue[ENC28J60_TXQUEUE];
+uint8_t         Enc28j60Eth::txCount;
+uint32_t        Enc28j60Eth::_txFrames;
+uint32_t        Enc28j60Eth::_txErrors;
+uint32_t        Enc28j60Eth::_txLateCollisions;
+uint32_t        Enc28j60Eth::_rxFrames;
+uint32_t        Enc28j60Eth::_spiTransactions;
+uint32_t        Enc28j60Eth::_spiBytes;
+uint32_t        Enc28j60Eth::_rxBytes;
+uint32_t        Enc28j60Eth::_txBytes;
+uint32_t        Enc28j60Eth::_rxOverflows;
+uint32_t        Enc28j60Eth::_rxCrcErrors;
+struct memblock Enc28j60Eth::receivePkt;
+
+// the received frame or a block of the pool, used in the members only
+#define block(handle)   ((handle) == UIP_RECEIVEBUFFERHANDLE ? &receivePkt : &blocks[handle])
+
+Enc28j60Eth::Enc28j60Eth(PinName mosi, PinName miso, PinName sclk, PinName cs) :
+    _spi(mosi, miso, sclk),
+    _cs(cs)
+{ }
+
+void Enc28j60Eth::init(uint8_t*)
+{
+    MemPool::init();
+}
+
+void Enc28j60Eth::checkRxErrors()   { }
+bool Enc28j60Eth::pollTx()          { return false; }
+bool Enc28j60Eth::txBusy()          { return false; }
+
+void Enc28j60Eth::freePacket()
+{
+    if (rxRing.empty())
+        return;
+    rxUsed -= (rxRing.front().size() + 6 + 1) & ~1;
+    rxRing.pop_front();
+}
+
+uint8_t Enc28j60Eth::readOp(uint8_t, uint8_t)
+{
+    return 0;                           // a DMA copy is done at once
+}
+
+void Enc28j60Eth::writeOp(uint8_t op, uint8_t address, uint8_t data)
+{
+    // the block move of MemPool
+    if (op == ENC28J60_BIT_FIELD_SET && address == ECON1 && (data & ECON1_DMAST))
+        memmove(mem + dmaDest, mem + dmaStart, dmaEnd - dmaStart + 1);
+}
+
+void Enc28j60Eth::writeRegPair(uint8_t address, uint16_t data)
+{
+    if (address == EDMASTL)
+        dmaStart = data;
+    else
+    if (address == EDMANDL)
+        dmaEnd = data;
+    else
+    if (address == EDMADSTL)
+        dmaDest = data;
+}
+
+uint8_t Enc28j60Eth::readByte(uint16_t address)
+{
+    return mem[address];
+}
+
+void Enc28j60Eth::writeByte(uint16_t address, uint8_t data)
+{
+    mem[address] = data;
+}
+
+memhandle Enc28j60Eth::receivePacket()
+{
+    if (wirePeer)
+        wirePeer();
+
+    // each frame takes its 6 byte receive status vector and starts even
+    while (!wireRx.empty()) {
+        size_t  len = (wireRx.front().size() + 6 + 1) & ~1;
+
+        if (rxUsed + len <= RXEND_INIT - RXSTART_INIT + 1) {
+            rxRing.push_back(wireRx.front());
+            rxUsed += len;
+        }
+        else
+            _rxOverflows++;
+        wireRx.pop_front();
+    }
+
+    if (rxRing.empty())
+        return NOBLOCK;
+
+    frame_t&    frame = rxRing.front();
+
+    memcpy(mem + RXSTART_INIT, frame.data(), frame.size());
+    receivePkt.begin = RXSTART_INIT;
+    receivePkt.size = frame.size();
+    _rxFrames++;
+    return UIP_RECEIVEBUFFERHANDLE;
+}
+
+size_t Enc28j60Eth::blockSize(memhandle handle)
+{
+    return handle == NOBLOCK ? 0 : block(handle)->size;
+}
+
+uint16_t Enc28j60Eth::readPacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len)
+{
+    memblock*   b = block(handle);
+
+    if (position > b->size)
+        return 0;
+    if (len > b->size - position)
+        len = b->size - position;
+    memcpy(buffer, mem + b->begin + position, len);
+    return len;
+}
+
+uint16_t Enc28j60Eth::writePacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len)
+{
+    memblock*   b = block(handle);
+
+    if (position > b->size)
+        return 0;
+    if (len > b->size - position)
+        len = b->size - position;
+    memcpy(mem + b->begin + position, buffer, len);
+    return len;
+}
+
+void Enc28j60Eth::copyPacket(memhandle dest, memaddress destPosition, memhandle src, memaddress srcPosition, uint16_t len)
+{
+    memmove(mem + block(dest)->begin + destPosition, mem + block(src)->begin + srcPosition, len);
+}
+
+void Enc28j60Eth::sendPacket(memhandle handle)
+{
+    memblock*   b = block(handle);
+
+    wireTx.push_back(frame_t(mem + b->begin, mem + b->begin + b->size));
+    _txFrames++;
+    _txBytes += b->size;
+    freeBlock(handle);
+}
+
+uint16_t Enc28j60Eth::chksum(uint16_t sum, memhandle handle, memaddress position, uint16_t len)
+{
+    const uint8_t*  p = mem + block(handle)->begin + position;
+
+    for (uint16_t i = 0; i < len; i += 2) {
+        uint16_t    t = (p[i] << 8) + (i + 1 < len ? p[i + 1] : 0);
+
+        sum += t;
+        if (sum < t)
+            sum++;
+    }
+
+    return sum;
+}
+
+extern "C" clock_time_t clock_time()
+{
+    return host_now_us() / 1000000;     // CLOCK_CONF_SECOND is 1, see clock-arch.c
+}
+
+extern "C" clock_time_t clock_time_ms()
+{
+    return host_now_us() / 1000;
+}
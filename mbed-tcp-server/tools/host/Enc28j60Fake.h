@@ -0,0 +1,25 @@
+/*
+ Enc28j60Fake.h - ENC28J60 replacement for running the network stack on a PC.
+
+ The 8 KB buffer memory of the controller is an array; frames the stack
+ sends are appended to wireTx, frames in wireRx are received by it. A
+ frame in wireRx reaches the receive ring when the stack next polls the
+ controller and is dropped as an overflow if the ring, sized by
+ ENC28J60_BUFFER_PROFILE, has no room for it.
+ */
+#ifndef ENC28J60FAKE_H
+#define ENC28J60FAKE_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+typedef std::vector<uint8_t>    frame_t;
+
+extern std::deque<frame_t>  wireRx;     // to the stack
+extern std::deque<frame_t>  wireTx;     // from the stack
+
+// called whenever the stack polls for a frame, also from within blocking
+// calls: the other end of the wire, which takes wireTx and fills wireRx
+extern void (*wirePeer)();
+#endif
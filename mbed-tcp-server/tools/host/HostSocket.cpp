@@ -0,0 +1,72 @@
+/*
+ HostSocket.cpp - sockets of the PC, for tools that bridge the fake wire to a
+ real server.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "HostSocket.h"
+
+// Socket of the given type connected to host:port, made non-blocking after
+static int open(const char* host, uint16_t port, int type)
+{
+    struct addrinfo     hints;
+    struct addrinfo*    list;
+    char                service[8];
+    int                 fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = type;
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &list) != 0)
+        return -1;
+
+    for (struct addrinfo* a = list; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    freeaddrinfo(list);
+    if (fd >= 0)
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+int hostTcpConnect(const char* host, uint16_t port)
+{
+    return open(host, port, SOCK_STREAM);
+}
+
+int hostUdpOpen(const char* host, uint16_t port)
+{
+    return open(host, port, SOCK_DGRAM);
+}
+
+long hostSend(int fd, const void* data, size_t len)
+{
+    return send(fd, data, len, MSG_NOSIGNAL);
+}
+
+long hostRecv(int fd, void* buf, size_t size)
+{
+    long    n = recv(fd, buf, size, 0);
+
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        return 0;                       // reset: closed as well
+    return n;
+}
+
+void hostClose(int fd)
+{
+    if (fd >= 0)
+        close(fd);
+}
@@ -0,0 +1,21 @@
+/*
+ HostSocket.h - sockets of the PC, for tools that bridge the fake wire to a
+ real server.
+
+ Kept apart from the network stack: uip.h defines htons and friends, which
+ clash with the system socket headers, so HostSocket.cpp includes those and
+ this header only plain types. Sockets do not block: hostRecv() returns -1
+ when nothing has arrived yet and 0 when a TCP peer has closed.
+ */
+#ifndef HOSTSOCKET_H
+#define HOSTSOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+int     hostTcpConnect(const char* host, uint16_t port);    // -1 if refused or unreachable
+int     hostUdpOpen(const char* host, uint16_t port);       // datagrams to and from host:port only
+long    hostSend(int fd, const void* data, size_t len);
+long    hostRecv(int fd, void* buf, size_t size);
+void    hostClose(int fd);
+#endif
@@ -0,0 +1,26 @@
+/*
+ analogin_api.h - HAL analog input for building on a PC. Every read returns
+ the next value of a ramp, so consecutive samples differ.
+ */
+#ifndef HOST_ANALOGIN_API_H
+#define HOST_ANALOGIN_API_H
+
+#include "mbed.h"
+
+typedef struct
+{
+    PinName     pin;
+    uint16_t    value;
+} analogin_t;
+
+static inline void analogin_init(analogin_t* obj, PinName pin)
+{
+    obj->pin = pin;
+    obj->value = 0;
+}
+
+static inline uint16_t analogin_read_u16(analogin_t* obj)
+{
+    return obj->value += 0x0100;
+}
+#endif
@@ -0,0 +1,9 @@
+/*
+ us_ticker_api.h - us_ticker_read() is the monotonic clock of the host, see
+ mbed.h.
+ */
+#ifndef HOST_US_TICKER_API_H
+#define HOST_US_TICKER_API_H
+
+#include "mbed.h"
+#endif
@@ -0,0 +1,131 @@
+/*
+ mbed.h - the part of the mbed API the network stack uses, for building it
+ on a PC. Time is the monotonic clock of the host; the SPI and pins do
+ nothing, Enc28j60Fake.cpp replaces the driver. Tickers do not interrupt:
+ the test calls Ticker::run() from its loop, which calls every callback due.
+ */
+#ifndef HOST_MBED_H
+#define HOST_MBED_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <functional>
+#include <vector>
+
+typedef int PinName;
+
+#define NC  -1
+
+static inline uint64_t host_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static inline uint32_t us_ticker_read()
+{
+    return host_now_us();
+}
+
+static inline void wait_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+class Timer
+{
+public:
+    Timer() : _start(0), _elapsed(0), _running(false) { }
+    void        start()     { if (!_running) { _start = host_now_us(); _running = true; } }
+    void        stop()      { _elapsed = read_high_resolution_us(); _running = false; }
+    void        reset()     { _elapsed = 0; _start = host_now_us(); }
+    uint64_t    read_high_resolution_us()   { return _elapsed + (_running ? host_now_us() - _start : 0); }
+    int         read_us()   { return read_high_resolution_us(); }
+    int         read_ms()   { return read_high_resolution_us() / 1000; }
+    float       read()      { return read_high_resolution_us() / 1e6f; }
+private:
+    uint64_t    _start;
+    uint64_t    _elapsed;
+    bool        _running;
+};
+
+template <typename T>
+std::function<void()> callback(T* obj, void (T::*method)())
+{
+    return [obj, method]() { (obj->*method)(); };
+}
+
+class Ticker
+{
+public:
+    Ticker() : _period(0)                   { all().push_back(this); }
+    ~Ticker()
+    {
+        std::vector<Ticker*>&   v = all();
+
+        for (size_t i = 0; i < v.size(); i++) {
+            if (v[i] == this)
+                v.erase(v.begin() + i);
+        }
+    }
+
+    void    attach_us(std::function<void()> func, uint32_t us)
+    {
+        _func = func;
+        _period = us;
+        _next = host_now_us() + us;
+    }
+
+    void    detach()                        { _period = 0; }
+
+    // calls the callbacks of every attached ticker as often as they are due
+    static void run()
+    {
+        std::vector<Ticker*>&   v = all();
+        uint64_t                now = host_now_us();
+
+        for (size_t i = 0; i < v.size(); i++) {
+            while (v[i]->_period && v[i]->_next <= now) {
+                v[i]->_next += v[i]->_period;
+                v[i]->_func();
+            }
+        }
+    }
+private:
+    std::function<void()>   _func;
+    uint32_t                _period;
+    uint64_t                _next;
+
+    static std::vector<Ticker*>& all()
+    {
+        static std::vector<Ticker*>     tickers;
+
+        return tickers;
+    }
+};
+
+class SPI
+{
+public:
+    SPI(PinName, PinName, PinName)  { }
+    void    format(int, int = 0)    { }
+    void    frequency(int)          { }
+    int     write(int)              { return 0; }
+};
+
+class DigitalOut
+{
+public:
+    DigitalOut(PinName, int = 0)    { }
+    DigitalOut& operator=(int)      { return *this; }
+    operator    int()               { return 0; }
+};
+#endif
@@ -0,0 +1,2 @@
+#define MBED_DEPRECATED_SINCE(version, message)
+#define MBED_UNREACHABLE    __builtin_unreachable()
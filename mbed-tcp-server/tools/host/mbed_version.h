@@ -0,0 +1 @@
+#define MBED_MAJOR_VERSION  2
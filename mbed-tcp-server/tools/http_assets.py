@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Compile the web pages of the STM32 TCP server into a C++ header.
+
+Every file below the input directory is gzipped and written as a byte array
+together with its complete response header (Content-Type,
+Content-Encoding, Content-Length, ETag), so HttpServer sends the page
+without computing anything. index.html is also served as "/". The ETag is
+the CRC-32 of the gzipped data and changes only when the page does.
+
+    python3 http_assets.py ../www ../stm32/www_assets.h
+"""
+import argparse
+import gzip
+import os
+import re
+import sys
+import zlib
+
+TYPES = {
+    ".html": "text/html; charset=utf-8",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+    ".txt": "text/plain",
+}
+
+HEADER_MAX = 320    # leaves room for the Connection line and the body in HTTP_TX_MAX
+
+
+def c_string(text):
+    """Returns text as a C string literal."""
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"').replace("\r", "\\r").replace("\n", "\\n") + '"'
+
+
+def c_bytes(data, indent="    "):
+    """Returns the bytes as lines of a C array initializer."""
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(indent + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "\n".join(lines)
+
+
+def assets(root):
+    """Yields (url path, file name) for every file below root."""
+    for folder, _, files in sorted(os.walk(root)):
+        for name in sorted(files):
+            path = os.path.join(folder, name)
+            url = "/" + os.path.relpath(path, root).replace(os.sep, "/")
+            yield url, path
+            if name == "index.html":
+                yield url[:-len("index.html")], path
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("root", help="directory holding the pages")
+    parser.add_argument("output", help="header to write")
+    parser.add_argument("--name", default="wwwAssets", help="name of the asset table")
+    args = parser.parse_args()
+
+    arrays = []
+    entries = []
+    compiled = {}
+    for url, path in assets(args.root):
+        ext = os.path.splitext(path)[1].lower()
+        if ext not in TYPES:
+            sys.exit("%s: unknown file type" % path)
+
+        if path not in compiled:
+            with open(path, "rb") as f:
+                data = gzip.compress(f.read(), 9, mtime=0)
+            symbol = "www_" + re.sub(r"\W", "_", os.path.relpath(path, args.root))
+            etag = '"%08x"' % (zlib.crc32(data) & 0xffffffff)
+            header = (
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: %s\r\n"
+                "Content-Encoding: gzip\r\n"
+                "Content-Length: %d\r\n"
+                "ETag: %s\r\n"
+                "Cache-Control: no-cache\r\n" % (TYPES[ext], len(data), etag)
+            )
+            if len(header) > HEADER_MAX:
+                sys.exit("%s: header too long" % path)
+            compiled[path] = (symbol, etag, header, len(data))
+            arrays.append("static const uint8_t %s[%d] =\n{\n%s\n};\n" % (symbol, len(data), c_bytes(data)))
+            print("%-24s %6d -> %5d bytes" % (url, os.path.getsize(path), len(data)))
+
+        symbol, etag, header, length = compiled[path]
+        entries.append(
+            "    { %s, %s, %s, %d, %s, %d }" % (c_string(url), c_string(etag), c_string(header), len(header), symbol, length)
+        )
+
+    guard = re.sub(r"\W", "_", os.path.basename(args.output)).upper()
+    with open(args.output, "w") as out:
+        out.write("/*\n %s - web pages compiled by tools/http_assets.py, do not edit.\n */\n" % os.path.basename(args.output))
+        out.write("#ifndef %s\n#define %s\n\n#include \"HttpServer.h\"\n\n" % (guard, guard))
+        out.write("\n".join(arrays))
+        out.write("\nstatic const http_asset_t  %s[] =\n{\n%s\n};\n" % (args.name, ",\n".join(entries)))
+        out.write("\nstatic const uint8_t       %sCount = %d;\n#endif\n" % (args.name, len(entries)))
+
+
+if __name__ == "__main__":
+    main()
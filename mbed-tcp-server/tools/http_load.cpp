@@ -0,0 +1,273 @@
+/*
+ http_load.cpp - HTTP load test for the STM32 TCP server's web page.
+
+ Opens a number of connections, sends requests one after another on each
+ and prints the request rate and the latency percentiles. Connections are
+ kept alive unless the server closes them; with --close every request
+ opens a new one, which shows what keep-alive saves. With --etag the
+ requests after the first carry If-None-Match, so static pages are answered
+ with 304 Not Modified.
+
+    g++ -O2 -std=c++11 -pthread -o http_load http_load.cpp
+    ./http_load -c 2 -n 500 192.168.137.120 80 /
+    ./http_load -c 2 -n 500 --etag 192.168.137.120 80 /
+    ./http_load -c 2 -n 500 192.168.137.120 80 /api/status
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options
+{
+    struct sockaddr_in  server;
+    const char*         host = NULL;
+    const char*         path = "/";
+    int                 connections = 2;
+    int                 requests = 200;
+    bool                close = false;
+    bool                etag = false;
+};
+
+struct Result
+{
+    std::vector<double> latencyUs;
+    uint64_t            bytes = 0;
+    int                 notModified = 0;
+    int                 errors = 0;
+    int                 connects = 0;
+};
+
+static std::atomic<int> remaining;
+
+static double nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int connectTo(const Options& opt)
+{
+    int             fd = socket(AF_INET, SOCK_STREAM, 0);
+    int             one = 1;
+    struct timeval  tv = { 5, 0 };
+
+    if (fd < 0)
+        return -1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr*)&opt.server, sizeof(opt.server)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Reads one response, returns its status or -1; sets keepAlive and etag.
+static int response(int fd, std::string& buf, bool& keepAlive, std::string& etag, uint64_t& bytes)
+{
+    size_t  end;
+    char    chunk[2048];
+
+    while ((end = buf.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+
+        if (n <= 0)
+            return -1;
+        buf.append(chunk, n);
+    }
+
+    std::string head = buf.substr(0, end + 2);
+    size_t      length = 0;
+    int         status = 0;
+
+    if (sscanf(head.c_str(), "HTTP/1.%*d %d", &status) != 1)
+        return -1;
+
+    keepAlive = true;
+    for (size_t pos = head.find("\r\n"); pos != std::string::npos && pos + 2 < head.size(); pos = head.find("\r\n", pos + 2)) {
+        const char* line = head.c_str() + pos + 2;
+
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+            length = strtoul(line + 15, NULL, 10);
+        else
+        if (strncasecmp(line, "Connection:", 11) == 0)
+            keepAlive = strncasecmp(line + 11 + strspn(line + 11, " "), "close", 5) != 0;
+        else
+        if (strncasecmp(line, "ETag:", 5) == 0) {
+            const char* value = line + 5;
+
+            while (*value == ' ')
+                value++;
+            etag.assign(value, strstr(value, "\r\n") - value);
+        }
+    }
+
+    buf.erase(0, end + 4);
+    while (buf.size() < length) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+
+        if (n <= 0)
+            return -1;
+        buf.append(chunk, n);
+    }
+
+    bytes += end + 4 + length;
+    buf.erase(0, length);
+    return status;
+}
+
+static void worker(const Options& opt, Result& result)
+{
+    int         fd = -1;
+    std::string buf;
+    std::string etag;
+    char        request[512];
+
+    while (remaining.fetch_sub(1) > 0) {
+        double  start = nowUs();
+
+        if (fd < 0) {
+            fd = connectTo(opt);
+            result.connects++;
+            buf.clear();
+            if (fd < 0) {
+                result.errors++;
+                usleep(100000);
+                continue;
+            }
+        }
+
+        int len = snprintf
+            (
+                request,
+                sizeof(request),
+                "GET %s HTTP/1.1\r\nHost: %s\r\nAccept-Encoding: gzip\r\n%s%s%s%s\r\n",
+                opt.path,
+                opt.host,
+                opt.close ? "Connection: close\r\n" : "",
+                opt.etag && !etag.empty() ? "If-None-Match: " : "",
+                opt.etag && !etag.empty() ? etag.c_str() : "",
+                opt.etag && !etag.empty() ? "\r\n" : ""
+            );
+        bool    keepAlive = false;
+        int     status = -1;
+
+        if (send(fd, request, len, MSG_NOSIGNAL) == len)
+            status = response(fd, buf, keepAlive, etag, result.bytes);
+
+        if (status == 200 || status == 304) {
+            result.latencyUs.push_back(nowUs() - start);
+            if (status == 304)
+                result.notModified++;
+        }
+        else
+            result.errors++;
+
+        if (status < 0 || !keepAlive) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd >= 0)
+        close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    int     arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc)
+            opt.connections = atoi(argv[++arg]);
+        else
+        if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+            opt.requests = atoi(argv[++arg]);
+        else
+        if (strcmp(argv[arg], "--close") == 0)
+            opt.close = true;
+        else
+        if (strcmp(argv[arg], "--etag") == 0)
+            opt.etag = true;
+        else
+            break;
+    }
+
+    if (arg >= argc || opt.connections < 1 || opt.requests < 1) {
+        fprintf(stderr, "usage: %s [-c connections] [-n requests] [--close] [--etag] <ip> [port] [path]\n", argv[0]);
+        return 1;
+    }
+
+    memset(&opt.server, 0, sizeof(opt.server));
+    opt.server.sin_family = AF_INET;
+    opt.server.sin_port = htons(arg + 1 < argc ? atoi(argv[arg + 1]) : 80);
+    opt.host = argv[arg];
+    if (arg + 2 < argc)
+        opt.path = argv[arg + 2];
+    if (inet_pton(AF_INET, opt.host, &opt.server.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", opt.host);
+        return 1;
+    }
+
+    std::vector<Result>         results(opt.connections);
+    std::vector<std::thread>    threads;
+    double                      start = nowUs();
+
+    remaining = opt.requests;
+    for (int i = 0; i < opt.connections; i++)
+        threads.push_back(std::thread(worker, std::cref(opt), std::ref(results[i])));
+    for (auto& t : threads)
+        t.join();
+
+    double              seconds = (nowUs() - start) / 1e6;
+    std::vector<double> latency;
+    Result              total;
+
+    for (auto& r : results) {
+        latency.insert(latency.end(), r.latencyUs.begin(), r.latencyUs.end());
+        total.bytes += r.bytes;
+        total.notModified += r.notModified;
+        total.errors += r.errors;
+        total.connects += r.connects;
+    }
+
+    std::sort(latency.begin(), latency.end());
+
+    size_t  n = latency.size();
+
+    printf("%zu requests in %.2f s: %.1f requests/s, %.1f kB/s\n", n, seconds, n / seconds, total.bytes / seconds / 1000);
+    printf("%d connections opened, %d answered 304, %d errors\n", total.connects, total.notModified, total.errors);
+    if (n) {
+        printf
+        (
+            "latency ms: min %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+            latency[0] / 1000,
+            latency[n / 2] / 1000,
+            latency[n * 90 / 100] / 1000,
+            latency[n * 99 / 100 < n ? n * 99 / 100 : n - 1] / 1000,
+            latency[n - 1] / 1000
+        );
+    }
+
+    return total.errors ? 2 : 0;
+}
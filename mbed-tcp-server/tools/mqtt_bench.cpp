@@ -0,0 +1,236 @@
+/*
+ mqtt_bench.cpp - MQTT publish throughput test for the STM32 TCP server.
+
+ Subscribes to stm32/bench/data and stm32/bench/done on the broker, then
+ publishes the number of messages and their size to stm32/bench. The
+ board answers by publishing that many messages as fast as it can, each
+ starting with its sequence number, and finally its counters to
+ stm32/bench/done. Prints the message rate seen through the broker, the
+ messages lost and how many messages the board packed into each TCP
+ segment.
+
+    g++ -O2 -std=c++11 -o mqtt_bench mqtt_bench.cpp
+    ./mqtt_bench 192.168.137.1
+    ./mqtt_bench -n 5000 -s 64 192.168.137.1 1883
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+static double nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void putString(std::string& out, const std::string& s)
+{
+    out += (char)(s.size() >> 8);
+    out += (char)(s.size() & 0xFF);
+    out += s;
+}
+
+// Fixed header with the remaining length in front of body.
+static std::string packet(uint8_t type, const std::string& body)
+{
+    std::string out(1, (char)type);
+    size_t      len = body.size();
+
+    do {
+        uint8_t b = len & 0x7F;
+
+        len >>= 7;
+        out += (char)(len ? b | 0x80 : b);
+    } while (len);
+
+    return out + body;
+}
+
+static bool sendAll(int fd, const std::string& data)
+{
+    return send(fd, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size();
+}
+
+// Reads one packet, returns its first byte or -1; body receives the rest.
+static int readPacket(int fd, std::string& buf, std::string& body)
+{
+    char    chunk[4096];
+
+    for (;;) {
+        size_t      len = 0;
+        size_t      pos = 1;
+        int         shift = 0;
+        bool        complete = false;
+
+        while (buf.size() > pos) {
+            uint8_t b = buf[pos++];
+
+            len |= (size_t)(b & 0x7F) << shift;
+            shift += 7;
+            if (!(b & 0x80)) {
+                complete = true;
+                break;
+            }
+        }
+
+        if (complete && buf.size() >= pos + len) {
+            int type = (uint8_t)buf[0];
+
+            body.assign(buf, pos, len);
+            buf.erase(0, pos + len);
+            return type;
+        }
+
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+
+        if (n <= 0)
+            return -1;
+        buf.append(chunk, n);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int     count = 1000;
+    int     size = 32;
+    int     arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+            count = atoi(argv[++arg]);
+        else
+        if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+            size = atoi(argv[++arg]);
+        else
+            break;
+    }
+
+    if (arg >= argc || count < 1 || size < 4) {
+        fprintf(stderr, "usage: %s [-n messages] [-s payload bytes, >= 4] <broker ip> [port]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_in  broker;
+    int                 fd = socket(AF_INET, SOCK_STREAM, 0);
+    int                 one = 1;
+    struct timeval      tv = { 10, 0 };
+
+    memset(&broker, 0, sizeof(broker));
+    broker.sin_family = AF_INET;
+    broker.sin_port = htons(arg + 1 < argc ? atoi(argv[arg + 1]) : 1883);
+    if (inet_pton(AF_INET, argv[arg], &broker.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", argv[arg]);
+        return 1;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr*)&broker, sizeof(broker)) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    std::string buf;
+    std::string body;
+    std::string connect("\x00\x04MQTT\x04\x02\x00\x3c", 10);
+    std::string subscribe("\x00\x01", 2);
+    std::string trigger;
+    char        text[32];
+
+    putString(connect, "mqtt_bench");
+    putString(subscribe, "stm32/bench/data");
+    subscribe += '\0';
+    putString(subscribe, "stm32/bench/done");
+    subscribe += '\0';
+    if (!sendAll(fd, packet(0x10, connect)) || readPacket(fd, buf, body) != 0x20 || body.size() < 2 || body[1] != 0) {
+        fprintf(stderr, "broker refused the connection\n");
+        return 1;
+    }
+
+    if (!sendAll(fd, packet(0x82, subscribe)) || readPacket(fd, buf, body) != 0x90) {
+        fprintf(stderr, "subscribe failed\n");
+        return 1;
+    }
+
+    snprintf(text, sizeof(text), "%d %d", count, size);
+    putString(trigger, "stm32/bench");
+    trigger += text;
+    sendAll(fd, packet(0x30, trigger));
+
+    std::vector<bool>   seen(count, false);
+    double              first = 0;
+    double              last = 0;
+    int                 received = 0;
+    int                 duplicates = 0;
+    std::string         done;
+
+    for (;;) {
+        int type = readPacket(fd, buf, body);
+
+        if (type < 0) {
+            fprintf(stderr, "timeout, the board did not finish\n");
+            break;
+        }
+
+        if ((type & 0xF0) != 0x30 || body.size() < 2)
+            continue;
+
+        size_t      topicLen = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+        std::string topic = body.substr(2, topicLen);
+        std::string payload = body.substr(2 + topicLen + ((type & 0x06) ? 2 : 0));
+
+        if (topic == "stm32/bench/done") {
+            done = payload;
+            break;
+        }
+
+        if (payload.size() < 4)
+            continue;
+
+        uint32_t    seq = (uint8_t)payload[0] | ((uint8_t)payload[1] << 8) | ((uint8_t)payload[2] << 16) | ((uint32_t)(uint8_t)payload[3] << 24);
+
+        last = nowUs();
+        if (!received)
+            first = last;
+        received++;
+        if (seq < (uint32_t)count) {
+            if (seen[seq])
+                duplicates++;
+            seen[seq] = true;
+        }
+    }
+
+    int lost = 0;
+
+    for (int i = 0; i < count; i++)
+        lost += !seen[i];
+
+    double  seconds = (last - first) / 1e6;
+
+    printf("%d of %d messages of %d bytes received, %d lost, %d duplicates\n", received, count, size, lost, duplicates);
+    if (received > 1 && seconds > 0)
+        printf("%.1f messages/s, %.1f kB/s of payload\n", (received - 1) / seconds, (received - 1) * size / seconds / 1000);
+
+    unsigned long   published = 0;
+    unsigned long   segments = 0;
+
+    if (sscanf(done.c_str(), "%lu %lu", &published, &segments) == 2 && segments)
+        printf("board: %lu messages in %lu segments, %.1f messages per segment\n", published, segments, (double)published / segments);
+
+    sendAll(fd, std::string("\xe0\x00", 2));
+    close(fd);
+    return lost ? 2 : 0;
+}
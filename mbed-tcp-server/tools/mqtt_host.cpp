@@ -0,0 +1,600 @@
+/*
+ mqtt_host.cpp - MqttClient and MqttSnClient run on a PC, against a real
+ broker or MQTT-SN gateway through the fake ENC28J60.
+
+ Builds UIPEthernet, uIP and both clients unchanged on top of the fake
+ ENC28J60. The other end of the wire is the router at 192.168.1.1: it
+ answers ARP, ends the board's TCP connection and relays its bytes over a
+ TCP connection of the PC to the broker, and relays the board's UDP
+ datagrams to the gateway and back. Everything the clients send crosses
+ uIP, MemPool and the frame checksums before it reaches the server.
+
+ The client subscribes to TOPIC, publishes COUNT numbered messages to it
+ and checks that each comes back through the subscription:
+
+    mqtt        QoS 1 publishes, at most MQTT_INFLIGHT unacknowledged;
+                every one must be acknowledged
+    mqtt-sn     (-s) QoS 0 publishes, BURST batched per poll, to the topic
+                id registered with the gateway; every one must be sent.
+                The echoes come in bursts as well, and UdpSocket ticks the
+                stack in parsePacket(), read() and flush(): every datagram
+                read can queue three more, so bursts of 4 at times overflow
+                the UIP_UDP_NUMPACKETS receive queue
+
+ -n sets COUNT, -t the seconds to give up after. The port is the server's
+ on the PC; the board always connects to MQTT_PORT or MQTTSN_PORT.
+
+    S=../stm32/UIPEthernet
+    M=../stm32/Mqtt
+    gcc -c -funsigned-char -w -Ihost -I$S/utility $S/utility/uip.c $S/utility/uip_arp.c \
+        $S/utility/uip_timer.c $S/utility/stoip4.c $S/utility/ip4tos.c $S/utility/stoip6.c \
+        $S/utility/ip6tos.c $S/utility/common_functions.c
+    g++ -std=gnu++11 -funsigned-char -w -Ihost -I$S -I$S/utility -I$M -o mqtt_host mqtt_host.cpp \
+        host/Enc28j60Fake.cpp host/HostSocket.cpp $S/UipEthernet.cpp $S/UdpSocket.cpp $S/TcpClient.cpp \
+        $S/TcpServer.cpp $S/DhcpClient.cpp $S/DnsClient.cpp $S/IpAddress.cpp $S/SocketAddress.cpp \
+        $S/utility/MemPool.cpp $M/MqttClient.cpp $M/MqttSnClient.cpp \
+        uip.o uip_arp.o uip_timer.o stoip4.o ip4tos.o stoip6.o ip6tos.o common_functions.o
+    mosquitto -p 1883 &
+    ./mqtt_host localhost
+    ./mqtt_host -s localhost 1885       # Eclipse Paho MQTT-SN gateway in front of mosquitto
+ */
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "UipEthernet.h"
+#include "MqttClient.h"
+#include "MqttSnClient.h"
+#include "Enc28j60Fake.h"
+#include "HostSocket.h"
+
+#define TOPIC           "stm32/host/echo"
+#define COUNT           100
+#define BURST           2
+#define TIMEOUT_S       30
+#define ROUTER_MSS      1460
+#define ROUTER_RTO_MS   200
+
+static const uint8_t    boardMac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+static const uint8_t    routerMac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t    boardIp[4] = { 192, 168, 1, 10 };
+static const uint8_t    routerIp[4] = { 192, 168, 1, 1 };
+
+enum { TCP_FIN = 0x01, TCP_SYN = 0x02, TCP_RST = 0x04, TCP_PSH = 0x08, TCP_ACK = 0x10 };
+
+// The router's end of the board's TCP connection, relayed to the broker
+struct Connection
+{
+    int                 fd;             // to the broker, -1 if none
+    uint16_t            port;           // the board's
+    uint16_t            serverPort;     // the port the board connected to
+    uint32_t            rcvNxt;
+    uint32_t            seq;            // next byte to send, unacknowledged ones included
+    uint32_t            una;            // oldest unacknowledged byte, toBoard starts with it
+    uint16_t            window;         // advertised by the board
+    uint16_t            mss;
+    bool                closed;         // the broker closed, FIN once toBoard is sent
+    bool                finSent;
+    std::deque<uint8_t> toBoard;
+    Timer               rexmit;
+};
+
+struct Stats
+{
+    int tcpOut;                         // segments of the board with data
+    int tcpIn;
+    int resent;                         // segments the router had to resend
+    int refused;                        // connections the broker refused
+    int udpOut;
+    int udpIn;
+    int badFrames;
+};
+
+static const char*  server;
+static uint16_t     serverPort;
+static Connection   conn = { -1 };
+static int          gatewayFd = -1;
+static uint16_t     gatewayPort;        // the port the board sends its datagrams to
+static uint16_t     boardUdpPort;
+static Stats        stats;
+static int          failures;
+
+static std::vector<bool>    echoed;     // by message number
+static int                  echoes;
+static int                  duplicates;
+
+static uint32_t sum16(const uint8_t* p, size_t len, uint32_t sum)
+{
+    for (size_t i = 0; i < len; i += 2)
+        sum += (p[i] << 8) + (i + 1 < len ? p[i + 1] : 0);
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Ethernet and IPv4 header of a frame from the router, returns the payload
+static uint8_t* ipFrame(frame_t& f, uint8_t protocol, size_t len)
+{
+    uint8_t*    ip;
+    uint16_t    sum;
+
+    f.assign(34 + len, 0);
+    ip = &f[14];
+    memcpy(&f[0], boardMac, 6);
+    memcpy(&f[6], routerMac, 6);
+    f[12] = 0x08;
+    ip[0] = 0x45;
+    ip[2] = (20 + len) >> 8;
+    ip[3] = 20 + len;
+    ip[8] = 64;
+    ip[9] = protocol;
+    memcpy(ip + 12, routerIp, 4);
+    memcpy(ip + 16, boardIp, 4);
+    sum = ~fold(sum16(ip, 20, 0));
+    ip[10] = sum >> 8;
+    ip[11] = sum;
+    return ip + 20;
+}
+
+// Puts a segment of the router on the wire, a SYN with the MSS option
+static void segment(uint8_t flags, uint32_t seq, const uint8_t* data, size_t len)
+{
+    frame_t     f;
+    size_t      hdrLen = flags & TCP_SYN ? 24 : 20;
+    uint8_t*    tcp = ipFrame(f, 6, hdrLen + len);
+    uint16_t    sum;
+
+    tcp[0] = conn.serverPort >> 8;
+    tcp[1] = conn.serverPort;
+    tcp[2] = conn.port >> 8;
+    tcp[3] = conn.port;
+    put32(tcp + 4, seq);
+    put32(tcp + 8, conn.rcvNxt);
+    tcp[12] = hdrLen << 2;
+    tcp[13] = flags;
+    tcp[14] = 0x10;                     // 4 KB window
+    if (flags & TCP_SYN) {
+        tcp[20] = 2;                    // MSS
+        tcp[21] = 4;
+        tcp[22] = ROUTER_MSS >> 8;
+        tcp[23] = ROUTER_MSS & 0xff;
+    }
+
+    if (len)
+        memcpy(tcp + hdrLen, data, len);
+    sum = ~fold(sum16(tcp, hdrLen + len, sum16(tcp - 8, 8, 6 + hdrLen + len)));
+    tcp[16] = sum >> 8;
+    tcp[17] = sum;
+    wireRx.push_back(f);
+}
+
+static void datagram(const uint8_t* data, size_t len)
+{
+    frame_t     f;
+    uint8_t*    udp = ipFrame(f, 17, 8 + len);
+    uint16_t    sum;
+
+    udp[0] = gatewayPort >> 8;
+    udp[1] = gatewayPort;
+    udp[2] = boardUdpPort >> 8;
+    udp[3] = boardUdpPort;
+    udp[4] = (8 + len) >> 8;
+    udp[5] = 8 + len;
+    memcpy(udp + 8, data, len);
+    sum = ~fold(sum16(udp, 8 + len, sum16(udp - 8, 8, 17 + 8 + len)));
+    udp[6] = sum >> 8;
+    udp[7] = sum;
+    wireRx.push_back(f);
+}
+
+static void arpReply(const frame_t& request)
+{
+    frame_t f(42);
+
+    memcpy(&f[0], &request[6], 6);
+    memcpy(&f[6], routerMac, 6);
+    f[12] = 0x08;
+    f[13] = 0x06;
+    f[15] = 1;
+    f[16] = 0x08;
+    f[18] = 6;
+    f[19] = 4;
+    f[21] = 2;
+    memcpy(&f[22], routerMac, 6);
+    memcpy(&f[28], routerIp, 4);
+    memcpy(&f[32], &request[22], 10);
+    wireRx.push_back(f);
+}
+
+static void closeBroker()
+{
+    hostClose(conn.fd);
+    conn.fd = -1;
+}
+
+// A SYN of the board opens the connection to the broker, a refused one is reset
+static void open(const uint8_t* tcp, size_t hdrLen)
+{
+    uint16_t    port = tcp[0] << 8 | tcp[1];
+    uint32_t    seq = get32(tcp + 4);
+
+    if (conn.fd >= 0 && conn.port == port && conn.rcvNxt == seq + 1) {
+        segment(TCP_SYN | TCP_ACK, conn.una - 1, NULL, 0);      // the SYN again
+        return;
+    }
+
+    closeBroker();
+    conn.port = port;
+    conn.serverPort = tcp[2] << 8 | tcp[3];
+    conn.rcvNxt = seq + 1;
+    conn.mss = hdrLen >= 24 && tcp[20] == 2 ? tcp[22] << 8 | tcp[23] : 536;   // uIP sends only the MSS option
+
+    conn.fd = hostTcpConnect(server, serverPort);
+    if (conn.fd < 0) {
+        stats.refused++;
+        segment(TCP_RST | TCP_ACK, 0, NULL, 0);
+        return;
+    }
+
+    conn.seq = conn.una = seq * 7 + 1;  // any ISS
+    conn.closed = false;
+    conn.finSent = false;
+    conn.toBoard.clear();
+    segment(TCP_SYN | TCP_ACK, conn.seq++, NULL, 0);
+    conn.una = conn.seq;
+}
+
+static void tcpIn(const uint8_t* tcp, size_t len)
+{
+    size_t      hdrLen = (tcp[12] >> 4) * 4;
+    uint8_t     flags = tcp[13];
+    uint32_t    seq = get32(tcp + 4);
+    uint32_t    ack = get32(tcp + 8);
+    size_t      dataLen = len - hdrLen;
+
+    if (flags & TCP_SYN) {
+        open(tcp, hdrLen);
+        return;
+    }
+
+    if ((tcp[0] << 8 | tcp[1]) != conn.port || conn.fd < 0)
+        return;
+
+    if (flags & TCP_RST) {
+        closeBroker();
+        return;
+    }
+
+    conn.window = tcp[14] << 8 | tcp[15];
+    if ((flags & TCP_ACK) && (int32_t)(ack - conn.una) > 0 && (int32_t)(ack - conn.seq) <= 0) {
+        size_t  acked = std::min((size_t)(ack - conn.una), conn.toBoard.size());
+
+        conn.toBoard.erase(conn.toBoard.begin(), conn.toBoard.begin() + acked);
+        conn.una = ack;
+    }
+
+    if (dataLen && seq == conn.rcvNxt) {
+        stats.tcpOut++;
+        hostSend(conn.fd, tcp + hdrLen, dataLen);
+        conn.rcvNxt += dataLen;
+    }
+
+    if ((flags & TCP_FIN) && seq + dataLen == conn.rcvNxt) {
+        conn.rcvNxt++;
+        segment(TCP_FIN | TCP_ACK, conn.seq, NULL, 0);
+        closeBroker();
+        return;
+    }
+
+    if (dataLen)
+        segment(TCP_ACK, conn.seq, NULL, 0);
+}
+
+// Sends what the broker sent to the board, one segment in flight as uIP
+// acknowledges them one by one, and the FIN once the broker closed
+static void tcpOut()
+{
+    uint8_t buf[ROUTER_MSS];
+    long    n;
+
+    while (conn.fd >= 0 && (n = hostRecv(conn.fd, buf, sizeof(buf))) != -1) {
+        if (n == 0) {
+            conn.closed = true;
+            closeBroker();
+            break;
+        }
+
+        conn.toBoard.insert(conn.toBoard.end(), buf, buf + n);
+    }
+
+    if (conn.seq != conn.una) {
+        if (conn.rexmit.read_ms() < ROUTER_RTO_MS)
+            return;
+        stats.resent++;
+        conn.seq = conn.una;
+    }
+
+    size_t  len = std::min(std::min(conn.toBoard.size(), (size_t)conn.mss), (size_t)conn.window);
+
+    if (len) {
+        std::copy(conn.toBoard.begin(), conn.toBoard.begin() + len, buf);
+        segment(TCP_ACK | TCP_PSH, conn.seq, buf, len);
+        conn.seq += len;
+        stats.tcpIn++;
+        conn.rexmit.reset();
+        conn.rexmit.start();
+    }
+    else
+    if (conn.closed && !conn.finSent && conn.toBoard.empty()) {
+        segment(TCP_FIN | TCP_ACK, conn.seq, NULL, 0);
+        conn.finSent = true;
+    }
+}
+
+static void udpIn(const uint8_t* udp, size_t len)
+{
+    if (gatewayFd < 0)
+        gatewayFd = hostUdpOpen(server, serverPort);
+    boardUdpPort = udp[0] << 8 | udp[1];
+    gatewayPort = udp[2] << 8 | udp[3];
+    stats.udpOut++;
+    hostSend(gatewayFd, udp + 8, len - 8);
+}
+
+// The other end of the wire: takes the board's frames and relays them
+static void wire()
+{
+    while (!wireTx.empty()) {
+        frame_t f = wireTx.front();
+
+        wireTx.pop_front();
+        if (f.size() >= 42 && f[12] == 0x08 && f[13] == 0x06) {
+            if (f[21] == 1 && memcmp(&f[38], routerIp, 4) == 0)
+                arpReply(f);
+            continue;
+        }
+
+        if (f.size() < 34 || f[12] != 0x08 || f[13] != 0x00) {
+            stats.badFrames++;
+            continue;
+        }
+
+        const uint8_t*  ip = &f[14];
+        size_t          ipLen = ip[2] << 8 | ip[3];
+
+        if (14 + ipLen > f.size() || fold(sum16(ip, 20, 0)) != 0xffff || memcmp(ip + 16, routerIp, 4) != 0) {
+            stats.badFrames++;
+            continue;
+        }
+
+        const uint8_t*  payload = ip + 20;
+        size_t          len = ipLen - 20;
+
+        bool            noSum = ip[9] == 17 && len >= 8 && !(payload[6] | payload[7]);
+
+        if (!noSum && fold(sum16(payload, len, sum16(ip + 12, 8, ip[9] + len))) != 0xffff) {
+            stats.badFrames++;
+            continue;
+        }
+
+        if (ip[9] == 6)
+            tcpIn(payload, len);
+        else
+        if (ip[9] == 17)
+            udpIn(payload, len);
+    }
+
+    tcpOut();
+
+    uint8_t buf[1500];
+    long    n;
+
+    while (gatewayFd >= 0 && (n = hostRecv(gatewayFd, buf, sizeof(buf))) > 0) {
+        stats.udpIn++;
+        datagram(buf, n);
+    }
+}
+
+static void onEcho(const char* topic, const uint8_t* payload, size_t len, void* ctx)
+{
+    char    number[12];
+    int     i;
+
+    memcpy(number, payload, std::min(len, sizeof(number) - 1));
+    number[std::min(len, sizeof(number) - 1)] = '\0';
+    i = atoi(number);
+    if (i < 0 || i >= (int)echoed.size())
+        return;
+    duplicates += echoed[i];
+    echoes += !echoed[i];
+    echoed[i] = true;
+}
+
+static const char* const            topics[] = { TOPIC };
+static const mqtt_subscription_t    subscriptions[] = { { TOPIC, 1, onEcho } };
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+static void runMqtt(UipEthernet& eth, int count, int timeoutS)
+{
+    MqttClient  mqtt("stm32-host", topics, 1, subscriptions, 1);
+    Timer       run;
+    Timer       poll;
+    bool        connected = false;
+    int         sent = 0;
+    int         worstPollUs = 0;
+    char        payload[12];
+
+    printf("\nMQTT, broker %s:%u\n", server, serverPort);
+    mqtt.open(&eth, "192.168.1.1");
+    run.start();
+    while (run.read_ms() < timeoutS * 1000 && (echoes < count || mqtt.inflight())) {
+        poll.reset();
+        poll.start();
+        eth.tick();
+        mqtt.poll();
+        worstPollUs = std::max(worstPollUs, poll.read_us());
+        connected |= mqtt.connected();
+
+        // up to MQTT_INFLIGHT per poll, batched into one segment
+        while (mqtt.connected() && sent < count) {
+            int len = snprintf(payload, sizeof(payload), "%d", sent);
+
+            if (mqtt.publish((uint8_t)0, payload, len, 1) < 0)
+                break;
+            sent++;
+        }
+
+        wait_ms(1);
+    }
+
+    uint32_t    reconnects = mqtt.reconnects();   // close() counts as well
+
+    mqtt.close();
+    for (int i = 0; i < 10; i++) {
+        eth.tick();
+        wait_ms(1);
+    }
+
+    printf("  %-40s %d of %d, %lu acknowledged\n", "published", sent, count, (unsigned long)mqtt.acknowledged());
+    printf("  %-40s %d, %d duplicates\n", "came back", echoes, duplicates);
+    printf("  %-40s %lu\n", "segments with packets", (unsigned long)mqtt.segments());
+    printf("  %-40s %lu\n", "reconnects", (unsigned long)reconnects);
+    printf("  %-40s %d us\n", "slowest tick and poll", worstPollUs);
+    check(connected, "connected to the broker");
+    check(sent == count && (int)mqtt.acknowledged() == count && mqtt.lost() == 0, "every QoS 1 publish acknowledged");
+    check(echoes == count, "every message came back through the subscription");
+}
+
+static void runMqttSn(UipEthernet& eth, int count, int timeoutS)
+{
+    MqttSnClient    sn("stm32-host", topics, 1, subscriptions, 1);
+    Timer           run;
+    Timer           poll;
+    bool            connected = false;
+    int             sent = 0;
+    int             worstPollUs = 0;
+    char            payload[12];
+
+    printf("\nMQTT-SN, gateway %s:%u\n", server, serverPort);
+    sn.open(&eth, "192.168.1.1");
+    run.start();
+    while (run.read_ms() < timeoutS * 1000 && echoes < count) {
+        poll.reset();
+        poll.start();
+        eth.tick();
+        sn.poll();
+        worstPollUs = std::max(worstPollUs, poll.read_us());
+        connected |= sn.connected();
+
+        // a burst per poll, sent as one sendmmsg batch
+        for (int i = 0; sn.connected() && sent < count && i < BURST; i++) {
+            int len = snprintf(payload, sizeof(payload), "%d", sent);
+
+            if (sn.publish(0, payload, len) < 0)
+                break;
+            sent++;
+        }
+
+        wait_ms(1);
+    }
+
+    uint16_t    topicId = sn.topicId(0);
+    uint32_t    reconnects = sn.reconnects();
+
+    sn.close();
+    for (int i = 0; i < 10; i++) {
+        eth.tick();
+        wait_ms(1);
+    }
+
+    printf("  %-40s %u\n", "topic id", topicId);
+    printf("  %-40s %d of %d, %lu dropped\n", "published", sent, count, (unsigned long)sn.dropped());
+    printf("  %-40s %d, %d duplicates\n", "came back", echoes, duplicates);
+    printf("  %-40s %lu\n", "sendmmsg batches", (unsigned long)sn.batches());
+    printf("  %-40s %lu\n", "reconnects", (unsigned long)reconnects);
+    printf("  %-40s %d us\n", "slowest tick and poll", worstPollUs);
+    check(connected && topicId != 0, "connected, topic registered");
+    check(sent == count && sn.dropped() == 0, "every publish sent");
+    check(echoes == count, "every message came back through the subscription");
+}
+
+int main(int argc, char* argv[])
+{
+    bool    mqttSn = false;
+    int     count = COUNT;
+    int     timeoutS = TIMEOUT_S;
+    int     arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (!strcmp(argv[arg], "-s"))
+            mqttSn = true;
+        else
+        if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+            count = atoi(argv[++arg]);
+        else
+        if (!strcmp(argv[arg], "-t") && arg + 1 < argc)
+            timeoutS = atoi(argv[++arg]);
+        else
+            break;
+    }
+
+    if (arg >= argc) {
+        printf("usage: mqtt_host [-s] [-n count] [-t seconds] server [port]\n");
+        return 2;
+    }
+
+    server = argv[arg];
+    serverPort = arg + 1 < argc ? atoi(argv[arg + 1]) : mqttSn ? MQTTSN_PORT : MQTT_PORT;
+    echoed.assign(count, false);
+
+    UipEthernet eth(boardMac, NC, NC, NC, NC);
+
+    eth.set_network("192.168.1.10", "255.255.255.0", "192.168.1.1");
+    eth.connect();
+    wirePeer = wire;
+    if (mqttSn)
+        runMqttSn(eth, count, timeoutS);
+    else
+        runMqtt(eth, count, timeoutS);
+
+    printf("  %-40s %d out, %d in, %d resent\n", "TCP segments relayed", stats.tcpOut, stats.tcpIn, stats.resent);
+    printf("  %-40s %d out, %d in\n", "UDP datagrams relayed", stats.udpOut, stats.udpIn);
+    printf
+        (
+            "  %-40s %lu ring full, %lu no memory\n",
+            "frames dropped by the board",
+            (unsigned long)eth.enc28j60Eth.rxOverflows(),
+            (unsigned long)eth.dropsNoMemory()
+        );
+    if (stats.refused)
+        printf("  %-40s %d\n", "connections refused", stats.refused);
+    check(stats.badFrames == 0, "no malformed frame");
+    wirePeer = NULL;
+    hostClose(conn.fd);
+    hostClose(gatewayFd);
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+/*
+ pcap_replay.cpp - replays a capture from the STM32 TCP server into the stack on a PC.
+
+ Reads a classic pcap file written by capture2pcap.py --pcap and puts the
+ frames the board received into wireRx of the fake ENC28J60, with UIPEthernet
+ and uIP built unchanged on top of it and TcpServer / UdpSocket listeners
+ that read and discard what arrives. What the stack sends back is counted
+ and, with -w, written to a pcap file of its own.
+
+ Not everything in a capture can be delivered again:
+
+ - Frames the board sent are skipped. Classic pcap keeps no direction, they
+   are told apart by the board's MAC address (main.cpp's by default).
+ - PacketCapture keeps only the first UIP_CAPTURE_SNAPLEN bytes (64 by
+   default) of a frame. Truncated frames are skipped, or with --pad filled
+   up with zeros to their length on the wire and their TCP, UDP or ICMP
+   checksum recomputed, which keeps lengths and sequence numbers but not
+   the payload. Build the board with UIP_CAPTURE_SNAPLEN 255 to keep small
+   frames whole; IPv6 frames are skipped when truncated.
+ - The replay is open loop. For TCP connections the peer opened, the
+   acknowledgment numbers of the peer are moved by the difference between
+   the captured initial sequence number of the board and the one it picks
+   now, so the connection stays in step as long as the board sends the
+   same segments as in the capture. Connections the board opened (MQTT,
+   the TcpClient sketch) are not reproduced, no client application runs.
+ - Without --realtime frames follow each other as fast as the stack takes
+   them, timers that fired between frames in the capture do not fire here.
+
+    S=../stm32/UIPEthernet
+    gcc -c -funsigned-char -w -Ihost -I$S/utility $S/utility/uip.c $S/utility/uip_arp.c \
+        $S/utility/uip_timer.c $S/utility/stoip4.c $S/utility/ip4tos.c $S/utility/stoip6.c \
+        $S/utility/ip6tos.c $S/utility/common_functions.c
+    g++ -std=gnu++11 -funsigned-char -w -Ihost -I$S -I$S/utility -o pcap_replay pcap_replay.cpp \
+        host/Enc28j60Fake.cpp $S/UipEthernet.cpp $S/UdpSocket.cpp $S/TcpClient.cpp $S/TcpServer.cpp \
+        $S/DhcpClient.cpp $S/DnsClient.cpp $S/IpAddress.cpp $S/SocketAddress.cpp $S/utility/MemPool.cpp \
+        uip.o uip_arp.o uip_timer.o stoip4.o ip4tos.o stoip6.o ip6tos.o common_functions.o
+    python3 capture2pcap.py --pcap console.log capture.pcap
+    ./pcap_replay --pad -w replies.pcap capture.pcap
+    ./pcap_replay -t 61 -u 62 -u 7 --realtime capture.pcap
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+#include "UipEthernet.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "UdpSocket.h"
+#include "Enc28j60Fake.h"
+
+#define MAX_LISTENERS   4
+#define SETTLE_MS       1000        // ticks after the last frame, for timers and retransmissions
+
+enum { TCP_FIN = 0x01, TCP_SYN = 0x02, TCP_RST = 0x04, TCP_ACK = 0x10 };
+
+struct Options
+{
+    uint8_t     mac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+    const char* ip = "192.168.137.120";
+    uint16_t    tcpPorts[MAX_LISTENERS] = { 61, 80 };
+    int         tcpCount = 2;
+    uint16_t    udpPorts[MAX_LISTENERS];
+    int         udpCount = 0;
+    bool        pad = false;
+    bool        realtime = false;
+    const char* output = NULL;
+    const char* input = NULL;
+};
+
+struct Record
+{
+    uint64_t    us;                 // timestamp in the capture
+    uint32_t    origLen;
+    frame_t     data;
+};
+
+struct Stats
+{
+    int         frames = 0;
+    int         replayed = 0;
+    int         padded = 0;
+    int         fromBoard = 0;
+    int         truncated = 0;
+    int         rewritten = 0;      // acknowledgment numbers moved
+    int         sent = 0;
+    int         resets = 0;
+    size_t      tcpBytes = 0;
+    int         tcpClients = 0;
+    int         datagrams = 0;
+};
+
+// a TCP connection opened by a peer, by peer address and port
+struct Connection
+{
+    bool        captured = false;   // board's SYN-ACK seen in the capture
+    bool        replayed = false;   // and sent again by the stack
+    uint32_t    capturedIss;
+    uint32_t    iss;
+};
+
+typedef std::map<uint64_t, Connection>  connections_t;
+
+static Options          opt;
+static Stats            stats;
+static connections_t    connections;
+static FILE*            out;
+
+static uint32_t sum16(const uint8_t* p, size_t len, uint32_t sum)
+{
+    for (size_t i = 0; i < len; i += 2)
+        sum += (p[i] << 8) + (i + 1 < len ? p[i + 1] : 0);
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static bool isIpv4(const frame_t& f)
+{
+    return f.size() >= 34 && f[12] == 0x08 && f[13] == 0x00 && (f[14] >> 4) == 4;
+}
+
+static size_t ipHeaderLen(const frame_t& f)
+{
+    return (f[14] & 0x0f) * 4;
+}
+
+static bool isTcp(const frame_t& f)
+{
+    return isIpv4(f) && f[23] == 6 && f.size() >= 14 + ipHeaderLen(f) + 20;
+}
+
+// Key of the connection from the peer's side: address and port
+static uint64_t peerKey(const uint8_t* ip, const uint8_t* port)
+{
+    return (uint64_t)get32(ip) << 16 | port[0] << 8 | port[1];
+}
+
+// Recomputes the checksum of the TCP, UDP or ICMP message in an IPv4 frame
+static void fixChecksum(frame_t& f)
+{
+    size_t      hl = ipHeaderLen(f);
+    size_t      total = f[16] << 8 | f[17];
+    uint8_t*    ip = &f[14];
+    uint8_t*    l4 = ip + hl;
+    size_t      len = total - hl;
+    size_t      at;
+    uint32_t    sum;
+
+    switch (ip[9]) {
+        case 6:
+            at = 16;
+            sum = sum16(ip + 12, 8, 6 + len);
+            break;
+
+        case 17:
+            at = 6;
+            sum = sum16(ip + 12, 8, 17 + len);
+            break;
+
+        case 1:
+            at = 2;
+            sum = 0;
+            break;
+
+        default:
+            return;
+    }
+
+    if (len < at + 2)
+        return;
+    l4[at] = l4[at + 1] = 0;
+
+    uint16_t    check = ~fold(sum16(l4, len, sum));
+
+    if (ip[9] == 17 && check == 0)
+        check = 0xffff;
+    l4[at] = check >> 8;
+    l4[at + 1] = check;
+}
+
+static bool readPcap(const char* path, std::vector<Record>& records)
+{
+    FILE*       f = fopen(path, "rb");
+    uint32_t    header[6];
+    bool        swap;
+
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    if (fread(header, 4, 6, f) != 6 || (header[0] != 0xa1b2c3d4 && header[0] != 0xd4c3b2a1)) {
+        fprintf(stderr, "%s: not a classic pcap file, convert it with capture2pcap.py --pcap\n", path);
+        fclose(f);
+        return false;
+    }
+
+    swap = header[0] == 0xd4c3b2a1;
+    if ((swap ? __builtin_bswap32(header[5]) : header[5]) != 1) {
+        fprintf(stderr, "%s: not an Ethernet capture\n", path);
+        fclose(f);
+        return false;
+    }
+
+    uint32_t    rec[4];
+
+    while (fread(rec, 4, 4, f) == 4) {
+        Record  r;
+
+        for (int i = 0; i < 4 && swap; i++)
+            rec[i] = __builtin_bswap32(rec[i]);
+        r.us = (uint64_t)rec[0] * 1000000 + rec[1];
+        r.origLen = rec[3];
+        if (rec[2] > 65535 || (r.data.resize(rec[2]), fread(r.data.data(), 1, rec[2], f)) != rec[2]) {
+            fprintf(stderr, "%s: truncated record\n", path);
+            break;
+        }
+
+        records.push_back(r);
+    }
+
+    fclose(f);
+    return true;
+}
+
+static void writePcapHeader(FILE* f)
+{
+    uint32_t    header[6] = { 0xa1b2c3d4, 2 | 4 << 16, 0, 0, 65535, 1 };
+
+    fwrite(header, 4, 6, f);
+}
+
+static void writePcapRecord(FILE* f, const frame_t& data)
+{
+    uint64_t    us = host_now_us();
+    uint32_t    rec[4] = { (uint32_t)(us / 1000000), (uint32_t)(us % 1000000), (uint32_t)data.size(), (uint32_t)data.size() };
+
+    fwrite(rec, 4, 4, f);
+    fwrite(data.data(), 1, data.size(), f);
+}
+
+// Takes the frames the stack sent, notes the initial sequence numbers of
+// the connections it accepted
+static void drain()
+{
+    while (!wireTx.empty()) {
+        frame_t f = wireTx.front();
+
+        wireTx.pop_front();
+        stats.sent++;
+        if (out)
+            writePcapRecord(out, f);
+        if (!isTcp(f))
+            continue;
+
+        const uint8_t*  tcp = &f[14 + ipHeaderLen(f)];
+
+        if (tcp[13] & TCP_RST)
+            stats.resets++;
+        if ((tcp[13] & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK)) {
+            Connection& c = connections[peerKey(&f[30], tcp + 2)];
+
+            c.iss = get32(tcp + 4);
+            c.replayed = true;
+        }
+    }
+}
+
+// Accepts and empties the connections and sockets of the listeners
+static void serve(TcpServer* servers, std::vector<TcpClient*>& clients, UdpSocket* sockets)
+{
+    uint8_t buf[256];
+    int     len;
+
+    for (int i = 0; i < opt.tcpCount; i++) {
+        TcpClient*  client = servers[i].accept();
+
+        if (client) {
+            clients.push_back(client);
+            stats.tcpClients++;
+        }
+    }
+
+    for (size_t i = 0; i < clients.size(); i++) {
+        while (clients[i]->available() && (len = clients[i]->recv(buf, sizeof(buf))) > 0)
+            stats.tcpBytes += len;
+        if (!clients[i]->connected()) {
+            clients[i]->close();
+            clients.erase(clients.begin() + i--);
+        }
+    }
+
+    for (int i = 0; i < opt.udpCount; i++) {
+        while (sockets[i].parsePacket() > 0) {
+            sockets[i].flush();
+            stats.datagrams++;
+        }
+    }
+}
+
+// Prepares a frame of the peer for the stack, false if it cannot be delivered
+static bool prepare(Record& r)
+{
+    bool    tcp = isTcp(r.data);
+
+    if (r.data.size() < r.origLen) {
+        if (!opt.pad || !isIpv4(r.data) || r.data.size() < 14 + ipHeaderLen(r.data) + (tcp ? 20 : 8)) {
+            stats.truncated++;
+            return false;
+        }
+
+        r.data.resize(r.origLen);
+        fixChecksum(r.data);
+        stats.padded++;
+    }
+
+    if (!tcp)
+        return true;
+
+    uint8_t*    tcph = &r.data[14 + ipHeaderLen(r.data)];
+    auto        it = connections.find(peerKey(&r.data[26], tcph));
+
+    if (it != connections.end() && it->second.captured && it->second.replayed && (tcph[13] & TCP_ACK)) {
+        put32(tcph + 8, get32(tcph + 8) + it->second.iss - it->second.capturedIss);
+        fixChecksum(r.data);
+        stats.rewritten++;
+    }
+
+    if (tcph[13] & TCP_SYN)
+        connections.erase(peerKey(&r.data[26], tcph));
+    return true;
+}
+
+// Notes the initial sequence number of a connection the board accepted in the capture
+static void boardFrame(const Record& r)
+{
+    if (!isTcp(r.data))
+        return;
+
+    const uint8_t*  tcp = &r.data[14 + ipHeaderLen(r.data)];
+
+    if ((tcp[13] & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK)) {
+        Connection& c = connections[peerKey(&r.data[30], tcp + 2)];
+
+        c.capturedIss = get32(tcp + 4);
+        c.captured = true;
+    }
+}
+
+static bool parseMac(const char* s, uint8_t* mac)
+{
+    unsigned int    m[6];
+
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+        return false;
+    for (int i = 0; i < 6; i++)
+        mac[i] = m[i];
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int     arg = 1;
+    bool    tcpGiven = false;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+            if (!parseMac(argv[++arg], opt.mac))
+                break;
+        }
+        else
+        if (strcmp(argv[arg], "-i") == 0 && arg + 1 < argc)
+            opt.ip = argv[++arg];
+        else
+        if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc && (opt.tcpCount < MAX_LISTENERS || !tcpGiven)) {
+            if (!tcpGiven)
+                opt.tcpCount = 0;
+            tcpGiven = true;
+            opt.tcpPorts[opt.tcpCount++] = atoi(argv[++arg]);
+        }
+        else
+        if (strcmp(argv[arg], "-u") == 0 && arg + 1 < argc && opt.udpCount < MAX_LISTENERS)
+            opt.udpPorts[opt.udpCount++] = atoi(argv[++arg]);
+        else
+        if (strcmp(argv[arg], "-w") == 0 && arg + 1 < argc)
+            opt.output = argv[++arg];
+        else
+        if (strcmp(argv[arg], "--pad") == 0)
+            opt.pad = true;
+        else
+        if (strcmp(argv[arg], "--realtime") == 0)
+            opt.realtime = true;
+        else
+            break;
+    }
+
+    if (arg + 1 != argc) {
+        fprintf
+        (
+            stderr,
+            "usage: %s [-m board mac] [-i board ip] [-t tcp port]... [-u udp port]... [-w out.pcap] [--pad] [--realtime] <capture.pcap>\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    std::vector<Record> records;
+
+    opt.input = argv[arg];
+    if (!readPcap(opt.input, records))
+        return 1;
+    if (opt.output && !(out = fopen(opt.output, "wb"))) {
+        perror(opt.output);
+        return 1;
+    }
+
+    if (out)
+        writePcapHeader(out);
+
+    UipEthernet             eth(opt.mac, NC, NC, NC, NC);
+    TcpServer               servers[MAX_LISTENERS];
+    UdpSocket               sockets[MAX_LISTENERS];
+    std::vector<TcpClient*> clients;
+
+    eth.set_network(opt.ip, "255.255.255.0", "0.0.0.0");
+    eth.connect();
+    for (int i = 0; i < opt.tcpCount; i++) {
+        servers[i].open(&eth);
+        servers[i].bind(opt.tcpPorts[i]);
+        servers[i].listen(1);
+    }
+
+    for (int i = 0; i < opt.udpCount; i++)
+        sockets[i].begin(opt.udpPorts[i]);
+
+    Timer   t;
+    Timer   settle;
+
+    t.start();
+    for (size_t i = 0; i < records.size(); i++) {
+        Record& r = records[i];
+
+        stats.frames++;
+        if (r.data.size() >= 12 && memcmp(&r.data[6], opt.mac, 6) == 0) {
+            stats.fromBoard++;
+            boardFrame(r);
+            continue;
+        }
+
+        while (opt.realtime && (uint64_t)t.read_high_resolution_us() < r.us - records[0].us) {
+            eth.tick();
+            drain();
+            serve(servers, clients, sockets);
+            wait_ms(1);
+        }
+
+        if (!prepare(r))
+            continue;
+        wireRx.push_back(r.data);
+        stats.replayed++;
+        while (!wireRx.empty()) {
+            eth.tick();
+            drain();
+            serve(servers, clients, sockets);
+        }
+    }
+
+    settle.start();
+    while (settle.read_ms() < SETTLE_MS) {
+        eth.tick();
+        drain();
+        serve(servers, clients, sockets);
+        wait_ms(1);
+    }
+
+    if (out)
+        fclose(out);
+
+    printf("%s: %d frames\n", opt.input, stats.frames);
+    printf("  %-40s %d\n", "replayed", stats.replayed);
+    printf("  %-40s %d\n", "  filled up to their length (--pad)", stats.padded);
+    printf("  %-40s %d\n", "  acknowledgment numbers moved", stats.rewritten);
+    printf("  %-40s %d\n", "skipped, sent by the board", stats.fromBoard);
+    printf("  %-40s %d\n", "skipped, truncated", stats.truncated);
+    printf("  %-40s %d\n", "frames sent by the stack", stats.sent);
+    printf("  %-40s %d\n", "  TCP resets", stats.resets);
+    printf("  %-40s %d\n", "TCP connections accepted", stats.tcpClients);
+    printf("  %-40s %zu\n", "TCP bytes received", stats.tcpBytes);
+    printf("  %-40s %d\n", "UDP datagrams received", stats.datagrams);
+    printf("  %-40s %lu\n", "frames dropped, no memory", (unsigned long)eth.dropsNoMemory());
+    return 0;
+}
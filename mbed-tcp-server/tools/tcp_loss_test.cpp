@@ -0,0 +1,339 @@
+/*
+ tcp_loss_test.cpp - recovery time of a lost TCP segment, run on a PC.
+
+ Builds UIPEthernet and uIP unchanged on top of the fake ENC28J60 and
+ streams 256 byte segments from a TcpServer connection to a peer modelled
+ here. Every tenth data segment is dropped on the wire once; the test
+ measures how long each segment takes from send() to the peer and prints
+ the median and the worst case of the intact and of the lost segments.
+
+ Two peers are run. The plain peer acknowledges what it receives, nothing
+ else: uIP keeps one segment in flight, so after a loss nothing arrives
+ that would make the peer send duplicate ACKs and the retransmission timer
+ has to recover it. The second peer keeps sending pure ACKs while it waits,
+ as window updates of an application draining its buffer do, which lets
+ fast retransmit resend the segment at the third one.
+
+ The second build below disables fast retransmit and raises the RTO floor
+ to three timer pulses, the fixed UIP_RTO used before the RTT was sampled
+ in milliseconds, for comparison with the old retransmission path.
+
+    S=../stm32/UIPEthernet
+    for v in "" "-DUIP_FAST_RETRANSMIT=0 -DUIP_RTO_MIN=750"; do
+        gcc -c -funsigned-char -w $v -Ihost -I$S/utility $S/utility/uip.c $S/utility/uip_arp.c \
+            $S/utility/uip_timer.c $S/utility/stoip4.c $S/utility/ip4tos.c $S/utility/stoip6.c \
+            $S/utility/ip6tos.c $S/utility/common_functions.c
+        g++ -std=gnu++11 -funsigned-char -w $v -Ihost -I$S -I$S/utility -o tcp_loss_test tcp_loss_test.cpp \
+            host/Enc28j60Fake.cpp $S/UipEthernet.cpp $S/UdpSocket.cpp $S/TcpClient.cpp $S/TcpServer.cpp \
+            $S/DhcpClient.cpp $S/DnsClient.cpp $S/IpAddress.cpp $S/SocketAddress.cpp $S/utility/MemPool.cpp \
+            uip.o uip_arp.o uip_timer.o stoip4.o ip4tos.o stoip6.o ip6tos.o common_functions.o
+        ./tcp_loss_test
+    done
+ */
+#include <algorithm>
+#include <vector>
+
+#include "UipEthernet.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "Enc28j60Fake.h"
+
+#define SEGMENT         256
+#define SEGMENTS        60
+#define LOSS_EVERY      10
+#define SLACK_MS        60          // loop and poll delays on top of the timer
+
+static const uint8_t    boardMac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+static const uint8_t    peerMac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t    boardIp[4] = { 192, 168, 1, 10 };
+static const uint8_t    peerIp[4] = { 192, 168, 1, 1 };
+static const uint16_t   boardPort = 61;
+static const uint16_t   peerPort = 40000;
+
+enum { TCP_FIN = 0x01, TCP_SYN = 0x02, TCP_RST = 0x04, TCP_PSH = 0x08, TCP_ACK = 0x10 };
+
+// the peer's end of the connection
+static uint32_t         peerSeq;
+static uint32_t         rcvNxt;         // next byte expected from the board
+static bool             established;
+static bool             windowUpdates;  // keep sending pure ACKs while waiting
+static uint32_t         dataSegments;   // first transmissions seen
+static uint32_t         droppedSeq;     // sequence number of the dropped segment
+static bool             dropping;       // droppedSeq not retransmitted yet
+static int              retransmissions;
+static int              badFrames;
+static int              failures;
+
+static uint32_t sum16(const uint8_t* p, size_t len, uint32_t sum)
+{
+    for (size_t i = 0; i < len; i += 2)
+        sum += (p[i] << 8) + (i + 1 < len ? p[i + 1] : 0);
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Puts a segment from the peer on the wire, a SYN with the MSS option
+static void segment(uint8_t flags, const char* payload = "")
+{
+    size_t      len = strlen(payload);
+    size_t      hdrLen = flags & TCP_SYN ? 24 : 20;
+    frame_t     f(34 + hdrLen + len);
+    uint8_t*    ip = &f[14];
+    uint8_t*    tcp = ip + 20;
+    uint16_t    sum;
+
+    memcpy(&f[0], boardMac, 6);
+    memcpy(&f[6], peerMac, 6);
+    f[12] = 0x08;
+    ip[0] = 0x45;
+    ip[3] = 20 + hdrLen + len;
+    ip[8] = 64;
+    ip[9] = 6;
+    memcpy(ip + 12, peerIp, 4);
+    memcpy(ip + 16, boardIp, 4);
+    sum = ~fold(sum16(ip, 20, 0));
+    ip[10] = sum >> 8;
+    ip[11] = sum;
+    tcp[0] = peerPort >> 8;
+    tcp[1] = peerPort & 0xff;
+    tcp[2] = boardPort >> 8;
+    tcp[3] = boardPort;
+    put32(tcp + 4, peerSeq);
+    put32(tcp + 8, rcvNxt);
+    tcp[12] = hdrLen << 2;
+    tcp[13] = flags;
+    tcp[14] = 0x10;                     // 4 KB window
+    if (flags & TCP_SYN) {
+        tcp[20] = 2;                    // MSS 1460, uIP has no default
+        tcp[21] = 4;
+        tcp[22] = 1460 >> 8;
+        tcp[23] = 1460 & 0xff;
+    }
+
+    memcpy(tcp + hdrLen, payload, len);
+    sum = ~fold(sum16(tcp, hdrLen + len, sum16(ip + 12, 8, 6 + hdrLen + len)));
+    tcp[16] = sum >> 8;
+    tcp[17] = sum;
+    wireRx.push_back(f);
+    peerSeq += len + (flags & (TCP_SYN | TCP_FIN) ? 1 : 0);
+}
+
+// ARP request for the board, which also enters the peer into its table
+static void arpRequest()
+{
+    frame_t     f(42);
+
+    memset(&f[0], 0xff, 6);
+    memcpy(&f[6], peerMac, 6);
+    f[12] = 0x08;
+    f[13] = 0x06;
+    f[15] = 1;
+    f[16] = 0x08;
+    f[18] = 6;
+    f[19] = 4;
+    f[21] = 1;
+    memcpy(&f[22], peerMac, 6);
+    memcpy(&f[28], peerIp, 4);
+    memcpy(&f[38], boardIp, 4);
+    wireRx.push_back(f);
+}
+
+// Takes the frames the board sent: completes the handshake with a request,
+// which is what makes accept() return the connection, acknowledges the data
+// and drops every LOSS_EVERY-th data segment once
+static void wire()
+{
+    while (!wireTx.empty()) {
+        frame_t     f = wireTx.front();
+
+        wireTx.pop_front();
+        if (f[12] != 0x08 || f[13] != 0x00)
+            continue;                   // ARP reply
+
+        const uint8_t*  ip = &f[14];
+        const uint8_t*  tcp = ip + 20;
+        size_t          ipLen = ip[2] << 8 | ip[3];
+        size_t          hdrLen = (tcp[12] >> 4) * 4;
+
+        if (ip[9] != 6 || 14 + ipLen > f.size() || fold(sum16(tcp, ipLen - 20, sum16(ip + 12, 8, 6 + ipLen - 20))) != 0xffff) {
+            badFrames++;
+            continue;
+        }
+
+        uint8_t     flags = tcp[13];
+        uint32_t    seq = get32(tcp + 4);
+        size_t      len = ipLen - 20 - hdrLen;
+
+        if (flags & TCP_SYN) {
+            rcvNxt = seq + 1;
+            established = true;
+            segment(TCP_ACK);
+            segment(TCP_ACK | TCP_PSH, "GET\r\n");
+            continue;
+        }
+
+        if (len == 0)
+            continue;
+
+        if (seq == rcvNxt) {
+            if (!(dropping && seq == droppedSeq) && dataSegments++ % LOSS_EVERY == LOSS_EVERY - 1) {
+                droppedSeq = seq;
+                dropping = true;
+                continue;
+            }
+
+            retransmissions += dropping && seq == droppedSeq;
+            dropping = false;
+            rcvNxt += len;
+        }
+
+        segment(TCP_ACK);
+    }
+
+    // a window update per round while a segment is missing
+    if (windowUpdates && dropping)
+        segment(TCP_ACK);
+}
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+static int median(std::vector<int> v)
+{
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0 : v[v.size() / 2];
+}
+
+static int worst(const std::vector<int>& v)
+{
+    return v.empty() ? 0 : *std::max_element(v.begin(), v.end());
+}
+
+// Streams SEGMENTS segments over a new connection, returns the delivery
+// times in ms of the intact and of the lost ones
+static bool run(UipEthernet& eth, TcpServer& server, std::vector<int>& intact, std::vector<int>& lost)
+{
+    TcpClient*  client = NULL;
+    uint8_t     data[SEGMENT];
+    Timer       t;
+
+    established = false;
+    dataSegments = 0;
+    dropping = false;
+    peerSeq = 1000;
+    segment(TCP_SYN);
+    t.start();
+    while (!client && t.read_ms() < 2000) {
+        eth.tick();
+        wire();
+        client = server.accept();
+        wait_ms(1);
+    }
+
+    if (!client || !established)
+        return false;
+
+    memset(data, 'x', sizeof(data));
+    for (int i = 0; i < SEGMENTS; i++) {
+        uint32_t    target = rcvNxt + SEGMENT;
+        bool        loss = dataSegments % LOSS_EVERY == LOSS_EVERY - 1;
+
+        t.reset();
+        if (client->send(data, sizeof(data)) != SEGMENT)
+            return false;
+        while (rcvNxt != target && t.read_ms() < 5000) {
+            eth.tick();
+            wire();
+            wait_ms(1);
+        }
+
+        if (rcvNxt != target)
+            return false;
+        (loss ? lost : intact).push_back(t.read_ms());
+    }
+
+    // closes without waiting for the FIN handshake, the slot is reset
+    segment(TCP_RST);
+    eth.tick();
+    client->stop();
+    return true;
+}
+
+int main()
+{
+    UipEthernet eth(boardMac, NC, NC, NC, NC);
+    TcpServer   server;
+
+    eth.set_network("192.168.1.10", "255.255.255.0", "192.168.1.1");
+    eth.connect();
+    server.open(&eth);
+    server.bind(boardPort);
+    server.listen(1);
+    arpRequest();
+    eth.tick();
+    wire();
+
+    // RTO is SRTT + one pulse, SRTT being a few ms on the fake wire. The timer
+    // is rearmed by the ACK before the loss and fires when it counts down past
+    // zero, so a loss costs between RTO and RTO + 1 pulses
+    int rto = (std::max(UIP_RTO_MIN, UIP_PERIODIC_TIMEOUT + 1) + UIP_PERIODIC_TIMEOUT - 1) / UIP_PERIODIC_TIMEOUT;
+
+    printf
+        (
+            "fast retransmit %s, RTO floor %d ms, timer pulse %d ms, one in %d segments lost\n",
+            UIP_FAST_RETRANSMIT ? "on" : "off", UIP_RTO_MIN, UIP_PERIODIC_TIMEOUT, LOSS_EVERY
+        );
+
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<int>    intact, lost;
+
+        retransmissions = 0;
+
+        windowUpdates = pass == 1;
+        printf("\n%s\n", windowUpdates ? "peer sending window updates" : "plain peer");
+        check(run(eth, server, intact, lost), "every segment delivered in order");
+        printf
+            (
+                "  intact: median %d ms, worst %d ms; lost: median %d ms, worst %d ms; %lu resent\n",
+                median(intact), worst(intact), median(lost), worst(lost), (unsigned long)retransmissions
+            );
+        check(worst(intact) < SLACK_MS, "intact segments are not delayed");
+        if (windowUpdates && UIP_FAST_RETRANSMIT) {
+            check(worst(lost) < UIP_PERIODIC_TIMEOUT, "lost segments resent on the third duplicate ACK");
+        }
+        else {
+            check
+            (
+                median(lost) >= rto * UIP_PERIODIC_TIMEOUT - SLACK_MS && worst(lost) <= (rto + 1) * UIP_PERIODIC_TIMEOUT + SLACK_MS,
+                "lost segments resent by the retransmission timer"
+            );
+        }
+
+        check(badFrames == 0, "no malformed frame");
+    }
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,301 @@
+/*
+ telemetry_rx.cpp - receives the STM32 TCP server's ADC telemetry stream on Linux.
+
+ Subscribes over TCP (the stream follows on the same connection) or UDP
+ (datagrams from the device's TELEMETRY_PORT), parses the sample blocks
+ described in stm32/Telemetry/Telemetry.h and prints once per second:
+
+    samples/s       samples per channel received
+    blocks lost     gaps in the block sequence numbers
+    sample jitter   deviation of the device timestamps from count * period,
+                    i.e. how late the sampling interrupt ran
+    arrival jitter  RFC 3550 interarrival jitter of the blocks, host clock
+                    against device timestamps
+    age             host wall clock at arrival minus the device's absolute
+                    time of the last sample in the block, smallest of the
+                    second; shows the latency once both clocks are
+                    synchronized to the same NTP server
+
+    g++ -O2 -std=c++11 -o telemetry_rx telemetry_rx.cpp
+    ./telemetry_rx 192.168.137.120 61 5          # TCP, 5 ms sample period
+    ./telemetry_rx --udp 192.168.137.120 62 5
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+static const uint8_t    SUBSCRIBE = 0x20;
+static const uint8_t    BLOCK_ID = 0x31;
+static const size_t     HEADER_LEN = 24;
+static const int        RENEW_S = 10;       // UDP subscriptions expire after 30 s
+
+static volatile sig_atomic_t    stopping = 0;
+
+struct Stats
+{
+    uint64_t    samples = 0;
+    uint64_t    blocks = 0;
+    uint64_t    lost = 0;
+    uint32_t    maxLateUs = 0;
+    double      sumLateUs = 0;
+    uint64_t    lateCount = 0;
+    double      jitterUs = 0;               // RFC 3550 estimator
+    double      minAgeUs = 0;               // since the last report, 0 if the device clock is not set
+};
+
+static uint16_t le16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t le64(const uint8_t* p)
+{
+    return le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+static double nowUs(clockid_t clock = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Tracks one stream of blocks: sequence gaps and both jitter figures.
+class Receiver
+{
+public:
+    void block(const uint8_t* b, size_t len, double arrival)
+    {
+        uint8_t     channels = b[3];
+        uint16_t    count = le16(b + 4);
+        uint16_t    seq = le16(b + 6);
+        uint32_t    timestamp = le32(b + 8);
+        uint32_t    period = le32(b + 12);
+        uint64_t    time = le64(b + 16);
+
+        if (len < HEADER_LEN + (size_t)count * channels * 2)
+            return;
+
+        if (_started) {
+            uint16_t    gap = seq - _seq - 1;
+
+            stats.lost += gap;
+
+            // a lost block shifts the expected timestamp by its length as well
+            uint32_t    expected = (uint32_t)(gap + 1) * _count * _period;
+            int32_t     late = (int32_t)(timestamp - _timestamp - expected);
+            uint32_t    absLate = late < 0 ? -late : late;
+
+            if (absLate > stats.maxLateUs)
+                stats.maxLateUs = absLate;
+            stats.sumLateUs += absLate;
+            stats.lateCount++;
+
+            double      d = (arrival - _arrival) - (double)(uint32_t)(timestamp - _timestamp);
+
+            stats.jitterUs += ((d < 0 ? -d : d) - stats.jitterUs) / 16;
+        }
+
+        if (time && count) {
+            double  age = nowUs(CLOCK_REALTIME) - (double)(time + (uint64_t)(count - 1) * period);
+
+            if (stats.minAgeUs == 0 || age < stats.minAgeUs)
+                stats.minAgeUs = age;
+        }
+
+        _started = true;
+        _seq = seq;
+        _count = count;
+        _period = period;
+        _timestamp = timestamp;
+        _arrival = arrival;
+        stats.blocks++;
+        stats.samples += count;
+    }
+
+    Stats   stats;
+private:
+    bool        _started = false;
+    uint16_t    _seq = 0;
+    uint16_t    _count = 0;
+    uint32_t    _period = 0;
+    uint32_t    _timestamp = 0;
+    double      _arrival = 0;
+};
+
+// Finds the blocks in a TCP byte stream; other frames (the OK reply) and
+// garbage are skipped by resynchronizing on A5 5A 31.
+class StreamParser
+{
+public:
+    StreamParser(Receiver& rx) : _rx(rx) { }
+
+    void feed(const uint8_t* data, size_t len, double arrival)
+    {
+        _buf.insert(_buf.end(), data, data + len);
+
+        size_t  pos = 0;
+
+        while (_buf.size() - pos >= HEADER_LEN) {
+            const uint8_t*  b = &_buf[pos];
+
+            if (b[0] != 0xA5 || b[1] != 0x5A || b[2] != BLOCK_ID) {
+                pos++;
+                continue;
+            }
+
+            size_t  total = HEADER_LEN + (size_t)le16(b + 4) * b[3] * 2;
+
+            if (_buf.size() - pos < total)
+                break;
+            _rx.block(b, total, arrival);
+            pos += total;
+        }
+
+        _buf.erase(_buf.begin(), _buf.begin() + pos);
+    }
+private:
+    Receiver&               _rx;
+    std::vector<uint8_t>    _buf;
+};
+
+static void onSignal(int)
+{
+    stopping = 1;
+}
+
+static void report(Stats& now, Stats& last, double seconds)
+{
+    printf
+    (
+        "%8.0f samples/s  %6.1f blocks/s  lost %llu  sample jitter avg %.1f max %u us  arrival jitter %.1f us  age %.1f ms\n",
+        (now.samples - last.samples) / seconds,
+        (now.blocks - last.blocks) / seconds,
+        (unsigned long long)now.lost,
+        now.lateCount ? now.sumLateUs / now.lateCount : 0.0,
+        now.maxLateUs,
+        now.jitterUs,
+        now.minAgeUs / 1000
+    );
+    fflush(stdout);
+    now.minAgeUs = 0;
+    last = now;
+}
+
+int main(int argc, char* argv[])
+{
+    bool    udp = argc > 1 && strcmp(argv[1], "--udp") == 0;
+    int     arg = udp ? 2 : 1;
+
+    if (argc - arg < 1) {
+        fprintf(stderr, "usage: %s [--udp] <device ip> [port] [period ms]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_in  device;
+    int                 period = argc - arg > 2 ? atoi(argv[arg + 2]) : 10;
+
+    memset(&device, 0, sizeof(device));
+    device.sin_family = AF_INET;
+    device.sin_port = htons(argc - arg > 1 ? atoi(argv[arg + 1]) : (udp ? 62 : 61));
+    if (inet_pton(AF_INET, argv[arg], &device.sin_addr) != 1 || period < 1 || period > 255) {
+        fprintf(stderr, "bad address or period (1..255 ms)\n");
+        return 1;
+    }
+
+    int fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+
+    if (fd < 0 || connect(fd, (struct sockaddr*)&device, sizeof(device)) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    struct sigaction    sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;           // no SA_RESTART, recv() returns on Ctrl-C
+    sigaction(SIGINT, &sa, NULL);
+
+    struct timeval  tv = { 1, 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    uint8_t         subscribe[] = { 0xA5, 0x5A, SUBSCRIBE, (uint8_t)period };
+    Receiver        rx;
+    StreamParser    parser(rx);
+    Stats           last;
+    double          start = nowUs();
+    double          lastReport = start;
+    double          lastRenew = start;
+    uint8_t         buf[65536];
+
+    send(fd, subscribe, sizeof(subscribe), 0);
+    while (!stopping) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        double  arrival = nowUs();
+
+        if (n == 0) {
+            fprintf(stderr, "connection closed by the device\n");
+            break;
+        }
+
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("recv");
+            break;
+        }
+
+        if (n > 0) {
+            if (udp) {
+                // one block per datagram
+                if (n >= (ssize_t)HEADER_LEN && buf[0] == 0xA5 && buf[1] == 0x5A && buf[2] == BLOCK_ID)
+                    rx.block(buf, n, arrival);
+            }
+            else
+                parser.feed(buf, n, arrival);
+        }
+
+        if (udp && arrival - lastRenew > RENEW_S * 1e6) {
+            send(fd, subscribe, sizeof(subscribe), 0);
+            lastRenew = arrival;
+        }
+
+        if (arrival - lastReport >= 1e6) {
+            report(rx.stats, last, (arrival - lastReport) / 1e6);
+            lastReport = arrival;
+        }
+    }
+
+    subscribe[3] = 0;                   // unsubscribe
+    send(fd, subscribe, sizeof(subscribe), 0);
+    close(fd);
+
+    double  seconds = (nowUs() - start) / 1e6;
+
+    printf
+    (
+        "total: %llu samples in %.1f s (%.0f samples/s), %llu blocks, %llu lost\n",
+        (unsigned long long)rx.stats.samples,
+        seconds,
+        rx.stats.samples / seconds,
+        (unsigned long long)rx.stats.blocks,
+        (unsigned long long)rx.stats.lost
+    );
+    return 0;
+}
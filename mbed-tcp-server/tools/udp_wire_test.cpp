@@ -0,0 +1,272 @@
+/*
+ udp_wire_test.cpp - UDP transmit test of the network stack, run on a PC.
+
+ Builds UIPEthernet, uIP and the ARP code unchanged on top of a fake
+ ENC28J60 (host/Enc28j60Fake.cpp) and checks the frames the stack puts on
+ the wire: a sendmmsg batch to a peer without ARP entry sends one ARP
+ request and no datagram, the same batch after the ARP reply sends every
+ datagram with valid IP and UDP checksums, and beginPacket/endPacket still
+ reaches the peer. Then DiagServer gets requests from several source ports
+ and must answer each of them: replying does not tie the socket to the
+ first requester. Last a UDP telemetry subscriber lets its lease expire and
+ subscribes again from a new port, and another one takes over after an
+ unsubscribe; both streams must reach the new port.
+
+    S=../stm32/UIPEthernet
+    T=../stm32/Telemetry
+    gcc -c -funsigned-char -w -Ihost -I$S/utility $S/utility/uip.c $S/utility/uip_arp.c \
+        $S/utility/uip_timer.c $S/utility/stoip4.c $S/utility/ip4tos.c $S/utility/stoip6.c \
+        $S/utility/ip6tos.c $S/utility/common_functions.c
+    g++ -std=gnu++11 -funsigned-char -w -DTELEMETRY_UDP_LEASE_MS=300 -Ihost -I$S -I$S/utility -I$T \
+        -o udp_wire_test udp_wire_test.cpp \
+        host/Enc28j60Fake.cpp $S/UipEthernet.cpp $S/UdpSocket.cpp $S/TcpClient.cpp $S/TcpServer.cpp \
+        $S/DhcpClient.cpp $S/DnsClient.cpp $S/IpAddress.cpp $S/SocketAddress.cpp $S/utility/MemPool.cpp \
+        $S/DiagServer.cpp $S/SntpClient.cpp $T/Telemetry.cpp \
+        uip.o uip_arp.o uip_timer.o stoip4.o ip4tos.o stoip6.o ip6tos.o common_functions.o
+    ./udp_wire_test
+ */
+#include "UipEthernet.h"
+#include "DiagServer.h"
+#include "Telemetry.h"
+#include "Enc28j60Fake.h"
+
+static const uint8_t    boardMac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+static const uint8_t    peerMac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t    boardIp[4] = { 192, 168, 1, 10 };
+static const uint8_t    peerIp[4] = { 192, 168, 1, 1 };
+static const uint16_t   peerPort = 5000;
+
+static bool             answerArp;
+static int              arpRequests;
+static int              datagrams;
+static int              badFrames;
+static uint16_t         lastPort;       // destination of the last datagram
+static int              failures;
+
+static uint32_t sum16(const uint8_t* p, size_t len, uint32_t sum)
+{
+    for (size_t i = 0; i < len; i += 2)
+        sum += (p[i] << 8) + (i + 1 < len ? p[i + 1] : 0);
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+// Takes the frames sent by the stack; ARP requests for the peer are
+// answered if answerArp is set, datagrams to it are checked and counted.
+static void wire()
+{
+    while (!wireTx.empty()) {
+        frame_t     f = wireTx.front();
+        uint16_t    type = f[12] << 8 | f[13];
+
+        wireTx.pop_front();
+        if (type == 0x0806) {
+            if (f.size() < 42 || f[21] != 1 || memcmp(&f[38], peerIp, 4) != 0) {
+                badFrames++;
+                continue;
+            }
+
+            arpRequests++;
+            if (!answerArp)
+                continue;
+
+            frame_t     r(42);
+
+            memcpy(&r[0], boardMac, 6);
+            memcpy(&r[6], peerMac, 6);
+            r[12] = 0x08;
+            r[13] = 0x06;
+            r[15] = 1;                  // Ethernet
+            r[16] = 0x08;               // IPv4
+            r[18] = 6;
+            r[19] = 4;
+            r[21] = 2;                  // reply
+            memcpy(&r[22], peerMac, 6);
+            memcpy(&r[28], peerIp, 4);
+            memcpy(&r[32], boardMac, 6);
+            memcpy(&r[38], boardIp, 4);
+            wireRx.push_back(r);
+            continue;
+        }
+
+        const uint8_t*  ip = &f[14];
+
+        if (type != 0x0800 || f.size() < 42 || memcmp(&f[0], peerMac, 6) != 0 || ip[9] != 17) {
+            badFrames++;
+            continue;
+        }
+
+        const uint8_t*  udp = ip + 20;
+        size_t          ipLen = ip[2] << 8 | ip[3];
+        size_t          udpLen = udp[4] << 8 | udp[5];
+
+        if (14 + ipLen > f.size() || udpLen != ipLen - 20 || fold(sum16(ip, 20, 0)) != 0xffff ||
+            memcmp(ip + 16, peerIp, 4) != 0) {
+            badFrames++;
+            continue;
+        }
+
+        // pseudo header: addresses, protocol and UDP length
+        if ((udp[6] | udp[7]) && fold(sum16(udp, udpLen, sum16(ip + 12, 8, 17 + udpLen))) != 0xffff) {
+            badFrames++;
+            continue;
+        }
+
+        lastPort = udp[2] << 8 | udp[3];
+        datagrams++;
+    }
+}
+
+// Puts a datagram from the peer on the wire
+static void request(uint16_t srcPort, uint16_t dstPort, const char* data)
+{
+    size_t      n = strlen(data);
+    frame_t     f(42 + n);
+    uint8_t*    ip = &f[14];
+    uint8_t*    udp = ip + 20;
+    uint16_t    sum;
+
+    memcpy(&f[0], boardMac, 6);
+    memcpy(&f[6], peerMac, 6);
+    f[12] = 0x08;
+    ip[0] = 0x45;
+    ip[2] = (28 + n) >> 8;
+    ip[3] = 28 + n;
+    ip[8] = 64;
+    ip[9] = 17;
+    memcpy(ip + 12, peerIp, 4);
+    memcpy(ip + 16, boardIp, 4);
+    sum = ~fold(sum16(ip, 20, 0));
+    ip[10] = sum >> 8;
+    ip[11] = sum;
+    udp[0] = srcPort >> 8;
+    udp[1] = srcPort;
+    udp[2] = dstPort >> 8;
+    udp[3] = dstPort;
+    udp[4] = (8 + n) >> 8;
+    udp[5] = 8 + n;
+    memcpy(udp + 8, data, n);
+    sum = ~fold(sum16(udp, 8 + n, sum16(ip + 12, 8, 17 + 8 + n)));
+    udp[6] = sum >> 8;
+    udp[7] = sum;
+    wireRx.push_back(f);
+}
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+// Runs the sampling and the stream for ms milliseconds, counts the
+// datagrams reaching port
+static int stream(Telemetry& telemetry, uint16_t port, int ms)
+{
+    Timer   t;
+    int     received = 0;
+
+    t.start();
+    while (t.read_ms() < ms) {
+        Ticker::run();
+        telemetry.poll();
+        datagrams = 0;
+        wire();
+        if (datagrams && lastPort == port)
+            received += datagrams;
+        wait_ms(1);
+    }
+
+    return received;
+}
+
+// Takes a subscription datagram from port the way main.cpp does
+static bool subscribe(Telemetry& telemetry, UdpSocket& udp, uint16_t port, uint32_t period)
+{
+    request(port, TELEMETRY_PORT, "sub");
+    if (udp.parsePacket() <= 0 || udp.remotePort() != port)
+        return false;
+    telemetry.subscribe(&udp, udp.remoteAddress(), period);
+    udp.flush();
+    return true;
+}
+
+int main()
+{
+    UipEthernet eth(boardMac, NC, NC, NC, NC);
+
+    eth.set_network("192.168.1.10", "255.255.255.0", "192.168.1.1");
+    eth.connect();
+
+    UdpSocket   udp(&eth);
+    const char* data[3] = { "first", "second", "third" };
+    udp_msg_t   msgs[3];
+    int         sent;
+
+    udp.begin(4000);
+    for (int i = 0; i < 3; i++) {
+        msgs[i].address = SocketAddress("192.168.1.1", peerPort);
+        msgs[i].data = (void*)data[i];
+        msgs[i].size = strlen(data[i]);
+    }
+
+    printf("sendmmsg to a peer without ARP entry\n");
+    sent = udp.sendmmsg(msgs, 3);
+    wire();
+    check(sent == 0 && msgs[0].len == 0 && msgs[2].len == 0, "no datagram reported as sent");
+    check(arpRequests == 1 && datagrams == 0 && badFrames == 0, "one ARP request and no datagram on the wire");
+
+    printf("\nsendmmsg after the ARP reply\n");
+    answerArp = true;
+    udp.sendmmsg(msgs, 3);
+    wire();
+    eth.tick();                         // takes the reply
+    sent = udp.sendmmsg(msgs, 3);
+    wire();
+    check(sent == 3 && msgs[0].len == msgs[0].size && msgs[2].len == msgs[2].size, "every datagram reported as sent");
+    check(datagrams == 3 && badFrames == 0 && lastPort == peerPort, "three datagrams with valid checksums on the wire");
+
+    printf("\nbeginPacket/endPacket\n");
+    udp.beginPacket("192.168.1.1", peerPort);
+    udp.write((const uint8_t*)"x", 1);
+    udp.endPacket();
+    wire();
+    check(datagrams == 4 && badFrames == 0 && lastPort == peerPort, "the datagram is on the wire");
+
+    printf("\nDiagServer, requests from different source ports\n");
+    DiagServer  diag;
+    int         answered = 0;
+
+    diag.open(&eth);
+    for (uint16_t port = 40000; port < 40003; port++) {
+        datagrams = 0;
+        request(port, UIP_DIAG_PORT, "?");
+        diag.poll();
+        wire();
+        answered += datagrams == 1 && lastPort == port;
+    }
+
+    check(answered == 3 && badFrames == 0, "every request answered to its source port");
+
+    printf("\nUDP telemetry, lease of %d ms\n", TELEMETRY_UDP_LEASE_MS);
+    const PinName   pins[TELEMETRY_CHANNELS] = { NC, NC };
+    Telemetry       telemetry(pins);
+    UdpSocket       telemetryUdp;
+
+    telemetryUdp.begin(TELEMETRY_PORT);
+    check(subscribe(telemetry, telemetryUdp, 50000, 1000) && stream(telemetry, 50000, 200) > 0, "first subscriber gets blocks");
+    stream(telemetry, 50000, TELEMETRY_UDP_LEASE_MS);
+    check(!telemetry.running(), "lease expired");
+    check(subscribe(telemetry, telemetryUdp, 50001, 1000) && stream(telemetry, 50001, 200) > 0, "subscription from a new port gets blocks");
+    check(subscribe(telemetry, telemetryUdp, 50001, 0) && !telemetry.running(), "unsubscribed");
+    check(subscribe(telemetry, telemetryUdp, 50002, 1000) && stream(telemetry, 50002, 200) > 0, "next subscriber gets blocks");
+    check(badFrames == 0, "no malformed frame");
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,353 @@
+/*
+ MqttQueue.cpp - outbound MQTT queue with coalescing windows and per topic QoS.
+ */
+#include "MqttQueue.h"
+#include <string.h>
+
+#define PUBLISH     0x30
+#define PUBACK      0x40
+#define DUP         0x08
+
+/**
+ * @brief
+ * @note    topics must outlive the queue.
+ * @param
+ * @retval
+ */
+MqttQueue::MqttQueue(const mqtt_topic_policy_t* topics, uint8_t topicCount) :
+    _topics(topics),
+    _topicCount(topicCount),
+    _seq(0),
+    _nextId(1),
+    _rxHeader(0),
+    _rxLength(0),
+    _rxShift(0),
+    _rxPos(0),
+    _posted(0),
+    _coalesced(0),
+    _dropped(0),
+    _published(0),
+    _acknowledged(0),
+    _retried(0)
+{
+    memset(_slots, 0, sizeof(_slots));
+    _timer.start();
+}
+
+/**
+ * @brief   Queues a message
+ * @note    Never blocks on the network. Within the coalescing window of the
+ *          topic the queued message is replaced instead.
+ * @param   topic Index into the policy table
+ * @retval  false if the payload is too long or no slot is free
+ */
+bool MqttQueue::post(uint8_t topic, const void* payload, size_t len)
+{
+    if (topic >= _topicCount || len > MQTT_QUEUE_PAYLOAD_MAX)
+        return false;
+
+    const mqtt_topic_policy_t*  policy = &_topics[topic];
+    slot_t*                     slot = NULL;
+
+    _mutex.lock();
+    _posted++;
+    if (policy->windowMs) {
+        for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+            if (_slots[i].state == QUEUED && _slots[i].topic == topic) {
+                slot = &_slots[i];
+                _coalesced++;
+                break;
+            }
+        }
+    }
+
+    if (!slot) {
+        for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+            if (_slots[i].state == FREE) {
+                slot = &_slots[i];
+                slot->state = QUEUED;
+                slot->topic = topic;
+                slot->dup = false;
+                slot->seq = _seq++;
+                slot->time = _timer.read_ms() + policy->windowMs;
+                break;
+            }
+        }
+    }
+
+    if (!slot) {
+        _dropped++;
+        _mutex.unlock();
+        return false;
+    }
+
+    memcpy(slot->payload, payload, len);
+    slot->len = len;
+    _mutex.unlock();
+    return true;
+}
+
+/**
+ * @brief   Picks the oldest message to send now
+ * @note    QoS 1 messages wait while MQTT_QUEUE_INFLIGHT are unacknowledged.
+ * @param
+ * @retval  Slot index, -1 if none
+ */
+int MqttQueue::_next(uint32_t now)
+{
+    int     next = -1;
+    uint8_t inflight = 0;
+
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++)
+        inflight += _slots[i].state == INFLIGHT;
+
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        slot_t* slot = &_slots[i];
+        bool    ready;
+
+        if (slot->state == QUEUED)
+            ready = (int32_t)(now - slot->time) >= 0 && (_topics[slot->topic].qos == 0 || inflight < MQTT_QUEUE_INFLIGHT);
+        else
+            ready = slot->state == INFLIGHT && now - slot->time >= MQTT_QUEUE_RETRY_MS;
+
+        if (ready && (next < 0 || (int32_t)(slot->seq - _slots[next].seq) < 0))
+            next = i;
+    }
+
+    return next;
+}
+
+/**
+ * @brief   Serializes the due messages as PUBLISH packets
+ * @note    A message that does not even fit into an empty buf is dropped.
+ * @param
+ * @retval  Bytes written to buf
+ */
+size_t MqttQueue::pack(uint8_t* buf, size_t size)
+{
+    size_t  len = 0;
+    int     i;
+
+    _mutex.lock();
+
+    uint32_t    now = _timer.read_ms();
+
+    while ((i = _next(now)) >= 0) {
+        slot_t*         slot = &_slots[i];
+        const char*     topic = _topics[slot->topic].topic;
+        uint8_t         qos = _topics[slot->topic].qos;
+        size_t          topicLen = strlen(topic);
+        size_t          remaining = 2 + topicLen + (qos ? 2 : 0) + slot->len;
+        size_t          total = 1 + (remaining < 128 ? 1 : 2) + remaining;
+
+        if (len + total > size || remaining >= 0x4000) {
+            if (len && remaining < 0x4000)
+                break;
+
+            slot->state = FREE;                 // can never be sent
+            _dropped++;
+            continue;
+        }
+
+        if (qos && slot->state == QUEUED) {
+            slot->id = _nextId++;
+            if (!_nextId)
+                _nextId = 1;
+        }
+
+        buf[len++] = PUBLISH | (qos << 1) | (slot->dup ? DUP : 0);
+        if (remaining < 128)
+            buf[len++] = remaining;
+        else {
+            buf[len++] = (remaining & 0x7F) | 0x80;
+            buf[len++] = remaining >> 7;
+        }
+
+        buf[len++] = topicLen >> 8;
+        buf[len++] = topicLen;
+        memcpy(buf + len, topic, topicLen);
+        len += topicLen;
+        if (qos) {
+            buf[len++] = slot->id >> 8;
+            buf[len++] = slot->id;
+        }
+
+        memcpy(buf + len, slot->payload, slot->len);
+        len += slot->len;
+
+        if (!qos) {
+            slot->state = FREE;
+            _published++;
+        }
+        else {
+            if (slot->state == INFLIGHT)
+                _retried++;
+            else
+                _published++;
+            slot->state = INFLIGHT;
+            slot->dup = true;                   // for a resend
+            slot->time = now;
+        }
+    }
+
+    _mutex.unlock();
+    return len;
+}
+
+/**
+ * @brief   Time until pack() has something to send
+ * @note    Queued QoS 1 messages waiting for a free in-flight place count
+ *          as due when the oldest in-flight one is retried.
+ * @param
+ * @retval  Milliseconds, 0 if something is due now, -1 if nothing is queued
+ */
+int MqttQueue::due()
+{
+    int wait = -1;
+
+    _mutex.lock();
+
+    uint32_t    now = _timer.read_ms();
+    uint8_t     inflight = 0;
+
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++)
+        inflight += _slots[i].state == INFLIGHT;
+
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        slot_t*     slot = &_slots[i];
+        int32_t     ms;
+
+        if (slot->state == QUEUED && (_topics[slot->topic].qos == 0 || inflight < MQTT_QUEUE_INFLIGHT))
+            ms = (int32_t)(slot->time - now);
+        else
+        if (slot->state == INFLIGHT)
+            ms = (int32_t)(slot->time + MQTT_QUEUE_RETRY_MS - now);
+        else
+            continue;
+
+        if (ms < 0)
+            ms = 0;
+        if (wait < 0 || ms < wait)
+            wait = ms;
+    }
+
+    _mutex.unlock();
+    return wait;
+}
+
+/**
+ * @brief   Frees the slot of an acknowledged message
+ * @note    Called with the mutex held.
+ * @param
+ * @retval
+ */
+void MqttQueue::_acked(uint16_t id)
+{
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        if (_slots[i].state == INFLIGHT && _slots[i].id == id) {
+            _slots[i].state = FREE;
+            _acknowledged++;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief   Follows the packets in the received byte stream
+ * @note    Only PUBACKs are looked into, however the data is split.
+ * @param
+ * @retval
+ */
+void MqttQueue::received(const uint8_t* data, size_t len)
+{
+    _mutex.lock();
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+
+        if (!_rxHeader) {
+            _rxHeader = c;
+            _rxLength = 0;
+            _rxShift = 0;
+            _rxPos = 0;
+            continue;
+        }
+
+        if (_rxShift != 0xFF) {
+            _rxLength |= (uint32_t)(c & 0x7F) << _rxShift;
+            if (!(c & 0x80)) {
+                _rxShift = 0xFF;
+                if (!_rxLength)
+                    _rxHeader = 0;
+            }
+            else
+            if ((_rxShift += 7) > 21)
+                _rxHeader = 0;                  // malformed, resynchronize
+            continue;
+        }
+
+        if (_rxPos < 2)
+            _rxId[_rxPos] = c;
+
+        if (++_rxPos == _rxLength) {
+            if ((_rxHeader & 0xF0) == PUBACK && _rxLength == 2)
+                _acked((_rxId[0] << 8) | _rxId[1]);
+            _rxHeader = 0;
+        }
+    }
+
+    _mutex.unlock();
+}
+
+/**
+ * @brief   Resends the unacknowledged messages with the next batch
+ * @note    MQTT 3.1.1 requires this after reconnecting with a session.
+ * @param
+ * @retval
+ */
+void MqttQueue::resend()
+{
+    _mutex.lock();
+
+    uint32_t    now = _timer.read_ms();
+
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        if (_slots[i].state == INFLIGHT)
+            _slots[i].time = now - MQTT_QUEUE_RETRY_MS;
+    }
+
+    _mutex.unlock();
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval  Messages waiting to be sent
+ */
+uint8_t MqttQueue::queued()
+{
+    uint8_t n = 0;
+
+    _mutex.lock();
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++)
+        n += _slots[i].state == QUEUED;
+    _mutex.unlock();
+    return n;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval  QoS 1 messages sent and not yet acknowledged
+ */
+uint8_t MqttQueue::inflight()
+{
+    uint8_t n = 0;
+
+    _mutex.lock();
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++)
+        n += _slots[i].state == INFLIGHT;
+    _mutex.unlock();
+    return n;
+}
@@ -0,0 +1,161 @@
+/*
+ MqttQueue.h - outbound MQTT queue with coalescing windows and per topic QoS.
+
+ Sampling code posts messages from any thread and never waits for the
+ network: post() copies the payload into one of MQTT_QUEUE_SLOTS slots and
+ returns. The thread owning the connection calls pack() to serialize all
+ messages that are due into one buffer and writes it with a single network
+ write, so the ESP8266 sends one AT+CIPSEND for the whole batch instead of
+ one per message.
+
+ Every topic has a policy:
+
+    qos             0 or 1. QoS 1 publishes are pipelined: up to
+                    MQTT_QUEUE_INFLIGHT are sent without waiting for their
+                    PUBACK, the slot is freed when it arrives and the
+                    message resent with DUP after MQTT_QUEUE_RETRY_MS.
+    windowMs        coalescing window. A message is held this long after
+                    it was posted; a newer message to the same topic within
+                    the window replaces it, so only the latest value is
+                    sent. 0 sends every message with the next batch.
+
+ PUBACKs are read from the byte stream the MQTT::Client receives: wrap the
+ network in MqttQueueNetwork and give that to the client.
+
+    const mqtt_topic_policy_t   topics[] = { { "adcVal", 0, 1000 } };
+    MqttQueue                   outbox(topics, 1);
+
+    outbox.post(0, buf, len);                      // sampling thread
+    len = outbox.pack(batch, sizeof(batch));       // connection thread
+ */
+#ifndef MQTTQUEUE_H
+#define MQTTQUEUE_H
+
+#include "mbed.h"
+
+#ifndef MQTT_QUEUE_SLOTS
+#define MQTT_QUEUE_SLOTS            8       // messages waiting or in flight
+#endif
+
+#ifndef MQTT_QUEUE_PAYLOAD_MAX
+#define MQTT_QUEUE_PAYLOAD_MAX      32
+#endif
+
+#ifndef MQTT_QUEUE_INFLIGHT
+#define MQTT_QUEUE_INFLIGHT         4       // unacknowledged QoS 1 publishes
+#endif
+
+#ifndef MQTT_QUEUE_RETRY_MS
+#define MQTT_QUEUE_RETRY_MS         5000    // resend QoS 1 without PUBACK
+#endif
+
+typedef struct
+{
+    const char*     topic;
+    uint8_t         qos;            // 0 or 1
+    uint16_t        windowMs;       // coalescing window, 0 for none
+} mqtt_topic_policy_t;
+
+class MqttQueue
+{
+public:
+    MqttQueue(const mqtt_topic_policy_t* topics, uint8_t topicCount);
+
+    // Any thread. Returns false if the payload is too long or no slot is free.
+    bool            post(uint8_t topic, const void* payload, size_t len);
+
+    // Connection thread. Serializes the due messages as PUBLISH packets
+    // into buf and returns the length, 0 if none is due.
+    size_t          pack(uint8_t* buf, size_t size);
+
+    // Milliseconds until pack() has something to send, -1 if nothing is queued.
+    int             due();
+
+    // Feed with the bytes received from the broker to see PUBACKs.
+    void            received(const uint8_t* data, size_t len);
+
+    // After a reconnect: resend the unacknowledged messages with the next batch.
+    void            resend();
+
+    uint8_t         queued();
+    uint8_t         inflight();
+
+    uint32_t        posted()                { return _posted; }
+    uint32_t        coalesced()             { return _coalesced; }      // replaced within their window
+    uint32_t        dropped()               { return _dropped; }        // no free slot
+    uint32_t        published()             { return _published; }
+    uint32_t        acknowledged()          { return _acknowledged; }   // QoS 1
+    uint32_t        retried()               { return _retried; }        // QoS 1 resent with DUP
+private:
+    enum
+    {
+        FREE,
+        QUEUED,
+        INFLIGHT                            // QoS 1, sent, waiting for PUBACK
+    };
+
+    typedef struct
+    {
+        uint8_t     state;
+        uint8_t     topic;
+        uint8_t     len;
+        bool        dup;
+        uint16_t    id;
+        uint32_t    seq;                    // post order
+        uint32_t    time;                   // due if QUEUED, sent if INFLIGHT
+        uint8_t     payload[MQTT_QUEUE_PAYLOAD_MAX];
+    } slot_t;
+
+    const mqtt_topic_policy_t*  _topics;
+    uint8_t                     _topicCount;
+    slot_t                      _slots[MQTT_QUEUE_SLOTS];
+    Mutex                       _mutex;
+    Timer                       _timer;
+    uint32_t                    _seq;
+    uint16_t                    _nextId;
+    uint8_t                     _rxHeader;  // fixed header of the packet being received, 0 before it
+    uint32_t                    _rxLength;  // remaining length of that packet
+    uint8_t                     _rxShift;   // 0xFF once the remaining length is complete
+    uint8_t                     _rxId[2];
+    uint32_t                    _rxPos;
+    uint32_t                    _posted;
+    uint32_t                    _coalesced;
+    uint32_t                    _dropped;
+    uint32_t                    _published;
+    uint32_t                    _acknowledged;
+    uint32_t                    _retried;
+
+    int                         _next(uint32_t now);
+    void                        _acked(uint16_t id);
+};
+
+// Network decorator for MQTT::Client: passes everything through and shows
+// the received bytes to the queue. Writes of the client and of the batches
+// must come from the same thread.
+template<class Network>
+class MqttQueueNetwork
+{
+public:
+    MqttQueueNetwork(Network& network, MqttQueue& queue) :
+        _network(network),
+        _queue(queue)
+    { }
+
+    int read(unsigned char* buffer, int len, int timeout)
+    {
+        int n = _network.read(buffer, len, timeout);
+
+        if (n > 0)
+            _queue.received(buffer, n);
+        return n;
+    }
+
+    int write(unsigned char* buffer, int len, int timeout)
+    {
+        return _network.write(buffer, len, timeout);
+    }
+private:
+    Network&    _network;
+    MqttQueue&  _queue;
+};
+#endif
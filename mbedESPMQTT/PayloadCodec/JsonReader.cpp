@@ -0,0 +1,260 @@
+/*
+ JsonReader.cpp - Event based (SAX) JSON reader working in place.
+ */
+#include "JsonReader.h"
+#include <string.h>
+
+bool JsonHandler::onBegin(const char*, size_t, uint8_t, bool)                          { return true; }
+bool JsonHandler::onEnd(uint8_t, bool)                                                 { return true; }
+bool JsonHandler::onNumber(const char*, size_t, uint8_t, int32_t, float, bool)         { return true; }
+bool JsonHandler::onString(const char*, size_t, uint8_t, const char*, size_t)          { return true; }
+bool JsonHandler::onBool(const char*, size_t, uint8_t, bool)                           { return true; }
+bool JsonHandler::onNull(const char*, size_t, uint8_t)                                 { return true; }
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+static const char* skipSpace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+    return p;
+}
+
+/**
+ * @brief   Finds the end of a string
+ * @note    Escapes are skipped, not decoded.
+ * @param   p Points behind the opening quote, advanced past the closing one
+ * @param   len Length between the quotes
+ * @retval  false if the string is not terminated
+ */
+static bool readString(const char*& p, const char* end, size_t& len)
+{
+    const char* start = p;
+
+    while (p < end && *p != '"') {
+        if (*p == '\\')
+            p++;
+        p++;
+    }
+
+    if (p >= end)
+        return false;
+
+    len = p++ - start;
+    return true;
+}
+
+/**
+ * @brief   Reads a member name and the colon behind it
+ * @note
+ * @param
+ * @retval
+ */
+static bool readKey(const char*& p, const char* end, const char*& key, size_t& keyLen)
+{
+    p = skipSpace(p, end);
+    if (p == end || *p++ != '"')
+        return false;
+
+    key = p;
+    if (!readString(p, end, keyLen))
+        return false;
+
+    p = skipSpace(p, end);
+    return p < end && *p++ == ':';
+}
+
+/**
+ * @brief   Parses a JSON number without strtod
+ * @note    Up to 9 significant digits are used.
+ * @param   p Advanced past the number
+ * @param   isFloat Set if the number has a fraction or an exponent or does
+ *          not fit into int32_t
+ * @retval  false if there is no number at p
+ */
+bool JsonReader::number(const char*& p, const char* end, int32_t& i, float& f, bool& isFloat)
+{
+    bool        negative = false;
+    uint32_t    mant = 0;
+    int         digits = 0;
+    int         scale = 0;
+    const char* start;
+
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+
+    start = p;
+    isFloat = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (digits < 9) {
+            mant = mant * 10 + (*p - '0');
+            if (mant)
+                digits++;
+        }
+        else
+            scale++;
+    }
+
+    if (p == start)
+        return false;
+
+    if (p < end && *p == '.') {
+        isFloat = true;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (digits < 9) {
+                mant = mant * 10 + (*p - '0');
+                if (mant)
+                    digits++;
+                scale--;
+            }
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        bool    expNegative = false;
+        int     exp = 0;
+
+        isFloat = true;
+        p++;
+        if (p < end && (*p == '+' || *p == '-'))
+            expNegative = *p++ == '-';
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (exp < 100)
+                exp = exp * 10 + (*p - '0');
+        }
+
+        scale += expNegative ? -exp : exp;
+    }
+
+    if (!isFloat && scale == 0 && mant <= 0x7FFFFFFF) {
+        i = negative ? -(int32_t)mant : (int32_t)mant;
+        return true;
+    }
+
+    float   v = mant;
+
+    for (; scale > 0; scale--)
+        v *= 10;
+    for (; scale < 0; scale++)
+        v /= 10;
+
+    f = negative ? -v : v;
+    isFloat = true;
+    return true;
+}
+
+/**
+ * @brief   Reports every value of a JSON text to handler
+ * @note    Not recursive: bit n of arrays tells if level n is an array.
+ * @param   len Input length, a terminating zero ends the text earlier
+ * @retval  false if malformed, too deep or stopped by the handler
+ */
+bool JsonReader::parse(const char* buf, size_t len, JsonHandler& handler)
+{
+    const char* p = buf;
+    const char* end = (const char*)memchr(buf, '\0', len);
+    const char* key = NULL;
+    size_t      keyLen = 0;
+    uint32_t    arrays = 0;
+    uint8_t     depth = 0;
+
+    if (!end)
+        end = buf + len;
+
+    for (;;) {
+        p = skipSpace(p, end);
+        if (p == end)
+            return false;
+
+        if (*p == '{' || *p == '[') {
+            bool    array = *p++ == '[';
+
+            if (depth == JSON_MAX_DEPTH)
+                return false;
+
+            depth++;
+            if (array)
+                arrays |= 1UL << depth;
+            else
+                arrays &= ~(1UL << depth);
+
+            if (!handler.onBegin(key, keyLen, depth, array))
+                return false;
+
+            p = skipSpace(p, end);
+            if (p == end)
+                return false;
+
+            if (*p != (array ? ']' : '}')) {
+                key = NULL;
+                keyLen = 0;
+                if (!array && !readKey(p, end, key, keyLen))
+                    return false;
+                continue;       // first member or element
+            }
+
+            p++;
+            if (!handler.onEnd(depth, array))
+                return false;
+            depth--;
+        }
+        else
+        if (*p == '"') {
+            const char* value = ++p;
+            size_t      n;
+
+            if (!readString(p, end, n) || !handler.onString(key, keyLen, depth, value, n))
+                return false;
+        }
+        else
+        if (*p == 't' || *p == 'f' || *p == 'n') {
+            const char* literal = *p == 't' ? "true" : *p == 'f' ? "false" : "null";
+            size_t      n = strlen(literal);
+
+            if ((size_t)(end - p) < n || strncmp(p, literal, n) != 0)
+                return false;
+
+            if (*p == 'n' ? !handler.onNull(key, keyLen, depth) : !handler.onBool(key, keyLen, depth, *p == 't'))
+                return false;
+            p += n;
+        }
+        else {
+            int32_t i = 0;
+            float   f = 0;
+            bool    isFloat;
+
+            if (!number(p, end, i, f, isFloat) || !handler.onNumber(key, keyLen, depth, i, f, isFloat))
+                return false;
+        }
+
+        // behind a value: a comma or the end of one or more containers
+        for (;;) {
+            p = skipSpace(p, end);
+            if (depth == 0)
+                return p == end;
+            if (p == end)
+                return false;
+
+            bool    array = (arrays >> depth) & 1;
+
+            if (*p == ',') {
+                p++;
+                key = NULL;
+                keyLen = 0;
+                if (!array && !readKey(p, end, key, keyLen))
+                    return false;
+                break;
+            }
+
+            if (*p++ != (array ? ']' : '}') || !handler.onEnd(depth, array))
+                return false;
+            depth--;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ JsonReader.h - Event based (SAX) JSON reader working in place.
+
+ JsonReader::parse() walks a JSON text once and reports every value to a
+ JsonHandler together with the key it belongs to and its nesting depth.
+ Keys and strings are pointers into the input, nothing is copied or
+ allocated, nesting is tracked in a bit mask instead of a stack. A handler
+ picks the keys it knows, e.g. for {"red":255,"green":0,"blue":64}:
+
+    onBegin(NULL, 0, 1, false)
+    onNumber("red", 3, 1, 255, 0, false)
+    onNumber("green", 5, 1, 0, 0, false)
+    onNumber("blue", 4, 1, 64, 0, false)
+    onEnd(1, false)
+
+ Numbers are parsed without strtod (newlib's allocates): integers that fit
+ into int32_t come as i, all others as f with isFloat set.
+ */
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH          8       // nested objects and arrays, up to 31
+#endif
+
+class JsonHandler
+{
+public:
+    virtual         ~JsonHandler()    { }
+
+    // key is not terminated and NULL for array elements and the top level
+    // value, depth is 1 for the members of the top level object. Strings
+    // are passed with their escapes. Returning false stops the parser.
+    virtual bool    onBegin(const char* key, size_t keyLen, uint8_t depth, bool array);
+    virtual bool    onEnd(uint8_t depth, bool array);
+    virtual bool    onNumber(const char* key, size_t keyLen, uint8_t depth, int32_t i, float f, bool isFloat);
+    virtual bool    onString(const char* key, size_t keyLen, uint8_t depth, const char* value, size_t len);
+    virtual bool    onBool(const char* key, size_t keyLen, uint8_t depth, bool value);
+    virtual bool    onNull(const char* key, size_t keyLen, uint8_t depth);
+};
+
+class JsonReader
+{
+public:
+    // A terminating zero ends the text, so payloads sent with it parse.
+    // Returns false if the text is malformed, nested deeper than
+    // JSON_MAX_DEPTH or a handler stopped the parser.
+    static bool     parse(const char* buf, size_t len, JsonHandler& handler);
+
+    // Parses the number at p and advances p past it.
+    static bool     number(const char*& p, const char* end, int32_t& i, float& f, bool& isFloat);
+};
+#endif
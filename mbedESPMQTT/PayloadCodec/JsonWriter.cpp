@@ -0,0 +1,298 @@
+/*
+ JsonWriter.cpp - JSON text written into a fixed buffer without snprintf.
+ */
+#include "JsonWriter.h"
+#include <string.h>
+
+/**
+ * @brief
+ * @note
+ * @param   buf Output, not terminated
+ * @retval
+ */
+JsonWriter::JsonWriter(char* buf, size_t size) :
+    _buf(buf),
+    _size(size),
+    _len(0),
+    _overflow(false),
+    _comma(false)
+{ }
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::_put(const char* data, size_t len)
+{
+    if (_overflow || _len + len > _size) {
+        _overflow = true;
+        return;
+    }
+
+    memcpy(_buf + _len, data, len);
+    _len += len;
+}
+
+/**
+ * @brief   Writes the comma between two values or members
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::_separate()
+{
+    if (_comma)
+        _put(',');
+    _comma = true;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::beginObject()
+{
+    _separate();
+    _put('{');
+    _comma = false;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::endObject()
+{
+    _put('}');
+    _comma = true;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::beginArray()
+{
+    _separate();
+    _put('[');
+    _comma = false;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::endArray()
+{
+    _put(']');
+    _comma = true;
+}
+
+/**
+ * @brief   Writes a member name, the value must follow
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::key(const char* key)
+{
+    string(key);
+    _put(':');
+    _comma = false;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::number(int32_t value)
+{
+    char    text[JSON_NUMBER_MAX];
+
+    _separate();
+    _put(text, formatInt(text, value));
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::number(float value, uint8_t decimals)
+{
+    char    text[JSON_NUMBER_MAX];
+
+    _separate();
+    _put(text, formatFloat(text, value, decimals));
+}
+
+/**
+ * @brief
+ * @note    Quotes, backslashes and control characters are escaped.
+ * @param
+ * @retval
+ */
+void JsonWriter::string(const char* value)
+{
+    static const char   hex[] = "0123456789abcdef";
+    const char*         start = value;
+
+    _separate();
+    _put('"');
+    for (; *value; value++) {
+        uint8_t c = *value;
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        _put(start, value - start);
+        start = value + 1;
+        if (c == '"' || c == '\\') {
+            char    esc[2] = { '\\', (char)c };
+
+            _put(esc, 2);
+        }
+        else {
+            char    esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F] };
+
+            _put(esc, 6);
+        }
+    }
+
+    _put(start, value - start);
+    _put('"');
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+void JsonWriter::boolean(bool value)
+{
+    _separate();
+    if (value)
+        _put("true", 4);
+    else
+        _put("false", 5);
+}
+
+/**
+ * @brief   Writes the decimal digits of value
+ * @note
+ * @param   width Pads with leading zeros to this many digits
+ * @retval  Number of characters written
+ */
+static size_t formatUint(char* buf, uint32_t value, uint8_t width)
+{
+    char    digits[10];
+    size_t  n = 0;
+    size_t  len = 0;
+
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (n < width && n < sizeof(digits))
+        digits[n++] = '0';
+    while (n)
+        buf[len++] = digits[--n];
+    return len;
+}
+
+/**
+ * @brief
+ * @note
+ * @param   buf Holds JSON_NUMBER_MAX bytes
+ * @retval  Number of characters written
+ */
+size_t JsonWriter::formatInt(char* buf, int32_t value)
+{
+    if (value < 0) {
+        buf[0] = '-';
+        return 1 + formatUint(buf + 1, 0 - (uint32_t)value, 0);
+    }
+
+    return formatUint(buf, value, 0);
+}
+
+/**
+ * @brief   Writes value with up to decimals decimals
+ * @note    Trailing zeros of the fraction are removed, values of 2^32 and
+ *          above get an exponent, NaN and infinity become null.
+ * @param   buf Holds JSON_NUMBER_MAX bytes
+ * @param   decimals Up to 9
+ * @retval  Number of characters written
+ */
+size_t JsonWriter::formatFloat(char* buf, float value, uint8_t decimals)
+{
+    static const uint32_t   powers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+    size_t                  len = 0;
+    bool                    negative = value < 0;
+    uint32_t                ip;
+    uint32_t                fp;
+
+    if (value != value || value - value != 0) {
+        memcpy(buf, "null", 4);
+        return 4;
+    }
+
+    if (negative)
+        value = -value;
+
+    if (value >= 4294967296.0f) {
+        int exp = 0;
+
+        while (value >= 10) {
+            value /= 10;
+            exp++;
+        }
+
+        if (negative)
+            buf[len++] = '-';
+        len += formatFloat(buf + len, value, 6);
+        buf[len++] = 'e';
+        return len + formatUint(buf + len, exp, 0);
+    }
+
+    if (decimals > 9)
+        decimals = 9;
+
+    ip = (uint32_t)value;
+    fp = (uint32_t)((value - ip) * powers[decimals] + 0.5f);
+    if (fp >= powers[decimals]) {
+        ip++;
+        fp -= powers[decimals];
+    }
+
+    if (negative && (ip || fp))
+        buf[len++] = '-';
+    len += formatUint(buf + len, ip, 0);
+
+    if (fp) {
+        while (fp % 10 == 0) {
+            fp /= 10;
+            decimals--;
+        }
+
+        buf[len++] = '.';
+        len += formatUint(buf + len, fp, decimals);
+    }
+
+    return len;
+}
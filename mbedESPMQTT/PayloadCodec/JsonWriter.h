@@ -0,0 +1,66 @@
+/*
+ JsonWriter.h - JSON text written into a fixed buffer without snprintf.
+
+ newlib's printf family allocates for floats (and pulls in the float
+ formatting code), so numbers are formatted by hand here:
+
+    char        buf[64];
+    JsonWriter  json(buf, sizeof(buf));
+
+    json.beginObject();
+    json.key("temp");
+    json.number(23.5f);
+    json.endObject();          // {"temp":23.5}, json.length() is 13
+
+ Floats get up to JSON_FLOAT_DECIMALS decimals with trailing zeros removed,
+ values of 2^32 and above are written with an exponent, NaN and infinity as
+ null. Once the buffer is full all further output is dropped and length()
+ returns -1.
+ */
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef JSON_FLOAT_DECIMALS
+#define JSON_FLOAT_DECIMALS     3
+#endif
+
+#define JSON_NUMBER_MAX         24      // longest formatted number
+
+class JsonWriter
+{
+public:
+    JsonWriter(char* buf, size_t size);
+
+    void            beginObject();
+    void            endObject();
+    void            beginArray();
+    void            endArray();
+    void            key(const char* key);
+    void            number(int32_t value);
+    void            number(float value, uint8_t decimals = JSON_FLOAT_DECIMALS);
+    void            string(const char* value);
+    void            boolean(bool value);
+
+    // Bytes written, -1 if they did not fit. The text is not terminated.
+    int             length() const     { return _overflow ? -1 : _len; }
+
+    // Write into buf, which must hold JSON_NUMBER_MAX bytes, and return
+    // the length. Not terminated.
+    static size_t   formatInt(char* buf, int32_t value);
+    static size_t   formatFloat(char* buf, float value, uint8_t decimals = JSON_FLOAT_DECIMALS);
+
+private:
+    char*           _buf;
+    size_t          _size;
+    size_t          _len;
+    bool            _overflow;
+    bool            _comma;     // a value precedes, the next one needs a comma
+
+    void            _put(const char* data, size_t len);
+    void            _put(char c)       { _put(&c, 1); }
+    void            _separate();
+};
+#endif
@@ -0,0 +1,507 @@
+/*
+ PayloadCodec.cpp - MQTT payloads encoded from and decoded into fixed structs.
+ */
+#include "PayloadCodec.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include <string.h>
+
+PackedCodec packedCodec;
+CborCodec   cborCodec;
+JsonCodec   jsonCodec;
+
+#define CBOR_UINT       0x00
+#define CBOR_NEGINT     0x20
+#define CBOR_BYTES      0x40
+#define CBOR_TEXT       0x60
+#define CBOR_MAP        0xA0
+#define CBOR_FLOAT16    0xF9
+#define CBOR_FLOAT32    0xFA
+#define CBOR_FLOAT64    0xFB
+
+/**
+ * @brief   Decodes with the codec the payload was encoded with
+ * @note
+ * @param   schema Fields to fill in
+ * @param   obj Struct described by schema
+ * @retval  false if the payload is malformed or of another schema
+ */
+bool PayloadCodec::decodeAny(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj)
+{
+    PayloadCodec*   codec = detect(buf, len);
+
+    return codec && codec->decode(schema, buf, len, obj);
+}
+
+/**
+ * @brief   Tells the codec from the first byte
+ * @note    JSON may start with white space.
+ * @param
+ * @retval  NULL if no codec matches
+ */
+PayloadCodec* PayloadCodec::detect(const uint8_t* buf, size_t len)
+{
+    if (!len)
+        return NULL;
+
+    uint8_t c = buf[0];
+
+    if (c == '{' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        return &jsonCodec;
+    if ((c & 0xE0) == CBOR_MAP)
+        return &cborCodec;
+    if (c != 0 && c <= PAYLOAD_ID_MAX)
+        return &packedCodec;
+    return NULL;
+}
+
+/**
+ * @brief   Looks up the field of a key
+ * @note
+ * @param   key Not terminated
+ * @retval  NULL if the schema has no such field
+ */
+const payload_field_t* PayloadCodec::field(const payload_schema_t* schema, const char* key, size_t keyLen)
+{
+    for (uint8_t i = 0; i < schema->count; i++) {
+        const payload_field_t*  f = &schema->fields[i];
+
+        if (strncmp(f->key, key, keyLen) == 0 && f->key[keyLen] == '\0')
+            return f;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief   Stores a decoded number, converted to the type of the field
+ * @note    Integers are clamped to the range of the field, floats are rounded.
+ * @param   i Value if isFloat is false
+ * @param   f Value if isFloat is true
+ * @retval
+ */
+void PayloadCodec::set(const payload_field_t* field, void* obj, int32_t i, float f, bool isFloat)
+{
+    uint8_t*    p = (uint8_t*)obj + field->offset;
+
+    switch (field->type) {
+        case PAYLOAD_UINT8:
+            if (isFloat)
+                i = f < 0 ? 0 : f > 255 ? 255 : (int32_t)(f + 0.5f);
+            *p = i < 0 ? 0 : i > 255 ? 255 : i;
+            break;
+
+        case PAYLOAD_INT32:
+        {
+            int32_t v = i;
+
+            if (isFloat)
+                v = f <= -2147483648.0f ? INT32_MIN : f >= 2147483647.0f ? INT32_MAX : (int32_t)(f < 0 ? f - 0.5f : f + 0.5f);
+
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+
+        case PAYLOAD_FLOAT:
+        {
+            float   v = isFloat ? f : (float)i;
+
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+    }
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+float PayloadCodec::getFloat(const payload_field_t* field, const void* obj)
+{
+    float   v;
+
+    memcpy(&v, (const uint8_t*)obj + field->offset, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+int32_t PayloadCodec::getInt(const payload_field_t* field, const void* obj)
+{
+    const uint8_t*  p = (const uint8_t*)obj + field->offset;
+    int32_t         v;
+
+    if (field->type == PAYLOAD_UINT8)
+        return *p;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief   Writes the id byte and the fields in schema order
+ * @note    Little endian, floats as IEEE 754 single precision.
+ * @param
+ * @retval  Payload length or -1 if size is too small
+ */
+int PackedCodec::encode(const payload_schema_t* schema, const void* obj, uint8_t* buf, size_t size)
+{
+    size_t  len = 1;
+
+    if (size < 1)
+        return -1;
+
+    buf[0] = schema->id;
+    for (uint8_t i = 0; i < schema->count; i++) {
+        const payload_field_t*  f = &schema->fields[i];
+        size_t                  n = f->type == PAYLOAD_UINT8 ? 1 : 4;
+        uint32_t                v;
+
+        if (len + n > size)
+            return -1;
+
+        if (f->type == PAYLOAD_FLOAT) {
+            float   fv = getFloat(f, obj);
+
+            memcpy(&v, &fv, sizeof(v));
+        }
+        else
+            v = getInt(f, obj);
+
+        for (size_t b = 0; b < n; b++)
+            buf[len++] = v >> (8 * b);
+    }
+
+    return len;
+}
+
+/**
+ * @brief
+ * @note    The id byte must be the schema's and the length match exactly.
+ * @param
+ * @retval
+ */
+bool PackedCodec::decode(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj)
+{
+    size_t  pos = 1;
+
+    if (len < 1 || buf[0] != schema->id)
+        return false;
+
+    for (uint8_t i = 0; i < schema->count; i++)
+        pos += schema->fields[i].type == PAYLOAD_UINT8 ? 1 : 4;
+    if (pos != len)
+        return false;
+
+    pos = 1;
+    for (uint8_t i = 0; i < schema->count; i++) {
+        const payload_field_t*  f = &schema->fields[i];
+        size_t                  n = f->type == PAYLOAD_UINT8 ? 1 : 4;
+        uint32_t                v = 0;
+
+        for (size_t b = 0; b < n; b++)
+            v |= (uint32_t)buf[pos++] << (8 * b);
+
+        if (f->type == PAYLOAD_FLOAT) {
+            float   fv;
+
+            memcpy(&fv, &v, sizeof(fv));
+            set(f, obj, 0, fv, true);
+        }
+        else
+            set(f, obj, f->type == PAYLOAD_UINT8 ? (int32_t)(uint8_t)v : (int32_t)v, 0, false);
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Writes a CBOR head: major type and argument
+ * @note
+ * @param
+ * @retval  Bytes written, 0 if size is too small
+ */
+static size_t cborHead(uint8_t* buf, size_t size, uint8_t major, uint32_t arg)
+{
+    size_t  n = arg < 24 ? 1 : arg < 0x100 ? 2 : arg < 0x10000 ? 3 : 5;
+
+    if (n > size)
+        return 0;
+
+    if (n == 1) {
+        buf[0] = major | arg;
+        return 1;
+    }
+
+    buf[0] = major | (n == 2 ? 24 : n == 3 ? 25 : 26);
+    for (size_t i = 1; i < n; i++)
+        buf[i] = arg >> (8 * (n - 1 - i));
+    return n;
+}
+
+/**
+ * @brief   Writes a map with one entry per field
+ * @note    Integers in the shortest form, floats as float32.
+ * @param
+ * @retval  Payload length or -1 if size is too small
+ */
+int CborCodec::encode(const payload_schema_t* schema, const void* obj, uint8_t* buf, size_t size)
+{
+    size_t  len = cborHead(buf, size, CBOR_MAP, schema->count);
+
+    if (!len)
+        return -1;
+
+    for (uint8_t i = 0; i < schema->count; i++) {
+        const payload_field_t*  f = &schema->fields[i];
+        size_t                  keyLen = strlen(f->key);
+        size_t                  n = cborHead(buf + len, size - len, CBOR_TEXT, keyLen);
+
+        if (!n || len + n + keyLen > size)
+            return -1;
+
+        len += n;
+        memcpy(buf + len, f->key, keyLen);
+        len += keyLen;
+
+        if (f->type == PAYLOAD_FLOAT) {
+            float       fv = getFloat(f, obj);
+            uint32_t    v;
+
+            if (len + 5 > size)
+                return -1;
+
+            memcpy(&v, &fv, sizeof(v));
+            buf[len++] = CBOR_FLOAT32;
+            for (int b = 3; b >= 0; b--)
+                buf[len++] = v >> (8 * b);
+        }
+        else {
+            int32_t v = getInt(f, obj);
+
+            n = v < 0 ? cborHead(buf + len, size - len, CBOR_NEGINT, -1 - v) : cborHead(buf + len, size - len, CBOR_UINT, v);
+            if (!n)
+                return -1;
+            len += n;
+        }
+    }
+
+    return len;
+}
+
+/**
+ * @brief   Reads the argument of a CBOR head
+ * @note
+ * @param   pos Advanced past the head
+ * @retval  false if the argument is indefinite, 64 bit or truncated
+ */
+static bool cborArg(const uint8_t* buf, size_t len, size_t& pos, uint32_t& arg)
+{
+    uint8_t info = buf[pos++] & 0x1F;
+    size_t  n;
+
+    if (info < 24) {
+        arg = info;
+        return true;
+    }
+
+    if (info > 26)
+        return false;
+
+    n = 1 << (info - 24);
+    if (pos + n > len)
+        return false;
+
+    arg = 0;
+    while (n--)
+        arg = (arg << 8) | buf[pos++];
+    return true;
+}
+
+/**
+ * @brief
+ * @note    IEEE 754 half precision, as other encoders may shorten floats.
+ * @param
+ * @retval
+ */
+static float halfToFloat(uint16_t h)
+{
+    int     exp = (h >> 10) & 0x1F;
+    float   mant = h & 0x3FF;
+    float   val;
+
+    if (exp == 0)
+        val = mant / (1 << 24);
+    else
+    if (exp == 31)
+        val = mant ? 0.0f / 0.0f : 1.0f / 0.0f;
+    else {
+        val = (mant + 1024) / 1024;
+        for (; exp > 15; exp--)
+            val *= 2;
+        for (; exp < 15; exp++)
+            val /= 2;
+    }
+
+    return h & 0x8000 ? -val : val;
+}
+
+/**
+ * @brief   Reads a map of text keys and numbers
+ * @note    Other values of unknown keys (strings, simple values) are
+ *          skipped, nested maps and arrays are not supported.
+ * @param
+ * @retval
+ */
+bool CborCodec::decode(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj)
+{
+    size_t      pos = 0;
+    uint32_t    count;
+
+    if (!len || (buf[0] & 0xE0) != CBOR_MAP || !cborArg(buf, len, pos, count))
+        return false;
+
+    while (count--) {
+        uint32_t    keyLen;
+
+        if (pos >= len || (buf[pos] & 0xE0) != CBOR_TEXT || !cborArg(buf, len, pos, keyLen) || pos + keyLen > len)
+            return false;
+
+        const payload_field_t*  f = field(schema, (const char*)buf + pos, keyLen);
+        uint8_t                 major;
+        uint32_t                arg;
+
+        pos += keyLen;
+        if (pos >= len)
+            return false;
+
+        major = buf[pos] & 0xE0;
+        if (buf[pos] == CBOR_FLOAT16 || buf[pos] == CBOR_FLOAT32 || buf[pos] == CBOR_FLOAT64) {
+            size_t      n = buf[pos] == CBOR_FLOAT16 ? 2 : buf[pos] == CBOR_FLOAT32 ? 4 : 8;
+            uint64_t    v = 0;
+            float       fv;
+
+            if (pos + 1 + n > len)
+                return false;
+            for (size_t b = 1; b <= n; b++)
+                v = (v << 8) | buf[pos + b];
+            pos += 1 + n;
+
+            if (n == 2)
+                fv = halfToFloat(v);
+            else
+            if (n == 4) {
+                uint32_t    v32 = v;
+
+                memcpy(&fv, &v32, sizeof(fv));
+            }
+            else {
+                double  d;
+
+                memcpy(&d, &v, sizeof(d));
+                fv = d;
+            }
+
+            if (f)
+                set(f, obj, 0, fv, true);
+        }
+        else
+        if (major == CBOR_UINT || major == CBOR_NEGINT) {
+            if (!cborArg(buf, len, pos, arg))
+                return false;
+            if (f)
+                set(f, obj, major == CBOR_UINT ? (int32_t)arg : -1 - (int32_t)arg, major == CBOR_UINT ? (float)arg : -1.0f - arg, arg > 0x7FFFFFFF);
+        }
+        else
+        if (major == CBOR_TEXT || major == CBOR_BYTES) {
+            if (!cborArg(buf, len, pos, arg) || pos + arg > len)
+                return false;
+            pos += arg;                 // no string fields
+        }
+        else
+        if (major == 0xE0 && (buf[pos] & 0x1F) < 24)
+            pos++;                      // false, true, null
+        else
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Writes a flat object
+ * @note    Floats with up to JSON_FLOAT_DECIMALS decimals.
+ * @param
+ * @retval  Payload length or -1 if size is too small
+ */
+int JsonCodec::encode(const payload_schema_t* schema, const void* obj, uint8_t* buf, size_t size)
+{
+    JsonWriter  json((char*)buf, size);
+
+    json.beginObject();
+    for (uint8_t i = 0; i < schema->count; i++) {
+        const payload_field_t*  f = &schema->fields[i];
+
+        json.key(f->key);
+        if (f->type == PAYLOAD_FLOAT)
+            json.number(getFloat(f, obj));
+        else
+            json.number(getInt(f, obj));
+    }
+
+    json.endObject();
+    return json.length();
+}
+
+// Stores the numbers and booleans of the top level members into the fields
+// of the same key, values of unknown keys and nested ones are skipped.
+class FieldHandler : public JsonHandler
+{
+public:
+    FieldHandler(const payload_schema_t* schema, void* obj) :
+        _schema(schema),
+        _obj(obj)
+    { }
+
+    virtual bool onNumber(const char* key, size_t keyLen, uint8_t depth, int32_t i, float f, bool isFloat)
+    {
+        const payload_field_t*  field = depth == 1 ? PayloadCodec::field(_schema, key, keyLen) : NULL;
+
+        if (field)
+            PayloadCodec::set(field, _obj, i, f, isFloat);
+        return depth > 0;
+    }
+
+    virtual bool onBool(const char* key, size_t keyLen, uint8_t depth, bool value)
+    {
+        return onNumber(key, keyLen, depth, value, 0, false);
+    }
+
+    virtual bool onString(const char*, size_t, uint8_t depth, const char*, size_t)    { return depth > 0; }
+    virtual bool onNull(const char*, size_t, uint8_t depth)                            { return depth > 0; }
+    virtual bool onBegin(const char*, size_t, uint8_t depth, bool array)               { return depth > 1 || !array; }
+
+private:
+    const payload_schema_t* _schema;
+    void*                   _obj;
+};
+
+/**
+ * @brief   Reads the members of an object
+ * @note    Numbers and booleans are stored, strings, null, nested objects
+ *          and arrays skipped.
+ * @param
+ * @retval  false if malformed or not an object
+ */
+bool JsonCodec::decode(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj)
+{
+    FieldHandler    handler(schema, obj);
+
+    return JsonReader::parse((const char*)buf, len, handler);
+}
@@ -0,0 +1,98 @@
+/*
+ PayloadCodec.h - MQTT payloads encoded from and decoded into fixed structs.
+
+ A payload is described once by a schema, the list of its fields with
+ their key, type and offset in a plain struct. Three codecs turn such a
+ struct into bytes and back without allocating:
+
+    packedCodec     id byte, then the fields in schema order, little endian
+                    (uint8 1 byte, int32 and float 4 bytes)
+    cborCodec       CBOR map (RFC 7049) with the keys as text strings,
+                    integers as CBOR integers, floats as float32
+    jsonCodec       JSON object, e.g. {"red":255,"green":0,"blue":64}, read
+                    with JsonReader and written with JsonWriter
+
+ E.g. {"temp": 23.5} is 13 bytes as JSON, 11 as CBOR and 5 packed.
+
+ PayloadCodec::decodeAny() detects the codec from the first byte ('{' JSON,
+ 0xA0 - 0xBF CBOR map, PAYLOAD_ID_MAX or below a packed id), so a
+ subscriber understands every codec whatever the publisher uses. Keys not
+ in the schema are skipped, fields missing from the payload keep their
+ value.
+ */
+#ifndef PAYLOADCODEC_H
+#define PAYLOADCODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAYLOAD_UINT8           0
+#define PAYLOAD_INT32           1
+#define PAYLOAD_FLOAT           2
+
+#define PAYLOAD_ID_MAX          0x1F    // packed schema ids are 1 - 0x1F
+
+// { "temp", PAYLOAD_FLOAT, offsetof(adc_t, temp) }
+typedef struct
+{
+    const char*     key;
+    uint8_t         type;
+    uint16_t        offset;
+} payload_field_t;
+
+typedef struct
+{
+    uint8_t                 id;         // first byte of a packed payload
+    const payload_field_t*  fields;
+    uint8_t                 count;
+} payload_schema_t;
+
+class PayloadCodec
+{
+public:
+    virtual         ~PayloadCodec()    { }
+
+    // Returns the payload length or -1 if it does not fit into size.
+    virtual int     encode(const payload_schema_t* schema, const void* obj, uint8_t* buf, size_t size) = 0;
+
+    // Returns false if the payload is malformed or of another schema.
+    virtual bool    decode(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj) = 0;
+
+    // Decodes with the codec the payload was encoded with.
+    static bool     decodeAny(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj);
+    static PayloadCodec*    detect(const uint8_t* buf, size_t len);
+
+protected:
+    friend class    FieldHandler;
+
+    static const payload_field_t*   field(const payload_schema_t* schema, const char* key, size_t keyLen);
+    static void     set(const payload_field_t* field, void* obj, int32_t i, float f, bool isFloat);
+    static float    getFloat(const payload_field_t* field, const void* obj);
+    static int32_t  getInt(const payload_field_t* field, const void* obj);
+};
+
+class PackedCodec : public PayloadCodec
+{
+public:
+    virtual int     encode(const payload_schema_t* schema, const void* obj, uint8_t* buf, size_t size);
+    virtual bool    decode(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj);
+};
+
+class CborCodec : public PayloadCodec
+{
+public:
+    virtual int     encode(const payload_schema_t* schema, const void* obj, uint8_t* buf, size_t size);
+    virtual bool    decode(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj);
+};
+
+class JsonCodec : public PayloadCodec
+{
+public:
+    virtual int     encode(const payload_schema_t* schema, const void* obj, uint8_t* buf, size_t size);
+    virtual bool    decode(const payload_schema_t* schema, const uint8_t* buf, size_t len, void* obj);
+};
+
+extern PackedCodec  packedCodec;
+extern CborCodec    cborCodec;
+extern JsonCodec    jsonCodec;
+#endif
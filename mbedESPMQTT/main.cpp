@@ -32,7 +32,28 @@
 #include "MQTTmbed.h"
 #include "MQTTNetwork.h"
 #include "MQTTClient.h"
-#include "picojson.h"
+#include "PayloadCodec.h"
+#include "MqttQueue.h"
+
+//codec of the published adc values: packedCodec, cborCodec or jsonCodec
+#ifndef PAYLOAD_CODEC
+#define PAYLOAD_CODEC   packedCodec
+#endif
+
+#define SAMPLE_MS       10              //adc sampling period
+#define ADC_WINDOW_MS   1000            //coalescing window of adcVal, the latest sample is sent once per window
+#define ADC_QOS         0               //0 or 1, QoS 1 publishes are pipelined by the queue
+#define LED_QOS         MQTT::QOS1      //led commands are idempotent, QoS 1 is 2 packets instead of 4 for QoS 2
+#define BATCH_MAX       256             //bytes of PUBLISH packets written at once
+#define YIELD_MS        100             //longest wait for incoming packets between batches
+
+//outbound queue: topic, QoS and coalescing window of every published topic
+enum { TOPIC_ADC };
+static const mqtt_topic_policy_t topics[] = {
+    { "adcVal", ADC_QOS, ADC_WINDOW_MS }
+};
+MqttQueue outbox(topics, sizeof(topics) / sizeof(topics[0]));
+Thread sampler;
 
 //to comminucate with pc
 Serial pc(USBTX, USBRX);
@@ -49,52 +70,95 @@ PwmOut bluePin(PE_14);
 //analog input pin
 AnalogIn tempPin(A0);
 
-//MQTT callback for rgb led messages
+//payload structs, the schemas tell the codecs their keys, types and offsets
+typedef struct
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} rgb_t;
+
+typedef struct
+{
+    uint8_t led;
+} led_t;
+
+typedef struct
+{
+    float   temp;
+} adc_t;
+
+static const payload_field_t rgbFields[] = {
+    { "red",   PAYLOAD_UINT8, offsetof(rgb_t, red)   },
+    { "green", PAYLOAD_UINT8, offsetof(rgb_t, green) },
+    { "blue",  PAYLOAD_UINT8, offsetof(rgb_t, blue)  }
+};
+static const payload_field_t led1Fields[] = { { "led1", PAYLOAD_UINT8, offsetof(led_t, led) } };
+static const payload_field_t led2Fields[] = { { "led2", PAYLOAD_UINT8, offsetof(led_t, led) } };
+static const payload_field_t adcFields[]  = { { "temp", PAYLOAD_FLOAT, offsetof(adc_t, temp) } };
+
+static const payload_schema_t rgbSchema  = { 1, rgbFields,  3 };
+static const payload_schema_t led1Schema = { 2, led1Fields, 1 };
+static const payload_schema_t led2Schema = { 3, led2Fields, 1 };
+static const payload_schema_t adcSchema  = { 4, adcFields,  1 };
+
+//MQTT callback for rgb led messages, JSON, CBOR or packed
 void rgbLedMessage(MQTT::MessageData& md)
 {
     MQTT::Message &message = md.message;
-    picojson::value v;
-		char *msg = (char*)message.payload;				//get message as a char array
-	
-		string err = picojson::parse(v, msg, msg + message.payloadlen);			//parse JSON from char array
-		
-		//get red, green, blue value from JSON with key name
-    pc.printf("redVal =%f\r\n" ,  v.get("red").get<double>());
-    pc.printf("greenVal =%f\r\n" ,  v.get("green").get<double>());
-    pc.printf("blueVal =%f\r\n" ,  v.get("blue").get<double>());
+    rgb_t rgb = { 0, 0, 0 };
+
+		if(!PayloadCodec::decodeAny(&rgbSchema, (const uint8_t*)message.payload, message.payloadlen, &rgb))
+		{
+			pc.printf("bad rgbLed payload\r\n");
+			return;
+		}
+
+		//get red, green, blue value from payload
+    pc.printf("redVal =%d\r\n" ,  rgb.red);
+    pc.printf("greenVal =%d\r\n" ,  rgb.green);
+    pc.printf("blueVal =%d\r\n" ,  rgb.blue);
 	
 		//subtract all values from max value to use with common anode rgb led
-		redPin = 1.0 - (v.get("red").get<double>() / 255.0);
-		greenPin = 1.0 - (v.get("green").get<double>() / 255.0);
-		bluePin = 1.0 - (v.get("blue").get<double>() / 255.0);
+		redPin = 1.0f - rgb.red / 255.0f;
+		greenPin = 1.0f - rgb.green / 255.0f;
+		bluePin = 1.0f - rgb.blue / 255.0f;
 }
 
 void led1Message(MQTT::MessageData& md)
 {
     MQTT::Message &message = md.message;
-    picojson::value v;
-		char *msg = (char*)message.payload;
-	
-		string err = picojson::parse(v, msg, msg + message.payloadlen);
-	
-		float val = v.get("led1").get<double>();
-	
-		led1 = val == 1.0 ? 1 : 0;
+    led_t val = { 0 };
+
+		if(PayloadCodec::decodeAny(&led1Schema, (const uint8_t*)message.payload, message.payloadlen, &val))
+			led1 = val.led == 1 ? 1 : 0;
 }
 
 void led2Message(MQTT::MessageData& md)
 {
     MQTT::Message &message = md.message;
-    picojson::value v;
-		char *msg = (char*)message.payload;
-	
-		string err = picojson::parse(v, msg, msg + message.payloadlen);
+    led_t val = { 0 };
 
-		float val = v.get("led2").get<double>();
-	
-		led2 = val == 1.0 ? 1 : 0;
+		if(PayloadCodec::decodeAny(&led2Schema, (const uint8_t*)message.payload, message.payloadlen, &val))
+			led2 = val.led == 1 ? 1 : 0;
 }
 
+//sampling thread, posting to the queue never waits for the network
+void sampleAdc()
+{
+    uint8_t buf[MQTT_QUEUE_PAYLOAD_MAX];
+    adc_t adc;
+
+		while(true)
+		{
+			adc.temp = tempPin.read() * 40;											//read adc value and scale it between 0 - 40
+			int len = PAYLOAD_CODEC.encode(&adcSchema, &adc, buf, sizeof(buf));		//5 bytes packed, 11 CBOR, 13 - 16 JSON
+			
+			if(len > 0)
+				outbox.post(TOPIC_ADC, buf, len);							//replaces the queued sample within ADC_WINDOW_MS
+			Thread::wait(SAMPLE_MS);
+		}
+}
 
 int main(int argc, char* argv[])
 {
@@ -114,7 +178,9 @@ int main(int argc, char* argv[])
 
     MQTTNetwork mqttNetwork(network);
 
-    MQTT::Client<MQTTNetwork, Countdown> client(mqttNetwork);
+    MqttQueueNetwork<MQTTNetwork> queueNetwork(mqttNetwork, outbox);		//shows the PUBACKs to the queue
+
+    MQTT::Client<MqttQueueNetwork<MQTTNetwork>, Countdown> client(queueNetwork);
 
     const char* hostname = "broker.shiftr.io";								//mqtt broker name
     int port = 1883;																					//mqtt port number
@@ -135,51 +201,39 @@ int main(int argc, char* argv[])
         pc.printf("rc from MQTT connect is %d\r\n", rc);
 
 		//subscribe rgb led messages
-    if ((rc = client.subscribe("rgbLed", MQTT::QOS2, rgbLedMessage)) != 0)
+    if ((rc = client.subscribe("rgbLed", LED_QOS, rgbLedMessage)) != 0)
         pc.printf("rc from MQTT subscribe is %d\r\n", rc);
 
 		//subscribe led1 messages
-		if ((rc = client.subscribe("led1", MQTT::QOS2, led1Message)) != 0)
+		if ((rc = client.subscribe("led1", LED_QOS, led1Message)) != 0)
         pc.printf("rc from MQTT subscribe is %d\r\n", rc);
 		
 		//subscribe led2 messages
-		if ((rc = client.subscribe("led2", MQTT::QOS2, led2Message)) != 0)
+		if ((rc = client.subscribe("led2", LED_QOS, led2Message)) != 0)
         pc.printf("rc from MQTT subscribe is %d\r\n", rc);
 		
-		//define MQTT Message
-    MQTT::Message message;
-
-    // QoS 0 
-    char buf[100];
-    message.qos = MQTT::QOS0;
-    message.retained = false;
-    message.dup = false;
-
-		//json parser 
-    picojson::object  adcJson;
-		int cnt = 0;
+		sampler.start(sampleAdc);
+		
+		uint8_t batch[BATCH_MAX];
+		Timer stats;
+		stats.start();
 		
 		while(true)
 		{
-			if(cnt == 100)												//if 100 steps passed send message
+			size_t len = outbox.pack(batch, sizeof(batch));							//all due messages in one write, one AT+CIPSEND
+			if(len && (rc = queueNetwork.write(batch, len, 1000)) != (int)len)
+				pc.printf("rc from batch write is %d\r\n", rc);
+			
+			int wait = outbox.due();
+			client.yield(wait < 0 || wait > YIELD_MS ? YIELD_MS : wait > 0 ? wait : 1);		//receive PUBACKs and led messages until the next batch
+			
+			if(stats.read_ms() >= 10000)
 			{
-				double adcVal = tempPin.read() * 40;											//read adc value and scale it between 0 - 40
-				adcJson["temp"] = picojson::value(adcVal);                //save value with "temp" key to JSON
-				string msgStr = picojson::value(adcJson).serialize();			//convert JSON value to string
-				
-				sprintf(buf, "%s", msgStr.c_str());                       //convert string value to char array
-				message.payload = (void*)buf;															//add converted value to MQTT message
-				message.payloadlen = strlen(buf)+1;												//set MQTT message length
-				if((rc = client.publish("adcVal", message)) != 0)					//send message to "adcVal" topic
-				{
-					pc.printf("rc from MQTT subscribe is %d\r\n", rc);			
-				}
-				
-				cnt = 0;
+				pc.printf("queued %d, in flight %d, published %lu, acked %lu, coalesced %lu, dropped %lu\r\n",
+						outbox.queued(), outbox.inflight(), (unsigned long)outbox.published(), (unsigned long)outbox.acknowledged(),
+						(unsigned long)outbox.coalesced(), (unsigned long)outbox.dropped());
+				stats.reset();
 			}
-
-			cnt++;
-			Thread::wait(10);															//wait 10 ms between steps
 		}
 		
 		/*if ((rc = client.unsubscribe(topic)) != 0)
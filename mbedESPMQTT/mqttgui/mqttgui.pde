@@ -1,5 +1,7 @@
 import mqtt.*;
 import controlP5.*;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 
 ControlP5 cp5;
 MQTTClient client;
@@ -114,11 +116,25 @@ void SW2(boolean theFlag) {
   //println("a toggle2 event.");
 }
 
-//MQTT subscriber callback
+//MQTT subscriber callback, the board publishes packed, CBOR or JSON payloads
 void messageReceived(String topic, byte[] payload) {
-  println("new message: " + topic + " - " + new String(payload));
-  String dataStr = new String(payload);
-  JSONObject json = parseJSONObject(dataStr);
-  float val = json.getFloat("temp");
+  if (payload.length == 0) {
+    return;
+  }
+  float val;
+  int first = payload[0] & 0xFF;
+  if (first == 4 && payload.length == 5) {                              //packed: schema id 4, temp as float little endian
+    val = ByteBuffer.wrap(payload, 1, 4).order(ByteOrder.LITTLE_ENDIAN).getFloat();
+  } else if (first == 0xA1 && payload.length == 11 && (payload[6] & 0xFF) == 0xFA) {    //CBOR: {"temp": float32}
+    val = ByteBuffer.wrap(payload, 7, 4).getFloat();
+  } else {                                                              //JSON
+    String dataStr = new String(payload).trim();
+    println("new message: " + topic + " - " + dataStr);
+    JSONObject json = parseJSONObject(dataStr);
+    if (json == null) {
+      return;
+    }
+    val = json.getFloat("temp");
+  }
   myChart.push("tempVal", val);
 }
@@ -0,0 +1,47 @@
+/*
+ mbed.h - the part of the mbed API MqttQueue uses, for building it on a PC.
+ Mutex is a std::mutex, time is the monotonic clock of the host.
+ */
+#ifndef HOST_MBED_H
+#define HOST_MBED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <mutex>
+
+static inline uint64_t host_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+class Mutex
+{
+public:
+    void        lock()      { _mutex.lock(); }
+    void        unlock()    { _mutex.unlock(); }
+private:
+    std::mutex  _mutex;
+};
+
+class Timer
+{
+public:
+    Timer() : _start(0), _elapsed(0), _running(false) { }
+    void        start()     { if (!_running) { _start = host_now_us(); _running = true; } }
+    void        stop()      { _elapsed = read_high_resolution_us(); _running = false; }
+    void        reset()     { _elapsed = 0; _start = host_now_us(); }
+    uint64_t    read_high_resolution_us()   { return _elapsed + (_running ? host_now_us() - _start : 0); }
+    int         read_us()   { return read_high_resolution_us(); }
+    int         read_ms()   { return read_high_resolution_us() / 1000; }
+    float       read()      { return read_high_resolution_us() / 1e6f; }
+private:
+    uint64_t    _start;
+    uint64_t    _elapsed;
+    bool        _running;
+};
+#endif
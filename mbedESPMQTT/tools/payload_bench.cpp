@@ -0,0 +1,218 @@
+/*
+ payload_bench.cpp - Encode and decode time and wire size of the payload codecs.
+
+ Runs the rgbLed and adcVal payloads of the board through the packed, CBOR
+ and JSON codecs and prints the bytes each puts on the wire and the time
+ and heap allocations per encode and decode. Allocations are counted by
+ replacing malloc (glibc) or operator new (elsewhere). If picojson.h is on
+ the include path, the picojson parse and serialize the board used before
+ are measured as well.
+
+    P=../PayloadCodec
+    g++ -O2 -std=c++11 -I$P -o payload_bench payload_bench.cpp \
+        $P/PayloadCodec.cpp $P/JsonReader.cpp $P/JsonWriter.cpp
+    g++ -O2 -std=c++11 -I$P -I<picojson dir> -o payload_bench payload_bench.cpp \
+        $P/PayloadCodec.cpp $P/JsonReader.cpp $P/JsonWriter.cpp
+    ./payload_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <new>
+
+#include "PayloadCodec.h"
+
+#if defined(__has_include)
+#if __has_include("picojson.h")
+#include "picojson.h"
+#define HAVE_PICOJSON
+#endif
+#endif
+
+typedef struct
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} rgb_t;
+
+typedef struct
+{
+    float   temp;
+} adc_t;
+
+static const payload_field_t rgbFields[] = {
+    { "red",   PAYLOAD_UINT8, offsetof(rgb_t, red)   },
+    { "green", PAYLOAD_UINT8, offsetof(rgb_t, green) },
+    { "blue",  PAYLOAD_UINT8, offsetof(rgb_t, blue)  }
+};
+static const payload_field_t adcFields[] = { { "temp", PAYLOAD_FLOAT, offsetof(adc_t, temp) } };
+
+static const payload_schema_t rgbSchema = { 1, rgbFields, 3 };
+static const payload_schema_t adcSchema = { 4, adcFields, 1 };
+
+static volatile uint32_t    sink;   // keeps the optimizer from dropping the loops
+static volatile size_t      allocations;
+
+#ifdef __GLIBC__
+extern "C" void*    __libc_malloc(size_t size);
+extern "C" void*    __libc_calloc(size_t count, size_t size);
+extern "C" void*    __libc_realloc(void* ptr, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+#else
+void* operator new(size_t size)
+{
+    void*   p = malloc(size);
+
+    allocations++;
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+#endif
+
+static double nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(const char* name, PayloadCodec& codec, const payload_schema_t* schema, const void* obj, void* out, size_t objSize, int iterations)
+{
+    uint8_t buf[64];
+    int     len = codec.encode(schema, obj, buf, sizeof(buf));
+    double  start;
+    double  encodeNs;
+    double  decodeNs;
+    size_t  encodeAllocs;
+    size_t  decodeAllocs;
+
+    if (len < 0) {
+        printf("%-8s encode failed\n", name);
+        return;
+    }
+
+    encodeAllocs = allocations;
+    start = nowNs();
+    for (int i = 0; i < iterations; i++)
+        sink += codec.encode(schema, obj, buf, sizeof(buf));
+    encodeNs = (nowNs() - start) / iterations;
+    encodeAllocs = allocations - encodeAllocs;
+
+    decodeAllocs = allocations;
+    start = nowNs();
+    for (int i = 0; i < iterations; i++)
+        sink += PayloadCodec::decodeAny(schema, buf, len, out);
+    decodeNs = (nowNs() - start) / iterations;
+    decodeAllocs = allocations - decodeAllocs;
+
+    printf("%-8s %3d bytes  encode %7.1f ns %5.1f allocs  decode %7.1f ns %5.1f allocs  %s\n",
+           name, len, encodeNs, (double)encodeAllocs / iterations, decodeNs, (double)decodeAllocs / iterations,
+           memcmp(obj, out, objSize) == 0 ? "ok" : "MISMATCH");
+}
+
+#ifdef HAVE_PICOJSON
+static void benchPicojson(const char* name, const char* text, const char* key, int iterations)
+{
+    size_t  len = strlen(text) + 1;     // the board sent the terminating zero
+    double  start;
+    double  encodeNs;
+    double  decodeNs;
+    size_t  encodeAllocs;
+    size_t  decodeAllocs;
+
+    decodeAllocs = allocations;
+    start = nowNs();
+    for (int i = 0; i < iterations; i++) {
+        picojson::value v;
+
+        picojson::parse(v, text, text + len - 1);
+        sink += (uint32_t)v.get(key).get<double>();
+    }
+    decodeNs = (nowNs() - start) / iterations;
+    decodeAllocs = allocations - decodeAllocs;
+
+    picojson::value v;
+
+    picojson::parse(v, text, text + len - 1);
+    encodeAllocs = allocations;
+    start = nowNs();
+    for (int i = 0; i < iterations; i++)
+        sink += v.serialize().size();
+    encodeNs = (nowNs() - start) / iterations;
+    encodeAllocs = allocations - encodeAllocs;
+
+    printf("%-8s %3d bytes  encode %7.1f ns %5.1f allocs  decode %7.1f ns %5.1f allocs\n",
+           name, (int)len, encodeNs, (double)encodeAllocs / iterations, decodeNs, (double)decodeAllocs / iterations);
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    int     iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    rgb_t   rgb = { 255, 128, 7 };
+    rgb_t   rgbOut;
+    adc_t   adc = { 23.5f };
+    adc_t   adcOut;
+
+    if (iterations < 1) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("rgbLed {\"red\":255,\"green\":128,\"blue\":7}\n");
+    bench("packed", packedCodec, &rgbSchema, &rgb, &rgbOut, sizeof(rgb), iterations);
+    bench("cbor", cborCodec, &rgbSchema, &rgb, &rgbOut, sizeof(rgb), iterations);
+    bench("json", jsonCodec, &rgbSchema, &rgb, &rgbOut, sizeof(rgb), iterations);
+#ifdef HAVE_PICOJSON
+    benchPicojson("picojson", "{\"red\":255,\"green\":128,\"blue\":7}", "red", iterations);
+#endif
+
+    printf("\nadcVal {\"temp\":23.5}\n");
+    bench("packed", packedCodec, &adcSchema, &adc, &adcOut, sizeof(adc), iterations);
+    bench("cbor", cborCodec, &adcSchema, &adc, &adcOut, sizeof(adc), iterations);
+    bench("json", jsonCodec, &adcSchema, &adc, &adcOut, sizeof(adc), iterations);
+#ifdef HAVE_PICOJSON
+    benchPicojson("picojson", "{\"temp\":23.5}", "temp", iterations);
+#else
+    printf("\npicojson.h not found, add its directory with -I to compare\n");
+#endif
+
+    return 0;
+}
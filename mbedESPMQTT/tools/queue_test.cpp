@@ -0,0 +1,442 @@
+/*
+ queue_test.cpp - MqttQueue against a local MQTT broker, run on a PC.
+
+ Builds MqttQueue.cpp unchanged on top of host/mbed.h, where Mutex is a
+ std::mutex, and drives it the way main.cpp does: a sampling thread posts
+ every SAMPLE_MS, the connection thread writes each pack() to a POSIX TCP
+ socket and reads the broker's answers through MqttQueueNetwork.
+
+ Without arguments the test runs its own broker on a loopback port. It
+ answers CONNECT and PINGREQ, acknowledges QoS 1 publishes ACK_DELAY_MS
+ later, as a broker across a network would, and counts what it receives.
+ Two runs:
+
+    pipelined   for RUN_MS adcVal is posted every SAMPLE_MS (QoS 0, window
+                ADC_WINDOW_MS, as in main.cpp) and a QoS 1 topic every
+                QOS1_MS. Every QoS 1 message must be acknowledged, more
+                than one must be in flight at a time and adcVal must go out
+                once per window. post() does not wake the connection
+                thread, so it reads for at most YIELD_MS: waiting main.cpp's
+                100 ms would queue 5 QoS 1 messages on top of the 4 in
+                flight, more than MQTT_QUEUE_SLOTS.
+    no acks     the broker holds back the PUBACKs. The messages must be
+                resent with DUP after MQTT_QUEUE_RETRY_MS and acknowledged
+                when the broker answers again.
+
+ Given a host and port the pipelined run goes to that broker instead, e.g.
+ mosquitto, which acknowledges at once. The no acks run needs the built-in
+ broker and is skipped.
+
+    Q=../MqttQueue
+    g++ -std=c++11 -pthread -Ihost -I$Q -o queue_test queue_test.cpp $Q/MqttQueue.cpp
+    ./queue_test
+    ./queue_test 127.0.0.1 1883
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MqttQueue.h"
+
+#define RUN_MS          5000
+#define SAMPLE_MS       10
+#define ADC_WINDOW_MS   1000
+#define QOS1_MS         20          // 50 messages per second
+#define ACK_DELAY_MS    50
+#define BATCH_MAX       256
+#define YIELD_MS        10          // main.cpp waits up to 100 ms, enough for adcVal alone
+#define NO_ACKS         3           // QoS 1 messages posted in the no acks run
+
+enum { TOPIC_ADC, TOPIC_QOS1 };
+
+static const mqtt_topic_policy_t    topics[] = {
+    { "adcVal", 0, ADC_WINDOW_MS },
+    { "queue_test/qos1", 1, 0 }
+};
+
+static int  failures;
+
+// The connection: a TCP socket with the read and write of MQTTNetwork
+struct Socket
+{
+    int fd;
+
+    int read(unsigned char* buffer, int len, int timeout)
+    {
+        struct pollfd   p = { fd, POLLIN, 0 };
+
+        if (poll(&p, 1, timeout) <= 0)
+            return 0;
+        return recv(fd, buffer, len, 0);
+    }
+
+    int write(unsigned char* buffer, int len, int)
+    {
+        return send(fd, buffer, len, MSG_NOSIGNAL);
+    }
+};
+
+// Test broker: one client at a time, QoS 0 and 1, no subscriptions
+class Broker
+{
+public:
+    std::atomic<bool>   holdAcks;
+    std::atomic<int>    publishes[2];   // by topic
+    std::atomic<int>    dups;
+    std::atomic<int>    acked;
+
+    Broker() :
+        holdAcks(false),
+        dups(0),
+        acked(0),
+        _fd(socket(AF_INET, SOCK_STREAM, 0))
+    {
+        struct sockaddr_in  a = { };
+        socklen_t           len = sizeof(a);
+
+        publishes[0] = publishes[1] = 0;
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_fd, (struct sockaddr*)&a, sizeof(a));
+        listen(_fd, 1);
+        getsockname(_fd, (struct sockaddr*)&a, &len);
+        _port = ntohs(a.sin_port);
+    }
+
+    ~Broker()   { close(_fd); }
+
+    int     port()  { return _port; }
+
+    // Serves the next client until it disconnects
+    void serve()
+    {
+        int                     fd = accept(_fd, NULL, NULL);
+        std::vector<uint8_t>    rx;
+        std::vector<Ack>        acks;
+        Timer                   t;
+        bool                    connected = true;
+
+        t.start();
+        while (connected) {
+            uint8_t         buf[512];
+            struct pollfd   p = { fd, POLLIN, 0 };
+            int             len;
+
+            if (poll(&p, 1, 1) > 0) {
+                if ((len = recv(fd, buf, sizeof(buf), 0)) <= 0)
+                    break;
+                rx.insert(rx.end(), buf, buf + len);
+            }
+
+            for (size_t used; (used = packet(fd, rx, acks, t.read_ms(), connected)) != 0;)
+                rx.erase(rx.begin(), rx.begin() + used);
+
+            for (size_t i = 0; i < acks.size();) {
+                if (holdAcks || t.read_ms() < acks[i].due) {
+                    i++;
+                    continue;
+                }
+
+                uint8_t puback[4] = { 0x40, 2, (uint8_t)(acks[i].id >> 8), (uint8_t)acks[i].id };
+
+                send(fd, puback, sizeof(puback), MSG_NOSIGNAL);
+                acked++;
+                acks.erase(acks.begin() + i);
+            }
+        }
+
+        close(fd);
+    }
+private:
+    struct Ack
+    {
+        uint16_t    id;
+        int         due;
+    };
+
+    int _fd;
+    int _port;
+
+    // Handles the first complete packet of rx, returns its length or 0
+    size_t packet(int fd, const std::vector<uint8_t>& rx, std::vector<Ack>& acks, int now, bool& connected)
+    {
+        size_t  length = 0;
+        size_t  pos = 1;
+
+        for (int shift = 0;; shift += 7) {
+            if (pos >= rx.size())
+                return 0;
+            length |= (rx[pos] & 0x7f) << shift;
+            if (!(rx[pos++] & 0x80))
+                break;
+        }
+
+        if (rx.size() < pos + length)
+            return 0;
+
+        const uint8_t*  body = &rx[pos];
+
+        switch (rx[0] >> 4) {
+        case 1:                         // CONNECT
+            {
+                uint8_t connack[4] = { 0x20, 2, 0, 0 };
+
+                send(fd, connack, sizeof(connack), MSG_NOSIGNAL);
+            }
+            break;
+
+        case 3:                         // PUBLISH
+            {
+                size_t      topicLen = body[0] << 8 | body[1];
+                std::string topic((const char*)body + 2, topicLen);
+
+                for (int i = 0; i < 2; i++)
+                    publishes[i] += topic == topics[i].topic;
+                dups += (rx[0] & 0x08) != 0;
+                if (rx[0] & 0x06) {
+                    Ack ack = { (uint16_t)(body[2 + topicLen] << 8 | body[3 + topicLen]), now + ACK_DELAY_MS };
+
+                    acks.push_back(ack);
+                }
+            }
+            break;
+
+        case 12:                        // PINGREQ
+            {
+                uint8_t pingresp[2] = { 0xd0, 0 };
+
+                send(fd, pingresp, sizeof(pingresp), MSG_NOSIGNAL);
+            }
+            break;
+
+        case 14:                        // DISCONNECT
+            connected = false;
+            break;
+        }
+
+        return pos + length;
+    }
+};
+
+static bool connectBroker(Socket& net, const char* host, int port)
+{
+    struct sockaddr_in  a = { };
+    unsigned char       connect[] = { 0x10, 22, 0, 4, 'M', 'Q', 'T', 'T', 4, 2, 0, 60, 0, 10, 'q', 'u', 'e', 'u', 'e', '_', 't', 'e', 's', 't' };
+    unsigned char       connack[4];
+
+    net.fd = socket(AF_INET, SOCK_STREAM, 0);
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &a.sin_addr) != 1 || ::connect(net.fd, (struct sockaddr*)&a, sizeof(a)) != 0) {
+        perror(host);
+        close(net.fd);
+        return false;
+    }
+
+    net.write(connect, sizeof(connect), 1000);
+    if (net.read(connack, sizeof(connack), 1000) != 4 || connack[0] != 0x20 || connack[3] != 0) {
+        printf("%s: no CONNACK\n", host);
+        close(net.fd);
+        return false;
+    }
+
+    return true;
+}
+
+static void disconnectBroker(Socket& net)
+{
+    unsigned char   disconnect[2] = { 0xe0, 0 };
+
+    net.write(disconnect, sizeof(disconnect), 1000);
+    close(net.fd);
+}
+
+// main.cpp's connection loop: one write per batch, read until the next one
+static void runConnection(MqttQueueNetwork<Socket>& network, MqttQueue& outbox, int& writes, int& maxInflight)
+{
+    uint8_t batch[BATCH_MAX];
+    uint8_t rx[64];
+    size_t  len = outbox.pack(batch, sizeof(batch));
+    int     wait = outbox.due();
+
+    if (len) {
+        network.write(batch, len, 1000);
+        writes++;
+    }
+
+    maxInflight = std::max(maxInflight, (int)outbox.inflight());
+    network.read(rx, sizeof(rx), wait < 0 || wait > YIELD_MS ? YIELD_MS : wait > 0 ? wait : 1);
+}
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+static void pipelined(const char* host, int port, Broker* broker)
+{
+    MqttQueue                   outbox(topics, 2);
+    Socket                      net;
+    MqttQueueNetwork<Socket>    network(net, outbox);
+    std::atomic<bool>           sampling(true);
+    int                         adcPosted = 0;
+    int                         qos1Posted = 0;
+    int                         refused = 0;
+    int                         worstPostUs = 0;
+    int                         writes = 0;
+    int                         maxInflight = 0;
+    Timer                       run;
+
+    printf("\npipelined, %s:%d", host, port);
+    if (broker)
+        printf(", test broker acknowledging after %d ms", ACK_DELAY_MS);
+    printf("\n");
+    if (!connectBroker(net, host, port)) {
+        failures++;
+        return;
+    }
+
+    // the sampling thread of main.cpp, plus the QoS 1 topic
+    std::thread sampler
+        (
+            [&]()
+            {
+                uint32_t    n = 0;
+                Timer       post;
+                Timer       clock;
+
+                post.start();
+                clock.start();
+                for (int tick = 0; sampling && tick < RUN_MS / SAMPLE_MS; tick++) {
+                    post.reset();
+                    refused += !outbox.post(TOPIC_ADC, &n, sizeof(n));
+                    adcPosted++;
+                    if (tick % (QOS1_MS / SAMPLE_MS) == 0) {
+                        refused += !outbox.post(TOPIC_QOS1, &n, sizeof(n));
+                        qos1Posted++;
+                    }
+
+                    worstPostUs = std::max(worstPostUs, post.read_us());
+                    n++;
+
+                    // on a fixed grid, a late sample does not delay the next ones
+                    int             ms = (tick + 1) * SAMPLE_MS - clock.read_ms();
+                    struct timespec ts = { 0, std::max(ms, 0) * 1000000L };
+
+                    nanosleep(&ts, NULL);
+                }
+            }
+        );
+
+    run.start();
+    while (run.read_ms() < RUN_MS || outbox.queued() || outbox.inflight()) {
+        if (run.read_ms() >= RUN_MS && sampling) {
+            sampling = false;
+            sampler.join();
+        }
+
+        if (run.read_ms() > RUN_MS + 2 * MQTT_QUEUE_RETRY_MS)
+            break;
+        runConnection(network, outbox, writes, maxInflight);
+    }
+
+    if (sampling) {
+        sampling = false;
+        sampler.join();
+    }
+
+    disconnectBroker(net);
+
+    int adcPublished = adcPosted - outbox.coalesced();
+
+    printf("  %-40s %d, %lu acknowledged\n", "QoS 1 posted", qos1Posted, (unsigned long)outbox.acknowledged());
+    printf("  %-40s %d, %d published\n", "adcVal posted", adcPosted, adcPublished);
+    printf("  %-40s %lu in %d writes\n", "publishes", (unsigned long)outbox.published(), writes);
+    printf("  %-40s %d of %d\n", "most in flight", maxInflight, MQTT_QUEUE_INFLIGHT);
+    printf("  %-40s %d us\n", "slowest post()", worstPostUs);
+    printf("  %-40s %d refused, %lu resent\n", "posts", refused, (unsigned long)outbox.retried());
+    check(refused == 0 && outbox.dropped() == 0, "every post() taken");
+    check((int)outbox.acknowledged() == qos1Posted, "every QoS 1 message acknowledged");
+    check(adcPublished <= RUN_MS / ADC_WINDOW_MS + 1, "adcVal coalesced to one publish per window");
+    if (broker) {
+        // the broker acknowledges after ACK_DELAY_MS, a QOS1_MS stream keeps several waiting
+        check(maxInflight > 1 && maxInflight <= MQTT_QUEUE_INFLIGHT, "QoS 1 publishes pipelined");
+        check(broker->publishes[TOPIC_ADC] == adcPublished && broker->publishes[TOPIC_QOS1] == qos1Posted, "broker received every publish");
+    }
+}
+
+static void noAcks(Broker& broker)
+{
+    MqttQueue                   outbox(topics, 2);
+    Socket                      net;
+    MqttQueueNetwork<Socket>    network(net, outbox);
+    int                         writes = 0;
+    int                         maxInflight = 0;
+    uint32_t                    n = 0;
+    Timer                       run;
+
+    printf("\nno acks, resent after %d ms\n", MQTT_QUEUE_RETRY_MS);
+    if (!connectBroker(net, "127.0.0.1", broker.port())) {
+        failures++;
+        return;
+    }
+
+    broker.holdAcks = true;
+    for (int i = 0; i < NO_ACKS; i++, n++)
+        outbox.post(TOPIC_QOS1, &n, sizeof(n));
+
+    run.start();
+    while (run.read_ms() < MQTT_QUEUE_RETRY_MS + 1000)
+        runConnection(network, outbox, writes, maxInflight);
+
+    uint32_t    retried = outbox.retried();
+    uint32_t    ackedEarly = outbox.acknowledged();
+
+    broker.holdAcks = false;
+    run.reset();
+    while (outbox.inflight() && run.read_ms() < 1000)
+        runConnection(network, outbox, writes, maxInflight);
+    disconnectBroker(net);
+
+    printf("  %-40s %lu, %d with DUP at the broker\n", "resent", (unsigned long)retried, (int)broker.dups);
+    printf("  %-40s %lu\n", "acknowledged", (unsigned long)outbox.acknowledged());
+    check(ackedEarly == 0 && retried == NO_ACKS && broker.dups == NO_ACKS, "unacknowledged messages resent with DUP");
+    check(outbox.acknowledged() == NO_ACKS && outbox.inflight() == 0, "acknowledged once the broker answers");
+}
+
+int main(int argc, char* argv[])
+{
+    printf
+        (
+            "MqttQueue: %d slots, %d in flight, QoS 1 resent after %d ms\n",
+            MQTT_QUEUE_SLOTS, MQTT_QUEUE_INFLIGHT, MQTT_QUEUE_RETRY_MS
+        );
+
+    if (argc >= 3) {
+        pipelined(argv[1], atoi(argv[2]), NULL);
+    }
+    else {
+        Broker      broker;
+        std::thread server([&]() { broker.serve(); broker.serve(); });
+
+        pipelined("127.0.0.1", broker.port(), &broker);
+        broker.dups = 0;
+        noAcks(broker);
+        server.join();
+    }
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+/*
+ EspAt.cpp - ESP8266 AT command engine with a command queue.
+ */
+#include "EspAt.h"
+#include <stdio.h>
+#include <string.h>
+
+#if (ESPAT_RX_SIZE & (ESPAT_RX_SIZE - 1)) != 0
+#error "ESPAT_RX_SIZE must be a power of 2"
+#endif
+
+/**
+ * @brief
+ * @note
+ * @param   write Writes bytes to the module
+ * @retval
+ */
+EspAt::EspAt(at_write_t write, void* writeCtx) :
+    _write(write),
+    _writeCtx(writeCtx),
+    _ctx(NULL),
+    _onData(NULL),
+    _onUrc(NULL),
+    _head(0),
+    _count(0),
+    _state(IDLE),
+    _started(0),
+    _rxHead(0),
+    _rxTail(0),
+    _lineLen(0),
+    _ipdLink(0),
+    _ipdLeft(0),
+    _completed(0),
+    _failed(0),
+    _timeouts(0),
+    _overruns(0)
+{ }
+
+/**
+ * @brief   Queues a command
+ * @note
+ * @param   cmd Without \r\n, copied
+ * @param   done Line (prefix) completing the command instead of OK, must
+ *          stay valid, NULL for OK
+ * @retval  false if the queue is full or cmd too long
+ */
+bool EspAt::command(const char* cmd, uint32_t timeoutMs, at_callback_t callback, const char* done)
+{
+    size_t  len = strlen(cmd);
+
+    if (_count == ESPAT_QUEUE || len > ESPAT_CMD_MAX)
+        return false;
+
+    command_t*  c = &_queue[(_head + _count) % ESPAT_QUEUE];
+
+    memcpy(c->text, cmd, len + 1);
+    c->done = done;
+    c->data = NULL;
+    c->len = 0;
+    c->timeout = timeoutMs;
+    c->callback = callback;
+    _count++;
+    return true;
+}
+
+/**
+ * @brief   Queues AT+CIPSEND with its data
+ * @note    The data is written when the > prompt arrives.
+ * @param   link Connection id, < 0 in single connection mode
+ * @param   data Must stay valid until the callback
+ * @retval  false if the queue is full
+ */
+bool EspAt::send(int link, const uint8_t* data, size_t len, uint32_t timeoutMs, at_callback_t callback)
+{
+    char    cmd[32];
+
+    if (link < 0)
+        snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%u", (unsigned)len);
+    else
+        snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%d,%u", link, (unsigned)len);
+
+    if (!command(cmd, timeoutMs, callback))
+        return false;
+
+    command_t*  c = &_queue[(_head + _count - 1) % ESPAT_QUEUE];
+
+    c->data = data;
+    c->len = len;
+    return true;
+}
+
+/**
+ * @brief   Stores a received byte
+ * @note    Serial interrupt context. Bytes are lost if poll() is not
+ *          called often enough to keep ESPAT_RX_SIZE free.
+ * @param
+ * @retval
+ */
+void EspAt::feed(uint8_t c)
+{
+    uint16_t    next = (_rxHead + 1) & (ESPAT_RX_SIZE - 1);
+
+    if (next == _rxTail) {
+        _overruns++;
+        return;
+    }
+
+    _rx[_rxHead] = c;
+    _rxHead = next;
+}
+
+/**
+ * @brief   Tokenizes the received bytes, runs the queue
+ * @note    Callbacks are called from here.
+ * @param   now Milliseconds
+ * @retval
+ */
+void EspAt::poll(uint32_t now)
+{
+    uint16_t    head = _rxHead;
+    uint16_t    tail = _rxTail;
+
+    while (tail != head) {
+        if (_ipdLeft) {
+            // +IPD data goes to the handler in place, as long as it is contiguous
+            size_t  n = (head > tail ? head : ESPAT_RX_SIZE) - tail;
+
+            if (n > _ipdLeft)
+                n = _ipdLeft;
+            if (_onData)
+                _onData(_ipdLink, &_rx[tail], n, _ctx);
+            _ipdLeft -= n;
+            tail = (tail + n) & (ESPAT_RX_SIZE - 1);
+        }
+        else {
+            uint8_t c = _rx[tail];
+
+            tail = (tail + 1) & (ESPAT_RX_SIZE - 1);
+            _token(c);
+        }
+
+        _rxTail = tail;
+    }
+
+    if (_state != IDLE && now - _started >= _queue[_head].timeout) {
+        _timeouts++;
+        _finish(AT_TIMEOUT, "");
+    }
+
+    if (_state == IDLE && _count)
+        _start(now);
+}
+
+/**
+ * @brief   Writes the next command
+ * @note
+ * @param
+ * @retval
+ */
+void EspAt::_start(uint32_t now)
+{
+    command_t*  c = &_queue[_head];
+
+    _write((const uint8_t*)c->text, strlen(c->text), _writeCtx);
+    _write((const uint8_t*)"\r\n", 2, _writeCtx);
+    _state = c->data ? WAIT_PROMPT : WAIT_RESULT;
+    _started = now;
+}
+
+/**
+ * @brief   Completes the running command
+ * @note    It is removed first, so the callback may queue the next one.
+ * @param
+ * @retval
+ */
+void EspAt::_finish(uint8_t event, const char* line)
+{
+    at_callback_t   callback = _queue[_head].callback;
+
+    _head = (_head + 1) % ESPAT_QUEUE;
+    _count--;
+    _state = IDLE;
+
+    if (event == AT_OK)
+        _completed++;
+    else
+    if (event == AT_ERROR)
+        _failed++;
+
+    if (callback)
+        callback(event, line, _ctx);
+}
+
+/**
+ * @brief   Adds a byte to the current line
+ * @note
+ * @param
+ * @retval
+ */
+void EspAt::_token(uint8_t c)
+{
+    if (c == '\n') {
+        _lineDone();
+        return;
+    }
+
+    if (c == '\r' || (c == ' ' && !_lineLen))
+        return;
+
+    if (_lineLen < ESPAT_LINE_MAX)
+        _line[_lineLen++] = c;
+
+    if (c == ':' && _ipdHeader()) {
+        _lineLen = 0;
+        return;
+    }
+
+    if (c == '>' && _lineLen == 1 && _state == WAIT_PROMPT) {
+        command_t*  cmd = &_queue[_head];
+
+        _lineLen = 0;
+        _state = WAIT_SENT;
+        _write(cmd->data, cmd->len, _writeCtx);
+    }
+}
+
+/**
+ * @brief   Parses +IPD,<link>,<len>: or +IPD,<len>: up to the colon
+ * @note    Further fields (AT+CIPDINFO=1) are ignored.
+ * @param
+ * @retval  true if the line is an +IPD header
+ */
+bool EspAt::_ipdHeader()
+{
+    uint32_t    values[2] = { 0, 0 };
+    uint8_t     count = 0;
+
+    if (_lineLen < 7 || strncmp(_line, "+IPD,", 5) != 0)
+        return false;
+
+    for (uint16_t i = 5; i < _lineLen && count < 2; i++) {
+        char    c = _line[i];
+
+        if (c >= '0' && c <= '9')
+            values[count] = values[count] * 10 + (c - '0');
+        else {
+            count++;
+            if (c != ',')
+                break;
+        }
+    }
+
+    if (count == 1) {
+        _ipdLink = 0;
+        _ipdLeft = values[0];
+    }
+    else {
+        _ipdLink = values[0];
+        _ipdLeft = values[1];
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Tells if a line is unsolicited even while a command runs
+ * @note    0,CONNECT, 0,CLOSED, WIFI GOT IP, busy p...
+ * @param
+ * @retval
+ */
+static bool unsolicited(const char* line)
+{
+    if (line[0] >= '0' && line[0] <= '9' && line[1] == ',')
+        return strncmp(line + 2, "CONNECT", 7) == 0 || strncmp(line + 2, "CLOSED", 6) == 0;
+
+    return strncmp(line, "WIFI ", 5) == 0 || strncmp(line, "busy ", 5) == 0;
+}
+
+/**
+ * @brief   Handles a complete line
+ * @note
+ * @param
+ * @retval
+ */
+void EspAt::_lineDone()
+{
+    _line[_lineLen] = '\0';
+    if (!_lineLen)
+        return;
+    _lineLen = 0;
+
+    if (_state == IDLE || unsolicited(_line)) {
+        if (_onUrc)
+            _onUrc(_line, _ctx);
+        return;
+    }
+
+    command_t*  cmd = &_queue[_head];
+
+    if (strcmp(_line, "ERROR") == 0 || strcmp(_line, "FAIL") == 0 || strcmp(_line, "SEND FAIL") == 0) {
+        _finish(AT_ERROR, _line);
+        return;
+    }
+
+    if (_state == WAIT_RESULT) {
+        if (cmd->done ? strncmp(_line, cmd->done, strlen(cmd->done)) == 0 : strcmp(_line, "OK") == 0) {
+            _finish(AT_OK, _line);
+            return;
+        }
+    }
+    else
+    if (_state == WAIT_SENT && strcmp(_line, "SEND OK") == 0) {
+        _finish(AT_OK, _line);
+        return;
+    }
+
+    if (cmd->callback)
+        cmd->callback(AT_LINE, _line, _ctx);
+}
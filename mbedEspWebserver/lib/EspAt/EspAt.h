@@ -0,0 +1,148 @@
+/*
+ EspAt.h - ESP8266 AT command engine with a command queue.
+
+ Commands are queued with their own timeout and a completion callback and
+ sent one after the other; nothing blocks and no fixed delays are needed.
+ The bytes received from the module are fed in from the serial interrupt
+ (feed(), into a ring buffer) and tokenized by poll() in the main loop:
+
+    OK, SEND OK, ready...   final line, completes the command with AT_OK
+    ERROR, FAIL, SEND FAIL  completes the command with AT_ERROR
+    >                       data prompt of AT+CIPSEND, the data is written
+    +IPD,<link>,<len>:      incoming data, passed on in chunks as it arrives
+    anything else           AT_LINE to the running command (e.g. +CIFSR:...)
+                            or to the unsolicited line handler (0,CONNECT,
+                            WIFI GOT IP, ...) when no command runs
+
+ The engine knows no hardware: bytes are written through a callback and the
+ time is passed to poll(), so it runs on mbed, HAL or a host.
+
+    EspAt   esp(espWrite, &serial);
+
+    esp.command("AT+CWJAP_CUR=\"ssid\",\"pass\"", 20000, onJoined);
+    esp.send(0, page, pageLen, 5000, onSent);   // AT+CIPSEND=0,<len>, data after >
+    while (true)
+        esp.poll(timer.read_ms());
+ */
+#ifndef ESPAT_H
+#define ESPAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef ESPAT_RX_SIZE
+#define ESPAT_RX_SIZE       512     // ring between feed() and poll(), power of 2
+#endif
+
+#ifndef ESPAT_LINE_MAX
+#define ESPAT_LINE_MAX      128     // longer lines are truncated
+#endif
+
+#ifndef ESPAT_QUEUE
+#define ESPAT_QUEUE         8       // queued commands
+#endif
+
+#ifndef ESPAT_CMD_MAX
+#define ESPAT_CMD_MAX       96      // command text, without \r\n
+#endif
+
+#ifndef ESPAT_TIMEOUT_MS
+#define ESPAT_TIMEOUT_MS    2000    // default per command timeout
+#endif
+
+enum
+{
+    AT_LINE,                        // response line of the running command, not final
+    AT_OK,
+    AT_ERROR,
+    AT_TIMEOUT
+};
+
+// event is one of the AT_ values, line the response line (empty on timeout);
+// the line is only valid during the call
+typedef void (*at_callback_t)(uint8_t event, const char* line, void* ctx);
+typedef void (*at_write_t)(const uint8_t* data, size_t len, void* ctx);
+typedef void (*at_data_t)(uint8_t link, const uint8_t* data, size_t len, void* ctx);
+typedef void (*at_urc_t)(const char* line, void* ctx);
+
+class EspAt
+{
+public:
+    EspAt(at_write_t write, void* writeCtx);
+
+    void            setContext(void* ctx)           { _ctx = ctx; }
+    void            onData(at_data_t handler)       { _onData = handler; }
+    void            onUnsolicited(at_urc_t handler) { _onUrc = handler; }
+
+    // Queue a command. done is a line that completes it with AT_OK besides
+    // OK, e.g. "ready" for AT+RST. Returns false if the queue is full or
+    // the command longer than ESPAT_CMD_MAX.
+    bool            command(const char* cmd, uint32_t timeoutMs = ESPAT_TIMEOUT_MS, at_callback_t callback = NULL, const char* done = NULL);
+
+    // Queue AT+CIPSEND=<link>,<len> (link < 0 for single connection mode)
+    // and write data at the > prompt; completes on SEND OK. data must stay
+    // valid until the callback.
+    bool            send(int link, const uint8_t* data, size_t len, uint32_t timeoutMs = ESPAT_TIMEOUT_MS, at_callback_t callback = NULL);
+
+    // Serial receive interrupt: one received byte.
+    void            feed(uint8_t c);
+
+    // Main loop: tokenizes the received bytes, sends the next command,
+    // times out the running one. now in milliseconds, may wrap.
+    void            poll(uint32_t now);
+
+    bool            idle()                          { return _count == 0; }
+    uint8_t         pending()                       { return _count; }
+
+    uint32_t        completed()                     { return _completed; }
+    uint32_t        failed()                        { return _failed; }     // ERROR, FAIL
+    uint32_t        timeouts()                      { return _timeouts; }
+    uint32_t        overruns()                      { return _overruns; }   // bytes lost, ring full
+private:
+    enum
+    {
+        IDLE,
+        WAIT_RESULT,                // command sent, waiting for its final line
+        WAIT_PROMPT,                // AT+CIPSEND sent, waiting for >
+        WAIT_SENT                   // data written, waiting for SEND OK
+    };
+
+    typedef struct
+    {
+        char            text[ESPAT_CMD_MAX + 1];
+        const char*     done;
+        const uint8_t*  data;       // AT+CIPSEND payload, NULL for others
+        size_t          len;
+        uint32_t        timeout;
+        at_callback_t   callback;
+    } command_t;
+
+    at_write_t          _write;
+    void*               _writeCtx;
+    void*               _ctx;
+    at_data_t           _onData;
+    at_urc_t            _onUrc;
+    command_t           _queue[ESPAT_QUEUE];
+    uint8_t             _head;      // running or next command
+    uint8_t             _count;
+    uint8_t             _state;
+    uint32_t            _started;
+    uint8_t             _rx[ESPAT_RX_SIZE];
+    volatile uint16_t   _rxHead;    // written by feed()
+    volatile uint16_t   _rxTail;    // read by poll()
+    char                _line[ESPAT_LINE_MAX + 1];
+    uint16_t            _lineLen;
+    uint8_t             _ipdLink;
+    size_t              _ipdLeft;   // +IPD bytes still to come
+    uint32_t            _completed;
+    uint32_t            _failed;
+    uint32_t            _timeouts;
+    volatile uint32_t   _overruns;
+
+    void                _start(uint32_t now);
+    void                _finish(uint8_t event, const char* line);
+    void                _token(uint8_t c);
+    void                _lineDone();
+    bool                _ipdHeader();
+};
+#endif
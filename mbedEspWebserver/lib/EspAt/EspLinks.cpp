@@ -0,0 +1,178 @@
+/*
+ EspLinks.cpp - per connection receive rings for the ESP8266 in AT+CIPMUX=1 mode.
+ */
+#include "EspLinks.h"
+#include <string.h>
+
+#if (ESPLINK_RX_SIZE & (ESPLINK_RX_SIZE - 1)) != 0
+#error "ESPLINK_RX_SIZE must be a power of 2"
+#endif
+
+#define MASK    (ESPLINK_RX_SIZE - 1)
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval
+ */
+EspLinks::EspLinks() :
+    _overruns(0)
+{
+    memset(_head, 0, sizeof(_head));
+    memset(_tail, 0, sizeof(_tail));
+    memset(_connected, 0, sizeof(_connected));
+}
+
+/**
+ * @brief   EspAt data handler
+ * @note
+ * @param   ctx EspLinks
+ * @retval
+ */
+void EspLinks::onData(uint8_t link, const uint8_t* data, size_t len, void* ctx)
+{
+    ((EspLinks*)ctx)->write(link, data, len);
+}
+
+/**
+ * @brief   Follows n,CONNECT and n,CLOSED
+ * @note    A new connection starts with an empty ring.
+ * @param
+ * @retval  true if the line was one of them
+ */
+bool EspLinks::unsolicited(const char* line)
+{
+    uint8_t link = line[0] - '0';
+
+    if (link >= ESPLINK_COUNT || line[1] != ',')
+        return false;
+
+    if (strcmp(line + 2, "CONNECT") == 0) {
+        clear(link);                    // left over from the previous connection
+        _connected[link] = true;
+    }
+    else
+    if (strcmp(line + 2, "CLOSED") == 0 || strcmp(line + 2, "CONNECT FAIL") == 0)
+        _connected[link] = false;       // what it sent can still be read
+    else
+        return false;
+
+    return true;
+}
+
+/**
+ * @brief   Appends received data to the ring of its link
+ * @note    At most two copies, whatever the length.
+ * @param
+ * @retval  Bytes stored, the rest is dropped
+ */
+size_t EspLinks::write(uint8_t link, const uint8_t* data, size_t len)
+{
+    if (link >= ESPLINK_COUNT) {
+        _overruns += len;
+        return 0;
+    }
+
+    uint16_t    head = _head[link];
+    size_t      space = (_tail[link] - head - 1) & MASK;
+
+    if (len > space) {
+        _overruns += len - space;
+        len = space;
+    }
+
+    size_t  first = ESPLINK_RX_SIZE - head;
+
+    if (first > len)
+        first = len;
+    memcpy(&_rx[link][head], data, first);
+    memcpy(&_rx[link][0], data + first, len - first);
+    _head[link] = (head + len) & MASK;
+    return len;
+}
+
+/**
+ * @brief
+ * @note
+ * @param
+ * @retval  Buffered bytes of the link
+ */
+size_t EspLinks::available(uint8_t link)
+{
+    if (link >= ESPLINK_COUNT)
+        return 0;
+
+    return (_head[link] - _tail[link]) & MASK;
+}
+
+/**
+ * @brief   Takes buffered bytes
+ * @note
+ * @param
+ * @retval  Bytes copied to buf
+ */
+size_t EspLinks::read(uint8_t link, uint8_t* buf, size_t size)
+{
+    size_t  len = available(link);
+
+    if (len > size)
+        len = size;
+    if (!len)
+        return 0;
+
+    uint16_t    tail = _tail[link];
+    size_t      first = ESPLINK_RX_SIZE - tail;
+
+    if (first > len)
+        first = len;
+    memcpy(buf, &_rx[link][tail], first);
+    memcpy(buf + first, &_rx[link][0], len - first);
+    _tail[link] = (tail + len) & MASK;
+    return len;
+}
+
+/**
+ * @brief   Takes a line
+ * @note    \r and \n are removed, the rest beyond size - 1 is dropped.
+ * @param
+ * @retval  Line length, -1 if none is complete
+ */
+int EspLinks::readLine(uint8_t link, char* buf, size_t size)
+{
+    size_t  len = available(link);
+    size_t  end;
+
+    for (end = 0; end < len; end++) {
+        if (_rx[link][(_tail[link] + end) & MASK] == '\n')
+            break;
+    }
+
+    if (end == len && len < ESPLINK_RX_SIZE - 1)
+        return -1;
+
+    size_t  n = 0;
+
+    for (size_t i = 0; i < end; i++) {
+        uint8_t c = _rx[link][(_tail[link] + i) & MASK];
+
+        if (c != '\r' && n < size - 1)
+            buf[n++] = c;
+    }
+    buf[n] = '\0';
+
+    _tail[link] = (_tail[link] + end + (end < len)) & MASK;
+    return n;
+}
+
+/**
+ * @brief   Drops the buffered bytes of a link
+ * @note
+ * @param
+ * @retval
+ */
+void EspLinks::clear(uint8_t link)
+{
+    if (link < ESPLINK_COUNT)
+        _tail[link] = _head[link];
+}
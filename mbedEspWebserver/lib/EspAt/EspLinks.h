@@ -0,0 +1,68 @@
+/*
+ EspLinks.h - per connection receive rings for the ESP8266 in AT+CIPMUX=1 mode.
+
+ EspAt parses the +IPD,<link>,<len>: headers as the bytes come in and
+ passes the data that follows in place; EspLinks copies it into one ring per
+ link id, so data of concurrent clients never mixes and reading one link
+ does not throw away what another one sent. A full ring drops the bytes of
+ its own link only.
+
+    EspLinks    links;
+
+    esp.setContext(&links);
+    esp.onData(EspLinks::onData);
+    ...
+    if (links.readLine(0, line, sizeof(line)) >= 0)     // request line of link 0
+
+ n,CONNECT and n,CLOSED must be passed to unsolicited() so a new connection
+ does not see the rest of the previous one.
+ */
+#ifndef ESPLINKS_H
+#define ESPLINKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef ESPLINK_COUNT
+#define ESPLINK_COUNT       5       // link ids 0..4
+#endif
+
+#ifndef ESPLINK_RX_SIZE
+#define ESPLINK_RX_SIZE     256     // per link, power of 2
+#endif
+
+class EspLinks
+{
+public:
+    EspLinks();
+
+    // EspAt data handler, ctx is the EspLinks.
+    static void     onData(uint8_t link, const uint8_t* data, size_t len, void* ctx);
+
+    // Follows n,CONNECT (clears the ring of the link) and n,CLOSED. Returns
+    // false for other lines.
+    bool            unsolicited(const char* line);
+
+    // Appends received data, returns the bytes stored.
+    size_t          write(uint8_t link, const uint8_t* data, size_t len);
+
+    size_t          available(uint8_t link);
+    size_t          read(uint8_t link, uint8_t* buf, size_t size);
+
+    // Takes a line without \r\n, truncated to size - 1. Returns its length
+    // or -1 if no complete line is buffered. A line filling the whole ring
+    // is returned as it is.
+    int             readLine(uint8_t link, char* buf, size_t size);
+
+    void            clear(uint8_t link);
+    bool            connected(uint8_t link)     { return link < ESPLINK_COUNT && _connected[link]; }
+
+    uint32_t        overruns()                  { return _overruns; }   // bytes dropped, ring full
+private:
+    uint8_t         _rx[ESPLINK_COUNT][ESPLINK_RX_SIZE];
+    uint16_t        _head[ESPLINK_COUNT];
+    uint16_t        _tail[ESPLINK_COUNT];
+    bool            _connected[ESPLINK_COUNT];
+    uint32_t        _overruns;
+};
+#endif
@@ -1,97 +1,111 @@
 #include <mbed.h>
-#include <string> 
-#include <sstream>
-//#include "ESP8266.h"
+#include "EspAt.h"
+#include "EspLinks.h"
 
-#define DEBUG 
-#define BUFFER_SIZE 1024
-#define OK "OK"
+#define DEBUG
+#define REQUEST_SIZE 256
+#define PAGE_SIZE 1024
 
 #define MY_WIFI_SSID "YOUR_SSID"
 #define MY_WIFI_PASS "YOUR_PSWD"
 
 //variables
-char rxBuff[BUFFER_SIZE], oldBUffer[BUFFER_SIZE];//array to store data received from esp
-unsigned int bufferWritingIndex=0;//write pointer
+bool answered[ESPLINK_COUNT];   //request line of the link handled, the rest is skipped
+char page[PAGE_SIZE];           //homepage being sent, valid until SEND OK
+bool pageBusy = false;
 char serverIp[16];
+unsigned int initStep = 0;
 
 //constructors
 DigitalOut led1(D13);
 AnalogOut led2(A2);
 
 Serial pc(USBTX, USBRX);
-Serial esp(D8,D2);//TX,RX TO BE CONNECTED TO ESP
+RawSerial espSerial(D8,D2);//TX,RX TO BE CONNECTED TO ESP, RawSerial: read from the interrupt
+Timer timer;
 
 //function prototype
 void espRxInterrupt();
+void espWrite(const uint8_t *data, size_t len, void *ctx);
+void espUnsolicited(const char *line, void *ctx);
+void initDone(uint8_t event, const char *line, void *ctx);
+void ipDone(uint8_t event, const char *line, void *ctx);
+void pageSent(uint8_t event, const char *line, void *ctx);
 void debugPrintf(const char *msg);
-bool isWifiConnected();
-bool readEspResponse(const char *key);
-void sendHomepage(char ch_id);
+void sendHomepage(int ch_id);
 void hadleHttpRequests();
-void flush_fifo(void);
-const std::string intToString(int p_val);
-void printIpAdress();
+void handleRequest(int link, char *request);
 
+EspAt esp(espWrite, NULL);
+EspLinks links;                 //+IPD data of every connection in its own ring
 
-int main() {
-    // put your setup code here, to run once:
-
-    led1 = 0;
+//start up commands, queued as the queue has room; no fixed delays, every
+//command is sent when the previous one answered
+typedef struct
+{
+    const char *cmd;
+    uint32_t timeout;
+    const char *done;           //final line other than OK
+} init_cmd_t;
 
-    pc.baud(115200);                            //bilgisayar ile haberleşme hıız
-    esp.baud(115200);                           //esp ile haberleşme hızı
-    
-    esp.attach(&espRxInterrupt, Serial::RxIrq);
+char joinCmd[96];
 
-    debugPrintf("Application starting...");
+const init_cmd_t initCmds[] = {
+    { "AT+RST", 5000, "ready" },            //completes when the firmware is up again
+    { "ATE0", ESPAT_TIMEOUT_MS, NULL },     //disable ECHO
+    { "AT+CWMODE_CUR=1", ESPAT_TIMEOUT_MS, NULL },  //station mode
+    { "AT+CWLAP", 10000, NULL },            //find wifi networks
+    { joinCmd, 20000, NULL },               //AT+CWJAP_CUR
+    { "AT+CIPMUX=1", ESPAT_TIMEOUT_MS, NULL },      //enable multiple connections
+    { "AT+CIPSERVER=1,80", ESPAT_TIMEOUT_MS, NULL },    //start server at port 80
+    { "AT+CIPSTO=10", ESPAT_TIMEOUT_MS, NULL },     //Server timeout=10 seconds
+};
 
-    esp.printf("AT+RST\r\n");        //wait after this command because firmares respons can be diferent
-    wait(3);        //wait for 3 seconds
-    debugPrintf("RESET");    
+#define INIT_COUNT (sizeof(initCmds) / sizeof(initCmds[0]))
 
-    esp.printf("ATE0\r\n");         //disable ECHO
-    while(readEspResponse("OK"));
 
-    esp.printf("AT+CWMODE_CUR=1\r\n");  //only softAp mode
-    while(readEspResponse("OK"));
-    
-    esp.printf("AT+CWLAP\r\n");     //find wifi networks
-    while(readEspResponse("OK"));   
+int main() {
+    // put your setup code here, to run once:
 
-    esp.printf("AT+CWJAP_CUR=\"%s\",\"%s\"\r\n", MY_WIFI_SSID, MY_WIFI_PASS);
-    while(readEspResponse("OK")); 
+    led1 = 0;
 
-    esp.printf("AT+CIPMUX=1\r\n");      //enable multiple connections
-    while(readEspResponse("OK"));
+    pc.baud(115200);                            //bilgisayar ile haberleşme hıız
+    espSerial.baud(115200);                     //esp ile haberleşme hızı
 
-    esp.printf("AT+CIPSERVER=1,80\r\n");        //start server at port 80
-    while(readEspResponse("OK"));
-    
-    esp.printf("AT+CIPSTO=10\r\n");     //Server timeout=10 seconds
-    while(readEspResponse("OK"));
+    esp.setContext(&links);
+    esp.onData(EspLinks::onData);
+    esp.onUnsolicited(espUnsolicited);
+    espSerial.attach(&espRxInterrupt, RawSerial::RxIrq);
+    timer.start();
 
-    printIpAdress();                //print Ip adress to serial terminal
+    debugPrintf("Application starting...");
 
-    debugPrintf("Server READY");
+    snprintf(joinCmd, sizeof(joinCmd), "AT+CWJAP_CUR=\"%s\",\"%s\"", MY_WIFI_SSID, MY_WIFI_PASS);
 
     while(1) {
         // put your main code here, to run repeatedly:
-        
+
+        //queue the start up commands, the ip adress last
+        while(initStep < INIT_COUNT && esp.command(initCmds[initStep].cmd, initCmds[initStep].timeout, initDone, initCmds[initStep].done))
+            initStep++;
+        if(initStep == INIT_COUNT && esp.command("AT+CIFSR", ESPAT_TIMEOUT_MS, ipDone))
+            initStep++;
+
+        esp.poll(timer.read_ms());
         hadleHttpRequests();
-        wait(0.1);
     }
 }
 
 //esp8266 rx interrupt funciton
 void espRxInterrupt(){
-    if(esp.readable())
-    {
-        rxBuff[bufferWritingIndex++]=esp.getc();            //save values to arr
-        //pc.printf("%c", rxBuff[bufferWritingIndex - 1]);
-        if(bufferWritingIndex>=BUFFER_SIZE)                 //if buffer fill overwrite array from start index
-            bufferWritingIndex=0;
-    }
+    while(espSerial.readable())
+        esp.feed(espSerial.getc());         //save values to the ring of the engine
+}
+
+void espWrite(const uint8_t *data, size_t len, void *ctx)
+{
+    for(size_t i = 0; i < len; i++)
+        espSerial.putc(data[i]);
 }
 
 void debugPrintf(const char *msg)
@@ -99,208 +113,131 @@ void debugPrintf(const char *msg)
     pc.printf("%s\n\r", msg);
 }
 
-//returns false when found key
-bool readEspResponse(const char *key)
+void initDone(uint8_t event, const char *line, void *ctx)
 {
-    char *ret;
-
-    ret = strstr(rxBuff, key);
-
-    //pc.printf("rxbuff: %s %s\n",key, rxBuff);
-
-    if(ret)
-    {
-        pc.printf("%s\n", rxBuff);
-        memcpy(oldBUffer, rxBuff, BUFFER_SIZE);
-        memset(&rxBuff[0], 0, BUFFER_SIZE);
-        bufferWritingIndex = 0;
-        return false;
-    }else{
-        return true;
-    }
+    if(event == AT_LINE)
+        pc.printf("%s\n", line);            //e.g. networks of AT+CWLAP
+    else if(event != AT_OK)
+        pc.printf("start up command failed (%d): %s\n", event, line);
 }
 
-unsigned int bufferReadingIndex_IpdSearch = 0;
-
-void hadleHttpRequests()
+//+CIFSR:STAIP,"192.168.1.42"
+void ipDone(uint8_t event, const char *line, void *ctx)
 {
-    char ipdBuff[256];
-
-    //get ipd string from last buffer
-    while(bufferReadingIndex_IpdSearch != bufferWritingIndex)
+    if(event == AT_LINE)
     {
-        if(rxBuff[bufferReadingIndex_IpdSearch] == '+')
+        if(strncmp(line, "+CIFSR:STAIP,\"", 14) == 0)
         {
-            for(int i = 0; i < 256; i++)
-            {
-                if(rxBuff[bufferReadingIndex_IpdSearch + i] == 0x0D)
-                    break;
-                ipdBuff[i] = rxBuff[bufferReadingIndex_IpdSearch + i];
-            }
-            break;
+            const char *end = strchr(line + 14, '"');
+            int len = end ? end - (line + 14) : 0;
+
+            if(len >= (int)sizeof(serverIp))
+                len = sizeof(serverIp) - 1;
+            memcpy(serverIp, line + 14, len);
+            serverIp[len] = '\0';
         }
-        bufferReadingIndex_IpdSearch++;
+        return;
     }
-    
-    if(strncmp(ipdBuff, "+IPD,", 5) == 0)       //if +IPD, is in start of the array
-    {
-        pc.printf("buff: %s\n", ipdBuff);
-
-        char requestType[20];
-        char request[50];
-        char linkId;
-        int ipdLen;
 
-        //get connection ID, len, request type and request from buffer array
-        sscanf(ipdBuff + 5, "%c,%d:%s %s", &linkId, &ipdLen, requestType, request);
+    pc.printf("Ip Adress: %s\r\n", serverIp);
+    debugPrintf("Server READY");
+}
 
-        //after parsing value clear buffer
-        flush_fifo();
+//connection events, wifi state
+void espUnsolicited(const char *line, void *ctx)
+{
+    if(links.unsolicited(line) && strstr(line, ",CONNECT"))
+        answered[line[0] - '0'] = false;    //new client on this link
 
-        //check pwm request
-        if(strncmp(request, "/?pwmVal", 8) == 0)
-        {
-            int pwmVal = 0;
-            char *ptr;
+    pc.printf("%s\n", line);
+}
 
-            //get integer value from request
-            ptr = std::strtok(request, "=");
-            ptr = std::strtok(NULL, "=");
+//one request per connection (Connection: close): the first line of every
+//link is answered, the rest of its request is skipped
+void hadleHttpRequests()
+{
+    char line[REQUEST_SIZE];
 
-            pwmVal = atoi(ptr);                 //convert string value to integer
+    for(int link = 0; link < ESPLINK_COUNT; link++)
+    {
+        //the page buffer is in use, the request waits in the ring of its link
+        if(!answered[link] && pageBusy)
+            continue;
 
-            led2.write((double)pwmVal / 255.0);         //write led pin to pwm value
-            
-            pc.printf("\nPWM val: %d %f\n", pwmVal, ((double)pwmVal / 255.0));
-            
-            sendHomepage(linkId);           //refresh homepage
-        
-        }else if(strcmp(request, "/?led") == 0) //check led request
+        while(links.readLine(link, line, sizeof(line)) >= 0)
         {
-            led1 = !led1;               //toggle led status
-            sendHomepage(linkId);       //refresh homepage
-        }else{                          //else send homepage again
-            sendHomepage(linkId);
-        }
+            if(answered[link])
+                continue;               //headers of an answered request
 
+            answered[link] = true;
+            handleRequest(link, line);
+            break;
+        }
     }
 }
 
-void sendHomepage(char ch_id)           //homepage
+void handleRequest(int link, char *request)
 {
-    std::string Header;        //http header
-
-    Header =  "HTTP/1.1 200 OK\r\n";
-    Header += "Content-Type: text/html\r\n";
-    Header += "Connection: close\r\n";
-
-    std::string Content;     //Web page content
-    Content = "<center><h1>Hello World!</h1></center><hr><center><h2>Oguzhan Baser</h2></center><hr>Led Durumu: ";
-    //Content += intToString(led1.read());
-    Content += (led1.read() == 1) ? "Yandi" : "Sondu";
-    Content += "<br><a href=\"/?led\"><input type=\"button\" value=\"Led Durum\"></a>";
-    Content += "<br><input type=\"text\" name=\"pwmVal\" id=\"pwmVal\">";
-    Content += "<input type=\"submit\" name=\"btnPWM\" value=\"PWM Ayarla\" onclick=\"location.href='?pwmVal='+document.getElementById('pwmVal').value;\" id=\"btnPWM\" class=\"btnPWM\"/>";
-
-    Header += "Content-Length: ";
-    Header += (int)(Content.length());
-    Header += "\r\n\r\n";
-
-    esp.printf("AT+CIPSEND=%c,%d\r\n", ch_id, Header.length() + Content.length());      //send web page length
-    wait(0.5);
-    int cc = 0;
-    
-    //while(readEspResponse(">")) wait_ms(10);
-    while(rxBuff[cc++] != '>') wait_ms(10);     // wait until '>' character
-
-    //send web page header and content
-    for(int i = 0; i < Header.length(); i++)
-    {
-        esp.putc(Header.at(i));
-    }
-    for(int i = 0; i < Content.length(); i++)
-    {
-        esp.putc(Content.at(i));
-    }
+    pc.printf("request: %s\n", request);
 
-    while(readEspResponse("OK"));       //wait until OK response
+    char requestType[20];
+    char path[50] = "";
 
-}
+    //get request type and request from the request line
+    sscanf(request, "%19s %49s", requestType, path);
 
+    //check pwm request
+    if(strncmp(path, "/?pwmVal", 8) == 0)
+    {
+        int pwmVal = 0;
+        char *ptr;
 
-//not used
-bool isWifiConnected()
-{
-    bool retVal = 0;
+        //get integer value from request
+        ptr = std::strtok(path, "=");
+        ptr = std::strtok(NULL, "=");
 
-    esp.printf("AT+CIFSR\r\n");
+        if(ptr)
+            pwmVal = atoi(ptr);                 //convert string value to integer
 
-    std::string ss(rxBuff);
+        led2.write((double)pwmVal / 255.0);         //write led pin to pwm value
 
-    int val1 = ss.find(":STAIP,");
-    int val2 = ss.find("\"", val1 + 1);
+        pc.printf("\nPWM val: %d %f\n", pwmVal, ((double)pwmVal / 255.0));
 
-    //pc.printf("vals: %s %d %d\n", ss, val1, val2);
+    }else if(strcmp(path, "/?led") == 0) //check led request
+    {
+        led1 = !led1;               //toggle led status
+    }
 
-    return retVal;
+    sendHomepage(link);             //refresh homepage
 }
 
-//clear rx buffer
-void flush_fifo(void) 
+void sendHomepage(int ch_id)           //homepage
 {
-    while (esp.readable()) {
-        (void)esp.getc();
-    }
-    
-    memset(&rxBuff[0], 0, BUFFER_SIZE);
-    bufferWritingIndex = 0;
-    bufferReadingIndex_IpdSearch = 0;
+    static const char header[] =        //http header
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/html\r\n"
+        "Connection: close\r\n"
+        "Content-Length: %d\r\n\r\n";
+    static const char content[] =       //Web page content
+        "<center><h1>Hello World!</h1></center><hr><center><h2>Oguzhan Baser</h2></center><hr>Led Durumu: %s"
+        "<br><a href=\"/?led\"><input type=\"button\" value=\"Led Durum\"></a>"
+        "<br><input type=\"text\" name=\"pwmVal\" id=\"pwmVal\">"
+        "<input type=\"submit\" name=\"btnPWM\" value=\"PWM Ayarla\" onclick=\"location.href='?pwmVal='+document.getElementById('pwmVal').value;\" id=\"btnPWM\" class=\"btnPWM\"/>";
+
+    const char *state = (led1.read() == 1) ? "Yandi" : "Sondu";
+    int contentLen = sizeof(content) - 1 - 2 + strlen(state);
+    int len = snprintf(page, PAGE_SIZE, header, contentLen);
+
+    len += snprintf(page + len, PAGE_SIZE - len, content, state);
+
+    //AT+CIPSEND=<id>,<len>, the page is written at the > prompt
+    if(esp.send(ch_id, (const uint8_t *)page, len, 5000, pageSent))
+        pageBusy = true;
 }
 
-const std::string intToString(int p_val)
+void pageSent(uint8_t event, const char *line, void *ctx)
 {
-    std::stringstream ssc;
-    ssc << p_val;
-    return ssc.str();
+    pageBusy = false;
+    if(event != AT_OK)
+        pc.printf("page not sent (%d): %s\n", event, line);
 }
-
-void printIpAdress()
-{
-    esp.printf("AT+CIFSR\r\n");
-    while(readEspResponse("OK"));
-
-    bool validIp = false;
-    while(!validIp)
-    {
-        if(strstr(oldBUffer, "0.0.0.0") == NULL)
-        {
-            validIp = true;
-        }
-    }
-    int index1, index2;
-
-    for(int i = 0; i < BUFFER_SIZE; i++)
-    {
-        if(oldBUffer[i] == ',')
-        {
-            index1 = i;
-        }
-
-        if(oldBUffer[i] == '\r')
-        {
-            index2 = i;
-            break;
-        }
-    }
-
-    char IpArr[20];
-    int cnt = 0;
-    for(int i = index1 + 1; i < index2 ; i++)
-    {
-        IpArr[cnt++] = oldBUffer[i];
-    }
-
-    IpArr[cnt] = '\0';
-
-    pc.printf("Ip Adress: %s\r\n", IpArr);
-}
\ No newline at end of file
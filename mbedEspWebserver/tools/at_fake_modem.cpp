@@ -0,0 +1,332 @@
+/*
+ at_fake_modem.cpp - EspAt against a scripted fake ESP8266 on the host.
+
+ The fake modem answers every command line after a scripted delay, streams
+ its answers at 115200 baud (11.5 bytes per millisecond) into
+ EspAt::feed() and runs on a simulated millisecond clock, so the results
+ do not depend on the host. Prints the latency of every command from
+ writing it to its callback and compares the sequences with the fixed
+ delays the projects used before (wait(3) after AT+RST, HAL_Delay(2000),
+ HAL_Delay(3000) and HAL_Delay(1000) around AT+CIPSTART and AT+CIPSEND).
+ Also checks +IPD data split over the ring buffer end, unsolicited lines
+ during a command, ERROR and timeouts.
+
+    g++ -O2 -std=c++11 -I../lib/EspAt -o at_fake_modem at_fake_modem.cpp ../lib/EspAt/EspAt.cpp
+    ./at_fake_modem
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "EspAt.h"
+
+#define BYTES_PER_MS    11.52       // 115200 baud, 10 bits per byte
+
+typedef struct
+{
+    const char*     prefix;         // command line prefix
+    uint32_t        delayMs;        // until the answer starts
+    const char*     answer;
+} script_t;
+
+// Answers of a real module, delays as measured on one (join depends on the AP).
+static const script_t script[] = {
+    { "AT+RST",         5,      "\r\nOK\r\n\x02\x8a garbage at 74880 baud\r\n\r\nready\r\n" },
+    { "AT+RST",         350,    NULL },         // ready comes after the boot
+    { "ATE0",           2,      "ATE0\r\n\r\nOK\r\n" },
+    { "AT+CWMODE_CUR",  2,      "\r\nOK\r\n" },
+    { "AT+CWJAP_CUR",   2100,   "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n" },
+    { "AT+CIPMUX",      2,      "\r\nOK\r\n" },
+    { "AT+CIPSERVER",   3,      "\r\nOK\r\n" },
+    { "AT+CIPSTO",      2,      "\r\nOK\r\n" },
+    { "AT+CIFSR",       4,      "+CIFSR:STAIP,\"192.168.1.42\"\r\n+CIFSR:STAMAC,\"5c:cf:7f:00:00:01\"\r\n\r\nOK\r\n" },
+    { "AT+CIPSTART",    180,    "CONNECT\r\n\r\nOK\r\n" },
+    { "AT+CIPSEND",     2,      "\r\nOK\r\n> " },
+    { "AT+CIPCLOSE",    10,     "0,CLOSED\r\n\r\nOK\r\n" },
+    { "AT+BAD",         2,      "\r\nERROR\r\n" },
+    { "AT+MUTE",        0,      NULL },         // never answers
+    { "AT",             2,      "\r\nOK\r\n" },
+};
+
+class FakeModem
+{
+public:
+    EspAt*      esp;
+    uint32_t    now;
+    double      wire;               // time the last queued byte is on the wire
+    uint32_t    sendLeft;           // AT+CIPSEND data still to come
+
+    FakeModem() : esp(NULL), now(0), wire(0), sendLeft(0) { }
+
+    // Queues text to arrive after delayMs, behind what is already on the wire.
+    void answer(const std::string& text, uint32_t delayMs)
+    {
+        double  t = now + delayMs;
+
+        if (t < wire)
+            t = wire;
+        for (size_t i = 0; i < text.size(); i++) {
+            _out.push_back(std::make_pair(t, (uint8_t)text[i]));
+            t += 1 / BYTES_PER_MS;
+        }
+        wire = t;
+    }
+
+    // Bytes written by EspAt.
+    void receive(const uint8_t* data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++) {
+            if (sendLeft) {
+                if (--sendLeft == 0) {
+                    char    text[48];
+
+                    snprintf(text, sizeof(text), "\r\nRecv %u bytes\r\n\r\nSEND OK\r\n", _sendLen);
+                    answer(text, 15);
+                }
+                continue;
+            }
+
+            if (data[i] != '\n') {
+                if (data[i] != '\r')
+                    _cmd += (char)data[i];
+                continue;
+            }
+
+            _command(_cmd);
+            _cmd.clear();
+        }
+    }
+
+    // Feeds the bytes that arrived until now, one poll per millisecond.
+    void step()
+    {
+        size_t  i = 0;
+
+        for (; i < _out.size() && _out[i].first <= now; i++)
+            esp->feed(_out[i].second);
+        _out.erase(_out.begin(), _out.begin() + i);
+        esp->poll(now);
+        now++;
+    }
+
+    bool quiet()    { return _out.empty(); }
+private:
+    std::vector<std::pair<double, uint8_t> >    _out;
+    std::string                                 _cmd;
+    unsigned                                    _sendLen;
+
+    void _command(const std::string& cmd)
+    {
+        bool    first = true;
+
+        for (size_t i = 0; i < sizeof(script) / sizeof(script[0]); i++) {
+            const script_t* s = &script[i];
+
+            if (cmd.compare(0, strlen(s->prefix), s->prefix) != 0)
+                continue;
+
+            if (!s->answer)
+                return;
+
+            if (strcmp(s->prefix, "AT+RST") == 0) {
+                // OK at once, ready after the boot time of the next entry
+                std::string text(s->answer);
+                size_t      ready = text.find("\r\nready");
+
+                answer(text.substr(0, ready), s->delayMs);
+                answer(text.substr(ready), script[i + 1].delayMs);
+                return;
+            }
+
+            if (strcmp(s->prefix, "AT+CIPSEND") == 0) {
+                size_t  comma = cmd.rfind(',');
+
+                _sendLen = atoi(cmd.c_str() + (comma == std::string::npos ? cmd.find('=') : comma) + 1);
+                sendLeft = _sendLen;
+            }
+
+            if (first)
+                answer(s->answer, s->delayMs);
+            first = false;
+        }
+    }
+};
+
+static FakeModem    modem;
+static int          failures;
+
+static void modemWrite(const uint8_t* data, size_t len, void*)
+{
+    modem.receive(data, len);
+}
+
+typedef struct
+{
+    const char*     name;
+    uint32_t        sent;
+    int32_t         latency;        // -1 until the callback
+    uint8_t         event;
+    std::string     lines;
+} result_t;
+
+static std::vector<result_t>    results;
+static std::string              received[2];
+static std::string              urcs;
+
+static void onData(uint8_t link, const uint8_t* data, size_t len, void*)
+{
+    if (link < 2)
+        received[link].append((const char*)data, len);
+}
+
+static void onUrc(const char* line, void*)
+{
+    urcs += line;
+    urcs += '|';
+}
+
+// Commands complete in order, results[current] is the running one.
+static size_t   current;
+
+static void onDone(uint8_t event, const char* line, void* ctx)
+{
+    result_t*   r = &results[current];
+
+    (void)ctx;
+    if (event == AT_LINE) {
+        r->lines += line;
+        r->lines += '|';
+        return;
+    }
+
+    r->latency = modem.now - r->sent;
+    r->event = event;
+    if (++current < results.size())
+        results[current].sent = modem.now;  // the next one is written in the same poll()
+}
+
+static void queue(EspAt& esp, const char* cmd, uint32_t timeout = ESPAT_TIMEOUT_MS, const char* done = NULL)
+{
+    result_t    r = { cmd, modem.now, -1, 0, "" };
+
+    results.push_back(r);
+    esp.command(cmd, timeout, onDone, done);
+}
+
+// Runs until the queue is empty and the modem quiet.
+static uint32_t run(EspAt& esp, uint32_t limitMs)
+{
+    uint32_t    start = modem.now;
+
+    while (modem.now - start < limitMs) {
+        modem.step();
+        if (esp.idle() && modem.quiet())
+            break;
+    }
+
+    return modem.now - start;
+}
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+static void report(size_t from, const char* title, uint32_t total, uint32_t fixed)
+{
+    printf("\n%s\n", title);
+    for (size_t i = from; i < results.size(); i++) {
+        const result_t* r = &results[i];
+        static const char* events[] = { "line", "OK", "ERROR", "TIMEOUT" };
+
+        printf("  %-40s %6d ms  %s\n", r->name, (int)r->latency, r->latency < 0 ? "-" : events[r->event]);
+    }
+    printf("  total %u ms", (unsigned)total);
+    if (fixed)
+        printf(", %u ms with the fixed delays", (unsigned)fixed);
+    printf("\n");
+}
+
+int main()
+{
+    EspAt   esp(modemWrite, NULL);
+    size_t  from;
+
+    modem.esp = &esp;
+    esp.onData(onData);
+    esp.onUnsolicited(onUrc);
+
+    // mbedEspWebserver start up; before: wait(3) after AT+RST, then polling for OK
+    from = results.size();
+    queue(esp, "AT+RST", 5000, "ready");
+    queue(esp, "ATE0");
+    queue(esp, "AT+CWMODE_CUR=1");
+    queue(esp, "AT+CWJAP_CUR=\"ssid\",\"password\"", 20000);
+    queue(esp, "AT+CIPMUX=1");
+    queue(esp, "AT+CIPSERVER=1,80");
+    queue(esp, "AT+CIPSTO=10");
+    queue(esp, "AT+CIFSR");
+
+    uint32_t    total = run(esp, 60000);
+    uint32_t    fixed = 3000 - results[from].latency + total;
+
+    report(from, "mbedEspWebserver start up", total, fixed);
+    check(results[from].event == AT_OK && results[from].latency >= 350, "AT+RST completes on ready, not on its OK");
+    check(results.back().lines.find("192.168.1.42") != std::string::npos, "AT+CIFSR lines reach the callback");
+    check(urcs.find("WIFI GOT IP") != std::string::npos, "WIFI GOT IP during AT+CWJAP is unsolicited");
+
+    // f103-DHT11-Thinkspeak upload; before: HAL_Delay(3000) + HAL_Delay(1000)
+    static const char   get[] = "GET /update?api_key=KEY&field1=23&field2=41\r\n";
+
+    from = results.size();
+    queue(esp, "AT+CIPSTART=\"TCP\",\"api.thingspeak.com\",80", 10000);
+    results.push_back((result_t){ "AT+CIPSEND=45 + data", modem.now, -1, 0, "" });
+    esp.send(-1, (const uint8_t*)get, sizeof(get) - 1, 5000, onDone);
+    total = run(esp, 60000);
+    report(from, "f103-DHT11-Thinkspeak upload", total, 3000 + 1000);
+    check(results.back().event == AT_OK, "AT+CIPSEND data written at > and SEND OK seen");
+
+    // an HTTP request on link 0, answered while link 1 sends data; the
+    // 600 bytes wrap around the 512 byte ring
+    std::string request("GET /?led HTTP/1.1\r\nHost: esp\r\n\r\n");
+    std::string big(600, 'x');
+    char        header[32];
+
+    from = results.size();
+    modem.answer("0,CONNECT\r\n", 1);
+    snprintf(header, sizeof(header), "\r\n+IPD,0,%u:", (unsigned)request.size());
+    modem.answer(header + request, 1);
+    snprintf(header, sizeof(header), "\r\n+IPD,1,%u:", (unsigned)big.size());
+    modem.answer(header + big + "\r\n", 1);
+    for (int i = 0; i < 3; i++)
+        modem.step();       // the answers arrive, a command starts meanwhile
+
+    static const char   page[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi";
+
+    results.push_back((result_t){ "AT+CIPSEND=0,40 + data", modem.now, -1, 0, "" });
+    esp.send(0, (const uint8_t*)page, sizeof(page) - 1, 5000, onDone);
+    queue(esp, "AT+CIPCLOSE=0");
+    total = run(esp, 60000);
+    report(from, "HTTP request and response", total, 500);
+    check(received[0] == request, "+IPD data of link 0 delivered intact");
+    check(received[1] == big, "600 bytes of link 1 delivered across the ring end");
+    check(urcs.find("0,CONNECT") != std::string::npos && urcs.find("0,CLOSED") != std::string::npos, "0,CONNECT and 0,CLOSED are unsolicited");
+    check(results[from].event == AT_OK && results[from + 1].event == AT_OK, "AT+CIPSEND and AT+CIPCLOSE complete");
+
+    // failures
+    from = results.size();
+    queue(esp, "AT+BAD");
+    queue(esp, "AT+MUTE", 1000);
+    queue(esp, "AT");
+    total = run(esp, 60000);
+    report(from, "errors", total, 0);
+    check(results[from].event == AT_ERROR, "ERROR completes the command with AT_ERROR");
+    check(results[from + 1].event == AT_TIMEOUT && results[from + 1].latency == 1000, "no answer times out after its own timeout");
+    check(esp.timeouts() == 1 && esp.failed() == 1 && esp.overruns() == 0, "counters");
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
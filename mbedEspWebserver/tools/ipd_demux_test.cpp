@@ -0,0 +1,284 @@
+/*
+ ipd_demux_test.cpp - fuzz and throughput test of the +IPD path, EspAt into EspLinks.
+
+ Generates the byte stream of an ESP8266 serving five links at once: +IPD
+ frames of random links and lengths (binary data, including \r, \n, : and
+ "+IPD" inside), n,CONNECT lines, WIFI lines and the answers of commands
+ queued meanwhile. The stream is fed in random chunks and every link is
+ read back with random sizes; each link must get exactly its own bytes.
+ Then checks that a link nobody reads only loses its own data, that
+ interleaved HTTP requests, down to one byte per frame, give every link
+ its request line, and measures the host throughput.
+
+    g++ -O2 -std=c++11 -I../lib/EspAt -o ipd_demux_test ipd_demux_test.cpp ../lib/EspAt/EspAt.cpp ../lib/EspAt/EspLinks.cpp
+    ./ipd_demux_test
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "EspAt.h"
+#include "EspLinks.h"
+
+static uint32_t     seed = 12345;
+static int          failures;
+
+static uint32_t rnd(uint32_t n)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % n;
+}
+
+// Data of a link: a fixed pseudo random sequence, so the reader can check
+// any position without keeping what was sent.
+static uint8_t linkByte(uint8_t link, uint32_t pos)
+{
+    static const char   nasty[] = "\r\n+IPD,1,5:OK\r\nERROR\r\n>";
+    uint32_t            x = (pos + 1) * 2654435761u ^ (link + 1) * 40503u;
+
+    x ^= x >> 15;
+    if (x % 7 == 0)
+        return nasty[(x >> 8) % (sizeof(nasty) - 1)];
+    return x >> 8;
+}
+
+static uint32_t     commandsWritten;
+static uint32_t     commandsOk;
+
+static void modemWrite(const uint8_t* data, size_t len, void*)
+{
+    if (len >= 2 && data[len - 2] == '\r' && data[len - 1] == '\n')
+        commandsWritten++;
+}
+
+static void onCommand(uint8_t event, const char*, void*)
+{
+    commandsOk += event == AT_OK;
+}
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+// Runs the fuzz stream through esp and links; returns the data bytes.
+static uint64_t fuzz(EspAt& esp, EspLinks& links, uint32_t frames, bool verify, uint8_t skipLink)
+{
+    uint32_t    sent[ESPLINK_COUNT] = { 0 };
+    uint32_t    got[ESPLINK_COUNT] = { 0 };
+    uint32_t    answered = 0;
+    uint32_t    now = 0;
+    uint64_t    total = 0;
+    bool        mismatch = false;
+    std::string stream;
+    uint8_t     buf[97];
+
+    for (uint8_t link = 0; link < ESPLINK_COUNT; link++) {
+        char    line[16];
+
+        snprintf(line, sizeof(line), "%u,CONNECT\r\n", link);
+        stream += line;
+    }
+
+    for (uint32_t f = 0; f < frames; f++) {
+        uint32_t    kind = rnd(100);
+
+        if (kind < 3)
+            esp.command("AT+CIPSTATUS", 1000, onCommand);
+        else
+        if (kind < 5)
+            stream += "WIFI GOT IP\r\n";
+
+        // the modem answers a written command between two frames
+        if (answered < commandsWritten) {
+            stream += "STATUS:3\r\n+CIPSTATUS:0,\"TCP\",\"192.168.1.2\",5000,80,1\r\n\r\nOK\r\n";
+            answered++;
+        }
+
+        uint8_t     link = rnd(ESPLINK_COUNT);
+        uint32_t    len = rnd(100) < 80 ? 1 + rnd(64) : 1 + rnd(1460);
+        char        header[24];
+
+        snprintf(header, sizeof(header), "\r\n+IPD,%u,%u:", link, (unsigned)len);
+        stream += header;
+        for (uint32_t i = 0; i < len; i++)
+            stream += (char)linkByte(link, sent[link]++);
+        total += len;
+
+        // feed in random chunks, small enough for the ring of EspAt
+        while (stream.size() > 64 || (f == frames - 1 && !stream.empty())) {
+            size_t  n = 1 + rnd(64);
+
+            if (n > stream.size())
+                n = stream.size();
+            for (size_t i = 0; i < n; i++)
+                esp.feed(stream[i]);
+            stream.erase(0, n);
+            esp.poll(now++);
+
+            for (uint8_t l = 0; l < ESPLINK_COUNT; l++) {
+                if (l == skipLink)
+                    continue;
+
+                size_t  n;
+
+                // drained after every poll, in random pieces
+                while ((n = links.read(l, buf, 1 + rnd(sizeof(buf)))) > 0) {
+                    if (verify) {
+                        for (size_t i = 0; i < n; i++)
+                            mismatch |= buf[i] != linkByte(l, got[l] + i);
+                    }
+                    got[l] += n;
+                }
+            }
+        }
+    }
+
+    // drain
+    for (uint8_t l = 0; l < ESPLINK_COUNT; l++) {
+        size_t  n;
+
+        while (l != skipLink && (n = links.read(l, buf, sizeof(buf))) > 0) {
+            if (verify) {
+                for (size_t i = 0; i < n; i++)
+                    mismatch |= buf[i] != linkByte(l, got[l] + i);
+            }
+            got[l] += n;
+        }
+    }
+
+    if (verify) {
+        bool    complete = true;
+
+        for (uint8_t l = 0; l < ESPLINK_COUNT; l++)
+            complete &= l == skipLink || got[l] == sent[l];
+        check(!mismatch, "every link gets only its own bytes, in order");
+        check(complete, "no byte lost on the links that are read");
+    }
+
+    return total;
+}
+
+int main()
+{
+    printf("interleaved links, random frames and chunks\n");
+    {
+        EspAt       esp(modemWrite, NULL);
+        EspLinks    links;
+
+        esp.setContext(&links);
+        esp.onData(EspLinks::onData);
+        fuzz(esp, links, 20000, true, 0xFF);
+        check(links.overruns() == 0 && esp.overruns() == 0, "no overruns");
+        check(commandsOk == commandsWritten && esp.completed() == commandsOk && esp.timeouts() == 0, "commands between the frames complete");
+    }
+
+    printf("\nlink 3 is never read\n");
+    {
+        EspAt       esp(modemWrite, NULL);
+        EspLinks    links;
+
+        commandsWritten = commandsOk = 0;
+        esp.setContext(&links);
+        esp.onData(EspLinks::onData);
+        fuzz(esp, links, 5000, true, 3);
+        check(links.overruns() > 0 && links.available(3) == ESPLINK_RX_SIZE - 1, "its ring fills up and drops its bytes");
+    }
+
+    printf("\nHTTP requests of five clients, interleaved byte by byte\n");
+    {
+        EspAt       esp(modemWrite, NULL);
+        EspLinks    links;
+        std::string request[ESPLINK_COUNT];
+        size_t      pos[ESPLINK_COUNT] = { 0 };
+        bool        ok = true;
+        uint32_t    now = 0;
+
+        esp.setContext(&links);
+        esp.onData(EspLinks::onData);
+        for (uint8_t l = 0; l < ESPLINK_COUNT; l++) {
+            char    text[96];
+
+            snprintf(text, sizeof(text), "GET /?pwmVal=%u HTTP/1.1\r\nHost: esp\r\nAccept: */*\r\n\r\n", l * 50);
+            request[l] = text;
+        }
+
+        for (bool left = true; left; ) {
+            left = false;
+            for (uint8_t l = 0; l < ESPLINK_COUNT; l++) {
+                if (pos[l] == request[l].size())
+                    continue;
+
+                char    frame[32];
+                int     n = snprintf(frame, sizeof(frame), "\r\n+IPD,%u,1:%c", l, request[l][pos[l]++]);
+
+                for (int i = 0; i < n; i++)
+                    esp.feed(frame[i]);
+                esp.poll(now++);
+                left = true;
+            }
+        }
+
+        for (uint8_t l = 0; l < ESPLINK_COUNT; l++) {
+            char    line[64];
+            char    expected[32];
+
+            snprintf(expected, sizeof(expected), "GET /?pwmVal=%u HTTP/1.1", l * 50);
+            ok &= links.readLine(l, line, sizeof(line)) >= 0 && strcmp(line, expected) == 0;
+            ok &= links.readLine(l, line, sizeof(line)) == 9 && strcmp(line, "Host: esp") == 0;
+        }
+        check(ok, "each link reads its own request line and headers");
+    }
+
+    printf("\nthroughput\n");
+    {
+        EspAt       esp(modemWrite, NULL);
+        EspLinks    links;
+        std::string stream;
+        uint32_t    sent[ESPLINK_COUNT] = { 0 };
+        uint64_t    bytes = 0;
+        uint8_t     buf[256];
+
+        esp.setContext(&links);
+        esp.onData(EspLinks::onData);
+        while (stream.size() < (16 << 20)) {
+            uint8_t     link = rnd(ESPLINK_COUNT);
+            uint32_t    len = 1 + rnd(1460);
+            char        header[24];
+
+            snprintf(header, sizeof(header), "\r\n+IPD,%u,%u:", link, (unsigned)len);
+            stream += header;
+            for (uint32_t i = 0; i < len; i++)
+                stream += (char)linkByte(link, sent[link]++);
+            bytes += len;
+        }
+
+        // 64 bytes per poll, every link drained after it
+        clock_t     start = clock();
+
+        for (size_t pos = 0; pos < stream.size(); pos += 64) {
+            size_t  end = pos + 64 < stream.size() ? pos + 64 : stream.size();
+
+            for (size_t i = pos; i < end; i++)
+                esp.feed(stream[i]);
+            esp.poll(0);
+            for (uint8_t l = 0; l < ESPLINK_COUNT; l++)
+                while (links.read(l, buf, sizeof(buf)))
+                    ;
+        }
+
+        double      s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("  %.1f MB of +IPD data in %.3f s: %.1f MB/s, %.1f ns per received byte\n", bytes / 1e6, s, stream.size() / 1e6 / s, s * 1e9 / stream.size());
+        printf("  115200 baud delivers 0.0115 MB/s\n");
+        check(links.overruns() == 0 && esp.overruns() == 0, "no overruns");
+    }
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
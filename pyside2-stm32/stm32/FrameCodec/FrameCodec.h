@@ -0,0 +1,88 @@
+/*
+ FrameCodec.h - streaming codec for the 0xA5 0x5A command frames.
+
+ Frames start with the sync bytes 0xA5 0x5A followed by the body: the
+ command id and its data. Two layouts are in use:
+
+    TCP server (C# client)      A5 5A id val                 fixed body length
+    UART (PySide2 GUI)          A5 5A len id val             FRAME_LEN, len = body length
+
+ With FRAME_CRC a CRC-8 (polynomial 0x07) of every byte after the sync
+ bytes ends the frame. The parser keeps its state between calls, so frames
+ may be split across TCP segments or UART reads and any number of them may
+ arrive in one buffer; every complete frame is dispatched to the handler
+ registered for its id.
+
+ mbed-tcp-server/stm32/FrameCodec and pyside2-stm32/stm32/FrameCodec are
+ two byte-identical copies, one per project, and nothing keeps them in
+ step: a change made to one copy must be made to the other (cmp the two
+ directories) or they drift apart. mbed-tcp-server/tools/frame_bench.cpp
+ tests either copy.
+ */
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_SYNC1     0xA5
+#define FRAME_SYNC2     0x5A
+
+#define FRAME_LEN       0x01    // a length byte follows the sync bytes
+#define FRAME_CRC       0x02    // a CRC-8 ends the frame
+
+#ifndef FRAME_MAXBODY
+#define FRAME_MAXBODY   32      // longest body accepted, id included
+#endif
+
+// Called with the command id, the bytes following it and the context set
+// with setContext().
+typedef void (*frame_handler_t)(uint8_t id, const uint8_t* data, uint8_t len, void* ctx);
+
+typedef struct
+{
+    uint8_t         id;
+    frame_handler_t handler;
+} frame_command_t;
+
+class FrameCodec
+{
+public:
+    FrameCodec(const frame_command_t* table, uint8_t count, uint8_t flags = FRAME_LEN, uint8_t bodyLen = 0);
+    size_t          feed(const uint8_t* data, size_t len);  // returns the number of frames dispatched
+    bool            feed(uint8_t c);                        // returns true if c completed a frame
+    void            reset();
+    size_t          encode(uint8_t* out, size_t size, uint8_t id, const uint8_t* data, uint8_t len);
+    void            setContext(void* ctx)       { _ctx = ctx; }
+    void            setDefault(frame_handler_t handler) { _default = handler; }
+    static uint8_t  crc8(uint8_t crc, const uint8_t* data, size_t len);
+
+    uint32_t        frames()        { return _frames; }     // dispatched
+    uint32_t        unknown()       { return _unknown; }    // no handler for the id
+    uint32_t        crcErrors()     { return _crcErrors; }
+    uint32_t        badLength()     { return _badLength; }  // length byte 0 or above FRAME_MAXBODY
+    uint32_t        skipped()       { return _skipped; }    // bytes dropped looking for the sync bytes
+private:
+    enum { SYNC1, SYNC2, LENGTH, BODY, CRC };
+
+    const frame_command_t*  _table;
+    uint8_t                 _count;
+    uint8_t                 _flags;
+    uint8_t                 _bodyLen;
+    frame_handler_t         _default;
+    void*                   _ctx;
+    uint8_t                 _state;
+    uint8_t                 _need;
+    uint8_t                 _pos;
+    uint8_t                 _crc;
+    uint8_t                 _body[FRAME_MAXBODY];
+    uint32_t                _frames;
+    uint32_t                _unknown;
+    uint32_t                _crcErrors;
+    uint32_t                _badLength;
+    uint32_t                _skipped;
+
+    void                    _startBody(uint8_t len);
+    void                    _dispatch();
+};
+#endif
@@ -6,6 +6,7 @@
 #include "mbed.h"
 #include "platform/mbed_thread.h"
 #include <string>
+#include "FrameCodec.h"
 
 Serial pcSerial(USBTX, USBRX);       // pc serial port connection over usb
 PwmOut led1(D9);                     // pwm1 pin
@@ -18,6 +19,41 @@ Timer t1;                           // timer for create async delay
 AnalogIn pot1(A0);                  // pot1 pin 
 AnalogIn pot2(A1);                  // pot2 pin
 
+// command handlers, data[0] is the value following the id
+void onPwm(uint8_t id, const uint8_t* data, uint8_t len, void* ctx)
+{
+    if (len < 1)
+        return;
+
+    switch(id){
+        case 0x80:
+            led1 = data[0] / 100.0;
+            break;
+        case 0x81:
+            led2 = data[0] / 100.0;
+            break;
+        case 0x82:
+            led3 = data[0] / 100.0;
+            break;
+    }
+}
+
+void onLed(uint8_t id, const uint8_t* data, uint8_t len, void* ctx)
+{
+    if (len >= 1)
+        led4 = data[0];             // write received data to LED value
+}
+
+const frame_command_t   commands[] =
+{
+    { 0x80, onPwm },
+    { 0x81, onPwm },
+    { 0x82, onPwm },
+    { 0x84, onLed }
+};
+
+FrameCodec codec(commands, sizeof(commands) / sizeof(commands[0]), FRAME_LEN);  // A5 5A len id val
+
 int main()
 {
     // Initialise the digital pin LED1 as an output
@@ -27,35 +63,11 @@ int main()
 
     while (true) {
 
-        if(pcSerial.readable())     // check data received from uart
+        // parse every received byte, the codec keeps partial frames
+        // between calls and dispatches each complete one by its ID
+        while(pcSerial.readable())
         {
-            if(pcSerial.getc() == 0xA5)     // check first byte of receivded data
-            {
-                if(pcSerial.getc() == 0x5A)     // check second byte of received data
-                {
-                    // parse received data to Id and value
-
-                    uint8_t mLen = pcSerial.getc();
-                    uint8_t mId = pcSerial.getc();
-                    uint8_t mVal = pcSerial.getc();
-                    
-                    // switch according to received ID
-                    switch(mId){
-                        case 0x80:
-                            led1 = mVal / 100.0;
-                            break;
-                        case 0x81:
-                            led2 = mVal / 100.0;
-                            break;
-                        case 0x82:
-                            led3 = mVal / 100.0;
-                            break;
-                        case 0x84:
-                            led4 = mVal;        // write received data to LED value
-                            break;
-                    } 
-                }
-            }
+            codec.feed((uint8_t)pcSerial.getc());
         }
 
         // send potantiometer values over uart to pc with 100ms time interval